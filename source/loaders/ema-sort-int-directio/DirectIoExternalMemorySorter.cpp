@@ -7,22 +7,36 @@
 #include <chrono>
 #include <cstdint>
 #include <iostream>
-#include <queue>
 #include <vector>
 #include <cstring>
 #include <memory>    // For smart pointers
+#include <mutex>
 #include <cstdlib>   // For posix_memalign and free
+#include "../util/loser_tree.hpp"
+#include "../util/natural_runs.hpp"
+#include "../util/run_prefetcher.hpp"
+#include "../util/simd_sort.hpp"
 #include "../util/sorter_utils.hpp" // Ensure this path is correct
 
-// Helper Struct for Merge Heap Nodes
-struct HeapNode {
-    uint32_t value;
-    size_t chunk_index;
-
-    HeapNode(uint32_t val, size_t idx) : value(val), chunk_index(idx) {}
-
-    bool operator>(const HeapNode& other) const {
-        return value > other.value;
+// Merge source reading one value at a time from a chunk file through the Lab2 block cache,
+// or taking the values from the blocks read ahead by a RunPrefetcher
+struct Lab2ChunkSource {
+    Lab2* lab2;
+    fd_t fd;
+    PrefetchedRun* prefetched = nullptr;
+    ssize_t last_read_bytes = 0;
+
+    bool next(uint32_t& value) {
+        if (fd < 0) {
+            return false;
+        }
+        if (prefetched != nullptr) {
+            bool const has_value = prefetched->next(value);
+            last_read_bytes = has_value ? static_cast<ssize_t>(sizeof(uint32_t)) : 0;
+            return has_value;
+        }
+        last_read_bytes = lab2->read(fd, &value, sizeof(uint32_t));
+        return last_read_bytes == static_cast<ssize_t>(sizeof(uint32_t));
     }
 };
 
@@ -101,8 +115,9 @@ void DirectIoExternalMemorySorter::generateRandomFile(const std::string& filenam
 // Sort chunks of the input file and save them as temporary files
 void DirectIoExternalMemorySorter::sortByChunksAndSave(
     const std::string& input_filename,
-    const std::string& temp_directory,
-    size_t chunk_size_mb
+    SpillDirectories& spill,
+    size_t chunk_size_mb,
+    ParallelSorter& sorter
 ) {
     // Calculate chunk size in bytes and elements
     size_t chunk_size_bytes = chunk_size_mb * BytesInMb;
@@ -140,6 +155,7 @@ void DirectIoExternalMemorySorter::sortByChunksAndSave(
 
     auto t_start = std::chrono::steady_clock::now();
 
+    PresortStats presort_stats;
     for (size_t i = 0; i < num_chunks; ++i) {
         size_t elements_to_read = std::min(chunk_size_in_elements, num_elements - i * chunk_size_in_elements);
         size_t bytes_to_read = elements_to_read * sizeof(uint32_t);
@@ -156,13 +172,10 @@ void DirectIoExternalMemorySorter::sortByChunksAndSave(
       std::cout << "Read " << bytes_read << "B, as expected\n";
 
         // Sort the chunk
-        std::sort(buffer, buffer + elements_to_read);
+        presort_stats.add(SortNaturalRuns(buffer, elements_to_read, sorter));
 
         // Define temporary chunk file name
-        std::ostringstream temp_filename_stream;
-        temp_filename_stream << temp_directory << "/"
-                             << SanitizeInputFilename(input_filename) << "_chunk_" << i << ".dat";
-        std::string temp_filename = temp_filename_stream.str();
+        std::string temp_filename = ChunkFilename(spill.directory(i), input_filename, i);
 
         // Open temporary chunk file with write flags
         fd_t chunk_fd = lab2_.open(temp_filename);
@@ -200,56 +213,102 @@ void DirectIoExternalMemorySorter::sortByChunksAndSave(
 
     std::cout << "ema-sort-int: Time to sort chunks from " << input_filename << " is "
               << time_elapsed << " ns\n";
+    PrintPresortStats("ema-sort-int", presort_stats);
 }
 
 #include <iomanip> // For std::hex and std::dec
 
 void DirectIoExternalMemorySorter::mergeChunksAndSave(
-    const std::string& temp_directory,
+    SpillDirectories& spill,
     const std::string& input_filename,
     const std::string& output_filename,
-    size_t num_chunks
+    size_t num_chunks,
+    const SortOptions& options
 ) {
   // TODO prevent the thing from writing zeroes beyond the expected file size
     using std::chrono::steady_clock;
     auto t_start = steady_clock::now();
 
     std::vector<fd_t> chunk_fds(num_chunks, -1);
-    std::priority_queue<HeapNode, std::vector<HeapNode>, std::greater<>> min_heap;
+    std::vector<Lab2ChunkSource> chunk_sources;
+    chunk_sources.reserve(num_chunks);
 
-    // Open temporary files and populate initial heap
+    // Open temporary files, the loser tree pulls the initial value of every chunk
     for (size_t i = 0; i < num_chunks; ++i) {
-        std::string temp_filename = temp_directory + "/" + SanitizeInputFilename(input_filename) + "_chunk_" + std::to_string(i) + ".dat";
+        std::string temp_filename = ChunkFilename(spill.directory(i), input_filename, i);
         chunk_fds[i] = lab2_.open(temp_filename);
         if (chunk_fds[i] < 0) {
             std::cerr << "Failed to open chunk file: " << temp_filename << '\n';
-            continue;
         }
+        chunk_sources.push_back(Lab2ChunkSource{&lab2_, chunk_fds[i]});
+    }
 
-        uint32_t value;
-        ssize_t read_bytes = lab2_.read(chunk_fds[i], &value, sizeof(uint32_t));
-        if (read_bytes == sizeof(uint32_t)) {
-            min_heap.emplace(value, i);
-            std::cout << "Chunk " << i << " initial value: " << value << " (0x"
-                      << std::hex << value << std::dec << ")\n";
-        } else if (read_bytes == 0) {
+    // Lab2 is not thread-safe: once the prefetch I/O threads run, every call goes through the lock
+    std::mutex lab2_mutex;
+    std::unique_ptr<RunPrefetcher> prefetcher;
+    if (options.prefetch_blocks > 0) {
+        std::vector<size_t> chunk_devices;
+        for (size_t i = 0; spill.size() > 1 && i < num_chunks; ++i) {
+            chunk_devices.push_back(spill.device(i));
+        }
+        prefetcher = std::make_unique<RunPrefetcher>(
+            num_chunks,
+            options.run_buffer_bytes,
+            options.prefetch_blocks,
+            options.prefetch_threads,
+            [&](size_t run_index, uint32_t* destination, size_t count) -> size_t {
+                std::lock_guard<std::mutex> lock(lab2_mutex);
+                ssize_t bytes_read = lab2_.read(chunk_fds[run_index], destination, count * sizeof(uint32_t));
+                return bytes_read > 0 ? static_cast<size_t>(bytes_read) / sizeof(uint32_t) : 0;
+            },
+            chunk_devices
+        );
+        for (size_t i = 0; i < num_chunks; ++i) {
+            chunk_sources[i].prefetched = prefetcher->run(i);
+        }
+    }
+    auto close_chunk = [&](size_t chunk_index) {
+        std::lock_guard<std::mutex> lock(lab2_mutex);
+        lab2_.close(chunk_fds[chunk_index]);
+        chunk_fds[chunk_index] = -1; // Mark as closed
+    };
+
+    std::vector<Lab2ChunkSource*> sources;
+    sources.reserve(num_chunks);
+    for (auto& chunk_source : chunk_sources) {
+        sources.push_back(&chunk_source);
+    }
+    LoserTree<uint32_t, Lab2ChunkSource> merger(std::move(sources));
+
+    for (size_t i = 0; i < num_chunks; ++i) {
+        if (chunk_fds[i] < 0) {
+            continue;
+        }
+        if (!merger.exhausted(i)) {
+            std::cout << "Chunk " << i << " initial value: " << merger.head(i) << " (0x"
+                      << std::hex << merger.head(i) << std::dec << ")\n";
+            continue;
+        }
+        if (chunk_sources[i].last_read_bytes == 0) {
             std::cerr << "Chunk " << i << " is empty.\n";
-            lab2_.close(chunk_fds[i]);
-            chunk_fds[i] = -1; // Mark as closed
         } else {
-            std::cerr << "Error reading from chunk " << i << ". Bytes read: " << read_bytes << '\n';
-            lab2_.close(chunk_fds[i]);
-            chunk_fds[i] = -1; // Mark as closed
+            std::cerr << "Error reading from chunk " << i << ". Bytes read: "
+                      << chunk_sources[i].last_read_bytes << '\n';
         }
+        close_chunk(i);
     }
 
-    fd_t output_fd = lab2_.open(output_filename);
+    fd_t output_fd = -1;
+    {
+        std::lock_guard<std::mutex> lock(lab2_mutex);
+        output_fd = lab2_.open(output_filename);
+    }
     if (output_fd < 0) {
         std::cerr << "Failed to open output file: " << output_filename << '\n';
         // Close all opened chunk files before returning
         for (size_t i = 0; i < num_chunks; ++i) {
             if (chunk_fds[i] >= 0) {
-                lab2_.close(chunk_fds[i]);
+                close_chunk(i);
             }
         }
         return;
@@ -259,6 +318,7 @@ void DirectIoExternalMemorySorter::mergeChunksAndSave(
     uint32_t* write_buffer = static_cast<uint32_t*>(aligned_alloc(4096, buffer_size));
     if (!write_buffer) {
         std::cerr << "Failed to allocate write buffer.\n";
+        std::lock_guard<std::mutex> lock(lab2_mutex);
         lab2_.close(output_fd);
         return;
     }
@@ -267,20 +327,21 @@ void DirectIoExternalMemorySorter::mergeChunksAndSave(
     size_t total_written = 0;
     size_t iteration = 0;
 
-    while (!min_heap.empty()) {
+    while (!merger.empty()) {
         iteration++;
-        HeapNode node = min_heap.top();
-        min_heap.pop();
+        uint32_t value = merger.top();
+        size_t chunk_index = merger.topSource();
 
-        write_buffer[buffer_count++] = node.value;
+        write_buffer[buffer_count++] = value;
         total_written++;
 
         // Debug: Current value and buffer status
-        std::cout << "Iteration " << iteration << ": Writing value " << node.value
-                  << " (0x" << std::hex << node.value << std::dec << "), Buffer count: "
+        std::cout << "Iteration " << iteration << ": Writing value " << value
+                  << " (0x" << std::hex << value << std::dec << "), Buffer count: "
                   << buffer_count << '\n';
 
         if (buffer_count * sizeof(uint32_t) == buffer_size) {
+            std::unique_lock<std::mutex> lock(lab2_mutex);
             ssize_t bytes_written = lab2_.write(output_fd, write_buffer, buffer_count * sizeof(uint32_t));
             if (bytes_written != static_cast<ssize_t>(buffer_count * sizeof(uint32_t))) {
                 std::cerr << "Failed to write to output file. Bytes written: " << bytes_written << '\n';
@@ -288,33 +349,37 @@ void DirectIoExternalMemorySorter::mergeChunksAndSave(
                 lab2_.close(output_fd);
                 return;
             }
+            lock.unlock();
             std::cout << "Buffer flushed to output. Total written: " << total_written << " elements.\n";
             buffer_count = 0;
         }
 
-        uint32_t next_value;
-        ssize_t read_bytes = lab2_.read(chunk_fds[node.chunk_index], &next_value, sizeof(uint32_t));
-        if (read_bytes == sizeof(uint32_t)) {
-            min_heap.emplace(next_value, node.chunk_index);
-            std::cout << "Pushed next value " << next_value << " (0x" << std::hex << next_value << std::dec
-                      << ") from chunk " << node.chunk_index << " to heap.\n";
-        } else if (read_bytes == 0) {
-            std::cout << "Chunk " << node.chunk_index << " exhausted.\n";
-            lab2_.close(chunk_fds[node.chunk_index]);
-            chunk_fds[node.chunk_index] = -1;
-            std::string temp_file = temp_directory + "/chunk_" + std::to_string(node.chunk_index) + ".dat";
+        merger.pop();
+        if (!merger.exhausted(chunk_index)) {
+            continue;
+        }
+        ssize_t read_bytes = chunk_sources[chunk_index].last_read_bytes;
+        if (read_bytes == 0) {
+            std::cout << "Chunk " << chunk_index << " exhausted.\n";
+            close_chunk(chunk_index);
+            std::string temp_file = ChunkFilename(spill.directory(chunk_index), input_filename, chunk_index);
             if (std::remove(temp_file.c_str()) != 0) {
                 std::cerr << "Failed to delete temporary file: " << temp_file << '\n';
             } else {
                 std::cout << "Deleted temporary file: " << temp_file << '\n';
             }
         } else {
-            std::cerr << "Error reading from chunk " << node.chunk_index << ". Bytes read: " << read_bytes << '\n';
-            lab2_.close(chunk_fds[node.chunk_index]);
-            chunk_fds[node.chunk_index] = -1;
+            std::cerr << "Error reading from chunk " << chunk_index << ". Bytes read: " << read_bytes << '\n';
+            close_chunk(chunk_index);
         }
     }
 
+    // Every chunk is exhausted, so the I/O threads are done with Lab2
+    if (prefetcher) {
+        prefetcher->stop();
+        PrintPrefetchStats("ema-sort-int", prefetcher->stats());
+    }
+
     // Flush any remaining data in the write buffer
     if (buffer_count > 0) {
         ssize_t bytes_written = lab2_.write(output_fd, write_buffer, buffer_count * sizeof(uint32_t));
@@ -341,46 +406,70 @@ void DirectIoExternalMemorySorter::mergeChunksAndSave(
 void DirectIoExternalMemorySorter::externalMemorySort(
     const std::string& input_filename,
     const std::string& output_filename,
-    size_t chunk_size_mb
+    size_t chunk_size_mb,
+    const SortOptions& options
 ) {
-    // Define a unique temporary directory for this sort operation
-    std::string temp_directory = "temp_chunks_" + SanitizeInputFilename(input_filename);
+    if (!RequireDirectIoOptions(options)) {
+        return;
+    }
 
-    // Create temporary directory if it doesn't exist
-    if (!std::filesystem::exists(temp_directory)) {
-        if (!std::filesystem::create_directory(temp_directory)) {
-            std::cerr << "Failed to create temporary directory: " << temp_directory << '\n';
-            return;
+    // Define a unique temporary directory for this sort operation in every spill directory
+    std::string const temp_name = "temp_chunks_" + SanitizeInputFilename(input_filename);
+    std::vector<std::string> temp_directories;
+    for (const std::string& spill_directory : options.spill_directories) {
+        temp_directories.push_back(spill_directory + "/" + temp_name);
+    }
+    if (temp_directories.empty()) {
+        temp_directories.push_back(temp_name);
+    }
+
+    // Create temporary directories if they don't exist
+    for (const std::string& temp_directory : temp_directories) {
+        if (!std::filesystem::exists(temp_directory)) {
+            std::error_code error;
+            if (!std::filesystem::create_directory(temp_directory, error)) {
+                std::cerr << "Failed to create temporary directory: " << temp_directory << '\n';
+                return;
+            }
         }
     }
+    SpillDirectories spill(temp_directories, options.spill_policy);
 
     // Step 1: Sort chunks and save them to temporary files
-    sortByChunksAndSave(input_filename, temp_directory, chunk_size_mb);
+    if (options.kernel == SortKernel::Simd) {
+        std::cout << "ema-sort-int-directio: SIMD kernel: " << SimdIsaName(DetectSimdIsa()) << '\n';
+    }
+    ParallelSorter sorter(options.threads, options.kernel);
+    sortByChunksAndSave(input_filename, spill, chunk_size_mb, sorter);
 
-    // Step 2: Calculate the number of chunks by counting files in temp_directory
+    // Step 2: Calculate the number of chunks by counting files in the temporary directories
     size_t num_chunks = 0;
-    for (const auto& entry : std::filesystem::directory_iterator(temp_directory)) {
-        if (entry.is_regular_file()) {
-            ++num_chunks;
+    for (const std::string& temp_directory : temp_directories) {
+        for (const auto& entry : std::filesystem::directory_iterator(temp_directory)) {
+            if (entry.is_regular_file()) {
+                ++num_chunks;
+            }
         }
     }
 
     if (num_chunks == 0) {
-        std::cerr << "No chunks were created in temporary directory: " << temp_directory << '\n';
+        std::cerr << "No chunks were created in temporary directory: " << spill.primary() << '\n';
         return;
     }
 
     std::cout << "Merging " << num_chunks << " sorted chunks...\n";
 
     // Step 3: Merge the sorted chunks into the final output file
-    mergeChunksAndSave(temp_directory, input_filename, output_filename, num_chunks);
-
-    // Step 4: Cleanup temporary directory
-    try {
-        std::filesystem::remove_all(temp_directory);
-    } catch (const std::filesystem::filesystem_error& e) {
-        std::cerr << "Warning: Failed to delete temporary directory: " << temp_directory
-                  << ". Error: " << e.what() << '\n';
+    mergeChunksAndSave(spill, input_filename, output_filename, num_chunks, options);
+
+    // Step 4: Cleanup temporary directories
+    for (const std::string& temp_directory : temp_directories) {
+        try {
+            std::filesystem::remove_all(temp_directory);
+        } catch (const std::filesystem::filesystem_error& e) {
+            std::cerr << "Warning: Failed to delete temporary directory: " << temp_directory
+                      << ". Error: " << e.what() << '\n';
+        }
     }
 
     std::cout << "External memory sort completed. Output file: " << output_filename << '\n';
@@ -464,12 +553,25 @@ void DirectIoExternalMemorySorter::checkFileSorted(const std::string& input_file
 void DirectIoExternalMemorySorter::printHelp() {
     std::cout << "Available subcommands:\n"
               << "\tgenerate <output_file> <size_mb>\n\t\tGenerate a random binary file of uint32_t values\n"
-              << "\tsort <input_file> <output_file> <chunk_size_mb>\n\t\tSort the file in chunks and save sorted result\n"
+              << "\tsort <input_file> <output_file> <chunk_size_mb> [options]\n\t\tSort the file in chunks and save sorted result\n"
               << "\tcheck <input_file>\n\t\tCheck if the file is sorted\n"
               << "\thelp\n\t\tPrint this help message (no args).\n"
               << "\tfull-benchmark <input_file> <output_file> <repeat-count>\n\t\t"
                  "Generate a 256MB file, sort it with 32MB chunk size, check the results, repeat "
                  "everything several times.\n";
+    std::cout << "Options (any other option of ema-sort-int is rejected):\n"
+              << "\t--threads=<threads>\n\t\tThreads sorting every chunk, 0 takes every "
+                 "hardware thread (default 1)\n"
+              << "\t--kernel=<std|radix|simd>\n\t\tSort routine of the chunks (default std)\n"
+              << "\t--spill-dirs=<dir>[,<dir>...]\n\t\tDirectories the sorted chunks are "
+                 "striped over\n"
+              << "\t--spill-policy=<round-robin|free-space>\n\t\tHow chunks are assigned to "
+                 "the spill directories (default round-robin)\n"
+              << "\t--prefetch-blocks=<blocks>\n\t\tKeep this many blocks read ahead for every "
+                 "chunk during the merge (default 0, off)\n"
+              << "\t--prefetch-threads=<threads>\n\t\tBackground I/O threads serving the "
+                 "prefetch (default 1)\n"
+              << "\t--run-buffer-kb=<kb>\n\t\tSize of a prefetched block\n";
 }
 
 void DirectIoExternalMemorySorter::echo(std::string message) {
@@ -4,20 +4,28 @@
 #include <cstdint>
 #include <string>
 #include "lab2_library.hpp"
+#include "../util/parallel_sort.hpp"
+#include "../util/sort_options.hpp"
+#include "../util/spill_directories.hpp"
 
 class DirectIoExternalMemorySorter {
 private:
   Lab2 lab2_;
 
+  // Chunk files are striped over `spill`, every chunk is sorted by `sorter`
   void sortByChunksAndSave(
-      const std::string& input_filename, const std::string& temp_directory, size_t chunk_size_mb
+      const std::string& input_filename,
+      SpillDirectories& spill,
+      size_t chunk_size_mb,
+      ParallelSorter& sorter
   );
 
   void mergeChunksAndSave(
-      const std::string& temp_directory,
+      SpillDirectories& spill,
       const std::string& input_filename, // To retrieve chunk file names
       const std::string& output_filename,
-      size_t num_chunks
+      size_t num_chunks,
+      const SortOptions& options
   );
 
 public:
@@ -28,7 +36,10 @@ public:
 
   // Sort a large file in chunks and write sorted chunks to the output file
   void externalMemorySort(
-      const std::string& input_filename, const std::string& output_filename, size_t chunk_size_mb
+      const std::string& input_filename,
+      const std::string& output_filename,
+      size_t chunk_size_mb,
+      const SortOptions& options = SortOptions()
   );
 
   // Check if the file is sorted
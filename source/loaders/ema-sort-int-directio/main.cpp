@@ -24,14 +24,18 @@ int main(int argc, char* argv[]) {
     size_t size_mb = std::stoull(argv[3]);
     sorter.generateRandomFile(output_file, size_mb);
   } else if (command == "sort") {
-    if (argc != ArgcForEmaSort) {
-      std::cout << "Usage: prog sort <input_file> <output_file> <chunk_size_mb>" << '\n';
+    SortOptions options;
+    if (argc < ArgcForEmaSort || !ParseSortOptions(argc, argv, ArgcForEmaSort, options)) {
+      std::cout << "Usage: prog sort <input_file> <output_file> <chunk_size_mb> [options]" << '\n';
+      return 1;
+    }
+    if (!RequireDirectIoOptions(options)) {
       return 1;
     }
     std::string const input_file = argv[2];
     std::string const output_file = argv[3];
     size_t const chunk_size_mb = std::stoull(argv[4]);
-    sorter.externalMemorySort(input_file, output_file, chunk_size_mb);
+    sorter.externalMemorySort(input_file, output_file, chunk_size_mb, options);
   } else if (command == "check") {
     if (argc != ArgcForCheck) {
       std::cout << "Usage: prog check <input_file>" << '\n';
@@ -1,18 +1,40 @@
 #include "ExternalMemorySorter.hpp"
 
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
 #include <filesystem>
 
 #include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <cstdint>
 #include <cstdio>  // For remove()
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <limits>
-#include <queue>
-#include <sstream>
+#include <memory>
+#include <thread>
 #include <vector>
 
+#include "../ram-sort-int/RamMemorySorter.hpp"
+#include "../util/blocking_queue.hpp"
+#include "../util/bucket_distribution.hpp"
+#include "../util/collapsing_output.hpp"
+#include "../util/engine_runs.hpp"
+#include "../util/io_engine.hpp"
+#include "../util/loser_tree.hpp"
+#include "../util/memory_budget.hpp"
+#include "../util/merge_partitioner.hpp"
+#include "../util/merge_planner.hpp"
+#include "../util/run_io.hpp"
+#include "../util/line_sort.hpp"
+#include "../util/natural_runs.hpp"
+#include "../util/parallel_sort.hpp"
+#include "../util/record_sort.hpp"
+#include "../util/run_prefetcher.hpp"
 #include "../util/sorter_utils.hpp"
 
 // Generate a random binary file of uint32_t values
@@ -42,185 +64,1801 @@ void ExternalMemorySorter::generateRandomFile(const std::string& filename, size_
 }
 
 // Sort chunks of the input file and save them as temporary files
-void ExternalMemorySorter::sortByChunksAndSave(
-    const std::string& input_filename, const std::string& temp_directory, size_t chunk_size_mb
+size_t ExternalMemorySorter::sortByChunksAndSave(
+    const std::string& input_filename,
+    SpillDirectories& spill,
+    size_t chunk_size_mb,
+    const SortOptions& options,
+    RunManifest& manifest
 ) {
-  std::ifstream input(input_filename, std::ios::binary);
-  if (!input) {
-    std::cerr << "Failed to open input file: " << input_filename << '\n';
-    return;
+  // A stream has no size to probe, its chunks are read until it ends
+  bool const streaming = IsStreamPath(input_filename);
+  size_t file_size_in_bytes = std::numeric_limits<size_t>::max();
+  if (!streaming) {
+    std::ifstream input_size_probe(input_filename, std::ios::binary | std::ios::ate);
+    if (!input_size_probe) {
+      std::cerr << "Failed to open input file: " << input_filename << '\n';
+      return 0;
+    }
+    file_size_in_bytes = input_size_probe.tellg();
+    input_size_probe.close();
   }
 
-  auto t_start = std::chrono::steady_clock::now();
+  if (options.run_generation == RunGeneration::ReplacementSelection) {
+    if (!manifest.runs().empty()) {
+      // Where the next run starts depends on the heap contents, which died with the last attempt
+      std::cout << "Replacement selection cannot continue after " << manifest.runs().size()
+                << " recorded runs, forming all runs again" << '\n';
+      manifest.start();
+    }
+    return sortByReplacementSelectionAndSave(
+        input_filename, spill, chunk_size_mb, options, manifest
+    );
+  }
+  if (!manifest.runs().empty()) {
+    std::cout << "Resuming run formation after " << manifest.runs().size() << " recorded runs"
+              << '\n';
+  }
+  if (streaming && (options.pipelined || options.io_engine != IoEngineKind::Stream)) {
+    std::cout << "ema-sort-int: The pipelined and engine run formation need the input size, "
+              << "reading the stream chunk by chunk" << '\n';
+  }
+  if (options.pipelined && !streaming) {
+    return sortByChunksAndSavePipelined(
+        input_filename, spill, chunk_size_mb, file_size_in_bytes, options, manifest
+    );
+  }
+  // The engine writes the sorted chunk as it is, collapsed runs go through the run writer
+  if (options.io_engine != IoEngineKind::Stream && options.spill_format == RunFormat::Raw &&
+      options.output_mode == OutputMode::All && !streaming) {
+    return sortByChunksAndSaveWithEngine(
+        input_filename, spill, chunk_size_mb, file_size_in_bytes, options, manifest
+    );
+  }
 
   size_t chunk_size_in_elements = chunk_size_mb * BytesInMb / sizeof(uint32_t);
-  std::vector<uint32_t> buffer(chunk_size_in_elements);
-
-  input.seekg(0, std::ios::end);
-  size_t file_size_in_bytes = input.tellg();
-  input.seekg(0, std::ios::beg);
-
   size_t num_elements = file_size_in_bytes / sizeof(uint32_t);
   size_t num_chunks = (num_elements + chunk_size_in_elements - 1) / chunk_size_in_elements;
+  size_t const first_chunk = std::min(manifest.runs().size(), num_chunks);
+  size_t const first_element = first_chunk * chunk_size_in_elements;
 
-  std::cout << "Sorting " << num_chunks << " chunks..." << '\n';
+  // The whole chunk is read with a single block read, so the reader needs no buffer of its own
+  RunReader input(input_filename, sizeof(uint32_t), first_element, num_elements - first_element);
 
-  for (size_t i = 0; i < num_chunks; ++i) {
+  auto t_start = std::chrono::steady_clock::now();
+
+  std::vector<uint32_t> buffer(chunk_size_in_elements);
+
+  if (streaming) {
+    std::cout << "Sorting chunks until the end of the stream..." << '\n';
+  } else {
+    std::cout << "Sorting " << num_chunks << " chunks..." << '\n';
+  }
+
+  IoStats write_stats;
+  PresortStats presort_stats;
+  ParallelSorter sorter(options.threads, options.kernel);
+  for (size_t i = first_chunk; i < num_chunks; ++i) {
     size_t elements_to_read =
         std::min(chunk_size_in_elements, num_elements - i * chunk_size_in_elements);
-    input.read(reinterpret_cast<char*>(
-                   buffer.data()), static_cast<std::streamsize>(elements_to_read * sizeof(uint32_t))
-               );
-    size_t elements_read = input.gcount() / sizeof(uint32_t);
+    size_t elements_read = input.readBlock(buffer.data(), elements_to_read);
+    if (elements_read == 0 && streaming) {
+      num_chunks = i;
+      break;
+    }
+    // Only a stream ends where it likes, a file was sized up front
+    if (!streaming && elements_read != elements_to_read) {
+      std::cerr << "Failed to read chunk " << i + 1 << " of " << input_filename << ": got "
+                << elements_read << " of " << elements_to_read << " values" << '\n';
+      return 0;
+    }
 
-    buffer.resize(elements_read);  // Resize buffer to actual number of elements read
-    std::sort(buffer.begin(), buffer.end());
+    presort_stats.add(SortNaturalRuns(buffer.data(), elements_read, sorter));
 
-    std::ostringstream temp_filename_stream;
-    temp_filename_stream << temp_directory << "/"
-                         << SanitizeInputFilename(input_filename) << "_chunk_" << i << ".dat";
-    std::string temp_filename = temp_filename_stream.str();
+    std::string temp_filename = ChunkFilename(spill.directory(i), input_filename, i);
 
-    std::ofstream temp_file(temp_filename, std::ios::binary);
-    if (!temp_file) {
+    RunWriter temp_file(temp_filename, options.run_buffer_bytes, options.spill_format);
+    if (!temp_file.isOpen()) {
       std::cerr << "Failed to open temp file: " << temp_filename << '\n';
-      return;
+      return 0;
     }
 
-    temp_file.write(reinterpret_cast<const char*>(
-                        buffer.data()), static_cast<std::streamsize>(elements_read * sizeof(uint32_t))
-                    );
+    WriteSortedBlock(temp_file, buffer.data(), elements_read, options.output_mode);
     temp_file.close();
+    write_stats += temp_file.stats();
+    if (temp_file.failed()) {
+      std::cerr << "Failed to write temp file: " << temp_filename << '\n';
+      return 0;
+    }
+    manifest.recordRun(RunRecord{
+        i * chunk_size_in_elements,
+        temp_file.stats().raw_bytes / sizeof(uint32_t),
+        temp_file.checksum()
+    });
 
     std::cout << "Chunk " << i + 1 << " sorted and saved to " << temp_filename << '\n';
   }
 
   input.close();
+  manifest.recordRunsComplete(num_chunks);
 
   auto t_end = std::chrono::steady_clock::now();
   std::chrono::duration<size_t, std::nano> const time_elapsed = t_end - t_start;
   std::cout << "ema-sort-int: Time to sort chunks from" << input_filename << " is "
           << time_elapsed.count() << " ns" << '\n';
+  PrintPhaseThroughput("ema-sort-int", "Run formation", input.stats(), write_stats, t_end - t_start);
+  PrintPresortStats("ema-sort-int", presort_stats);
+  if (options.spill_format == RunFormat::Compressed) {
+    PrintCompressionRatio("ema-sort-int", "Run formation", write_stats);
+  }
+  return num_chunks;
 }
 
-// Merge sorted chunks from temporary files into the output file
-void ExternalMemorySorter::mergeChunksAndSave(
-    const std::string& temp_directory,
+// Sort chunks like sortByChunksAndSave, but read chunk N+1 and write chunk N-1 on their own
+// threads while chunk N is sorted. The chunk memory is split into rotating buffers.
+size_t ExternalMemorySorter::sortByChunksAndSavePipelined(
     const std::string& input_filename,
-    const std::string& output_filename,
-    size_t num_chunks
+    SpillDirectories& spill,
+    size_t chunk_size_mb,
+    size_t file_size_in_bytes,
+    const SortOptions& options,
+    RunManifest& manifest
 ) {
-  auto t_start = std::chrono::steady_clock::now();
-  struct HeapNode final {
-    uint32_t value;
+  struct ChunkJob final {
     size_t chunk_index;
+    std::vector<uint32_t>* buffer;  // nullptr marks the end of the stream
+    size_t size;
+  };
+
+  size_t chunk_size_in_elements =
+      std::max<size_t>(1, chunk_size_mb * BytesInMb / sizeof(uint32_t) / PipelineBufferCount);
+  size_t num_elements = file_size_in_bytes / sizeof(uint32_t);
+  size_t num_chunks = (num_elements + chunk_size_in_elements - 1) / chunk_size_in_elements;
+  size_t const first_chunk = std::min(manifest.runs().size(), num_chunks);
+  size_t const first_element = first_chunk * chunk_size_in_elements;
 
-    HeapNode(uint32_t val, size_t ch_idx): value(val), chunk_index(ch_idx) {}
+  RunReader input(input_filename, sizeof(uint32_t), first_element, num_elements - first_element);
+  if (!input.isOpen()) {
+    std::cerr << "Failed to open input file: " << input_filename << '\n';
+    return 0;
+  }
 
-    bool operator>(const HeapNode& other) const {
-      return value > other.value;
+  auto t_start = std::chrono::steady_clock::now();
+
+  std::vector<std::vector<uint32_t>> buffers(
+      PipelineBufferCount, std::vector<uint32_t>(chunk_size_in_elements)
+  );
+
+  std::cout << "Sorting " << num_chunks << " chunks in a " << PipelineBufferCount
+            << "-buffer pipeline..." << '\n';
+
+  BlockingQueue<std::vector<uint32_t>*> free_buffers;
+  BlockingQueue<ChunkJob> to_sort;
+  BlockingQueue<ChunkJob> to_write;
+  for (auto& buffer: buffers) {
+    free_buffers.push(&buffer);
+  }
+
+  std::chrono::nanoseconds read_time{0};
+  std::chrono::nanoseconds sort_time{0};
+  std::chrono::nanoseconds write_time{0};
+  IoStats write_stats;
+  PresortStats presort_stats;
+  ParallelSorter sorter(options.threads, options.kernel);
+  std::atomic<bool> failed = false;
+
+  auto t_pipeline_start = std::chrono::steady_clock::now();
+  std::thread reader([&] {
+    for (size_t i = first_chunk; i < num_chunks && !failed; ++i) {
+      std::vector<uint32_t>* buffer = free_buffers.pop();
+      auto t_read = std::chrono::steady_clock::now();
+      size_t elements_to_read =
+          std::min(chunk_size_in_elements, num_elements - i * chunk_size_in_elements);
+      size_t elements_read = input.readBlock(buffer->data(), elements_to_read);
+      read_time += std::chrono::steady_clock::now() - t_read;
+      // The input size was probed up front, a short chunk means it shrank or a read failed
+      if (elements_read != elements_to_read) {
+        std::cerr << "Failed to read chunk " << i + 1 << " of " << input_filename << ": got "
+                  << elements_read << " of " << elements_to_read << " values" << '\n';
+        failed = true;
+        free_buffers.push(buffer);
+        break;
+      }
+      to_sort.push(ChunkJob{i, buffer, elements_read});
     }
-  };
+    to_sort.push(ChunkJob{num_chunks, nullptr, 0});
+  });
 
-  std::vector<std::ifstream> temp_files(num_chunks);
-  std::vector<uint32_t> current_values(num_chunks);
-  std::vector<bool> has_more(num_chunks, true);
+  std::thread writer([&] {
+    for (ChunkJob job = to_write.pop(); job.buffer != nullptr; job = to_write.pop()) {
+      auto t_write = std::chrono::steady_clock::now();
+      std::string temp_filename =
+          ChunkFilename(spill.directory(job.chunk_index), input_filename, job.chunk_index);
+      RunWriter temp_file(temp_filename, options.run_buffer_bytes, options.spill_format);
+      if (temp_file.isOpen()) {
+        WriteSortedBlock(temp_file, job.buffer->data(), job.size, options.output_mode);
+        temp_file.close();
+        write_stats += temp_file.stats();
+        if (temp_file.failed()) {
+          std::cerr << "Failed to write temp file: " << temp_filename << '\n';
+          failed = true;
+        } else if (!failed) {
+          // The manifest only holds a gapless prefix of the runs, none after a failed one
+          manifest.recordRun(RunRecord{
+              job.chunk_index * chunk_size_in_elements,
+              temp_file.stats().raw_bytes / sizeof(uint32_t),
+              temp_file.checksum()
+          });
+        }
+        if (!temp_file.failed()) {
+          std::cout << "Chunk " << job.chunk_index + 1 << " sorted and saved to "
+                    << temp_filename << '\n';
+        }
+      } else {
+        std::cerr << "Failed to open temp file: " << temp_filename << '\n';
+        failed = true;
+      }
+      write_time += std::chrono::steady_clock::now() - t_write;
+      free_buffers.push(job.buffer);
+    }
+  });
 
-  for (size_t i = 0; i < num_chunks; ++i) {
-    std::ostringstream temp_filename_stream;
-    temp_filename_stream << temp_directory << "/"
-                         << SanitizeInputFilename(input_filename) << "_chunk_" << i << ".dat";
-    std::string temp_filename = temp_filename_stream.str();
-
-    temp_files[i].open(temp_filename, std::ios::binary);
-    if (!temp_files[i]) {
-      std::cerr << "Failed to open temp file for merging: " << temp_filename << '\n';
-      return;
+  for (ChunkJob job = to_sort.pop(); job.buffer != nullptr; job = to_sort.pop()) {
+    auto t_sort = std::chrono::steady_clock::now();
+    presort_stats.add(SortNaturalRuns(job.buffer->data(), job.size, sorter));
+    sort_time += std::chrono::steady_clock::now() - t_sort;
+    to_write.push(job);
+  }
+  to_write.push(ChunkJob{num_chunks, nullptr, 0});
+
+  reader.join();
+  writer.join();
+  input.close();
+  if (!failed) {
+    manifest.recordRunsComplete(num_chunks);
+  }
+
+  auto t_end = std::chrono::steady_clock::now();
+  std::chrono::nanoseconds const time_elapsed = t_end - t_start;
+  std::chrono::nanoseconds const pipeline_time = t_end - t_pipeline_start;
+  std::chrono::nanoseconds const busy_time = read_time + sort_time + write_time;
+  std::cout << "ema-sort-int: Time to sort chunks from" << input_filename << " is "
+            << time_elapsed.count() << " ns" << '\n';
+  std::cout << "ema-sort-int: Pipeline stages busy for read " << read_time.count() << " ns, sort "
+            << sort_time.count() << " ns, write " << write_time.count() << " ns; "
+            << (busy_time - std::min(busy_time, pipeline_time)).count() << " ns of "
+            << pipeline_time.count() << " ns pipeline time overlapped" << '\n';
+  PrintPhaseThroughput("ema-sort-int", "Run formation", input.stats(), write_stats, time_elapsed);
+  PrintPresortStats("ema-sort-int", presort_stats);
+  if (options.spill_format == RunFormat::Compressed) {
+    PrintCompressionRatio("ema-sort-int", "Run formation", write_stats);
+  }
+  return failed ? 0 : num_chunks;
+}
+
+// Sort chunks like sortByChunksAndSave, but move every chunk through the I/O engine as a batch of
+// run-buffer-sized requests, so the io_uring keeps many of them in flight at once
+size_t ExternalMemorySorter::sortByChunksAndSaveWithEngine(
+    const std::string& input_filename,
+    SpillDirectories& spill,
+    size_t chunk_size_mb,
+    size_t file_size_in_bytes,
+    const SortOptions& options,
+    RunManifest& manifest
+) {
+  int const input_fd = open(input_filename.c_str(), O_RDONLY);
+  if (input_fd < 0) {
+    std::cerr << "Failed to open input file: " << input_filename << '\n';
+    return 0;
+  }
+
+  auto t_start = std::chrono::steady_clock::now();
+
+  std::unique_ptr<IoEngine> engine = MakeIoEngine(options.io_engine, options.queue_depth);
+  size_t chunk_size_in_elements = std::max<size_t>(1, chunk_size_mb * BytesInMb / sizeof(uint32_t));
+  std::vector<uint32_t> buffer(chunk_size_in_elements);
+  int buffer_index = -1;
+  if (options.register_buffers &&
+      engine->registerBuffers({iovec{buffer.data(), buffer.size() * sizeof(uint32_t)}})) {
+    buffer_index = 0;
+  }
+
+  size_t num_elements = file_size_in_bytes / sizeof(uint32_t);
+  size_t num_chunks = (num_elements + chunk_size_in_elements - 1) / chunk_size_in_elements;
+
+  std::cout << "Sorting " << num_chunks << " chunks through " << engine->name() << " with queue depth "
+            << engine->queueDepth() << (buffer_index >= 0 ? " and registered buffers" : "") << "..."
+            << '\n';
+
+  IoStats read_stats;
+  IoStats write_stats;
+  PresortStats presort_stats;
+  ParallelSorter sorter(options.threads, options.kernel);
+  for (size_t i = std::min(manifest.runs().size(), num_chunks); i < num_chunks; ++i) {
+    size_t const bytes_to_read =
+        std::min(chunk_size_in_elements, num_elements - i * chunk_size_in_elements) *
+        sizeof(uint32_t);
+    auto t_read = std::chrono::steady_clock::now();
+    size_t const bytes_read = ReadFileBlocks(
+        *engine,
+        input_fd,
+        buffer.data(),
+        bytes_to_read,
+        static_cast<off_t>(i * chunk_size_in_elements * sizeof(uint32_t)),
+        options.run_buffer_bytes,
+        buffer_index
+    );
+    read_stats += IoStats{bytes_read, std::chrono::steady_clock::now() - t_read};
+    if (bytes_read != bytes_to_read) {
+      std::cerr << "Failed to read chunk " << i + 1 << " of " << input_filename << ": got "
+                << bytes_read << " of " << bytes_to_read << " bytes" << '\n';
+      close(input_fd);
+      return 0;
+    }
+    size_t const elements_read = bytes_read / sizeof(uint32_t);
+
+    presort_stats.add(SortNaturalRuns(buffer.data(), elements_read, sorter));
+
+    std::string temp_filename = ChunkFilename(spill.directory(i), input_filename, i);
+    int const temp_fd =
+        open(temp_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);  // NOLINT(hicpp-signed-bitwise)
+    if (temp_fd < 0) {
+      std::cerr << "Failed to open temp file: " << temp_filename << '\n';
+      close(input_fd);
+      return 0;
     }
 
-    if (!temp_files[i].read(reinterpret_cast<char*>(&current_values[i]), sizeof(uint32_t))) {
-      has_more[i] = false;
+    auto t_write = std::chrono::steady_clock::now();
+    bool const written = WriteFileBlocks(
+        *engine,
+        temp_fd,
+        buffer.data(),
+        elements_read * sizeof(uint32_t),
+        0,
+        options.run_buffer_bytes,
+        buffer_index
+    );
+    write_stats += IoStats{elements_read * sizeof(uint32_t), std::chrono::steady_clock::now() - t_write};
+    // A failing close may be the first to report the lost writes
+    bool const closed = close(temp_fd) == 0;
+    if (!written || !closed) {
+      std::cerr << "Failed to write temp file: " << temp_filename << '\n';
+      close(input_fd);
+      return 0;
     }
+    RunChecksum checksum;
+    checksum.update(buffer.data(), elements_read);
+    manifest.recordRun(RunRecord{i * chunk_size_in_elements, elements_read, checksum.value()});
+
+    std::cout << "Chunk " << i + 1 << " sorted and saved to " << temp_filename << '\n';
   }
 
-  std::ofstream output(output_filename, std::ios::binary);
-  if (!output) {
-    std::cerr << "Failed to open output file for writing: " << output_filename << '\n';
+  close(input_fd);
+  manifest.recordRunsComplete(num_chunks);
+
+  auto t_end = std::chrono::steady_clock::now();
+  std::chrono::duration<size_t, std::nano> const time_elapsed = t_end - t_start;
+  std::cout << "ema-sort-int: Time to sort chunks from" << input_filename << " is "
+            << time_elapsed.count() << " ns" << '\n';
+  PrintPhaseThroughput("ema-sort-int", "Run formation", read_stats, write_stats, t_end - t_start);
+  PrintPresortStats("ema-sort-int", presort_stats);
+  if (options.spill_format == RunFormat::Compressed) {
+    PrintCompressionRatio("ema-sort-int", "Run formation", write_stats);
+  }
+  return num_chunks;
+}
+
+// Stream the input through a min-heap of chunk size and cut it into runs by replacement
+// selection. A value smaller than the last one written cannot extend the current run, so it is
+// parked behind the heap until the heap drains and the next run starts.
+size_t ExternalMemorySorter::sortByReplacementSelectionAndSave(
+    const std::string& input_filename,
+    SpillDirectories& spill,
+    size_t chunk_size_mb,
+    const SortOptions& options,
+    RunManifest& manifest
+) {
+  RunReader input(input_filename, options.run_buffer_bytes);
+  if (!input.isOpen()) {
+    std::cerr << "Failed to open input file: " << input_filename << '\n';
+    return 0;
+  }
+
+  auto t_start = std::chrono::steady_clock::now();
+
+  size_t chunk_size_in_elements = std::max<size_t>(1, chunk_size_mb * BytesInMb / sizeof(uint32_t));
+  std::vector<uint32_t> buffer(chunk_size_in_elements);
+  auto heap_begin = buffer.begin();
+  std::greater<> const min_heap_order;
+
+  // buffer[0, heap_size) is the heap of the current run, buffer[heap_size, end) waits for the next
+  size_t end = input.readBlock(buffer.data(), chunk_size_in_elements);
+  size_t heap_size = end;
+  std::make_heap(heap_begin, heap_begin + static_cast<std::ptrdiff_t>(heap_size), min_heap_order);
+
+  std::cout << "Forming runs by replacement selection over " << chunk_size_in_elements
+            << " elements..." << '\n';
+
+  IoStats write_stats;
+  size_t num_runs = 0;
+  size_t total_elements = 0;
+  while (end > 0) {
+    std::string temp_filename = ChunkFilename(spill.directory(num_runs), input_filename, num_runs);
+    RunWriter temp_file(temp_filename, options.run_buffer_bytes, options.spill_format);
+    if (!temp_file.isOpen()) {
+      std::cerr << "Failed to open temp file: " << temp_filename << '\n';
+      return 0;
+    }
+    CollapsingOutput<RunWriter> run_output(temp_file, options.output_mode);
+
+    size_t run_length = 0;
+    while (heap_size > 0) {
+      std::pop_heap(heap_begin, heap_begin + static_cast<std::ptrdiff_t>(heap_size), min_heap_order);
+      const size_t free_slot = heap_size - 1;
+      const uint32_t value = buffer[free_slot];
+      run_output.put(value);
+      ++run_length;
+
+      uint32_t next_value = 0;
+      if (input.next(next_value)) {
+        buffer[free_slot] = next_value;
+        if (next_value >= value) {
+          std::push_heap(
+              heap_begin, heap_begin + static_cast<std::ptrdiff_t>(heap_size), min_heap_order
+          );
+        } else {
+          --heap_size;
+        }
+      } else {
+        // Input is drained: shrink the buffer by moving its last parked value into the hole
+        buffer[free_slot] = buffer[end - 1];
+        --end;
+        --heap_size;
+      }
+    }
+
+    run_output.finish();
+    temp_file.close();
+    write_stats += temp_file.stats();
+    if (temp_file.failed()) {
+      std::cerr << "Failed to write temp file: " << temp_filename << '\n';
+      return 0;
+    }
+    manifest.recordRun(RunRecord{
+        total_elements, temp_file.stats().raw_bytes / sizeof(uint32_t), temp_file.checksum()
+    });
+    total_elements += run_length;
+    ++num_runs;
+    std::cout << "Run " << num_runs << " of " << run_length << " elements saved to "
+              << temp_filename << '\n';
+
+    heap_size = end;
+    std::make_heap(heap_begin, heap_begin + static_cast<std::ptrdiff_t>(heap_size), min_heap_order);
+  }
+
+  input.close();
+  manifest.recordRunsComplete(num_runs);
+
+  auto t_end = std::chrono::steady_clock::now();
+  std::chrono::duration<size_t, std::nano> const time_elapsed = t_end - t_start;
+  std::cout << "ema-sort-int: Time to sort chunks from" << input_filename << " is "
+            << time_elapsed.count() << " ns" << '\n';
+  if (num_runs > 0) {
+    std::cout << "ema-sort-int: Replacement selection formed " << num_runs
+              << " runs, average run length is "
+              << static_cast<double>(total_elements) / static_cast<double>(num_runs) /
+                     static_cast<double>(chunk_size_in_elements)
+              << " x memory" << '\n';
+  }
+  PrintPhaseThroughput("ema-sort-int", "Run formation", input.stats(), write_stats, t_end - t_start);
+  if (options.spill_format == RunFormat::Compressed) {
+    PrintCompressionRatio("ema-sort-int", "Run formation", write_stats);
+  }
+  return num_runs;
+}
+
+namespace {
+
+// Input identity and every setting that shapes the runs, a manifest is only resumed on a match
+std::string ManifestConfig(
+    const std::string& input_filename, size_t chunk_size_mb, const SortOptions& options
+) {
+  std::error_code error;
+  auto const input_bytes = std::filesystem::file_size(input_filename, error);
+  auto const input_mtime =
+      std::filesystem::last_write_time(input_filename, error).time_since_epoch().count();
+  std::string spill_directories;
+  for (const std::string& directory: options.spill_directories) {
+    spill_directories += (spill_directories.empty() ? "" : ",") + directory;
+  }
+  return "input_bytes=" + std::to_string(input_bytes) +
+         " input_mtime=" + std::to_string(input_mtime) +
+         " chunk_mb=" + std::to_string(chunk_size_mb) +
+         " pipelined=" + std::to_string(static_cast<int>(options.pipelined)) +
+         " run_generation=" + std::to_string(static_cast<int>(options.run_generation)) +
+         " spill_format=" + std::to_string(static_cast<int>(options.spill_format)) +
+         " spill_dirs=" + spill_directories +
+         " output_mode=" + std::to_string(static_cast<int>(options.output_mode));
+}
+
+// Every thread of the parallel merge opens every run. The fan-in is only bounded by the open file
+// limit for one thread, so more threads fall back to a merge on one thread when they would exceed
+// it.
+bool ParallelMergeFitsFileLimit(size_t num_runs, size_t merge_threads) {
+  size_t const max_open = MaxOpenRunFiles();
+  if (num_runs <= max_open / merge_threads) {
+    return true;
+  }
+  std::cout << "ema-sort-int: " << merge_threads << " merge threads over " << num_runs
+            << " runs exceed the " << max_open << " open run files allowed, merging on one thread"
+            << '\n';
+  return false;
+}
+
+// Pass every value of the merge with the index of its source to `put`, calling `on_exhausted`
+// with the index of every drained source
+template <typename Merger, typename Put>
+void DrainMerger(Merger& merger, const Put& put, const std::function<void(size_t)>& on_exhausted) {
+  while (!merger.empty()) {
+    size_t idx = merger.topSource();
+    put(merger.top(), idx);
+
+    merger.pop();
+    if (merger.exhausted(idx)) {
+      on_exhausted(idx);
+    }
+  }
+}
+
+// Merge `sources` into `output` in `mode`, calling `on_exhausted` with the index of every drained
+// source. Count runs hold (value, count) pairs, their counts are added up for equal values, unless
+// `counted_sources` is false and they hold plain values counted once each.
+template <typename Source, typename Output>
+void MergeSources(
+    std::vector<Source*> sources,
+    Output& output,
+    const std::function<void(size_t)>& on_exhausted,
+    OutputMode mode = OutputMode::All,
+    bool counted_sources = true
+) {
+  if (mode == OutputMode::All) {
+    LoserTree<uint32_t, Source> merger(std::move(sources));
+    auto const put = [&output](uint32_t value, size_t /*idx*/) { output.put(value); };
+    DrainMerger(merger, put, on_exhausted);
     return;
   }
 
-  auto cmp = [](const HeapNode& left, const HeapNode& right) { return left.value > right.value; };
+  CollapsingOutput<Output> collapsed(output, mode);
+  if (mode == OutputMode::Count && counted_sources) {
+    std::vector<CountedSource<Source>> counted;
+    counted.reserve(sources.size());
+    std::vector<CountedSource<Source>*> counted_sources;
+    for (Source* source: sources) {
+      counted.emplace_back(source);
+      counted_sources.push_back(&counted.back());
+    }
+    LoserTree<uint32_t, CountedSource<Source>> merger(std::move(counted_sources));
+    DrainMerger(
+        merger,
+        [&](uint32_t value, size_t idx) { collapsed.put(value, counted[idx].count()); },
+        on_exhausted
+    );
+  } else {
+    LoserTree<uint32_t, Source> merger(std::move(sources));
+    auto const put = [&collapsed](uint32_t value, size_t /*idx*/) { collapsed.put(value); };
+    DrainMerger(merger, put, on_exhausted);
+  }
+  collapsed.finish();
+}
+
+}  // namespace
 
-  std::priority_queue<HeapNode, std::vector<HeapNode>, decltype(cmp)> min_heap(cmp);
+// Merge sorted run files into the output file, closing every run once it is exhausted. The run
+// files stay until the caller has recorded the merged run.
+bool ExternalMemorySorter::mergeRunFiles(
+    const std::vector<std::string>& run_filenames,
+    const std::vector<size_t>& run_devices,
+    const std::string& output_filename,
+    RunFormat output_format,
+    const SortOptions& options,
+    IoStats& read_stats,
+    IoStats& write_stats,
+    RunRecord& merged_run,
+    bool counted_runs
+) {
+  // The engine writes at offsets, which a stream output does not have
+  if (options.io_engine != IoEngineKind::Stream && options.spill_format == RunFormat::Raw &&
+      output_format == RunFormat::Raw && !IsStreamPath(output_filename)) {
+    return mergeRunFilesWithEngine(
+        run_filenames, output_filename, options, read_stats, write_stats, merged_run, counted_runs
+    );
+  }
 
-  for (size_t i = 0; i < num_chunks; ++i) {
-    if (has_more[i]) {
-      min_heap.emplace(current_values[i], i);
+  // Runs striped over several devices are read ahead by one I/O thread per device, so that the
+  // merge keeps every device busy instead of reading them one at a time
+  bool const striped =
+      std::any_of(run_devices.begin(), run_devices.end(), [&run_devices](size_t device) {
+        return device != run_devices.front();
+      });
+  bool const prefetch = options.prefetch_blocks > 0 || striped;
+  std::vector<std::unique_ptr<RunReader>> run_files;
+  run_files.reserve(run_filenames.size());
+
+  // Prefetched raw runs are read in whole blocks straight into the prefetch buffers, compressed
+  // runs still need a buffer to decode into
+  size_t const reader_buffer_bytes = prefetch && options.spill_format == RunFormat::Raw
+                                         ? sizeof(uint32_t)
+                                         : options.run_buffer_bytes;
+  for (const std::string& run_filename: run_filenames) {
+    run_files.push_back(
+        std::make_unique<RunReader>(run_filename, reader_buffer_bytes, options.spill_format)
+    );
+    if (!run_files.back()->isOpen()) {
+      std::cerr << "Failed to open temp file for merging: " << run_filename << '\n';
+      return false;
     }
   }
 
-  while (!min_heap.empty()) {
-    HeapNode node = min_heap.top();
-    min_heap.pop();
+  RunWriter output(output_filename, options.run_buffer_bytes, output_format);
+  if (!output.isOpen()) {
+    std::cerr << "Failed to open output file for writing: " << output_filename << '\n';
+    return false;
+  }
 
-    output.write(reinterpret_cast<const char*>(&node.value), sizeof(uint32_t));
+  auto close_run = [&](size_t idx) {
+    read_stats += run_files[idx]->stats();
+    run_files[idx]->close();
+  };
 
-    size_t idx = node.chunk_index;
-    if (temp_files[idx].read(reinterpret_cast<char*>(&current_values[idx]), sizeof(uint32_t))) {
-      min_heap.emplace(current_values[idx], idx);
-    } else {
-      has_more[idx] = false;
-      temp_files[idx].close();
-      // Delete temp file
-      std::ostringstream temp_filename_stream;
-      temp_filename_stream << temp_directory << "/chunk_" << idx << ".dat";
-      std::string temp_filename = temp_filename_stream.str();
-      (void) std::remove(temp_filename.c_str());
+  if (prefetch) {
+    RunPrefetcher prefetcher(
+        run_files.size(),
+        options.run_buffer_bytes,
+        options.prefetch_blocks > 0 ? options.prefetch_blocks : StripedPrefetchBlocks,
+        options.prefetch_threads,
+        [&run_files](size_t run_index, uint32_t* destination, size_t count) {
+          return run_files[run_index]->readBlock(destination, count);
+        },
+        striped ? run_devices : std::vector<size_t>()
+    );
+    std::vector<PrefetchedRun*> sources;
+    sources.reserve(run_files.size());
+    for (size_t i = 0; i < run_files.size(); ++i) {
+      sources.push_back(prefetcher.run(i));
+    }
+    MergeSources(std::move(sources), output, close_run, options.output_mode, counted_runs);
+    prefetcher.stop();
+    PrintPrefetchStats("ema-sort-int", prefetcher.stats());
+  } else {
+    std::vector<RunReader*> sources;
+    sources.reserve(run_files.size());
+    for (auto& run_file: run_files) {
+      sources.push_back(run_file.get());
     }
+    MergeSources(std::move(sources), output, close_run, options.output_mode, counted_runs);
   }
 
+  output.close();
+  write_stats += output.stats();
+  for (size_t i = 0; i < run_files.size(); ++i) {
+    if (run_files[i]->failed()) {
+      std::cerr << "Corrupt block in run file: " << run_filenames[i] << '\n';
+      return false;
+    }
+  }
+  if (output.failed()) {
+    std::cerr << "Failed to write output file: " << output_filename << '\n';
+    return false;
+  }
+  merged_run.count = output.stats().raw_bytes / sizeof(uint32_t);
+  merged_run.checksum = output.checksum();
+  return true;
+}
+
+// Merge sorted run files into the output file with every run read and the output written through
+// the I/O engine. Run refills are gathered into batches of up to the queue depth.
+bool ExternalMemorySorter::mergeRunFilesWithEngine(
+    const std::vector<std::string>& run_filenames,
+    const std::string& output_filename,
+    const SortOptions& options,
+    IoStats& read_stats,
+    IoStats& write_stats,
+    RunRecord& merged_run,
+    bool counted_runs
+) {
+  std::unique_ptr<IoEngine> engine = MakeIoEngine(options.io_engine, options.queue_depth);
+
+  EngineRunSet runs(*engine, run_filenames, options.run_buffer_bytes);
+  if (!runs.isOpen()) {
+    return false;
+  }
+  EngineRunWriter output(*engine, output_filename, options.run_buffer_bytes);
+  if (!output.isOpen()) {
+    std::cerr << "Failed to open output file for writing: " << output_filename << '\n';
+    return false;
+  }
+
+  if (options.register_buffers) {
+    std::vector<iovec> buffers;
+    runs.collectBuffers(buffers);
+    output.collectBuffers(buffers);
+    // Without registration the requests use the same buffers unpinned
+    (void) engine->registerBuffers(buffers);
+  }
+
+  runs.start();
+  std::vector<EngineRunSet::Source> run_sources = runs.sources();
+  std::vector<EngineRunSet::Source*> sources;
+  sources.reserve(run_sources.size());
+  for (auto& source: run_sources) {
+    sources.push_back(&source);
+  }
+  // The descriptors of drained runs stay open until the run set goes away
+  MergeSources(
+      std::move(sources), output, [](size_t /*idx*/) {}, options.output_mode, counted_runs
+  );
+
+  bool const written = output.close();
+  read_stats += runs.stats();
+  write_stats += output.stats();
+  if (!written) {
+    std::cerr << "Failed to write output file: " << output_filename << '\n';
+    return false;
+  }
+  merged_run.count = output.stats().bytes / sizeof(uint32_t);
+  merged_run.checksum = output.checksum();
+  return true;
+}
+
+// Merge sorted run files into the output file on several threads. The runs are split into
+// disjoint key ranges, and every thread merges one range straight into its slice of the output.
+bool ExternalMemorySorter::mergeRunFilesParallel(
+    const std::vector<std::string>& run_filenames,
+    const std::string& output_filename,
+    size_t run_buffer_bytes,
+    size_t num_threads,
+    IoStats& read_stats,
+    IoStats& write_stats
+) {
+  std::vector<MergePartition> const partitions = PartitionRunsByKey(run_filenames, num_threads);
+  size_t const total_elements = partitions.back().output_offset + partitions.back().size;
+
+  {
+    std::ofstream output(output_filename, std::ios::binary);
+    if (!output) {
+      std::cerr << "Failed to open output file for writing: " << output_filename << '\n';
+      return false;
+    }
+  }
+  std::error_code error;
+  std::filesystem::resize_file(output_filename, total_elements * sizeof(uint32_t), error);
+  if (error) {
+    std::cerr << "Failed to resize output file: " << output_filename << '\n';
+    return false;
+  }
+
+  // Every thread holds a buffer per run, keep the total close to the sequential merge
+  size_t const thread_buffer_bytes = std::max(run_buffer_bytes / num_threads, MinRunBufferBytes);
+  std::vector<IoStats> thread_read_stats(partitions.size());
+  std::vector<IoStats> thread_write_stats(partitions.size());
+  std::atomic<bool> failed = false;
+
+  std::vector<std::thread> threads;
+  for (size_t p = 0; p < partitions.size(); ++p) {
+    threads.emplace_back([&, p] {
+      const MergePartition& partition = partitions[p];
+      std::vector<std::unique_ptr<RunReader>> run_files;
+      std::vector<RunReader*> sources;
+      for (size_t i = 0; i < run_filenames.size(); ++i) {
+        run_files.push_back(std::make_unique<RunReader>(
+            run_filenames[i],
+            thread_buffer_bytes,
+            partition.run_begin[i],
+            partition.run_end[i] - partition.run_begin[i]
+        ));
+        if (!run_files.back()->isOpen()) {
+          std::cerr << "Failed to open run file: " << run_filenames[i] << '\n';
+          failed = true;
+          return;
+        }
+        sources.push_back(run_files.back().get());
+      }
+      RunWriter output(output_filename, thread_buffer_bytes, partition.output_offset);
+      if (!output.isOpen()) {
+        std::cerr << "Failed to open output file for writing: " << output_filename << '\n';
+        failed = true;
+        return;
+      }
+
+      LoserTree<uint32_t, RunReader> merger(std::move(sources));
+      uint32_t value = 0;
+      size_t written = 0;
+      while (merger.next(value)) {
+        output.put(value);
+        ++written;
+      }
+      output.close();
+      // The output was sized up front, a short run would leave a hole of zeros in it
+      if (written != partition.size || output.failed()) {
+        std::cerr << "Partition " << p << " wrote " << written << " of " << partition.size
+                  << " values to " << output_filename << '\n';
+        failed = true;
+      }
+
+      for (auto& run_file: run_files) {
+        thread_read_stats[p] += run_file->stats();
+      }
+      thread_write_stats[p] = output.stats();
+    });
+  }
+  for (auto& thread: threads) {
+    thread.join();
+  }
+
+  for (size_t p = 0; p < partitions.size(); ++p) {
+    std::cout << "Partition " << p << ": keys [" << partitions[p].lower_key << ", "
+              << partitions[p].upper_key << "), " << partitions[p].size << " elements" << '\n';
+    read_stats += thread_read_stats[p];
+    write_stats += thread_write_stats[p];
+  }
+
+  return !failed;
+}
+
+// Merge sorted chunks from temporary files into the output file, in as many passes as the
+// fan-in allowed by the chunk memory and the open file limit requires. Merged runs recorded in the
+// manifest by an earlier attempt are kept, and the runs they replace are already gone.
+bool ExternalMemorySorter::mergeChunksAndSave(
+    SpillDirectories& spill,
+    const std::string& input_filename,
+    const std::string& output_filename,
+    size_t num_chunks,
+    size_t chunk_size_mb,
+    const SortOptions& options,
+    RunManifest& manifest
+) {
+  auto t_start = std::chrono::steady_clock::now();
+
+  std::vector<std::string> runs;
+  std::vector<size_t> run_devices;
+  std::vector<RunRecord> run_records = manifest.runs();
+  runs.reserve(num_chunks);
+  size_t total_bytes = 0;
+  for (size_t i = 0; i < num_chunks; ++i) {
+    runs.push_back(ChunkFilename(spill.directory(i), input_filename, i));
+    run_devices.push_back(spill.device(i));
+    std::error_code error;
+    total_bytes += std::filesystem::file_size(runs.back(), error);
+  }
+
+  // The plan of an earlier attempt fixes the file names of its merged runs, keep its fan-in
+  size_t fan_in = manifest.fanIn();
+  if (fan_in == 0) {
+    fan_in = MaxMergeFanIn(
+        chunk_size_mb * BytesInMb,
+        options.run_buffer_bytes * MergeRunBuffers(options),
+        options.max_fan_in
+    );
+    manifest.recordMergePlan(fan_in);
+  }
+  MergePlan const plan = PlanMergePasses(num_chunks, fan_in);
+  PrintMergePlan("ema-sort-int", plan, total_bytes);
+  bool const stream_output = IsStreamPath(output_filename);
+
+  for (size_t pass_index = 0; pass_index < plan.passes.size(); ++pass_index) {
+    const MergePass& pass = plan.passes[pass_index];
+    bool const last_pass = pass_index + 1 == plan.passes.size();
+    auto t_pass_start = std::chrono::steady_clock::now();
+
+    IoStats read_stats;
+    IoStats write_stats;
+    std::vector<std::string> next_runs;
+    std::vector<size_t> next_devices;
+    std::vector<RunRecord> next_records;
+    size_t output_offset = 0;
+    size_t first_run = 0;
+    size_t reused_runs = 0;
+    for (size_t group = 0; group < pass.output_runs; ++group) {
+      size_t const group_size = pass.group_sizes[group];
+      std::string const merged_filename =
+          last_pass ? output_filename
+                    : MergePassFilename(spill.directory(group), input_filename, pass_index + 1, group);
+      const RunRecord* recorded = last_pass ? nullptr : manifest.mergedRun(pass_index + 1, group);
+      if (recorded != nullptr) {
+        next_runs.push_back(merged_filename);
+        next_devices.push_back(spill.device(group));
+        next_records.push_back(*recorded);
+        output_offset += recorded->count;
+        first_run += group_size;
+        ++reused_runs;
+        continue;
+      }
+
+      std::vector<std::string> const group_runs(
+          runs.begin() + static_cast<std::ptrdiff_t>(first_run),
+          runs.begin() + static_cast<std::ptrdiff_t>(first_run + group_size)
+      );
+      std::vector<size_t> const group_devices(
+          run_devices.begin() + static_cast<std::ptrdiff_t>(first_run),
+          run_devices.begin() + static_cast<std::ptrdiff_t>(first_run + group_size)
+      );
+      for (size_t i = first_run; i < first_run + group_size; ++i) {
+        if (run_records[i].reused && !VerifyRunFile(runs[i], options.spill_format, run_records[i])) {
+          std::cerr << "Run " << runs[i] << " does not match the run manifest, sort again without "
+                    << "--resume" << '\n';
+          return false;
+        }
+      }
+
+      RunRecord merged_run{output_offset};
+      // Compressed runs cannot be split at arbitrary values for the parallel merge, and the output
+      // slices of its threads are only known up front while no duplicates are collapsed. A stream
+      // output takes its values in order.
+      bool const merged =
+          last_pass && options.merge_threads > 1 && options.spill_format == RunFormat::Raw &&
+                  options.output_mode == OutputMode::All && !stream_output &&
+                  ParallelMergeFitsFileLimit(group_runs.size(), options.merge_threads)
+              ? mergeRunFilesParallel(
+                    group_runs,
+                    merged_filename,
+                    options.run_buffer_bytes,
+                    options.merge_threads,
+                    read_stats,
+                    write_stats
+                )
+              : mergeRunFiles(
+                    group_runs,
+                    group_devices,
+                    merged_filename,
+                    last_pass ? RunFormat::Raw : options.spill_format,
+                    options,
+                    read_stats,
+                    write_stats,
+                    merged_run
+                );
+      if (!merged) {
+        return false;
+      }
+      if (!last_pass) {
+        manifest.recordMergedRun(pass_index + 1, group, merged_run);
+      }
+      // Delete temp files only once the merged run is recorded, a resume may still need them
+      for (const std::string& run_filename: group_runs) {
+        (void) std::remove(run_filename.c_str());
+      }
+      next_runs.push_back(merged_filename);
+      next_devices.push_back(spill.device(group));
+      next_records.push_back(merged_run);
+      output_offset += merged_run.count;
+      first_run += group_size;
+    }
+    runs = std::move(next_runs);
+    run_devices = std::move(next_devices);
+    run_records = std::move(next_records);
+
+    if (reused_runs > 0) {
+      std::cout << "ema-sort-int: Merge pass " << pass_index + 1 << " reused " << reused_runs
+                << " of " << pass.output_runs << " runs recorded by an earlier attempt" << '\n';
+    }
+    PrintPhaseThroughput(
+        "ema-sort-int",
+        "Merge pass " + std::to_string(pass_index + 1),
+        read_stats,
+        write_stats,
+        std::chrono::steady_clock::now() - t_pass_start
+    );
+    if (options.spill_format == RunFormat::Compressed) {
+      PrintCompressionRatio(
+          "ema-sort-int", "Merge pass " + std::to_string(pass_index + 1) + " input", read_stats
+      );
+    }
+  }
+  manifest.remove();
+
   auto t_end = std::chrono::steady_clock::now();
   std::chrono::duration<size_t, std::nano> const time_elapsed = t_end - t_start;
   std::cout << "ema-sort-int: Time to merge chunks into" << output_filename << " is "
           << time_elapsed.count() << " ns" << '\n';
+  return true;
+}
 
+// Partition the input by the splitters of `plan` in one pass, then sort the buckets one at a time
+// and append them to the output in bucket order. The buckets are disjoint value ranges, so the
+// output needs no merge and collapsing duplicates never spans two buckets.
+bool ExternalMemorySorter::distributionSort(
+    const std::string& input_filename,
+    const std::string& output_filename,
+    SpillDirectories& spill,
+    size_t chunk_size_mb,
+    const DistributionPlan& plan,
+    const SortOptions& options
+) {
+  auto t_start = std::chrono::steady_clock::now();
+  size_t const chunk_size_in_elements =
+      std::max<size_t>(1, chunk_size_mb * BytesInMb / sizeof(uint32_t));
+  BucketIndex const index(plan.splitters);
+
+  // Step 1: Partition the input into the bucket files
+  std::vector<std::string> buckets;
+  std::vector<std::unique_ptr<RunWriter>> writers;
+  for (size_t i = 0; i < plan.bucket_count; ++i) {
+    buckets.push_back(BucketFilename(spill.directory(i), input_filename, i));
+    writers.push_back(
+        std::make_unique<RunWriter>(buckets.back(), plan.bucket_buffer_bytes, options.spill_format)
+    );
+    if (!writers.back()->isOpen()) {
+      std::cerr << "Failed to open temp file: " << buckets.back() << '\n';
+      return false;
+    }
+  }
+  RunReader input(input_filename, options.run_buffer_bytes);
+  if (!input.isOpen()) {
+    std::cerr << "Failed to open input file: " << input_filename << '\n';
+    return false;
+  }
+  std::vector<uint32_t> block(std::max<size_t>(1, options.run_buffer_bytes / sizeof(uint32_t)));
+  for (size_t read = input.readBlock(block.data(), block.size()); read > 0;
+       read = input.readBlock(block.data(), block.size())) {
+    for (size_t i = 0; i < read; ++i) {
+      writers[index.bucket(block[i])]->put(block[i]);
+    }
+  }
+  input.close();
+  block = std::vector<uint32_t>();
+
+  IoStats write_stats;
+  std::vector<size_t> bucket_sizes;
+  for (size_t i = 0; i < writers.size(); ++i) {
+    writers[i]->close();
+    write_stats += writers[i]->stats();
+    if (writers[i]->failed()) {
+      std::cerr << "Failed to write temp file: " << buckets[i] << '\n';
+      return false;
+    }
+    bucket_sizes.push_back(writers[i]->stats().raw_bytes / sizeof(uint32_t));
+  }
+  writers.clear();
+  auto t_partitioned = std::chrono::steady_clock::now();
+  std::cout << "ema-sort-int: Largest bucket holds "
+            << *std::max_element(bucket_sizes.begin(), bucket_sizes.end()) << " values" << '\n';
+  PrintPhaseThroughput(
+      "ema-sort-int", "Distribution", input.stats(), write_stats, t_partitioned - t_start
+  );
+  if (options.spill_format == RunFormat::Compressed) {
+    PrintCompressionRatio("ema-sort-int", "Distribution", write_stats);
+  }
+
+  // Step 2: Sort every bucket in memory and append it to the output
+  RunWriter output(output_filename, options.run_buffer_bytes);
+  if (!output.isOpen()) {
+    std::cerr << "Failed to open output file for writing: " << output_filename << '\n';
+    return false;
+  }
+  IoStats read_stats;
+  PresortStats presort_stats;
+  ParallelSorter sorter(options.threads, options.kernel);
+  std::vector<uint32_t> buffer;
+  for (size_t i = 0; i < buckets.size(); ++i) {
+    bool const single_value = IsSingleValueBucket(plan.splitters, i);
+    if (single_value && options.output_mode != OutputMode::All) {
+      // The bucket collapses into its value without being read
+      CollapsingOutput<RunWriter> collapsed(output, options.output_mode);
+      for (size_t left = bucket_sizes[i]; left > 0;) {
+        auto const count = static_cast<uint32_t>(
+            std::min<size_t>(left, std::numeric_limits<uint32_t>::max())
+        );
+        collapsed.put(plan.splitters[i - 1], count);
+        left -= count;
+      }
+      collapsed.finish();
+    } else if (single_value || bucket_sizes[i] > chunk_size_in_elements) {
+      // A bucket of a single value is sorted as it is. Any other bucket the sample missed the size
+      // of is sorted by merging like a whole input.
+      std::string sorted_filename = buckets[i];
+      if (!single_value) {
+        std::cout << "ema-sort-int: Bucket " << i << " of " << bucket_sizes[i]
+                  << " values exceeds the chunk, sorting it by merging" << '\n';
+        sorted_filename = buckets[i] + ".sorted";
+        // The nested sort brings buffers of its own and reads its input as plain values, a
+        // compressed bucket is decoded first
+        std::vector<uint32_t>().swap(buffer);
+        sorter.releaseScratch();
+        std::string bucket_input = buckets[i];
+        if (options.spill_format == RunFormat::Compressed) {
+          bucket_input = buckets[i] + ".raw";
+          RunReader encoded(buckets[i], options.run_buffer_bytes, RunFormat::Compressed);
+          RunWriter decoded(bucket_input, options.run_buffer_bytes);
+          if (!encoded.isOpen() || !decoded.isOpen()) {
+            std::cerr << "Failed to decode bucket: " << buckets[i] << '\n';
+            return false;
+          }
+          buffer.resize(std::max<size_t>(1, options.run_buffer_bytes / sizeof(uint32_t)));
+          for (size_t read = encoded.readBlock(buffer.data(), buffer.size()); read > 0;
+               read = encoded.readBlock(buffer.data(), buffer.size())) {
+            decoded.writeBlock(buffer.data(), read);
+          }
+          encoded.close();
+          decoded.close();
+          read_stats += encoded.stats();
+          if (encoded.failed() || decoded.failed() ||
+              decoded.stats().raw_bytes != bucket_sizes[i] * sizeof(uint32_t)) {
+            std::cerr << "Failed to decode bucket: " << buckets[i] << '\n';
+            return false;
+          }
+        }
+        SortOptions bucket_options = options;
+        bucket_options.strategy = SortStrategy::Merge;
+        bucket_options.resume = false;
+        externalMemorySort(bucket_input, sorted_filename, chunk_size_mb, bucket_options);
+        if (bucket_input != buckets[i]) {
+          (void) std::remove(bucket_input.c_str());
+        }
+      }
+      RunReader sorted(
+          sorted_filename,
+          options.run_buffer_bytes,
+          single_value ? options.spill_format : RunFormat::Raw
+      );
+      if (!sorted.isOpen()) {
+        std::cerr << "Failed to sort bucket: " << buckets[i] << '\n';
+        return false;
+      }
+      buffer.resize(std::max<size_t>(1, options.run_buffer_bytes / sizeof(uint32_t)));
+      for (size_t read = sorted.readBlock(buffer.data(), buffer.size()); read > 0;
+           read = sorted.readBlock(buffer.data(), buffer.size())) {
+        output.writeBlock(buffer.data(), read);
+      }
+      sorted.close();
+      read_stats += sorted.stats();
+      if (sorted.failed()) {
+        std::cerr << "Corrupt block in run file: " << sorted_filename << '\n';
+        return false;
+      }
+      (void) std::remove(sorted_filename.c_str());
+    } else {
+      buffer.resize(bucket_sizes[i]);
+      // A raw bucket is read with a single block read and needs no buffer of its own
+      RunReader bucket =
+          options.spill_format == RunFormat::Raw
+              ? RunReader(buckets[i], sizeof(uint32_t), 0, bucket_sizes[i])
+              : RunReader(buckets[i], options.run_buffer_bytes, options.spill_format);
+      if (bucket.readBlock(buffer.data(), buffer.size()) != buffer.size()) {
+        std::cerr << "Failed to read temp file: " << buckets[i] << '\n';
+        return false;
+      }
+      bucket.close();
+      read_stats += bucket.stats();
+      presort_stats.add(SortNaturalRuns(buffer.data(), buffer.size(), sorter));
+      WriteSortedBlock(output, buffer.data(), buffer.size(), options.output_mode);
+    }
+    (void) std::remove(buckets[i].c_str());
+  }
   output.close();
+  if (output.failed()) {
+    std::cerr << "Failed to write output file: " << output_filename << '\n';
+    return false;
+  }
+
+  auto t_end = std::chrono::steady_clock::now();
+  PrintPhaseThroughput(
+      "ema-sort-int", "Bucket sort", read_stats, output.stats(), t_end - t_partitioned
+  );
+  PrintPresortStats("ema-sort-int", presort_stats);
+  std::cout << "ema-sort-int: Time to distribution sort " << input_filename << " is "
+            << std::chrono::nanoseconds(t_end - t_start).count() << " ns" << '\n';
+  return true;
 }
 
 // External memory sort implementation
 void ExternalMemorySorter::externalMemorySort(
-    const std::string& input_filename, const std::string& output_filename, size_t chunk_size_mb
+    const std::string& input_filename,
+    const std::string& output_filename,
+    size_t chunk_size_mb,
+    const SortOptions& options
 ) {
+  if (options.record_type != RecordType::U32) {
+    size_t const chunk_size_bytes = chunk_size_mb * BytesInMb;
+    bool const sorted =
+        options.record_type == RecordType::Lines
+            ? LineSorter::externalSort(
+                  input_filename, output_filename, chunk_size_bytes, options, "ema-sort-int"
+              )
+            : DispatchRecordType(options.record_type, [&](auto record) {
+                return RecordSorter<decltype(record)>::externalSort(
+                    input_filename, output_filename, chunk_size_bytes, options, "ema-sort-int"
+                );
+              });
+    if (sorted) {
+      std::cout << "External memory sort completed. Output file: " << output_filename << '\n';
+    }
+    return;
+  }
 
-  std::string temp_directory = std::filesystem::temp_directory_path();
-  if (temp_directory.empty()) {
-    temp_directory = ".";
+  std::vector<std::string> spill_directories = options.spill_directories;
+  if (spill_directories.empty()) {
+    std::string temp_directory = std::filesystem::temp_directory_path();
+    if (temp_directory.empty()) {
+      temp_directory = ".";
+    }
+    spill_directories.push_back(temp_directory);
+  }
+  for (const std::string& directory: spill_directories) {
+    if (!std::filesystem::is_directory(directory)) {
+      std::cerr << "Spill directory does not exist: " << directory << '\n';
+      return;
+    }
+  }
+  SpillDirectories spill(spill_directories, options.spill_policy);
+
+  RunManifest manifest(
+      ManifestFilename(spill.primary(), input_filename),
+      ManifestConfig(input_filename, chunk_size_mb, options)
+  );
+  // A stream is gone once read, its runs cannot be matched to it again
+  bool const streaming = IsStreamPath(input_filename);
+  if (streaming && options.resume) {
+    std::cout << "ema-sort-int: " << input_filename << " is a stream, --resume is ignored" << '\n';
+  }
+  size_t num_chunks = 0;
+  if (options.resume && !streaming && manifest.load()) {
+    std::cout << "Resuming from the run manifest: " << manifest.runs().size() << " runs recorded"
+              << (manifest.completedRuns() > 0 ? ", run formation complete" : "") << '\n';
+    num_chunks = manifest.completedRuns();
+    // The runs of the earlier attempt are found where its weights placed them
+    if (manifest.spillWeights().size() == spill.size()) {
+      spill.setWeights(manifest.spillWeights());
+    }
+  } else {
+    if (options.resume && !streaming) {
+      std::cout << "No run manifest matches " << input_filename << ", sorting from the start"
+                << '\n';
+    }
+    manifest.start();
+    manifest.recordSpillWeights(spill.weights());
+  }
+  // A sorted input needs no runs at all: it is copied, or left alone when sorted onto itself. A
+  // stream would be used up by the scan, and only files can be copied.
+  if (num_chunks == 0 && manifest.runs().empty() && options.output_mode == OutputMode::All &&
+      !streaming && !IsStreamPath(output_filename)) {
+    auto t_scan = std::chrono::steady_clock::now();
+    IoStats scan_stats;
+    bool const sorted = IsRawFileSorted(input_filename, options.run_buffer_bytes, scan_stats);
+    std::cout << "ema-sort-int: Presortedness scan read " << scan_stats.bytes << " B in "
+              << (std::chrono::steady_clock::now() - t_scan).count() << " ns" << '\n';
+    if (sorted) {
+      manifest.remove();
+      std::error_code error;
+      bool const in_place = std::filesystem::equivalent(input_filename, output_filename, error);
+      if (!in_place) {
+        std::filesystem::copy_file(
+            input_filename,
+            output_filename,
+            std::filesystem::copy_options::overwrite_existing,
+            error
+        );
+        if (error) {
+          std::cerr << "Failed to copy the sorted input to " << output_filename << ": "
+                    << error.message() << '\n';
+          return;
+        }
+      }
+      std::cout << "ema-sort-int: Input is already sorted, "
+                << (in_place ? "nothing to do" : "copied it to the output") << '\n';
+      std::cout << "External memory sort completed. Output file: " << output_filename << '\n';
+      return;
+    }
+  }
+  if (spill.size() > 1) {
+    std::cout << "ema-sort-int: Striping runs over " << spill.size() << " spill directories"
+              << '\n';
+  }
+
+  // A distribution sort writes its buckets in output order and needs neither runs nor a merge
+  if (options.strategy != SortStrategy::Merge && num_chunks == 0 && manifest.runs().empty()) {
+    if (streaming) {
+      std::cout << "ema-sort-int: A stream cannot be sampled, sorting by merging" << '\n';
+    } else {
+      std::error_code error;
+      size_t const input_elements =
+          std::filesystem::file_size(input_filename, error) / sizeof(uint32_t);
+      DistributionPlan const plan = PlanDistribution(
+          SampleRawFile(input_filename, input_elements, DistributionSampleSize),
+          input_elements,
+          std::max<size_t>(1, chunk_size_mb * BytesInMb / sizeof(uint32_t)),
+          options.run_buffer_bytes,
+          MaxMergeFanIn(chunk_size_mb * BytesInMb, MinRunBufferBytes, options.max_fan_in),
+          options.strategy
+      );
+      if (plan.bucket_count == 0) {
+        std::cout << "ema-sort-int: Sorting by merging, " << plan.reason << '\n';
+      } else {
+        std::cout << "ema-sort-int: Distributing into " << plan.bucket_count
+                  << " buckets, the largest predicted to hold " << plan.largest_bucket_elements
+                  << " values, " << plan.reason << '\n';
+        manifest.remove();
+        if (distributionSort(
+                input_filename, output_filename, spill, chunk_size_mb, plan, options
+            )) {
+          std::cout << "External memory sort completed. Output file: " << output_filename << '\n';
+        }
+        return;
+      }
+    }
   }
 
   // Step 1: Sort chunks and save them to temporary files
-  sortByChunksAndSave(input_filename, temp_directory, chunk_size_mb);
+  if (num_chunks == 0) {
+    num_chunks =
+        sortByChunksAndSave(input_filename, spill, chunk_size_mb, options, manifest);
+  }
+  if (num_chunks == 0) {
+    std::cerr << "No chunks were created from input file: " << input_filename << '\n';
+    return;
+  }
 
-  // Step 2: Calculate the number of chunks
-  std::ifstream input(input_filename, std::ios::binary | std::ios::ate);
-  if (!input) {
-    std::cerr << "Failed to open input file for size calculation: " << input_filename << '\n';
+  // Step 2: Merge the sorted chunks into the final output file
+  if (!mergeChunksAndSave(
+          spill, input_filename, output_filename, num_chunks, chunk_size_mb, options, manifest
+      )) {
+    return;
+  }
+
+  std::cout << "External memory sort completed. Output file: " << output_filename << '\n';
+}
+
+namespace {
+
+// options.memory_budget_bytes, or the budget derived from the detected memory limits if it is 0
+size_t ResolveMemoryBudget(const SortOptions& options) {
+  if (options.memory_budget_bytes > 0) {
+    return options.memory_budget_bytes;
+  }
+  MemoryLimits const limits = ReadMemoryLimits();
+  std::cout << "ema-sort-int: Detected " << limits.available_bytes << " B available";
+  if (limits.cgroup_limit_bytes > 0) {
+    std::cout << ", cgroup limit " << limits.cgroup_limit_bytes << " B with "
+              << limits.cgroup_usage_bytes << " B in use";
+  }
+  std::cout << '\n';
+  return DeriveMemoryBudget(limits);
+}
+
+// Write `count` sorted values as the output file in `mode`
+bool WriteSortedValues(
+    const std::string& output_filename,
+    uint32_t* values,
+    size_t count,
+    size_t buffer_size_bytes,
+    IoStats& write_stats,
+    OutputMode mode = OutputMode::All
+) {
+  RunWriter output(output_filename, buffer_size_bytes);
+  if (!output.isOpen()) {
+    std::cerr << "Failed to open output file for writing: " << output_filename << '\n';
+    return false;
+  }
+  WriteSortedBlock(output, values, count, mode);
+  output.close();
+  write_stats += output.stats();
+  if (output.failed()) {
+    std::cerr << "Failed to write output file: " << output_filename << '\n';
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+// Sort with every size derived from one memory budget
+void ExternalMemorySorter::memoryBudgetSort(
+    const std::string& input_filename,
+    const std::string& output_filename,
+    const SortOptions& options
+) {
+  size_t const budget_bytes = ResolveMemoryBudget(options);
+  size_t input_bytes = 0;
+  if (IsStreamPath(input_filename)) {
+    // The size of a stream is only known at its end. It is planned as the smallest input the
+    // budget cannot hold, the merge derives its fan-in from the runs actually formed.
+    input_bytes = std::max(budget_bytes, BytesInMb) + 1;
+    std::cout << "ema-sort-int: " << input_filename << " is a stream of unknown size, sorting it "
+              << "externally" << '\n';
+  } else {
+    std::error_code error;
+    input_bytes = std::filesystem::file_size(input_filename, error);
+    if (error) {
+      std::cerr << "Failed to open input file: " << input_filename << '\n';
+      return;
+    }
+  }
+
+  BudgetPlan const plan = PlanForMemoryBudget(input_bytes, budget_bytes, options);
+  PrintBudgetPlan("ema-sort-int", plan);
+  if (plan.in_memory) {
+    RamMemorySorter::sortInMemory(input_filename, output_filename, options);
+    return;
+  }
+
+  SortOptions budget_options = options;
+  budget_options.run_buffer_bytes = plan.run_buffer_bytes;
+  externalMemorySort(input_filename, output_filename, plan.chunk_size_mb, budget_options);
+}
+
+// Merge the sorted inputs with the run merge of the external sort. The inputs take the place of
+// the runs of the first pass, further passes merge raw temporary runs in the spill directories.
+bool ExternalMemorySorter::mergeSortedFiles(
+    const std::vector<std::string>& input_filenames,
+    const std::string& output_filename,
+    const SortOptions& options
+) {
+  if (options.record_type != RecordType::U32) {
+    std::cerr << "merge supports --type=u32 only" << '\n';
+    return false;
+  }
+  if (input_filenames.empty()) {
+    std::cerr << "No input files to merge" << '\n';
+    return false;
+  }
+  size_t total_bytes = 0;
+  for (const std::string& input_filename: input_filenames) {
+    std::error_code error;
+    if (std::filesystem::equivalent(input_filename, output_filename, error)) {
+      std::cerr << "The output file must not be one of the inputs: " << output_filename << '\n';
+      return false;
+    }
+    if (!IsStreamPath(input_filename)) {
+      total_bytes += std::filesystem::file_size(input_filename, error);
+      if (error) {
+        std::cerr << "Failed to open input file: " << input_filename << '\n';
+        return false;
+      }
+    }
+  }
+  std::vector<std::string> spill_directories = options.spill_directories;
+  if (spill_directories.empty()) {
+    spill_directories.push_back(std::filesystem::temp_directory_path().string());
+  }
+  for (const std::string& directory: spill_directories) {
+    if (!std::filesystem::is_directory(directory)) {
+      std::cerr << "Spill directory does not exist: " << directory << '\n';
+      return false;
+    }
+  }
+  SpillDirectories spill(spill_directories, options.spill_policy);
+
+  // The inputs are plain values, and so are the temporary runs of the passes in between
+  SortOptions merge_options = options;
+  merge_options.spill_format = RunFormat::Raw;
+  size_t const fan_in = MaxMergeFanIn(
+      ResolveMemoryBudget(options),
+      merge_options.run_buffer_bytes * MergeRunBuffers(merge_options),
+      options.max_fan_in
+  );
+  MergePlan const plan = PlanMergePasses(input_filenames.size(), fan_in);
+  PrintMergePlan("ema-sort-int", plan, total_bytes);
+
+  auto t_start = std::chrono::steady_clock::now();
+  std::vector<std::string> runs = input_filenames;
+  std::vector<size_t> run_devices(runs.size(), 0);
+  for (size_t pass_index = 0; pass_index < plan.passes.size(); ++pass_index) {
+    const MergePass& pass = plan.passes[pass_index];
+    bool const last_pass = pass_index + 1 == plan.passes.size();
+    auto t_pass_start = std::chrono::steady_clock::now();
+    IoStats read_stats;
+    IoStats write_stats;
+    std::vector<std::string> next_runs;
+    std::vector<size_t> next_devices;
+    size_t first_run = 0;
+    for (size_t group = 0; group < pass.output_runs; ++group) {
+      size_t const group_size = pass.group_sizes[group];
+      std::vector<std::string> const group_runs(
+          runs.begin() + static_cast<std::ptrdiff_t>(first_run),
+          runs.begin() + static_cast<std::ptrdiff_t>(first_run + group_size)
+      );
+      std::vector<size_t> const group_devices(
+          run_devices.begin() + static_cast<std::ptrdiff_t>(first_run),
+          run_devices.begin() + static_cast<std::ptrdiff_t>(first_run + group_size)
+      );
+      std::string const merged_filename =
+          last_pass
+              ? output_filename
+              : MergePassFilename(spill.directory(group), output_filename, pass_index + 1, group);
+      // Only the inputs in front of the first pass hold plain values in the Count mode
+      bool const counted_runs = pass_index > 0;
+      bool const parallel = last_pass && options.merge_threads > 1 &&
+                            options.output_mode == OutputMode::All &&
+                            std::none_of(
+                                group_runs.begin(),
+                                group_runs.end(),
+                                [](const std::string& run) { return IsStreamPath(run); }
+                            ) &&
+                            !IsStreamPath(merged_filename) &&
+                            ParallelMergeFitsFileLimit(group_runs.size(), options.merge_threads);
+      RunRecord merged_run{};
+      bool const merged =
+          parallel ? mergeRunFilesParallel(
+                         group_runs,
+                         merged_filename,
+                         options.run_buffer_bytes,
+                         options.merge_threads,
+                         read_stats,
+                         write_stats
+                     )
+                   : mergeRunFiles(
+                         group_runs,
+                         group_devices,
+                         merged_filename,
+                         RunFormat::Raw,
+                         merge_options,
+                         read_stats,
+                         write_stats,
+                         merged_run,
+                         counted_runs
+                     );
+      if (!merged) {
+        return false;
+      }
+      // The inputs belong to the caller, only the temporary runs go
+      if (pass_index > 0) {
+        for (const std::string& run_filename: group_runs) {
+          (void) std::remove(run_filename.c_str());
+        }
+      }
+      next_runs.push_back(merged_filename);
+      next_devices.push_back(spill.device(group));
+      first_run += group_size;
+    }
+    runs = std::move(next_runs);
+    run_devices = std::move(next_devices);
+    PrintPhaseThroughput(
+        "ema-sort-int",
+        "Merge pass " + std::to_string(pass_index + 1),
+        read_stats,
+        write_stats,
+        std::chrono::steady_clock::now() - t_pass_start
+    );
+  }
+
+  std::cout << "ema-sort-int: Time to merge " << input_filenames.size() << " files into "
+            << output_filename << " is "
+            << std::chrono::nanoseconds(std::chrono::steady_clock::now() - t_start).count()
+            << " ns" << '\n';
+  return true;
+}
+
+// Keep the `k` smallest values in a buffer of 2k: once it fills up, nth_element cuts it back to
+// the k smallest, and values not below the largest of those can be rejected without a look at
+// the buffer from then on. The output mode is ignored, the output always holds k values.
+void ExternalMemorySorter::topK(
+    const std::string& input_filename,
+    const std::string& output_filename,
+    size_t k,
+    const SortOptions& options
+) {
+  if (options.record_type != RecordType::U32) {
+    std::cerr << "Top-K selection supports --type=u32 only" << '\n';
+    return;
+  }
+  auto t_start = std::chrono::steady_clock::now();
+  RunReader input(input_filename, sizeof(uint32_t));
+  if (!input.isOpen()) {
+    std::cerr << "Failed to open input file: " << input_filename << '\n';
+    return;
+  }
+
+  // A pipe has no size up front, its values are counted as they are read instead
+  bool const stream_input = IsStreamPath(input_filename);
+  std::error_code error;
+  size_t input_elements = 0;
+  if (!stream_input) {
+    input_elements = std::filesystem::file_size(input_filename, error) / sizeof(uint32_t);
+    k = std::min(k, input_elements);
+  }
+  if (2 * k * sizeof(uint32_t) > ResolveMemoryBudget(options)) {
+    // The selection buffer would not fit, the first k values of the sorted input are the answer
+    input.close();
+    std::cout << "ema-sort-int: " << k << " values exceed the memory budget, sorting the input "
+              << "and keeping the smallest " << k << '\n';
+    SortOptions all_options = options;
+    all_options.output_mode = OutputMode::All;
+    if (!IsStreamPath(output_filename)) {
+      memoryBudgetSort(input_filename, output_filename, all_options);
+      if (std::filesystem::file_size(output_filename, error) > k * sizeof(uint32_t)) {
+        std::filesystem::resize_file(output_filename, k * sizeof(uint32_t), error);
+      }
+      if (error) {
+        std::cerr << "Failed to truncate output file: " << output_filename << '\n';
+      }
+      return;
+    }
+    // A pipe cannot be truncated, the input is sorted aside and its first k values copied over
+    std::string const spill_directory = options.spill_directories.empty()
+                                            ? std::filesystem::temp_directory_path().string()
+                                            : options.spill_directories.front();
+    std::string const sorted_filename =
+        spill_directory + "/" + SanitizeInputFilename(input_filename) + "_topk.dat";
+    memoryBudgetSort(input_filename, sorted_filename, all_options);
+    RunReader sorted(sorted_filename, sizeof(uint32_t), 0, k);
+    RunWriter output(output_filename, options.run_buffer_bytes);
+    if (!sorted.isOpen() || !output.isOpen()) {
+      std::cerr << "Failed to copy the smallest " << k << " values to: " << output_filename
+                << '\n';
+      (void) std::remove(sorted_filename.c_str());
+      return;
+    }
+    std::vector<uint32_t> block(std::max<size_t>(1, options.run_buffer_bytes / sizeof(uint32_t)));
+    for (size_t read = sorted.readBlock(block.data(), block.size()); read > 0;
+         read = sorted.readBlock(block.data(), block.size())) {
+      output.writeBlock(block.data(), read);
+    }
+    sorted.close();
+    output.close();
+    (void) std::remove(sorted_filename.c_str());
+    if (output.failed()) {
+      std::cerr << "Failed to write output file: " << output_filename << '\n';
+    }
     return;
   }
 
-  size_t file_size_in_bytes = input.tellg();
+  std::vector<uint32_t> selected;
+  selected.reserve(2 * k);
+  std::vector<uint32_t> block(std::max<size_t>(1, options.run_buffer_bytes / sizeof(uint32_t)));
+  uint32_t threshold = std::numeric_limits<uint32_t>::max();
+  bool bounded = false;
+  size_t rejected = 0;
+  for (size_t read = input.readBlock(block.data(), block.size()); read > 0 && k > 0;
+       read = input.readBlock(block.data(), block.size())) {
+    if (stream_input) {
+      input_elements += read;
+    }
+    for (size_t i = 0; i < read; ++i) {
+      uint32_t const value = block[i];
+      if (bounded && value >= threshold) {
+        ++rejected;
+        continue;
+      }
+      selected.push_back(value);
+      if (selected.size() == 2 * k) {
+        std::nth_element(
+            selected.begin(), selected.begin() + static_cast<std::ptrdiff_t>(k - 1), selected.end()
+        );
+        threshold = selected[k - 1];
+        bounded = true;
+        selected.resize(k);
+      }
+    }
+  }
   input.close();
+  if (selected.size() > k) {
+    std::nth_element(
+        selected.begin(), selected.begin() + static_cast<std::ptrdiff_t>(k - 1), selected.end()
+    );
+    selected.resize(k);
+  }
+  std::sort(selected.begin(), selected.end());
 
-  size_t chunk_size_in_bytes = chunk_size_mb * BytesInMb;
-  size_t num_chunks = (file_size_in_bytes + chunk_size_in_bytes - 1) / chunk_size_in_bytes;
+  IoStats write_stats;
+  if (!WriteSortedValues(
+          output_filename, selected.data(), selected.size(), options.run_buffer_bytes, write_stats
+      )) {
+    return;
+  }
+  auto t_end = std::chrono::steady_clock::now();
+  std::cout << "ema-sort-int: Selected the " << selected.size() << " smallest of "
+            << input_elements << " values, " << rejected << " rejected by the running bound"
+            << '\n';
+  PrintPhaseThroughput("ema-sort-int", "Top-K", input.stats(), write_stats, t_end - t_start);
+  std::cout << "Top-K selection completed. Output file: " << output_filename << '\n';
+}
 
-  // Step 3: Merge the sorted chunks into the final output file
-  mergeChunksAndSave(temp_directory, input_filename, output_filename, num_chunks);
+// Filter the values of [low, high] in a single pass. They are sorted in memory while they fit the
+// memory budget, past that the filtered values are spilled and the spill file is sorted instead.
+void ExternalMemorySorter::extractRange(
+    const std::string& input_filename,
+    const std::string& output_filename,
+    uint32_t low,
+    uint32_t high,
+    const SortOptions& options
+) {
+  if (options.record_type != RecordType::U32) {
+    std::cerr << "Range extraction supports --type=u32 only" << '\n';
+    return;
+  }
+  auto t_start = std::chrono::steady_clock::now();
+  RunReader input(input_filename, sizeof(uint32_t));
+  if (!input.isOpen()) {
+    std::cerr << "Failed to open input file: " << input_filename << '\n';
+    return;
+  }
 
-  std::cout << "External memory sort completed. Output file: " << output_filename << '\n';
+  size_t const max_in_memory = std::max<size_t>(1, ResolveMemoryBudget(options) / sizeof(uint32_t));
+  std::string spill_directory = options.spill_directories.empty()
+                                    ? std::filesystem::temp_directory_path().string()
+                                    : options.spill_directories.front();
+  std::string const spill_filename =
+      spill_directory + "/" + SanitizeInputFilename(input_filename) + "_range.dat";
+  std::unique_ptr<RunWriter> spill;
+
+  std::vector<uint32_t> selected;
+  std::vector<uint32_t> block(std::max<size_t>(1, options.run_buffer_bytes / sizeof(uint32_t)));
+  size_t matched = 0;
+  for (size_t read = input.readBlock(block.data(), block.size()); read > 0;
+       read = input.readBlock(block.data(), block.size())) {
+    for (size_t i = 0; i < read; ++i) {
+      if (block[i] >= low && block[i] <= high) {
+        selected.push_back(block[i]);
+      }
+    }
+    if (selected.size() > max_in_memory) {
+      if (!spill) {
+        std::cout << "ema-sort-int: Values in range exceed the memory budget, spilling them to "
+                  << spill_filename << '\n';
+        spill = std::make_unique<RunWriter>(spill_filename, options.run_buffer_bytes);
+        if (!spill->isOpen()) {
+          std::cerr << "Failed to open spill file: " << spill_filename << '\n';
+          return;
+        }
+      }
+      spill->writeBlock(selected.data(), selected.size());
+      matched += selected.size();
+      selected.clear();
+    }
+  }
+  input.close();
+  matched += selected.size();
+
+  IoStats write_stats;
+  if (spill) {
+    spill->writeBlock(selected.data(), selected.size());
+    spill->close();
+    write_stats += spill->stats();
+    if (spill->failed()) {
+      std::cerr << "Failed to write spill file: " << spill_filename << '\n';
+      (void) std::remove(spill_filename.c_str());
+      return;
+    }
+    selected = std::vector<uint32_t>();
+    memoryBudgetSort(spill_filename, output_filename, options);
+    (void) std::remove(spill_filename.c_str());
+  } else {
+    ParallelSorter sorter(options.threads, options.kernel);
+    PresortPath const path = SortNaturalRuns(selected.data(), selected.size(), sorter);
+    std::cout << "ema-sort-int: Sort path of the values in range: " << PresortPathName(path)
+              << '\n';
+    if (!WriteSortedValues(
+            output_filename,
+            selected.data(),
+            selected.size(),
+            options.run_buffer_bytes,
+            write_stats,
+            options.output_mode
+        )) {
+      return;
+    }
+  }
+  auto t_end = std::chrono::steady_clock::now();
+  std::cout << "ema-sort-int: Extracted " << matched << " values in [" << low << ", " << high
+            << "]" << '\n';
+  PrintPhaseThroughput("ema-sort-int", "Range extraction", input.stats(), write_stats, t_end - t_start);
+  std::cout << "Range extraction completed. Output file: " << output_filename << '\n';
 }
 
 // Check if the file is sorted
-void ExternalMemorySorter::checkFileSorted(const std::string& input_filename) {
+void ExternalMemorySorter::checkFileSorted(
+    const std::string& input_filename, const SortOptions& options
+) {
+  if (options.record_type != RecordType::U32) {
+    bool const sorted =
+        options.record_type == RecordType::Lines
+            ? LineSorter::isFileSorted(input_filename, options.line_key)
+            : DispatchRecordType(options.record_type, [&](auto record) {
+                return RecordSorter<decltype(record)>::isFileSorted(
+                    input_filename, options.run_buffer_bytes
+                );
+              });
+    std::cout << (sorted ? "File is sorted." : "File is not sorted.") << '\n';
+    return;
+  }
   std::ifstream input(input_filename, std::ios::binary);
   if (!input) {
     std::cerr << "Failed to open file for checking: " << input_filename << '\n';
@@ -270,11 +1908,23 @@ void ExternalMemorySorter::printHelp() {
   std::cout << "Available subcommands:\n"
             << "\tgenerate <output_file> <size_mb>\n\t\tGenerate a random binary file of uint32_t "
                "values\n"
-            << "\tsort <input_file> <output_file> <chunk_size_mb>\n\t\tSort the file in chunks and "
-               "save sorted result\n"
-            << "\tcheck <input_file>\n\t\tCheck if the file is sorted\n"
+            << "\tsort <input_file> <output_file> <chunk_size_mb|auto> [options]\n\t\tSort the "
+               "file in chunks and save sorted result, auto sizes everything\n\t\tfrom the "
+               "detected memory budget (see --memory-budget)\n\t\t- as the input reads "
+               "stdin or a pipe until its end, - as the output writes stdout\n"
+            << "\ttopk <input_file> <output_file> <k> [options]\n\t\tWrite the k smallest "
+               "values in sorted order, in one pass with memory for 2k values\n"
+            << "\trange <input_file> <output_file> <low> <high> [options]\n\t\tWrite the "
+               "values within [low, high] in sorted order, in one pass over the input\n"
+            << "\tmerge <output_file> <input_file>... [options]\n\t\tMerge already sorted "
+               "files into one sorted output without sorting them\n\t\tagain, in bounded "
+               "memory (see --memory-budget and --max-fan-in)\n"
+            << "\tcheck <input_file> [options]\n\t\tCheck if the file is sorted in the order "
+               "of --type and the line key\n"
             << "\thelp\n\t\tPrint this help message (no args).\n"
-            << "\tfull-benchmark <input_file> <output_file> <repeat-count>\n\t\t"
+            << "\tfull-benchmark <input_file> <output_file> <repeat-count> [options]\n\t\t"
                "Generate a 256MB file, sort it with 32MB chunk size, check the results, repeat "
-               "everything several times.\n";
+               "everything several times.\n\t\tWith --threads=N every round sorts on 1, 2, "
+               "4... up to N threads and prints the speedup over 1 thread.\n";
+  PrintSortOptionsHelp();
 }
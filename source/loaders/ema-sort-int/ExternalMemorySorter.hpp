@@ -3,18 +3,104 @@
 
 #include <cstdint>
 #include <string>
+#include <vector>
+
+#include "../util/run_manifest.hpp"
+#include "../util/sort_options.hpp"
+#include "../util/spill_directories.hpp"
 
 class ExternalMemorySorter {
 private:
-  static void sortByChunksAndSave(
-      const std::string& input_filename, const std::string& temp_directory, size_t chunk_size_mb
+  // Returns the number of chunk files written, striped over `spill`. Every run is recorded in
+  // `manifest`, and the chunk variants continue after the runs it already holds.
+  static size_t sortByChunksAndSave(
+      const std::string& input_filename,
+      SpillDirectories& spill,
+      size_t chunk_size_mb,
+      const SortOptions& options,
+      RunManifest& manifest
+  );
+
+  static size_t sortByReplacementSelectionAndSave(
+      const std::string& input_filename,
+      SpillDirectories& spill,
+      size_t chunk_size_mb,
+      const SortOptions& options,
+      RunManifest& manifest
+  );
+
+  static size_t sortByChunksAndSavePipelined(
+      const std::string& input_filename,
+      SpillDirectories& spill,
+      size_t chunk_size_mb,
+      size_t file_size_in_bytes,
+      const SortOptions& options,
+      RunManifest& manifest
   );
 
-  static void mergeChunksAndSave(
-      const std::string& temp_directory,
+  static size_t sortByChunksAndSaveWithEngine(
+      const std::string& input_filename,
+      SpillDirectories& spill,
+      size_t chunk_size_mb,
+      size_t file_size_in_bytes,
+      const SortOptions& options,
+      RunManifest& manifest
+  );
+
+  // `run_devices` holds the spill device of every run, the prefetcher reads each on its own thread.
+  // In the Count mode, `counted_runs` tells (value, count) runs from runs of plain values.
+  // `merged_run` is filled in only when the output was written without a failure.
+  static bool mergeRunFiles(
+      const std::vector<std::string>& run_filenames,
+      const std::vector<size_t>& run_devices,
+      const std::string& output_filename,
+      RunFormat output_format,
+      const SortOptions& options,
+      IoStats& read_stats,
+      IoStats& write_stats,
+      RunRecord& merged_run,
+      bool counted_runs = true
+  );
+
+  static bool mergeRunFilesWithEngine(
+      const std::vector<std::string>& run_filenames,
+      const std::string& output_filename,
+      const SortOptions& options,
+      IoStats& read_stats,
+      IoStats& write_stats,
+      RunRecord& merged_run,
+      bool counted_runs
+  );
+
+  static bool mergeRunFilesParallel(
+      const std::vector<std::string>& run_filenames,
+      const std::string& output_filename,
+      size_t run_buffer_bytes,
+      size_t num_threads,
+      IoStats& read_stats,
+      IoStats& write_stats
+  );
+
+  // Returns false once a run cannot be read or the output cannot be written
+  static bool mergeChunksAndSave(
+      SpillDirectories& spill,
       const std::string& input_filename, // To retrieve chunk file names
       const std::string& output_filename,
-      size_t num_chunks
+      size_t num_chunks,
+      size_t chunk_size_mb,  // Memory budget of the merge
+      const SortOptions& options,
+      RunManifest& manifest
+  );
+
+  // Partition the input into the buckets of `plan` striped over `spill`, then sort every bucket
+  // in memory and append it to the output. False if a file cannot be read or written.
+  static bool distributionSort(
+      const std::string& input_filename,
+      const std::string& output_filename,
+      SpillDirectories& spill,
+      size_t chunk_size_mb,
+      const DistributionPlan& plan,
+      const SortOptions& options
   );
 
 public:
@@ -23,11 +109,50 @@ public:
 
   // Sort a large file in chunks and write sorted chunks to the output file
   static void externalMemorySort(
-      const std::string& input_filename, const std::string& output_filename, size_t chunk_size_mb
+      const std::string& input_filename,
+      const std::string& output_filename,
+      size_t chunk_size_mb,
+      const SortOptions& options = SortOptions()
+  );
+
+  // Sort within options.memory_budget_bytes (detected if 0): in memory when the input fits, else
+  // externally with the chunk size and run buffers derived from the budget
+  static void memoryBudgetSort(
+      const std::string& input_filename,
+      const std::string& output_filename,
+      const SortOptions& options
+  );
+
+  // Write the `k` smallest values of the input in sorted order without sorting the input
+  static void topK(
+      const std::string& input_filename,
+      const std::string& output_filename,
+      size_t k,
+      const SortOptions& options = SortOptions()
+  );
+
+  // Write the values of the input within [low, high] in sorted order
+  static void extractRange(
+      const std::string& input_filename,
+      const std::string& output_filename,
+      uint32_t low,
+      uint32_t high,
+      const SortOptions& options = SortOptions()
+  );
+
+  // Merge already sorted u32 files into one sorted output without sorting them again, in as many
+  // passes as the memory budget and the open file limit allow. The inputs are left alone, an input
+  // out of order gives an output out of order. False if a file cannot be read or written.
+  static bool mergeSortedFiles(
+      const std::vector<std::string>& input_filenames,
+      const std::string& output_filename,
+      const SortOptions& options = SortOptions()
   );
 
   // Check if the file is sorted
-  static void checkFileSorted(const std::string& input_filename);
+  static void checkFileSorted(
+      const std::string& input_filename, const SortOptions& options = SortOptions()
+  );
 
   // Print help information
   static void printHelp();
@@ -1,12 +1,31 @@
 //
 // Created by vadim on 13.10.2024.
 //
+#include <chrono>
+#include <cstdint>
 #include <iostream>
+#include <limits>
 #include <string>
+#include <vector>
 
 #include "../util/ema_ram_sorter_cli_constants.hpp"
+#include "../util/parallel_sort.hpp"
+#include "../util/sorter_utils.hpp"
 #include "ExternalMemorySorter.hpp"
 
+namespace {
+
+// Path of the output argument. For "-" the sorted output takes the standard output, and the status
+// lines move to the standard error so that they do not end up in the middle of it.
+std::string OutputArgument(const std::string& argument) {
+  if (argument == StandardStreamName) {
+    std::cout.rdbuf(std::cerr.rdbuf());
+  }
+  return OutputPath(argument);
+}
+
+}  // namespace
+
 int main(int argc, char* argv[]) {
   if (argc < ArgcMin) {
     ExternalMemorySorter::printHelp();
@@ -24,37 +43,106 @@ int main(int argc, char* argv[]) {
     size_t size_mb = std::stoull(argv[3]);
     ExternalMemorySorter::generateRandomFile(output_file, size_mb);
   } else if (command == "sort") {
-    if (argc != ArgcForEmaSort) {
-      std::cout << "Usage: prog sort <input_file> <output_file> <chunk_size_mb>" << '\n';
+    SortOptions options;
+    if (argc < ArgcForEmaSort || !ParseSortOptions(argc, argv, ArgcForEmaSort, options)) {
+      std::cout << "Usage: prog sort <input_file> <output_file> <chunk_size_mb|auto> [options]"
+                << '\n';
+      return 1;
+    }
+    std::string input_file = InputPath(argv[2]);
+    std::string output_file = OutputArgument(argv[3]);
+    std::string chunk_size = argv[4];
+    if (chunk_size == "auto" || options.memory_budget_mode) {
+      ExternalMemorySorter::memoryBudgetSort(input_file, output_file, options);
+    } else {
+      size_t chunk_size_mb = std::stoull(chunk_size);
+      ExternalMemorySorter::externalMemorySort(input_file, output_file, chunk_size_mb, options);
+    }
+  } else if (command == "topk") {
+    SortOptions options;
+    if (argc < ArgcForTopK || !ParseSortOptions(argc, argv, ArgcForTopK, options)) {
+      std::cout << "Usage: prog topk <input_file> <output_file> <k> [options]" << '\n';
+      return 1;
+    }
+    ExternalMemorySorter::topK(
+        InputPath(argv[2]), OutputArgument(argv[3]), std::stoull(argv[4]), options
+    );
+  } else if (command == "range") {
+    SortOptions options;
+    if (argc < ArgcForRange || !ParseSortOptions(argc, argv, ArgcForRange, options)) {
+      std::cout << "Usage: prog range <input_file> <output_file> <low> <high> [options]" << '\n';
+      return 1;
+    }
+    unsigned long long const low = std::stoull(argv[4]);
+    unsigned long long const high = std::stoull(argv[5]);
+    if (low > high || high > std::numeric_limits<uint32_t>::max()) {
+      std::cout << "Range bounds must satisfy low <= high <= "
+                << std::numeric_limits<uint32_t>::max() << '\n';
+      return 1;
+    }
+    ExternalMemorySorter::extractRange(
+        InputPath(argv[2]),
+        OutputArgument(argv[3]),
+        static_cast<uint32_t>(low),
+        static_cast<uint32_t>(high),
+        options
+    );
+  } else if (command == "merge") {
+    // The input files run up to the first option
+    int first_option = ArgcForMergeMin - 1;
+    while (first_option < argc && std::string(argv[first_option]).rfind("--", 0) != 0) {
+      ++first_option;
+    }
+    SortOptions options;
+    if (first_option < ArgcForMergeMin || !ParseSortOptions(argc, argv, first_option, options)) {
+      std::cout << "Usage: prog merge <output_file> <input_file>... [options]" << '\n';
+      return 1;
+    }
+    std::vector<std::string> input_files;
+    for (int i = ArgcForMergeMin - 1; i < first_option; ++i) {
+      input_files.push_back(InputPath(argv[i]));
+    }
+    if (!ExternalMemorySorter::mergeSortedFiles(input_files, OutputArgument(argv[2]), options)) {
       return 1;
     }
-    std::string input_file = argv[2];
-    std::string output_file = argv[3];
-    size_t chunk_size_mb = std::stoull(argv[4]);
-    ExternalMemorySorter::externalMemorySort(input_file, output_file, chunk_size_mb);
   } else if (command == "check") {
-    if (argc != ArgcForCheck) {
-      std::cout << "Usage: prog check <input_file>" << '\n';
+    SortOptions options;
+    if (argc < ArgcForCheck || !ParseSortOptions(argc, argv, ArgcForCheck, options)) {
+      std::cout << "Usage: prog check <input_file> [options]" << '\n';
       return 1;
     }
     std::string input_file = argv[2];
-    ExternalMemorySorter::checkFileSorted(input_file);
+    ExternalMemorySorter::checkFileSorted(input_file, options);
   } else if (command == "help") {
     ExternalMemorySorter::printHelp();
   } else if (command == "full-benchmark") {
-    if (argc != ArgcForFull) {
-      std::cout << "Usage: prog full-benchmark <input_file> <output_file> <repeat-count>" << '\n';
+    SortOptions options;
+    if (argc < ArgcForFull || !ParseSortOptions(argc, argv, ArgcForFull, options)) {
+      std::cout << "Usage: prog full-benchmark <input_file> <output_file> <repeat-count> [options]"
+                << '\n';
       return 1;
     }
     std::string input_file = argv[2];
     std::string output_file = argv[3];
     size_t repeat_count = std::stoull(argv[4]);
 
-    // Fallback to sequential execution
+    // Every round sorts the same file on 1, 2, 4... up to --threads threads
+    std::vector<size_t> const sweep = ThreadSweep(ResolveThreadCount(options.threads));
     for (size_t i = 0; i < repeat_count; ++i) {
       ExternalMemorySorter::generateRandomFile(input_file, FullBenchmarkFileSizeMb);
-      ExternalMemorySorter::externalMemorySort(input_file, output_file, FullBenchmarkChunkSizeMb);
-      ExternalMemorySorter::checkFileSorted(output_file);
+      std::chrono::nanoseconds baseline{};
+      for (size_t const threads: sweep) {
+        SortOptions sweep_options = options;
+        sweep_options.threads = threads;
+        auto t_start = std::chrono::steady_clock::now();
+        ExternalMemorySorter::externalMemorySort(
+            input_file, output_file, FullBenchmarkChunkSizeMb, sweep_options
+        );
+        std::chrono::nanoseconds const elapsed = std::chrono::steady_clock::now() - t_start;
+        baseline = threads == 1 ? elapsed : baseline;
+        PrintThreadSpeedup("ema-sort-int", threads, elapsed, baseline);
+        ExternalMemorySorter::checkFileSorted(output_file, sweep_options);
+      }
     }
   } else {
     std::cout << "Unknown subcommand: " << command << '\n';
@@ -8,6 +8,7 @@
 #include <vector>
 #include <chrono>
 
+#include "../util/natural_runs.hpp"
 #include "../util/sorter_utils.hpp"
 
 // Generate a random binary file of uint32_t values
@@ -129,7 +130,8 @@ void DirectIoRamMemorySorter::sortInMemory(
 
   // Sort the data in memory
   std::cout << "Sorting " << num_elements << " elements in memory..." << '\n';
-  std::sort(data.begin(), data.end());
+  PresortPath const path = SortNaturalRuns(data.data(), data.size());
+  std::cout << "ram-sort-int: Sort path: " << PresortPathName(path) << '\n';
 
   t_end = std::chrono::steady_clock::now();
   time_elapsed = t_end - t_start;
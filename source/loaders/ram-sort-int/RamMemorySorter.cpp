@@ -1,15 +1,151 @@
 #include "RamMemorySorter.hpp"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
 #include <algorithm>
 #include <cstdint>
 #include <fstream>
 #include <iostream>
 #include <limits>
+#include <memory>
 #include <vector>
 #include <chrono>
+#include <filesystem>
 
+#include "../util/collapsing_output.hpp"
+#include "../util/io_engine.hpp"
+#include "../util/line_sort.hpp"
+#include "../util/natural_runs.hpp"
+#include "../util/parallel_sort.hpp"
+#include "../util/record_io.hpp"
+#include "../util/record_sort.hpp"
+#include "../util/simd_sort.hpp"
 #include "../util/sorter_utils.hpp"
 
+namespace {
+
+// Read the whole file through the engine as a batch of run-buffer-sized requests
+bool ReadFileWithEngine(
+    IoEngine& engine,
+    const std::string& filename,
+    std::vector<uint32_t>& data,
+    const SortOptions& options
+) {
+  int const fd = open(filename.c_str(), O_RDONLY);
+  struct stat file_stat{};
+  if (fd < 0 || fstat(fd, &file_stat) != 0) {
+    std::cout << "Failed to open input file: " << filename << '\n';
+    if (fd >= 0) {
+      close(fd);
+    }
+    return false;
+  }
+
+  data.resize(static_cast<size_t>(file_stat.st_size) / sizeof(uint32_t));
+  size_t const length = data.size() * sizeof(uint32_t);
+  int buffer_index = -1;
+  if (options.register_buffers && !data.empty() &&
+      engine.registerBuffers({iovec{data.data(), length}})) {
+    buffer_index = 0;
+  }
+  size_t const bytes_read =
+      ReadFileBlocks(engine, fd, data.data(), length, 0, options.run_buffer_bytes, buffer_index);
+  close(fd);
+  if (bytes_read != length) {
+    std::cout << "Failed to read input file: " << filename << '\n';
+    return false;
+  }
+  return true;
+}
+
+// Write the data through the engine, reusing the registration made by ReadFileWithEngine while
+// `registered` says the data still lives in the buffer that was read into
+bool WriteFileWithEngine(
+    IoEngine& engine,
+    const std::string& filename,
+    const std::vector<uint32_t>& data,
+    const SortOptions& options,
+    bool registered
+) {
+  int const fd =
+      open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);  // NOLINT(hicpp-signed-bitwise)
+  if (fd < 0) {
+    std::cout << "Failed to open output file: " << filename << '\n';
+    return false;
+  }
+  bool const written = WriteFileBlocks(
+      engine,
+      fd,
+      data.data(),
+      data.size() * sizeof(uint32_t),
+      0,
+      options.run_buffer_bytes,
+      registered && options.register_buffers && !data.empty() ? 0 : -1
+  );
+  close(fd);
+  if (!written) {
+    std::cout << "Failed to write output file: " << filename << '\n';
+  }
+  return written;
+}
+
+// Descriptor of a file and its shared mapping, released together
+struct MappedFile {
+  int fd = -1;
+  void* mapping = MAP_FAILED;
+  size_t length = 0;
+
+  MappedFile() = default;
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  ~MappedFile() {
+    if (mapping != MAP_FAILED) {
+      munmap(mapping, length);
+    }
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+
+  bool map(size_t bytes, int flags) {
+    length = bytes;
+    mapping = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | flags, fd, 0);
+    return mapping != MAP_FAILED;
+  }
+};
+
+// Output collecting the values of a CollapsingOutput
+struct VectorOutput {
+  std::vector<uint32_t>& values;
+
+  void put(uint32_t value) {
+    values.push_back(value);
+  }
+};
+
+// Collapse the sorted `data` to the output of `mode`
+void CollapseSortedData(std::vector<uint32_t>& data, OutputMode mode) {
+  if (mode == OutputMode::Unique) {
+    data.erase(std::unique(data.begin(), data.end()), data.end());
+  } else if (mode == OutputMode::Count) {
+    std::vector<uint32_t> pairs;
+    VectorOutput output{pairs};
+    CollapsingOutput<VectorOutput> collapsed(output, mode);
+    for (uint32_t const value: data) {
+      collapsed.put(value);
+    }
+    collapsed.finish();
+    data = std::move(pairs);
+  }
+}
+
+}  // namespace
+
 // Generate a random binary file of uint32_t values
 void RamMemorySorter::generateRandomFile(const std::string& filename, size_t size_mb) {
   auto t_start = std::chrono::steady_clock::now();
@@ -37,27 +173,83 @@ void RamMemorySorter::generateRandomFile(const std::string& filename, size_t siz
 
 // Sort the entire file in memory and write the sorted data to the output file
 void RamMemorySorter::sortInMemory(
-    const std::string& input_filename, const std::string& output_filename
+    const std::string& input_filename,
+    const std::string& output_filename,
+    const SortOptions& options
 ) {
-  auto t_start = std::chrono::steady_clock::now();
-  // Read the entire file into memory
-  std::ifstream input(input_filename, std::ios::binary | std::ios::ate);
-  if (!input) {
-    std::cout << "Failed to open input file: " << input_filename << '\n';
+  if (options.record_type != RecordType::U32) {
+    bool const sorted =
+        options.record_type == RecordType::Lines
+            ? LineSorter::sortInMemory(input_filename, output_filename, options, "ram-sort-int")
+            : DispatchRecordType(options.record_type, [&](auto record) {
+                return RecordSorter<decltype(record)>::sortInMemory(
+                    input_filename, output_filename, options, "ram-sort-int"
+                );
+              });
+    if (sorted) {
+      std::cout << "In-memory sort completed. Output file: " << output_filename << '\n';
+    }
     return;
   }
+  // The engine reads and writes at offsets of files of known size, which streams do not have
+  bool const streaming = IsStreamPath(input_filename) || IsStreamPath(output_filename);
+  if (options.mmap_io) {
+    if (streaming) {
+      std::cout << "ram-sort-int: Streams cannot be mapped, reading into memory instead" << '\n';
+    } else if (options.output_mode == OutputMode::Count) {
+      std::cout << "ram-sort-int: Counted output can outgrow the mapping, reading into memory "
+                   "instead"
+                << '\n';
+    } else {
+      sortInMappedFile(input_filename, output_filename, options);
+      return;
+    }
+  }
+  auto t_start = std::chrono::steady_clock::now();
+  std::unique_ptr<IoEngine> engine;
+  std::vector<uint32_t> data;
+  if (options.io_engine != IoEngineKind::Stream && streaming) {
+    std::cout << "ram-sort-int: Streams are read and written without the I/O engine" << '\n';
+  }
+  if (options.io_engine != IoEngineKind::Stream && !streaming) {
+    engine = MakeIoEngine(options.io_engine, options.queue_depth);
+    std::cout << "Reading and writing through " << engine->name() << " with queue depth "
+              << engine->queueDepth() << '\n';
+    if (!ReadFileWithEngine(*engine, input_filename, data, options)) {
+      return;
+    }
+  } else if (IsStreamPath(input_filename)) {
+    RecordReader<uint32_t> input(input_filename, options.run_buffer_bytes);
+    if (!input.isOpen()) {
+      std::cout << "Failed to open input file: " << input_filename << '\n';
+      return;
+    }
+    input.readAll(data);
+    input.close();
+  } else {
+    // Read the entire file into memory
+    std::ifstream input(input_filename, std::ios::binary | std::ios::ate);
+    if (!input) {
+      std::cout << "Failed to open input file: " << input_filename << '\n';
+      return;
+    }
 
-  std::streamsize file_size = input.tellg();
-  input.seekg(0, std::ios::beg);
+    std::streamsize const input_size = input.tellg();
+    input.seekg(0, std::ios::beg);
 
-  size_t num_elements = file_size / sizeof(uint32_t);
-  std::vector<uint32_t> data(num_elements);
+    data.resize(input_size / sizeof(uint32_t));
 
-  if (!input.read(reinterpret_cast<char*>(data.data()), file_size)) {
-    std::cout << "Failed to read input file: " << input_filename << '\n';
-    return;
+    if (!input.read(
+            reinterpret_cast<char*>(data.data()),
+            static_cast<std::streamsize>(data.size() * sizeof(uint32_t))
+        )) {
+      std::cout << "Failed to read input file: " << input_filename << '\n';
+      return;
+    }
+    input.close();
   }
-  input.close();
+  size_t num_elements = data.size();
+  size_t file_size = num_elements * sizeof(uint32_t);
 
   auto t_end = std::chrono::steady_clock::now();
   std::chrono::duration<size_t, std::nano> time_elapsed = t_end - t_start;
@@ -66,8 +258,16 @@ void RamMemorySorter::sortInMemory(
   t_start = std::chrono::steady_clock::now();
 
   // Sort the data in memory
-  std::cout << "Sorting " << num_elements << " elements in memory..." << '\n';
-  std::sort(data.begin(), data.end());
+  ParallelSorter sorter(options.threads, options.kernel);
+  std::cout << "Sorting " << num_elements << " elements in memory on " << sorter.threads()
+            << " threads..." << '\n';
+  if (options.kernel == SortKernel::Simd) {
+    std::cout << "ram-sort-int: SIMD kernel: " << SimdIsaName(DetectSimdIsa()) << '\n';
+  }
+  PresortPath const path = SortNaturalRuns(data.data(), data.size(), sorter);
+  std::cout << "ram-sort-int: Sort path: " << PresortPathName(path) << '\n';
+  uint32_t const* const read_buffer = data.data();
+  CollapseSortedData(data, options.output_mode);
   // for(size_t i = 0; i < num_elements * 1024; ++i);
 
   t_end = std::chrono::steady_clock::now();
@@ -76,15 +276,144 @@ void RamMemorySorter::sortInMemory(
       << time_elapsed.count() << " ns" << '\n';
   t_start = std::chrono::steady_clock::now();
 
-  // Write the sorted data to the output file
-  std::ofstream output(output_filename, std::ios::binary);
-  if (!output) {
-    std::cout << "Failed to open output file: " << output_filename << '\n';
+  // Write the sorted data to the output file, unless it is the already sorted input itself
+  std::error_code error;
+  if (path == PresortPath::Sorted && options.output_mode == OutputMode::All && !streaming &&
+      std::filesystem::equivalent(input_filename, output_filename, error)) {
+    std::cout << "ram-sort-int: Input is already sorted in place, nothing to write" << '\n';
+  } else if (engine) {
+    if (!WriteFileWithEngine(
+            *engine, output_filename, data, options, data.data() == read_buffer
+        )) {
+      return;
+    }
+  } else {
+    std::ofstream output(output_filename, std::ios::binary);
+    if (!output) {
+      std::cout << "Failed to open output file: " << output_filename << '\n';
+      return;
+    }
+
+    output.write(
+        reinterpret_cast<const char*>(data.data()),
+        static_cast<std::streamsize>(data.size() * sizeof(uint32_t))
+    );
+    output.close();
+  }
+
+  t_end = std::chrono::steady_clock::now();
+  time_elapsed = t_end - t_start;
+  std::cout << "ram-sort-int: Time taken to write data to file " << output_filename << " MB is "
+      << time_elapsed.count() << " ns" << '\n';
+
+  std::cout << "In-memory sort completed. Output file: " << output_filename << '\n';
+}
+
+// Sort within a shared mapping: the output file is allocated up front and the input is read
+// straight into its pages, or the input file is sorted where it lies. Either way no vector is
+// zeroed and nothing is copied out for writing, the page cache of the output is the sort buffer.
+void RamMemorySorter::sortInMappedFile(
+    const std::string& input_filename,
+    const std::string& output_filename,
+    const SortOptions& options
+) {
+  auto t_start = std::chrono::steady_clock::now();
+  std::error_code error;
+  bool const same_file = std::filesystem::equivalent(input_filename, output_filename, error);
+  if (options.in_place && !same_file) {
+    std::cout << "--in-place sorts the input file itself, the output must name the same file"
+              << '\n';
+    return;
+  }
+  if (options.io_engine != IoEngineKind::Stream) {
+    std::cout << "ram-sort-int: The mapping replaces the I/O engine" << '\n';
+  }
+
+  MappedFile input;
+  input.fd = open(input_filename.c_str(), same_file ? O_RDWR : O_RDONLY);
+  struct stat input_stat{};
+  if (input.fd < 0 || fstat(input.fd, &input_stat) != 0) {
+    std::cout << "Failed to open input file: " << input_filename << '\n';
+    return;
+  }
+  size_t const num_elements = static_cast<size_t>(input_stat.st_size) / sizeof(uint32_t);
+  size_t const file_size = num_elements * sizeof(uint32_t);
+
+  MappedFile separate_output;
+  MappedFile& output = same_file ? input : separate_output;
+  if (!same_file) {
+    output.fd =
+        open(output_filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);  // NOLINT(hicpp-signed-bitwise)
+    if (output.fd < 0) {
+      std::cout << "Failed to open output file: " << output_filename << '\n';
+      return;
+    }
+    // Reserve the blocks now, a full disk would otherwise surface as a SIGBUS in the sort
+    if (file_size > 0 && posix_fallocate(output.fd, 0, static_cast<off_t>(file_size)) != 0) {
+      std::cout << "Failed to allocate output file: " << output_filename << '\n';
+      return;
+    }
+  }
+  if (file_size > 0 && !output.map(file_size, same_file ? MAP_POPULATE : 0)) {
+    std::cout << "Failed to map output file: " << output_filename << '\n';
     return;
   }
+  auto* const data = file_size > 0 ? static_cast<uint32_t*>(output.mapping) : nullptr;
+
+  if (!same_file) {
+    size_t bytes_read = 0;
+    while (bytes_read < file_size) {
+      ssize_t const bytes = read(
+          input.fd, reinterpret_cast<char*>(data) + bytes_read, file_size - bytes_read
+      );
+      if (bytes <= 0) {
+        break;
+      }
+      bytes_read += static_cast<size_t>(bytes);
+    }
+    if (bytes_read != file_size) {
+      std::cout << "Failed to read input file: " << input_filename << '\n';
+      return;
+    }
+  }
+
+  auto t_end = std::chrono::steady_clock::now();
+  std::chrono::duration<size_t, std::nano> time_elapsed = t_end - t_start;
+  std::cout << "ram-sort-int: Time taken to map data of file " << input_filename << " is "
+      << time_elapsed.count() << " ns" << '\n';
+  t_start = std::chrono::steady_clock::now();
+
+  ParallelSorter sorter(options.threads, options.kernel);
+  std::cout << "Sorting " << num_elements << " elements in a mapping of " << output_filename
+            << " on " << sorter.threads() << " threads..." << '\n';
+  if (options.kernel == SortKernel::Simd) {
+    std::cout << "ram-sort-int: SIMD kernel: " << SimdIsaName(DetectSimdIsa()) << '\n';
+  }
+  PresortPath const path = SortNaturalRuns(data, num_elements, sorter);
+  std::cout << "ram-sort-int: Sort path: " << PresortPathName(path) << '\n';
+  size_t output_elements = num_elements;
+  if (options.output_mode == OutputMode::Unique) {
+    output_elements = static_cast<size_t>(std::unique(data, data + num_elements) - data);
+  }
+
+  t_end = std::chrono::steady_clock::now();
+  time_elapsed = t_end - t_start;
+  std::cout << "ram-sort-int: Time taken to sort data of size " << (file_size / BytesInMb)
+            << "MB is " << time_elapsed.count() << " ns" << '\n';
+  t_start = std::chrono::steady_clock::now();
 
-  output.write(reinterpret_cast<const char*>(data.data()), file_size);
-  output.close();
+  // The sorted pages are the file, they only have to reach the disk. The output ends with the
+  // last value, without the duplicates dropped or a partial value trailing the input.
+  if (file_size > 0 && msync(data, file_size, MS_SYNC) != 0) {
+    std::cout << "Failed to write output file: " << output_filename << '\n';
+    return;
+  }
+  size_t const output_bytes = output_elements * sizeof(uint32_t);
+  size_t const current_size = same_file ? static_cast<size_t>(input_stat.st_size) : file_size;
+  if (output_bytes < current_size && ftruncate(output.fd, static_cast<off_t>(output_bytes)) != 0) {
+    std::cout << "Failed to truncate output file: " << output_filename << '\n';
+    return;
+  }
 
   t_end = std::chrono::steady_clock::now();
   time_elapsed = t_end - t_start;
@@ -145,10 +474,14 @@ void RamMemorySorter::printHelp() {
   std::cout << "Available commands:\n"
             << "\tgenerate <output_file> <size_mb>\n\t\tGenerate a random binary file of uint32_t "
                "values\n"
-            << "\tsort <input_file> <output_file>\n\t\tSort the file entirely in memory\n"
+            << "\tsort <input_file> <output_file> [options]\n\t\tSort the file entirely in memory, "
+               "the I/O options apply\n\t\t- as the input reads stdin or a pipe, - as the "
+               "output writes stdout\n"
             << "\tcheck <input_file>\n\t\tCheck if the file is sorted\n"
             << "\thelp\n\t\tPrint this help message\n"
-            << "\tfull-benchmark <input_file> <output_file> <repeat-count>\n\t\t"
+            << "\tfull-benchmark <input_file> <output_file> <repeat-count> [options]\n\t\t"
             << "Generate a file of size 256MB, sort it in memory, save the result, check it, and "
-               "repeat several times.\n";
+               "repeat several times.\n\t\tWith --threads=N every round sorts on 1, 2, 4... up "
+               "to N threads and prints the speedup over 1 thread.\n";
+  PrintSortOptionsHelp();
 }
@@ -3,13 +3,27 @@
 
 #include <string>
 
+#include "../util/sort_options.hpp"
+
 class RamMemorySorter {
+private:
+  // Sort u32 values within a shared mapping of the output file, or of the input file itself
+  static void sortInMappedFile(
+      const std::string& input_filename,
+      const std::string& output_filename,
+      const SortOptions& options
+  );
+
 public:
   // Generate a random binary file of uint32_t values
   static void generateRandomFile(const std::string& filename, size_t size_mb);
 
   // Sort the entire file in memory and write the sorted data to the output file
-  static void sortInMemory(const std::string& input_filename, const std::string& output_filename);
+  static void sortInMemory(
+      const std::string& input_filename,
+      const std::string& output_filename,
+      const SortOptions& options = SortOptions()
+  );
 
   // Check if the file is sorted
   static void checkFileSorted(const std::string& filename);
@@ -1,12 +1,29 @@
 //
 // Created by vadim on 14.10.2024.
 //
+#include <chrono>
 #include <iostream>
 #include <string>
+#include <vector>
 
 #include "RamMemorySorter.hpp"
 #include "../../common/unistd_check.hpp"
 #include "../util/ema_ram_sorter_cli_constants.hpp"
+#include "../util/parallel_sort.hpp"
+#include "../util/sorter_utils.hpp"
+
+namespace {
+
+// Path of the output argument. For "-" the sorted output takes the standard output, and the status
+// lines move to the standard error so that they do not end up in the middle of it.
+std::string OutputArgument(const std::string& argument) {
+  if (argument == StandardStreamName) {
+    std::cout.rdbuf(std::cerr.rdbuf());
+  }
+  return OutputPath(argument);
+}
+
+}  // namespace
 
 int main(int argc, char* argv[]) {
   if (argc < ArgcMin) {
@@ -25,13 +42,14 @@ int main(int argc, char* argv[]) {
     size_t size_mb = std::stoull(argv[3]);
     RamMemorySorter::generateRandomFile(output_file, size_mb);
   } else if (command == "sort") {
-    if (argc != ArgcForRamSort) {
-      std::cout << "Usage: prog sort <input_file> <output_file>" << '\n';
+    SortOptions options;
+    if (argc < ArgcForRamSort || !ParseSortOptions(argc, argv, ArgcForRamSort, options)) {
+      std::cout << "Usage: prog sort <input_file> <output_file> [options]" << '\n';
       return 1;
     }
-    std::string input_file = argv[2];
-    std::string output_file = argv[3];
-    RamMemorySorter::sortInMemory(input_file, output_file);
+    std::string input_file = InputPath(argv[2]);
+    std::string output_file = OutputArgument(argv[3]);
+    RamMemorySorter::sortInMemory(input_file, output_file, options);
   } else if (command == "check") {
     if (argc != ArgcForCheck) {
       std::cout << "Usage: prog check <input_file>" << '\n';
@@ -40,19 +58,31 @@ int main(int argc, char* argv[]) {
     std::string input_file = argv[2];
     RamMemorySorter::checkFileSorted(input_file);
   } else if (command == "full-benchmark") {
-    if (argc != ArgcForFull) {
-      std::cout << "Usage: prog full-benchmark <input_file> <output-file> <repeat-count>" << '\n';
+    SortOptions options;
+    if (argc < ArgcForFull || !ParseSortOptions(argc, argv, ArgcForFull, options)) {
+      std::cout << "Usage: prog full-benchmark <input_file> <output-file> <repeat-count> [options]"
+                << '\n';
       return 1;
     }
     std::string input_file = argv[2];
     std::string output_file = argv[3];
     size_t repeat_count = std::stoull(argv[4]);
 
-    // Fallback to sequential execution
+    // Every round sorts the same file on 1, 2, 4... up to --threads threads
+    std::vector<size_t> const sweep = ThreadSweep(ResolveThreadCount(options.threads));
     for (size_t i = 0; i < repeat_count; ++i) {
       RamMemorySorter::generateRandomFile(input_file, FullBenchmarkFileSizeMb);
-      RamMemorySorter::sortInMemory(input_file, output_file);
-      RamMemorySorter::checkFileSorted(output_file);
+      std::chrono::nanoseconds baseline{};
+      for (size_t const threads: sweep) {
+        SortOptions sweep_options = options;
+        sweep_options.threads = threads;
+        auto t_start = std::chrono::steady_clock::now();
+        RamMemorySorter::sortInMemory(input_file, output_file, sweep_options);
+        std::chrono::nanoseconds const elapsed = std::chrono::steady_clock::now() - t_start;
+        baseline = threads == 1 ? elapsed : baseline;
+        PrintThreadSpeedup("ram-sort-int", threads, elapsed, baseline);
+        RamMemorySorter::checkFileSorted(output_file);
+      }
     }
   } else if (command == "help") {
     RamMemorySorter::printHelp();
@@ -0,0 +1,35 @@
+#ifndef MONOLITH_BLOCKING_QUEUE_HPP
+#define MONOLITH_BLOCKING_QUEUE_HPP
+
+#include <condition_variable>
+#include <mutex>
+#include <queue>
+#include <utility>
+
+// Unbounded multi-producer/multi-consumer queue that blocks consumers until an item arrives
+template <typename T>
+class BlockingQueue {
+private:
+  std::queue<T> items_;
+  std::mutex mutex_;
+  std::condition_variable not_empty_;
+
+public:
+  void push(T item) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      items_.push(std::move(item));
+    }
+    not_empty_.notify_one();
+  }
+
+  T pop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_empty_.wait(lock, [this] { return !items_.empty(); });
+    T item = std::move(items_.front());
+    items_.pop();
+    return item;
+  }
+};
+
+#endif  // MONOLITH_BLOCKING_QUEUE_HPP
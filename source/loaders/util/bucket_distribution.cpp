@@ -0,0 +1,150 @@
+#include "bucket_distribution.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <utility>
+
+#include "run_io.hpp"
+
+std::vector<uint32_t> SampleRawFile(
+    const std::string& filename, size_t input_elements, size_t count
+) {
+  std::vector<uint32_t> sample;
+  std::ifstream file(filename, std::ios::binary);
+  if (!file) {
+    return sample;
+  }
+  count = std::min(count, input_elements);
+  sample.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    size_t const element = i * input_elements / count;
+    uint32_t value = 0;
+    file.seekg(static_cast<std::streamoff>(element * sizeof(uint32_t)), std::ios::beg);
+    if (!file.read(reinterpret_cast<char*>(&value), sizeof(value))) {
+      break;
+    }
+    sample.push_back(value);
+  }
+  return sample;
+}
+
+DistributionPlan PlanDistribution(
+    std::vector<uint32_t> sample,
+    size_t input_elements,
+    size_t chunk_elements,
+    size_t run_buffer_bytes,
+    size_t max_buckets,
+    SortStrategy strategy
+) {
+  DistributionPlan plan;
+  if (sample.empty()) {
+    plan.reason = "the input is empty";
+    return plan;
+  }
+  bool const in_order = std::is_sorted(sample.begin(), sample.end());
+  std::sort(sample.begin(), sample.end());
+
+  size_t const chunk_bytes = chunk_elements * sizeof(uint32_t);
+  size_t const bucket_elements =
+      std::max<size_t>(1, chunk_elements * DistributionBucketFillPercent / 100);
+  size_t const wanted_buckets = (input_elements + bucket_elements - 1) / bucket_elements;
+  // Every bucket keeps a write buffer of its own within the chunk memory
+  size_t const bucket_limit =
+      std::max<size_t>(1, std::min(max_buckets, chunk_bytes / MinRunBufferBytes));
+  if (strategy == SortStrategy::Auto) {
+    if (in_order) {
+      plan.reason = "the sample is in order, the merge takes its natural runs";
+      return plan;
+    }
+    if (wanted_buckets < 2) {
+      plan.reason = "the input fits a single chunk";
+      return plan;
+    }
+    if (wanted_buckets > bucket_limit) {
+      plan.reason = std::to_string(wanted_buckets) + " buckets exceed the limit of " +
+                    std::to_string(bucket_limit);
+      return plan;
+    }
+  }
+
+  plan.splitters = SampleSplitters(sample, std::clamp<size_t>(wanted_buckets, 1, bucket_limit));
+
+  size_t largest_sampled = 0;
+  size_t previous = 0;
+  for (size_t i = 0; i <= plan.splitters.size(); ++i) {
+    size_t const end =
+        i < plan.splitters.size()
+            ? static_cast<size_t>(
+                  std::lower_bound(sample.begin(), sample.end(), plan.splitters[i]) - sample.begin()
+              )
+            : sample.size();
+    if (!IsSingleValueBucket(plan.splitters, i)) {
+      largest_sampled = std::max(largest_sampled, end - previous);
+    }
+    previous = end;
+  }
+  plan.largest_bucket_elements =
+      (largest_sampled * input_elements + sample.size() - 1) / sample.size();
+  if (strategy == SortStrategy::Auto && plan.largest_bucket_elements > chunk_elements) {
+    plan.reason = "the sample predicts a bucket of " +
+                  std::to_string(plan.largest_bucket_elements) + " values beyond the chunk";
+    plan.splitters.clear();
+    return plan;
+  }
+
+  plan.bucket_count = plan.splitters.size() + 1;
+  plan.bucket_buffer_bytes = std::clamp(
+      chunk_bytes / plan.bucket_count,
+      MinRunBufferBytes,
+      std::max(MinRunBufferBytes, run_buffer_bytes)
+  );
+  plan.reason = strategy == SortStrategy::Distribution
+                    ? "requested"
+                    : "the sample predicts buckets within the chunk memory";
+  return plan;
+}
+
+std::vector<uint32_t> SampleSplitters(const std::vector<uint32_t>& sorted_sample, size_t buckets) {
+  // A key as frequent as a whole bucket repeats among the evenly spaced ranks, it gets a bucket
+  // of its own that needs no sort instead of several empty ones
+  std::vector<uint32_t> splitters;
+  if (sorted_sample.empty()) {
+    return splitters;
+  }
+  for (size_t i = 1; i < buckets; ++i) {
+    uint32_t const splitter = sorted_sample[i * sorted_sample.size() / buckets];
+    if (!splitters.empty() && splitter <= splitters.back()) {
+      continue;
+    }
+    splitters.push_back(splitter);
+    bool const frequent =
+        i + 1 < buckets && sorted_sample[(i + 1) * sorted_sample.size() / buckets] == splitter;
+    if (frequent && splitter < std::numeric_limits<uint32_t>::max()) {
+      splitters.push_back(splitter + 1);
+    }
+  }
+  return splitters;
+}
+
+bool IsSingleValueBucket(const std::vector<uint32_t>& splitters, size_t bucket) {
+  if (bucket == 0 || bucket > splitters.size()) {
+    return false;
+  }
+  if (bucket == splitters.size()) {
+    return splitters.back() == std::numeric_limits<uint32_t>::max();
+  }
+  return splitters[bucket] == splitters[bucket - 1] + 1;
+}
+
+BucketIndex::BucketIndex(std::vector<uint32_t> splitters)
+    : splitters_(std::move(splitters)), first_bucket_(size_t{1} << 16U) {
+  size_t bucket = 0;
+  for (size_t high = 0; high < first_bucket_.size(); ++high) {
+    auto const low_end = static_cast<uint32_t>(high << 16U);
+    while (bucket < splitters_.size() && splitters_[bucket] <= low_end) {
+      ++bucket;
+    }
+    first_bucket_[high] = static_cast<uint32_t>(bucket);
+  }
+}
@@ -0,0 +1,85 @@
+#ifndef MONOLITH_BUCKET_DISTRIBUTION_HPP
+#define MONOLITH_BUCKET_DISTRIBUTION_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Values sampled from the input to choose the bucket splitters
+const size_t DistributionSampleSize = 16384;
+
+// Share of the chunk memory a bucket is planned to fill, the rest absorbs the sampling error
+const size_t DistributionBucketFillPercent = 75;
+
+// How the external sorter orders the input
+enum class SortStrategy {
+  // Sort chunks into runs and merge them
+  Merge,
+  // Partition the input into value ranges by sampled splitters and sort every bucket in memory
+  Distribution,
+  // Distribution when the sample predicts buckets that fit the chunk memory, merge otherwise
+  Auto,
+};
+
+// Outcome of the strategy choice over the sample
+struct DistributionPlan {
+  // 0 sorts by merging
+  size_t bucket_count = 0;
+  // Bucket i holds the values in [splitters[i - 1], splitters[i]), without bounds at either end
+  std::vector<uint32_t> splitters;
+  // Largest bucket predicted by the sample, leaving out the buckets of a single value
+  size_t largest_bucket_elements = 0;
+  // Write buffer of every bucket during the partitioning pass
+  size_t bucket_buffer_bytes = 0;
+  // Why the strategy was chosen
+  std::string reason;
+};
+
+// Read about `count` values evenly spaced over the raw file of `input_elements` values
+std::vector<uint32_t> SampleRawFile(
+    const std::string& filename, size_t input_elements, size_t count
+);
+
+// Choose between distribution and merge for an input of `input_elements` values sorted with
+// chunks of `chunk_elements`. Distribution needs at most `max_buckets` buckets of
+// `run_buffer_bytes` (shrunk down to MinRunBufferBytes to fit the chunk memory). Auto falls back
+// to merge for a sample in order, a predicted bucket beyond the chunk or too many buckets, forced
+// distribution plans as many buckets as it can. Keys frequent enough to fill a bucket by themselves
+// get buckets of their own.
+DistributionPlan PlanDistribution(
+    std::vector<uint32_t> sample,
+    size_t input_elements,
+    size_t chunk_elements,
+    size_t run_buffer_bytes,
+    size_t max_buckets,
+    SortStrategy strategy
+);
+
+// Splitters of about `buckets` buckets at evenly spaced ranks of `sorted_sample`. Keys frequent
+// enough to fill a bucket by themselves get buckets of their own.
+std::vector<uint32_t> SampleSplitters(const std::vector<uint32_t>& sorted_sample, size_t buckets);
+
+// Whether bucket `bucket` of `splitters` can only hold a single value, which is sorted as it is
+bool IsSingleValueBucket(const std::vector<uint32_t>& splitters, size_t bucket);
+
+// Bucket lookup over the splitters: a table on the top 16 bits of the value gives the first
+// bucket the value can fall in, and the few splitters within that range are stepped over
+class BucketIndex {
+private:
+  std::vector<uint32_t> splitters_;
+  std::vector<uint32_t> first_bucket_;
+
+public:
+  explicit BucketIndex(std::vector<uint32_t> splitters);
+
+  size_t bucket(uint32_t value) const {
+    size_t bucket = first_bucket_[value >> 16U];
+    while (bucket < splitters_.size() && value >= splitters_[bucket]) {
+      ++bucket;
+    }
+    return bucket;
+  }
+};
+
+#endif  // MONOLITH_BUCKET_DISTRIBUTION_HPP
@@ -0,0 +1,110 @@
+#ifndef MONOLITH_COLLAPSING_OUTPUT_HPP
+#define MONOLITH_COLLAPSING_OUTPUT_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+// What the sorter writes for every group of equal values, in its runs as well as its output
+enum class OutputMode {
+  // Every value, duplicates included
+  All,
+  // Every distinct value once
+  Unique,
+  // A (value, count) pair of uint32_t for every distinct value
+  Count,
+};
+
+// Merge source over a Count run that yields the values of its (value, count) pairs and keeps the
+// count of the value it yielded last, which is the head of the source in the merge
+template <typename Source>
+class CountedSource {
+private:
+  Source* source_;
+  uint32_t count_ = 0;
+
+public:
+  explicit CountedSource(Source* source): source_(source) {}
+
+  bool next(uint32_t& value) {
+    return source_->next(value) && source_->next(count_);
+  }
+
+  uint32_t count() const {
+    return count_;
+  }
+};
+
+// Sorted stream of values written to `Output` in an OutputMode. Equal neighbours are collapsed as
+// they arrive, so the output never holds a duplicate of the previous value. A count beyond the
+// range of uint32_t is split over several pairs of the same value.
+template <typename Output>
+class CollapsingOutput {
+private:
+  Output& output_;
+  OutputMode mode_;
+  bool pending_ = false;
+  uint32_t value_ = 0;
+  uint64_t count_ = 0;
+
+  void flush() {
+    if (!pending_) {
+      return;
+    }
+    pending_ = false;
+    output_.put(value_);
+    if (mode_ == OutputMode::Count) {
+      uint64_t const max_count = std::numeric_limits<uint32_t>::max();
+      for (; count_ > max_count; count_ -= max_count) {
+        output_.put(static_cast<uint32_t>(max_count));
+        output_.put(value_);
+      }
+      output_.put(static_cast<uint32_t>(count_));
+    }
+  }
+
+public:
+  CollapsingOutput(Output& output, OutputMode mode): output_(output), mode_(mode) {}
+
+  // Write `count` occurrences of `value`, which must not be below the previous value
+  void put(uint32_t value, uint32_t count = 1) {
+    if (mode_ == OutputMode::All) {
+      output_.put(value);
+      return;
+    }
+    if (pending_ && value == value_) {
+      count_ += count;
+      return;
+    }
+    flush();
+    pending_ = true;
+    value_ = value;
+    count_ = count;
+  }
+
+  // Write the last group of values, call before the output is closed
+  void finish() {
+    flush();
+  }
+};
+
+// Write the sorted `values` in `mode`. Unique collapses them in place first, so that the output
+// takes a single block write as in the All mode.
+template <typename Output>
+void WriteSortedBlock(Output& output, uint32_t* values, size_t count, OutputMode mode) {
+  if (mode == OutputMode::Count) {
+    CollapsingOutput<Output> collapsed(output, mode);
+    for (size_t i = 0; i < count; ++i) {
+      collapsed.put(values[i]);
+    }
+    collapsed.finish();
+    return;
+  }
+  if (mode == OutputMode::Unique) {
+    count = static_cast<size_t>(std::unique(values, values + count) - values);
+  }
+  output.writeBlock(values, count);
+}
+
+#endif  // MONOLITH_COLLAPSING_OUTPUT_HPP
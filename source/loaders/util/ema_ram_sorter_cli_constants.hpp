@@ -14,6 +14,10 @@ const int ArgcForGenerate = 4;
 const int ArgcForRamSort = 4;
 const int ArgcForEmaSort = 5;
 const int ArgcForFull = 5;
+const int ArgcForTopK = 5;
+const int ArgcForRange = 6;
+// merge <output_file> and at least one input file
+const int ArgcForMergeMin = 4;
 const int ArgcForUnifiedSort = 7;
 
 #endif  // MONOLITH_EMA_RAM_SORTER_CLI_CONSTANTS_HPP
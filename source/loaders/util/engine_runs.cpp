@@ -0,0 +1,208 @@
+#include "engine_runs.hpp"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <utility>
+
+namespace {
+
+size_t ElementsInBlock(size_t block_size_bytes) {
+  return std::max<size_t>(1, block_size_bytes / sizeof(uint32_t));
+}
+
+}  // namespace
+
+EngineRunSet::EngineRunSet(
+    IoEngine& engine, const std::vector<std::string>& filenames, size_t block_size_bytes
+)
+    : engine_(engine)
+    , runs_(filenames.size())
+    , batch_size_(std::clamp<size_t>(engine.queueDepth(), 1, std::max<size_t>(1, filenames.size()))) {
+  size_t const block_elements = ElementsInBlock(block_size_bytes);
+  for (size_t i = 0; i < filenames.size(); ++i) {
+    Run& run = runs_[i];
+    run.fd = open(filenames[i].c_str(), O_RDONLY);
+    struct stat file_stat{};
+    if (run.fd < 0 || fstat(run.fd, &file_stat) != 0) {
+      std::cerr << "Failed to open temp file for merging: " << filenames[i] << '\n';
+      open_ = false;
+      continue;
+    }
+    run.remaining_bytes = static_cast<size_t>(file_stat.st_size) / sizeof(uint32_t) * sizeof(uint32_t);
+    run.front.resize(block_elements);
+    run.back.resize(block_elements);
+  }
+}
+
+EngineRunSet::~EngineRunSet() {
+  for (Run& run : runs_) {
+    if (run.fd >= 0) {
+      close(run.fd);
+    }
+  }
+}
+
+void EngineRunSet::collectBuffers(std::vector<iovec>& buffers) {
+  for (Run& run : runs_) {
+    run.front_index = static_cast<int>(buffers.size());
+    buffers.push_back(iovec{run.front.data(), run.front.size() * sizeof(uint32_t)});
+    run.back_index = static_cast<int>(buffers.size());
+    buffers.push_back(iovec{run.back.data(), run.back.size() * sizeof(uint32_t)});
+  }
+}
+
+void EngineRunSet::schedule(size_t run_index) {
+  Run& run = runs_[run_index];
+  if (run.remaining_bytes == 0) {
+    run.back_size = 0;
+    run.back_ready = true;
+  } else {
+    pending_.push_back(run_index);
+  }
+}
+
+void EngineRunSet::refillPending() {
+  if (pending_.empty()) {
+    return;
+  }
+  std::vector<IoRequest> requests;
+  requests.reserve(pending_.size());
+  for (size_t run_index : pending_) {
+    Run& run = runs_[run_index];
+    size_t const length = std::min(run.back.size() * sizeof(uint32_t), run.remaining_bytes);
+    requests.push_back(IoRequest{run.fd, run.back.data(), length, run.offset, false, run.back_index});
+  }
+
+  auto t_start = std::chrono::steady_clock::now();
+  engine_.submitAndWait(requests);
+  stats_.time += std::chrono::steady_clock::now() - t_start;
+
+  for (size_t i = 0; i < pending_.size(); ++i) {
+    Run& run = runs_[pending_[i]];
+    const IoRequest& request = requests[i];
+    size_t bytes_read = request.result > 0 ? static_cast<size_t>(request.result) : 0;
+    if (bytes_read < request.length) {
+      std::cerr << "Short read from a merge run: " << request.result << " of " << request.length
+                << " bytes" << '\n';
+      run.remaining_bytes = 0;
+    } else {
+      run.remaining_bytes -= bytes_read;
+    }
+    run.offset += static_cast<off_t>(bytes_read);
+    run.back_size = bytes_read / sizeof(uint32_t);
+    run.back_ready = true;
+    stats_.bytes += bytes_read;
+  }
+  pending_.clear();
+}
+
+bool EngineRunSet::advance(size_t run_index, uint32_t& value) {
+  Run& run = runs_[run_index];
+  if (!run.back_ready) {
+    refillPending();
+  }
+  std::swap(run.front, run.back);
+  std::swap(run.front_index, run.back_index);
+  run.front_size = run.back_size;
+  run.position = 0;
+  run.back_ready = false;
+  if (run.front_size == 0) {
+    run.back_ready = true;  // Nothing left to read, keep the run out of later batches
+    return false;
+  }
+
+  schedule(run_index);
+  if (pending_.size() >= batch_size_) {
+    refillPending();
+  }
+  value = run.front[run.position++];
+  return true;
+}
+
+void EngineRunSet::start() {
+  for (size_t i = 0; i < runs_.size(); ++i) {
+    schedule(i);
+  }
+  refillPending();
+  for (Run& run : runs_) {
+    std::swap(run.front, run.back);
+    std::swap(run.front_index, run.back_index);
+    run.front_size = run.back_size;
+    run.position = 0;
+    run.back_ready = false;
+  }
+  for (size_t i = 0; i < runs_.size(); ++i) {
+    schedule(i);
+  }
+  refillPending();
+}
+
+std::vector<EngineRunSet::Source> EngineRunSet::sources() {
+  std::vector<Source> result;
+  result.reserve(runs_.size());
+  for (size_t i = 0; i < runs_.size(); ++i) {
+    result.emplace_back(this, i);
+  }
+  return result;
+}
+
+EngineRunWriter::EngineRunWriter(
+    IoEngine& engine, const std::string& filename, size_t block_size_bytes
+)
+    : engine_(engine)
+    , fd_(open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644))  // NOLINT(hicpp-signed-bitwise)
+    , blocks_(std::max<size_t>(1, engine.queueDepth()), std::vector<uint32_t>(ElementsInBlock(block_size_bytes))) {}
+
+EngineRunWriter::~EngineRunWriter() {
+  close();
+}
+
+void EngineRunWriter::collectBuffers(std::vector<iovec>& buffers) {
+  first_buffer_index_ = static_cast<int>(buffers.size());
+  for (auto& block : blocks_) {
+    buffers.push_back(iovec{block.data(), block.size() * sizeof(uint32_t)});
+  }
+}
+
+void EngineRunWriter::flushBlocks() {
+  std::vector<IoRequest> requests;
+  size_t const blocks_to_write = block_ + (size_ > 0 ? 1 : 0);
+  for (size_t i = 0; i < blocks_to_write; ++i) {
+    size_t const elements = i < block_ ? blocks_[i].size() : size_;
+    checksum_.update(blocks_[i].data(), elements);
+    int const buffer_index = first_buffer_index_ >= 0 ? first_buffer_index_ + static_cast<int>(i) : -1;
+    requests.push_back(IoRequest{
+        fd_, blocks_[i].data(), elements * sizeof(uint32_t), offset_, true, buffer_index
+    });
+    offset_ += static_cast<off_t>(elements * sizeof(uint32_t));
+  }
+
+  auto t_start = std::chrono::steady_clock::now();
+  engine_.submitAndWait(requests);
+  stats_.time += std::chrono::steady_clock::now() - t_start;
+
+  for (const IoRequest& request : requests) {
+    if (request.result != static_cast<ssize_t>(request.length)) {
+      failed_ = true;
+    } else {
+      stats_.bytes += request.length;
+    }
+  }
+  block_ = 0;
+  size_ = 0;
+}
+
+bool EngineRunWriter::close() {
+  if (fd_ < 0) {
+    return !failed_;
+  }
+  flushBlocks();
+  ::close(fd_);
+  fd_ = -1;
+  return !failed_;
+}
@@ -0,0 +1,141 @@
+#ifndef MONOLITH_ENGINE_RUNS_HPP
+#define MONOLITH_ENGINE_RUNS_HPP
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "io_engine.hpp"
+#include "run_io.hpp"
+
+// Sorted runs of a merge read through an IoEngine. Every run is double-buffered, and the refills
+// of all runs whose back buffer was handed to the merger are submitted to the engine as one batch.
+class EngineRunSet {
+private:
+  struct Run {
+    int fd = -1;
+    off_t offset = 0;
+    size_t remaining_bytes = 0;
+    std::vector<uint32_t> front;
+    std::vector<uint32_t> back;
+    int front_index = -1;
+    int back_index = -1;
+    size_t front_size = 0;
+    size_t back_size = 0;
+    size_t position = 0;
+    bool back_ready = false;
+  };
+
+  IoEngine& engine_;
+  std::vector<Run> runs_;
+  std::vector<size_t> pending_;
+  size_t batch_size_;
+  bool open_ = true;
+  IoStats stats_;
+
+  void schedule(size_t run_index);
+  void refillPending();
+  bool advance(size_t run_index, uint32_t& value);
+
+public:
+  // Merge source reading one run of the set
+  class Source {
+  private:
+    EngineRunSet* set_;
+    size_t run_index_;
+
+  public:
+    Source(EngineRunSet* set, size_t run_index): set_(set), run_index_(run_index) {}
+
+    bool next(uint32_t& value) {
+      Run& run = set_->runs_[run_index_];
+      if (run.position < run.front_size) {
+        value = run.front[run.position++];
+        return true;
+      }
+      return set_->advance(run_index_, value);
+    }
+  };
+
+  EngineRunSet(IoEngine& engine, const std::vector<std::string>& filenames, size_t block_size_bytes);
+
+  ~EngineRunSet();
+
+  EngineRunSet(const EngineRunSet&) = delete;
+  EngineRunSet& operator=(const EngineRunSet&) = delete;
+
+  bool isOpen() const {
+    return open_;
+  }
+
+  // Append the buffers of every run to `buffers` and remember their registration indices
+  void collectBuffers(std::vector<iovec>& buffers);
+
+  // Read the first two blocks of every run in one batch
+  void start();
+
+  std::vector<Source> sources();
+
+  const IoStats& stats() const {
+    return stats_;
+  }
+};
+
+// Output of a merge written through an IoEngine: as many blocks as the engine queue depth are
+// filled and then written with a single batch
+class EngineRunWriter {
+private:
+  IoEngine& engine_;
+  int fd_ = -1;
+  off_t offset_ = 0;
+  std::vector<std::vector<uint32_t>> blocks_;
+  int first_buffer_index_ = -1;
+  size_t block_ = 0;
+  size_t size_ = 0;
+  bool failed_ = false;
+  RunChecksum checksum_;
+  IoStats stats_;
+
+  void flushBlocks();
+
+public:
+  EngineRunWriter(IoEngine& engine, const std::string& filename, size_t block_size_bytes);
+
+  ~EngineRunWriter();
+
+  EngineRunWriter(const EngineRunWriter&) = delete;
+  EngineRunWriter& operator=(const EngineRunWriter&) = delete;
+
+  bool isOpen() const {
+    return fd_ >= 0;
+  }
+
+  void put(uint32_t value) {
+    blocks_[block_][size_++] = value;
+    if (size_ == blocks_[block_].size()) {
+      size_ = 0;
+      if (++block_ == blocks_.size()) {
+        flushBlocks();
+      }
+    }
+  }
+
+  void collectBuffers(std::vector<iovec>& buffers);
+
+  // Write the buffered blocks, returns false if any write of the output failed
+  bool close();
+
+  const IoStats& stats() const {
+    return stats_;
+  }
+
+  uint64_t checksum() const {
+    return checksum_.value();
+  }
+};
+
+#endif  // MONOLITH_ENGINE_RUNS_HPP
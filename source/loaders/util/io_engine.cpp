@@ -0,0 +1,353 @@
+#include "io_engine.hpp"
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+// Transfer the rest of a request that came back short, e.g. a write interrupted by a signal
+ssize_t CompleteRequest(const IoRequest& request, size_t done) {
+  auto* bytes = static_cast<char*>(request.buffer);
+  while (done < request.length) {
+    ssize_t const transferred =
+        request.write
+            ? pwrite(request.fd, bytes + done, request.length - done, request.offset + static_cast<off_t>(done))
+            : pread(request.fd, bytes + done, request.length - done, request.offset + static_cast<off_t>(done));
+    if (transferred < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return done > 0 ? static_cast<ssize_t>(done) : -errno;
+    }
+    if (transferred == 0) {
+      break;  // End of file
+    }
+    done += static_cast<size_t>(transferred);
+  }
+  return static_cast<ssize_t>(done);
+}
+
+class SyncIoEngine final : public IoEngine {
+private:
+  size_t queue_depth_;
+
+public:
+  explicit SyncIoEngine(size_t queue_depth): queue_depth_(queue_depth) {}
+
+  void submitAndWait(std::vector<IoRequest>& requests) override {
+    for (IoRequest& request : requests) {
+      request.result = CompleteRequest(request, 0);
+    }
+  }
+
+  bool registerBuffers(const std::vector<iovec>& /*buffers*/) override {
+    return false;
+  }
+
+  size_t queueDepth() const override {
+    return queue_depth_;
+  }
+
+  std::string name() const override {
+    return "pread/pwrite";
+  }
+};
+
+// io_uring driven through the raw system calls, so no liburing is needed
+class IoUringEngine final : public IoEngine {
+private:
+  int ring_fd_ = -1;
+  size_t queue_depth_ = 0;
+  bool buffers_registered_ = false;
+  // Set once io_uring_enter fails, the engine then serves everything synchronously
+  bool broken_ = false;
+
+  void* sq_ring_ = nullptr;
+  size_t sq_ring_size_ = 0;
+  void* cq_ring_ = nullptr;
+  size_t cq_ring_size_ = 0;
+  io_uring_sqe* sqes_ = nullptr;
+  size_t sqes_size_ = 0;
+
+  unsigned* sq_tail_ = nullptr;
+  unsigned* sq_mask_ = nullptr;
+  unsigned* sq_array_ = nullptr;
+  unsigned* cq_head_ = nullptr;
+  unsigned* cq_tail_ = nullptr;
+  unsigned* cq_mask_ = nullptr;
+  io_uring_cqe* cqes_ = nullptr;
+
+  static unsigned loadAcquire(const unsigned* pointer) {
+    return std::atomic_ref<const unsigned>(*pointer).load(std::memory_order_acquire);
+  }
+
+  static void storeRelease(unsigned* pointer, unsigned value) {
+    std::atomic_ref<unsigned>(*pointer).store(value, std::memory_order_release);
+  }
+
+  static void* ringPointer(void* ring, unsigned offset) {
+    return static_cast<char*>(ring) + offset;
+  }
+
+  // Submit requests[first, first + count) and reap all their completions
+  void submitBatch(std::vector<IoRequest>& requests, size_t first, size_t count) {
+    unsigned tail = *sq_tail_;
+    for (size_t i = first; i < first + count; ++i) {
+      const IoRequest& request = requests[i];
+      unsigned const index = tail & *sq_mask_;
+      io_uring_sqe& sqe = sqes_[index];
+      std::memset(&sqe, 0, sizeof(sqe));
+      bool const fixed = buffers_registered_ && request.buffer_index >= 0;
+      if (request.write) {
+        sqe.opcode = fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+      } else {
+        sqe.opcode = fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+      }
+      sqe.fd = request.fd;
+      sqe.addr = reinterpret_cast<uint64_t>(request.buffer);
+      sqe.len = static_cast<uint32_t>(request.length);
+      sqe.off = static_cast<uint64_t>(request.offset);
+      sqe.buf_index = fixed ? static_cast<uint16_t>(request.buffer_index) : 0;
+      sqe.user_data = i;
+      sq_array_[index] = index;
+      ++tail;
+    }
+    storeRelease(sq_tail_, tail);
+
+    size_t to_submit = count;
+    size_t completed = 0;
+    while (completed < count) {
+      long const entered = syscall(
+          __NR_io_uring_enter, ring_fd_, to_submit, 1, IORING_ENTER_GETEVENTS, nullptr, 0
+      );
+      if (entered < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        // The ring is unusable, finish the outstanding requests synchronously
+        broken_ = true;
+        for (size_t i = first; i < first + count; ++i) {
+          requests[i].result = CompleteRequest(requests[i], 0);
+        }
+        return;
+      }
+      to_submit -= std::min(to_submit, static_cast<size_t>(entered));
+
+      unsigned head = *cq_head_;
+      unsigned const cq_tail = loadAcquire(cq_tail_);
+      for (; head != cq_tail; ++head) {
+        const io_uring_cqe& cqe = cqes_[head & *cq_mask_];
+        IoRequest& request = requests[cqe.user_data];
+        request.result = cqe.res;
+        if (cqe.res > 0 && static_cast<size_t>(cqe.res) < request.length) {
+          request.result = CompleteRequest(request, static_cast<size_t>(cqe.res));
+        }
+        ++completed;
+      }
+      storeRelease(cq_head_, head);
+    }
+  }
+
+public:
+  explicit IoUringEngine(size_t queue_depth) {
+    io_uring_params params{};
+    int const ring_fd =
+        static_cast<int>(syscall(__NR_io_uring_setup, static_cast<unsigned>(queue_depth), &params));
+    if (ring_fd < 0) {
+      return;
+    }
+    ring_fd_ = ring_fd;
+    queue_depth_ = params.sq_entries;
+
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool const single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+      sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+
+    sq_ring_ = mmap(
+        nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_,
+        IORING_OFF_SQ_RING
+    );
+    if (sq_ring_ == MAP_FAILED) {
+      sq_ring_ = nullptr;
+      return;
+    }
+    if (single_mmap) {
+      cq_ring_ = sq_ring_;
+    } else {
+      cq_ring_ = mmap(
+          nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_,
+          IORING_OFF_CQ_RING
+      );
+      if (cq_ring_ == MAP_FAILED) {
+        cq_ring_ = nullptr;
+        return;
+      }
+    }
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(
+        nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_,
+        IORING_OFF_SQES
+    );
+    if (sqes == MAP_FAILED) {
+      return;
+    }
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+    sq_tail_ = static_cast<unsigned*>(ringPointer(sq_ring_, params.sq_off.tail));
+    sq_mask_ = static_cast<unsigned*>(ringPointer(sq_ring_, params.sq_off.ring_mask));
+    sq_array_ = static_cast<unsigned*>(ringPointer(sq_ring_, params.sq_off.array));
+    cq_head_ = static_cast<unsigned*>(ringPointer(cq_ring_, params.cq_off.head));
+    cq_tail_ = static_cast<unsigned*>(ringPointer(cq_ring_, params.cq_off.tail));
+    cq_mask_ = static_cast<unsigned*>(ringPointer(cq_ring_, params.cq_off.ring_mask));
+    cqes_ = static_cast<io_uring_cqe*>(ringPointer(cq_ring_, params.cq_off.cqes));
+  }
+
+  ~IoUringEngine() override {
+    if (sqes_ != nullptr) {
+      munmap(sqes_, sqes_size_);
+    }
+    if (cq_ring_ != nullptr && cq_ring_ != sq_ring_) {
+      munmap(cq_ring_, cq_ring_size_);
+    }
+    if (sq_ring_ != nullptr) {
+      munmap(sq_ring_, sq_ring_size_);
+    }
+    if (ring_fd_ >= 0) {
+      close(ring_fd_);
+    }
+  }
+
+  IoUringEngine(const IoUringEngine&) = delete;
+  IoUringEngine& operator=(const IoUringEngine&) = delete;
+
+  bool isReady() const {
+    return sqes_ != nullptr;
+  }
+
+  void submitAndWait(std::vector<IoRequest>& requests) override {
+    if (broken_) {
+      for (IoRequest& request : requests) {
+        request.result = CompleteRequest(request, 0);
+      }
+      return;
+    }
+    for (size_t first = 0; first < requests.size(); first += queue_depth_) {
+      submitBatch(requests, first, std::min(queue_depth_, requests.size() - first));
+    }
+  }
+
+  bool registerBuffers(const std::vector<iovec>& buffers) override {
+    if (buffers_registered_) {
+      syscall(__NR_io_uring_register, ring_fd_, IORING_UNREGISTER_BUFFERS, nullptr, 0);
+      buffers_registered_ = false;
+    }
+    buffers_registered_ = syscall(
+                              __NR_io_uring_register,
+                              ring_fd_,
+                              IORING_REGISTER_BUFFERS,
+                              buffers.data(),
+                              static_cast<unsigned>(buffers.size())
+                          ) == 0;
+    return buffers_registered_;
+  }
+
+  size_t queueDepth() const override {
+    return queue_depth_;
+  }
+
+  std::string name() const override {
+    return "io_uring";
+  }
+};
+
+}  // namespace
+
+std::unique_ptr<IoEngine> MakeIoEngine(IoEngineKind kind, size_t queue_depth) {
+  queue_depth = std::max<size_t>(1, queue_depth);
+  if (kind == IoEngineKind::IoUring) {
+    auto engine = std::make_unique<IoUringEngine>(queue_depth);
+    if (engine->isReady()) {
+      return engine;
+    }
+    std::cerr << "io_uring is unavailable (" << std::strerror(errno)
+              << "), falling back to pread/pwrite" << '\n';
+  }
+  return std::make_unique<SyncIoEngine>(queue_depth);
+}
+
+size_t ReadFileBlocks(
+    IoEngine& engine,
+    int fd,
+    void* buffer,
+    size_t length,
+    off_t offset,
+    size_t block_size,
+    int buffer_index
+) {
+  std::vector<IoRequest> requests;
+  auto* bytes = static_cast<char*>(buffer);
+  for (size_t done = 0; done < length; done += block_size) {
+    requests.push_back(IoRequest{
+        fd,
+        bytes + done,
+        std::min(block_size, length - done),
+        offset + static_cast<off_t>(done),
+        false,
+        buffer_index
+    });
+  }
+  engine.submitAndWait(requests);
+
+  // Blocks past a short read hold nothing useful, count the contiguous prefix only
+  size_t total = 0;
+  for (const IoRequest& request : requests) {
+    if (request.result <= 0) {
+      break;
+    }
+    total += static_cast<size_t>(request.result);
+    if (static_cast<size_t>(request.result) < request.length) {
+      break;
+    }
+  }
+  return total;
+}
+
+bool WriteFileBlocks(
+    IoEngine& engine,
+    int fd,
+    const void* buffer,
+    size_t length,
+    off_t offset,
+    size_t block_size,
+    int buffer_index
+) {
+  std::vector<IoRequest> requests;
+  // Requests share one type for reads and writes, the engine never writes into a write buffer
+  auto* bytes = const_cast<char*>(static_cast<const char*>(buffer));
+  for (size_t done = 0; done < length; done += block_size) {
+    requests.push_back(IoRequest{
+        fd,
+        bytes + done,
+        std::min(block_size, length - done),
+        offset + static_cast<off_t>(done),
+        true,
+        buffer_index
+    });
+  }
+  engine.submitAndWait(requests);
+
+  return std::all_of(requests.begin(), requests.end(), [](const IoRequest& request) {
+    return request.result == static_cast<ssize_t>(request.length);
+  });
+}
@@ -0,0 +1,76 @@
+#ifndef MONOLITH_IO_ENGINE_HPP
+#define MONOLITH_IO_ENGINE_HPP
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+// File I/O backend of the sorters
+enum class IoEngineKind {
+  // Buffered std::fstream, the original behaviour
+  Stream,
+  // Blocking pread/pwrite on raw descriptors
+  Sync,
+  // Batched submissions through an io_uring, falls back to Sync where io_uring is unavailable
+  IoUring,
+};
+
+// Single positional read or write, `result` holds the bytes transferred or -errno afterwards
+struct IoRequest {
+  int fd;
+  void* buffer;
+  size_t length;
+  off_t offset;
+  bool write;
+  // Index into the registered buffers, or -1 for a plain buffer
+  int buffer_index = -1;
+  ssize_t result = 0;
+};
+
+// Positional I/O engine that executes batches of requests
+class IoEngine {
+public:
+  virtual ~IoEngine() = default;
+
+  // Execute every request and wait for all of them to complete
+  virtual void submitAndWait(std::vector<IoRequest>& requests) = 0;
+
+  // Pin `buffers` for requests with a buffer_index, returns false if they stay unregistered
+  virtual bool registerBuffers(const std::vector<iovec>& buffers) = 0;
+
+  virtual size_t queueDepth() const = 0;
+
+  virtual std::string name() const = 0;
+};
+
+// Create the engine for `kind` (Stream is served by the Sync engine) with up to `queue_depth`
+// requests in flight
+std::unique_ptr<IoEngine> MakeIoEngine(IoEngineKind kind, size_t queue_depth);
+
+// Read `length` bytes at `offset` in requests of `block_size`, returns the number of bytes read
+size_t ReadFileBlocks(
+    IoEngine& engine,
+    int fd,
+    void* buffer,
+    size_t length,
+    off_t offset,
+    size_t block_size,
+    int buffer_index = -1
+);
+
+// Write `length` bytes at `offset` in requests of `block_size`, returns false on a failed write
+bool WriteFileBlocks(
+    IoEngine& engine,
+    int fd,
+    const void* buffer,
+    size_t length,
+    off_t offset,
+    size_t block_size,
+    int buffer_index = -1
+);
+
+#endif  // MONOLITH_IO_ENGINE_HPP
@@ -0,0 +1,193 @@
+#include "line_key.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <string_view>
+#include <utility>
+
+#include "record_types.hpp"
+
+namespace {
+
+// Partitions of at most this many lines are finished by insertion sort
+const size_t LineInsertionSortThreshold = 16;
+
+const size_t WordBytes = sizeof(uint64_t);
+
+// Big-endian word of the key bytes [depth * 8, depth * 8 + 8), zero padded past the end of the key
+uint64_t KeyWord(const char* key, uint32_t key_length, size_t depth) {
+  size_t const begin = depth * WordBytes;
+  size_t const end = std::min<size_t>(key_length, begin + WordBytes);
+  uint64_t word = 0;
+  for (size_t i = begin; i < begin + WordBytes; ++i) {
+    word = word << 8 | (i < end ? static_cast<unsigned char>(key[i]) : 0U);
+  }
+  return word;
+}
+
+double ParseNumber(const char* key, uint32_t key_length) {
+  const char* begin = key;
+  const char* end = key + key_length;
+  while (begin < end && (*begin == ' ' || *begin == '\t')) {
+    ++begin;
+  }
+  // from_chars takes no explicit plus sign
+  if (begin < end && *begin == '+') {
+    ++begin;
+  }
+  double value = 0.0;
+  if (std::from_chars(begin, end, value).ec != std::errc()) {
+    return 0.0;
+  }
+  return value;
+}
+
+// Word of a key at one depth of the multikey quicksort. `available` counts the key bytes in the
+// word, so that a key ending in zero bytes still sorts after its shorter prefix.
+struct DepthKey {
+  uint64_t word;
+  uint32_t available;
+
+  auto operator<=>(const DepthKey&) const = default;
+};
+
+class MultikeySorter {
+private:
+  const char* arena_;
+  const LineKeySpec& spec_;
+
+  DepthKey depthKey(const LineRef& line, size_t depth) const {
+    size_t const begin = depth * WordBytes;
+    auto const available = static_cast<uint32_t>(
+        line.key_length > begin ? std::min<size_t>(line.key_length - begin, WordBytes) : 0
+    );
+    if (depth == 0) {
+      return DepthKey{line.prefix, available};
+    }
+    const char* key = arena_ + line.offset + line.key_offset;
+    return DepthKey{KeyWord(key, line.key_length, depth), available};
+  }
+
+  bool less(const LineRef& left, const LineRef& right) const {
+    return CompareLines(arena_ + left.offset, left, arena_ + right.offset, right, spec_) < 0;
+  }
+
+  void insertionSort(LineRef* first, LineRef* last) const {
+    for (LineRef* i = first + 1; i < last; ++i) {
+      LineRef const line = *i;
+      LineRef* j = i;
+      for (; j > first && less(line, *(j - 1)); --j) {
+        *j = *(j - 1);
+      }
+      *j = line;
+    }
+  }
+
+public:
+  MultikeySorter(const char* arena, const LineKeySpec& spec): arena_(arena), spec_(spec) {}
+
+  // Sort [first, last), whose keys agree on their first `depth` words
+  void sort(LineRef* first, LineRef* last, size_t depth) const {
+    while (static_cast<size_t>(last - first) > LineInsertionSortThreshold) {
+      // Median of three as the pivot
+      LineRef* middle = first + (last - first) / 2;
+      DepthKey a = depthKey(*first, depth);
+      DepthKey b = depthKey(*middle, depth);
+      DepthKey c = depthKey(*(last - 1), depth);
+      DepthKey const pivot = std::max(std::min(a, b), std::min(std::max(a, b), c));
+
+      // Three-way partition: [first, lt) below, [lt, gt) equal, [gt, last) above the pivot
+      LineRef* lt = first;
+      LineRef* gt = last;
+      for (LineRef* i = first; i < gt;) {
+        DepthKey const key = depthKey(*i, depth);
+        if (key < pivot) {
+          std::swap(*lt++, *i++);
+        } else if (pivot < key) {
+          std::swap(*i, *--gt);
+        } else {
+          ++i;
+        }
+      }
+      sort(first, lt, depth);
+      sort(gt, last, depth);
+
+      if (pivot.available < WordBytes) {
+        // The keys of the equal partition ended in this word, only the whole lines are left
+        if (spec_.field != 0) {
+          std::sort(lt, gt, [this](const LineRef& left, const LineRef& right) {
+            return less(left, right);
+          });
+        }
+        return;
+      }
+      first = lt;
+      last = gt;
+      ++depth;
+    }
+    insertionSort(first, last);
+  }
+};
+
+}  // namespace
+
+LineRef MakeLineRef(const char* line, uint32_t offset, uint32_t length, const LineKeySpec& spec) {
+  uint32_t key_offset = 0;
+  uint32_t key_length = length;
+  if (spec.field > 0) {
+    std::string_view const text(line, length);
+    size_t begin = 0;
+    for (size_t field = 1; field < spec.field && begin <= length; ++field) {
+      size_t const separator = text.find(spec.separator, begin);
+      begin = separator == std::string_view::npos ? length + 1 : separator + 1;
+    }
+    if (begin > length) {
+      // A missing field is an empty key
+      key_offset = length;
+      key_length = 0;
+    } else {
+      size_t const end = std::min<size_t>(text.find(spec.separator, begin), length);
+      key_offset = static_cast<uint32_t>(begin);
+      key_length = static_cast<uint32_t>(end - begin);
+    }
+  }
+
+  const char* key = line + key_offset;
+  uint64_t const prefix = spec.numeric ? RecordTraits<double>::key(ParseNumber(key, key_length))
+                                       : KeyWord(key, key_length, 0);
+  return LineRef{prefix, offset, length, key_offset, key_length};
+}
+
+int CompareLines(
+    const char* left,
+    const LineRef& left_ref,
+    const char* right,
+    const LineRef& right_ref,
+    const LineKeySpec& spec
+) {
+  if (left_ref.prefix != right_ref.prefix) {
+    return left_ref.prefix < right_ref.prefix ? -1 : 1;
+  }
+  if (!spec.numeric) {
+    std::string_view const left_key(left + left_ref.key_offset, left_ref.key_length);
+    std::string_view const right_key(right + right_ref.key_offset, right_ref.key_length);
+    if (int const order = left_key.compare(right_key); order != 0) {
+      return order;
+    }
+    if (spec.field == 0) {
+      return 0;
+    }
+  }
+  return std::string_view(left, left_ref.length).compare(std::string_view(right, right_ref.length));
+}
+
+void SortLines(const char* arena, std::vector<LineRef>& lines, const LineKeySpec& spec) {
+  if (spec.numeric) {
+    auto const less = [arena, &spec](const LineRef& left, const LineRef& right) {
+      return CompareLines(arena + left.offset, left, arena + right.offset, right, spec) < 0;
+    };
+    std::sort(lines.begin(), lines.end(), less);
+    return;
+  }
+  MultikeySorter(arena, spec).sort(lines.data(), lines.data() + lines.size(), 0);
+}
@@ -0,0 +1,45 @@
+#ifndef MONOLITH_LINE_KEY_HPP
+#define MONOLITH_LINE_KEY_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Which part of a text line it is sorted by, and how
+struct LineKeySpec {
+  // 1-based field of the key, 0 keys on the whole line
+  size_t field = 0;
+  char separator = ',';
+  // Order by the value of the key as a number instead of by its bytes, lines that do not start
+  // with a number count as 0
+  bool numeric = false;
+};
+
+// A line of a chunk arena with its key. `prefix` caches the first 8 key bytes in big-endian order,
+// or the order-preserving bits of the number for numeric keys.
+struct LineRef {
+  uint64_t prefix;
+  uint32_t offset;
+  uint32_t length;
+  uint32_t key_offset;
+  uint32_t key_length;
+};
+
+// Describe the line at `line` of `length` bytes, without its newline, found at `offset` of its
+// arena
+LineRef MakeLineRef(const char* line, uint32_t offset, uint32_t length, const LineKeySpec& spec);
+
+// Three-way comparison of two lines by their keys, ties are decided by the whole lines
+int CompareLines(
+    const char* left,
+    const LineRef& left_ref,
+    const char* right,
+    const LineRef& right_ref,
+    const LineKeySpec& spec
+);
+
+// Sort the lines of `arena`. Byte keys go through a multikey quicksort over 8 byte words of the
+// keys, whose first word is the cached prefix, numeric keys through a comparison sort on it.
+void SortLines(const char* arena, std::vector<LineRef>& lines, const LineKeySpec& spec);
+
+#endif  // MONOLITH_LINE_KEY_HPP
@@ -0,0 +1,520 @@
+#include "line_sort.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "loser_tree.hpp"
+#include "merge_planner.hpp"
+#include "run_io.hpp"
+#include "sorter_utils.hpp"
+#include "spill_directories.hpp"
+
+namespace {
+
+const size_t LineLengthBytes = sizeof(uint32_t);
+
+// Largest arena, LineRef keeps offsets and lengths within an arena as uint32_t
+const size_t LineArenaMaxBytes = std::numeric_limits<uint32_t>::max();
+
+// Reader of a text file into arenas of whole lines. A line left unfinished at the end of an arena
+// opens the next one, and an arena grows to hold a line longer than itself, but not beyond
+// LineArenaMaxBytes.
+class LineChunkReader {
+private:
+  std::ifstream file_;
+  std::vector<char> arena_;
+  // Bytes of the unfinished line at the end of the previous arena
+  size_t pending_begin_ = 0;
+  size_t pending_end_ = 0;
+  bool eof_ = false;
+  bool too_large_ = false;
+  // Grow the arena until the file ends instead of stopping at the first complete lines
+  bool whole_file_;
+  IoStats stats_;
+
+  size_t read(size_t offset) {
+    auto t_start = std::chrono::steady_clock::now();
+    file_.read(arena_.data() + offset, static_cast<std::streamsize>(arena_.size() - offset));
+    auto const bytes_read = static_cast<size_t>(file_.gcount());
+    stats_.time += std::chrono::steady_clock::now() - t_start;
+    stats_.bytes += bytes_read;
+    stats_.raw_bytes += bytes_read;
+    if (!file_) {
+      eof_ = true;
+    }
+    return bytes_read;
+  }
+
+public:
+  LineChunkReader(const std::string& filename, size_t chunk_size_bytes, bool whole_file = false)
+      : file_(filename, std::ios::binary)
+      , arena_(std::clamp<size_t>(chunk_size_bytes, 1, LineArenaMaxBytes))
+      , whole_file_(whole_file) {}
+
+  bool isOpen() const {
+    return file_.is_open();
+  }
+
+  // Fill the arena with the next lines and describe them in `lines`, false once the file is
+  // exhausted or the lines do not fit into an arena. The arena stays valid until the next call.
+  bool next(std::vector<LineRef>& lines, const LineKeySpec& spec) {
+    lines.clear();
+    if (too_large_) {
+      return false;
+    }
+    size_t size = pending_end_ - pending_begin_;
+    std::memmove(arena_.data(), arena_.data() + pending_begin_, size);
+    size_t start = 0;
+    while ((lines.empty() || whole_file_) && !eof_) {
+      if (size == arena_.size()) {
+        if (arena_.size() == LineArenaMaxBytes) {
+          too_large_ = true;
+          lines.clear();
+          return false;
+        }
+        arena_.resize(std::min(2 * arena_.size(), LineArenaMaxBytes));
+      }
+      size_t const scan_from = size;
+      size += read(size);
+      const char* const arena_end = arena_.data() + size;
+      const char* newline = arena_.data() + scan_from;
+      while ((newline = static_cast<const char*>(
+                  std::memchr(newline, '\n', static_cast<size_t>(arena_end - newline))
+              )) != nullptr) {
+        auto const end = static_cast<size_t>(newline - arena_.data());
+        lines.push_back(MakeLineRef(
+            arena_.data() + start,
+            static_cast<uint32_t>(start),
+            static_cast<uint32_t>(end - start),
+            spec
+        ));
+        start = end + 1;
+        ++newline;
+      }
+    }
+    if (eof_ && start < size) {
+      lines.push_back(MakeLineRef(
+          arena_.data() + start,
+          static_cast<uint32_t>(start),
+          static_cast<uint32_t>(size - start),
+          spec
+      ));
+      start = size;
+    }
+    pending_begin_ = start;
+    pending_end_ = size;
+    return !lines.empty();
+  }
+
+  const char* arena() const {
+    return arena_.data();
+  }
+
+  // Check if next() stopped at a line, or a whole file, longer than LineArenaMaxBytes
+  bool tooLarge() const {
+    return too_large_;
+  }
+
+  const IoStats& stats() const {
+    return stats_;
+  }
+};
+
+// Buffered writer of lines, either as a run of length-prefixed lines or as newline-terminated text
+class LineWriter {
+private:
+  std::ofstream file_;
+  std::vector<char> buffer_;
+  size_t size_ = 0;
+  bool length_prefixed_;
+  IoStats stats_;
+
+  void write(const char* data, size_t bytes) {
+    auto t_start = std::chrono::steady_clock::now();
+    file_.write(data, static_cast<std::streamsize>(bytes));
+    stats_.time += std::chrono::steady_clock::now() - t_start;
+    stats_.bytes += bytes;
+    stats_.raw_bytes += bytes;
+  }
+
+  void append(const char* data, size_t bytes) {
+    if (size_ + bytes > buffer_.size()) {
+      flush();
+      if (bytes > buffer_.size()) {
+        write(data, bytes);
+        return;
+      }
+    }
+    std::memcpy(buffer_.data() + size_, data, bytes);
+    size_ += bytes;
+  }
+
+public:
+  LineWriter(const std::string& filename, size_t buffer_size_bytes, bool length_prefixed)
+      : file_(filename, std::ios::binary | std::ios::trunc)
+      , buffer_(std::max<size_t>(LineLengthBytes, buffer_size_bytes))
+      , length_prefixed_(length_prefixed) {}
+
+  ~LineWriter() {
+    close();
+  }
+
+  LineWriter(const LineWriter&) = delete;
+  LineWriter& operator=(const LineWriter&) = delete;
+
+  bool isOpen() const {
+    return file_.is_open();
+  }
+
+  void put(const char* line, uint32_t length) {
+    if (length_prefixed_) {
+      char header[LineLengthBytes];
+      std::memcpy(header, &length, LineLengthBytes);
+      append(header, LineLengthBytes);
+      append(line, length);
+    } else {
+      append(line, length);
+      append("\n", 1);
+    }
+  }
+
+  void flush() {
+    if (size_ > 0) {
+      write(buffer_.data(), size_);
+      size_ = 0;
+    }
+  }
+
+  void close() {
+    if (file_.is_open()) {
+      flush();
+      file_.close();
+    }
+  }
+
+  const IoStats& stats() const {
+    return stats_;
+  }
+};
+
+// Head line of a run in the merge
+struct LineHead {
+  const char* line;
+  LineRef ref;
+};
+
+struct LineHeadLess {
+  LineKeySpec spec;
+
+  bool operator()(const LineHead& left, const LineHead& right) const {
+    return CompareLines(left.line, left.ref, right.line, right.ref, spec) < 0;
+  }
+};
+
+// Merge source over a run of length-prefixed lines. The head line stays in the buffer until the
+// next call, which is after the merge has written it.
+class LineRunReader {
+private:
+  std::ifstream file_;
+  std::vector<char> buffer_;
+  size_t position_ = 0;
+  size_t size_ = 0;
+  bool eof_ = false;
+  LineKeySpec spec_;
+  IoStats stats_;
+
+  // Make at least `bytes` unread bytes available, as far as the run holds them
+  bool ensure(size_t bytes) {
+    if (size_ - position_ >= bytes) {
+      return true;
+    }
+    std::memmove(buffer_.data(), buffer_.data() + position_, size_ - position_);
+    size_ -= position_;
+    position_ = 0;
+    if (bytes > buffer_.size()) {
+      buffer_.resize(bytes);
+    }
+    while (size_ < bytes && !eof_) {
+      auto t_start = std::chrono::steady_clock::now();
+      file_.read(buffer_.data() + size_, static_cast<std::streamsize>(buffer_.size() - size_));
+      auto const bytes_read = static_cast<size_t>(file_.gcount());
+      stats_.time += std::chrono::steady_clock::now() - t_start;
+      stats_.bytes += bytes_read;
+      stats_.raw_bytes += bytes_read;
+      size_ += bytes_read;
+      if (!file_) {
+        eof_ = true;
+      }
+    }
+    return size_ >= bytes;
+  }
+
+public:
+  LineRunReader(const std::string& filename, size_t buffer_size_bytes, const LineKeySpec& spec)
+      : file_(filename, std::ios::binary)
+      , buffer_(std::max<size_t>(LineLengthBytes, buffer_size_bytes))
+      , spec_(spec) {}
+
+  bool isOpen() const {
+    return file_.is_open();
+  }
+
+  bool next(LineHead& head) {
+    if (!ensure(LineLengthBytes)) {
+      return false;
+    }
+    uint32_t length = 0;
+    std::memcpy(&length, buffer_.data() + position_, LineLengthBytes);
+    if (!ensure(LineLengthBytes + length)) {
+      return false;
+    }
+    head.line = buffer_.data() + position_ + LineLengthBytes;
+    head.ref = MakeLineRef(head.line, 0, length, spec_);
+    position_ += LineLengthBytes + length;
+    return true;
+  }
+
+  const IoStats& stats() const {
+    return stats_;
+  }
+};
+
+bool MergeLineRuns(
+    const std::vector<std::string>& run_filenames,
+    const std::string& output_filename,
+    bool length_prefixed,
+    const SortOptions& options,
+    IoStats& read_stats,
+    IoStats& write_stats
+) {
+  std::vector<std::unique_ptr<LineRunReader>> readers;
+  std::vector<LineRunReader*> sources;
+  for (const std::string& run_filename: run_filenames) {
+    readers.push_back(
+        std::make_unique<LineRunReader>(run_filename, options.run_buffer_bytes, options.line_key)
+    );
+    if (!readers.back()->isOpen()) {
+      std::cerr << "Failed to open temp file: " << run_filename << '\n';
+      return false;
+    }
+    sources.push_back(readers.back().get());
+  }
+  LineWriter output(output_filename, options.run_buffer_bytes, length_prefixed);
+  if (!output.isOpen()) {
+    std::cerr << "Failed to open output file for writing: " << output_filename << '\n';
+    return false;
+  }
+
+  LoserTree<LineHead, LineRunReader, LineHeadLess> merger(
+      std::move(sources), LineHeadLess{options.line_key}
+  );
+  while (!merger.empty()) {
+    output.put(merger.top().line, merger.top().ref.length);
+    merger.pop();
+  }
+  output.close();
+  write_stats += output.stats();
+  for (const auto& reader: readers) {
+    read_stats += reader->stats();
+  }
+  return true;
+}
+
+// Write the sorted lines of an arena
+bool WriteLines(
+    const std::string& filename,
+    const char* arena,
+    const std::vector<LineRef>& lines,
+    bool length_prefixed,
+    size_t buffer_size_bytes,
+    IoStats& write_stats
+) {
+  LineWriter output(filename, buffer_size_bytes, length_prefixed);
+  if (!output.isOpen()) {
+    std::cerr << "Failed to open output file for writing: " << filename << '\n';
+    return false;
+  }
+  for (const LineRef& line: lines) {
+    output.put(arena + line.offset, line.length);
+  }
+  output.close();
+  write_stats += output.stats();
+  return true;
+}
+
+}  // namespace
+
+bool LineSorter::sortInMemory(
+    const std::string& input_filename,
+    const std::string& output_filename,
+    const SortOptions& options,
+    const std::string& tag
+) {
+  // The file size only sizes the arena up front, a stream grows it until its end
+  std::error_code error;
+  size_t const input_bytes = IsStreamPath(input_filename)
+                                 ? options.run_buffer_bytes
+                                 : std::filesystem::file_size(input_filename, error);
+  if (!error && input_bytes >= LineArenaMaxBytes) {
+    std::cout << tag << ": Input exceeds " << LineArenaMaxBytes
+              << " bytes for one arena, sorting it externally" << '\n';
+    return externalSort(input_filename, output_filename, LineArenaMaxBytes / 2, options, tag);
+  }
+  LineChunkReader input(input_filename, input_bytes + 1, true);
+  if (error || !input.isOpen()) {
+    std::cerr << "Failed to open input file: " << input_filename << '\n';
+    return false;
+  }
+  auto t_start = std::chrono::steady_clock::now();
+  std::vector<LineRef> lines;
+  input.next(lines, options.line_key);
+  if (input.tooLarge()) {
+    std::cerr << "Input exceeds " << LineArenaMaxBytes
+              << " bytes for an in-memory sort: " << input_filename << '\n';
+    return false;
+  }
+
+  std::cout << "Sorting " << lines.size() << " lines in memory..." << '\n';
+  SortLines(input.arena(), lines, options.line_key);
+
+  IoStats write_stats;
+  if (!WriteLines(
+          output_filename, input.arena(), lines, false, options.run_buffer_bytes, write_stats
+      )) {
+    return false;
+  }
+  auto t_end = std::chrono::steady_clock::now();
+  PrintPhaseThroughput(tag, "In-memory sort", input.stats(), write_stats, t_end - t_start);
+  return true;
+}
+
+bool LineSorter::externalSort(
+    const std::string& input_filename,
+    const std::string& output_filename,
+    size_t chunk_size_bytes,
+    const SortOptions& options,
+    const std::string& tag
+) {
+  std::vector<std::string> spill_directories = options.spill_directories;
+  if (spill_directories.empty()) {
+    spill_directories.push_back(std::filesystem::temp_directory_path().string());
+  }
+  for (const std::string& directory: spill_directories) {
+    if (!std::filesystem::is_directory(directory)) {
+      std::cerr << "Spill directory does not exist: " << directory << '\n';
+      return false;
+    }
+  }
+  SpillDirectories spill(spill_directories, options.spill_policy);
+
+  LineChunkReader input(input_filename, chunk_size_bytes);
+  if (!input.isOpen()) {
+    std::cerr << "Failed to open input file: " << input_filename << '\n';
+    return false;
+  }
+
+  // Step 1: Sort arenas and save them to temporary files
+  auto t_start = std::chrono::steady_clock::now();
+  std::vector<LineRef> lines;
+  std::vector<std::string> runs;
+  size_t total_lines = 0;
+  IoStats write_stats;
+  while (input.next(lines, options.line_key)) {
+    SortLines(input.arena(), lines, options.line_key);
+    runs.push_back(ChunkFilename(spill.directory(runs.size()), input_filename, runs.size()));
+    if (!WriteLines(
+            runs.back(), input.arena(), lines, true, options.run_buffer_bytes, write_stats
+        )) {
+      return false;
+    }
+    total_lines += lines.size();
+  }
+  if (input.tooLarge()) {
+    std::cerr << "Line longer than " << LineArenaMaxBytes << " bytes in " << input_filename
+              << '\n';
+    return false;
+  }
+  std::cout << tag << ": Sorted " << total_lines << " lines into " << runs.size() << " runs"
+            << '\n';
+  PrintPhaseThroughput(
+      tag, "Run formation", input.stats(), write_stats, std::chrono::steady_clock::now() - t_start
+  );
+  if (runs.empty()) {
+    std::cerr << "No chunks were created from input file: " << input_filename << '\n';
+    return false;
+  }
+
+  // Step 2: Merge the sorted runs into the final output file
+  size_t const fan_in =
+      MaxMergeFanIn(chunk_size_bytes, options.run_buffer_bytes, options.max_fan_in);
+  MergePlan const plan = PlanMergePasses(runs.size(), fan_in);
+  PrintMergePlan(tag, plan, write_stats.bytes);
+  for (size_t pass_index = 0; pass_index < plan.passes.size(); ++pass_index) {
+    const MergePass& pass = plan.passes[pass_index];
+    bool const last_pass = pass_index + 1 == plan.passes.size();
+    auto t_pass_start = std::chrono::steady_clock::now();
+    IoStats read_stats;
+    IoStats pass_write_stats;
+    std::vector<std::string> next_runs;
+    size_t first_run = 0;
+    for (size_t group = 0; group < pass.output_runs; ++group) {
+      std::vector<std::string> const group_runs(
+          runs.begin() + static_cast<std::ptrdiff_t>(first_run),
+          runs.begin() + static_cast<std::ptrdiff_t>(first_run + pass.group_sizes[group])
+      );
+      std::string const merged_filename =
+          last_pass
+              ? output_filename
+              : MergePassFilename(spill.directory(group), input_filename, pass_index + 1, group);
+      if (!MergeLineRuns(
+              group_runs, merged_filename, !last_pass, options, read_stats, pass_write_stats
+          )) {
+        return false;
+      }
+      for (const std::string& run_filename: group_runs) {
+        (void) std::remove(run_filename.c_str());
+      }
+      next_runs.push_back(merged_filename);
+      first_run += pass.group_sizes[group];
+    }
+    runs = std::move(next_runs);
+    PrintPhaseThroughput(
+        tag,
+        "Merge pass " + std::to_string(pass_index + 1),
+        read_stats,
+        pass_write_stats,
+        std::chrono::steady_clock::now() - t_pass_start
+    );
+  }
+  return true;
+}
+
+bool LineSorter::isFileSorted(const std::string& filename, const LineKeySpec& spec) {
+  std::ifstream input(filename, std::ios::binary);
+  std::string previous;
+  std::string current;
+  bool first = true;
+  while (std::getline(input, current)) {
+    if (!first) {
+      LineRef const previous_ref =
+          MakeLineRef(previous.data(), 0, static_cast<uint32_t>(previous.size()), spec);
+      LineRef const current_ref =
+          MakeLineRef(current.data(), 0, static_cast<uint32_t>(current.size()), spec);
+      if (CompareLines(current.data(), current_ref, previous.data(), previous_ref, spec) < 0) {
+        return false;
+      }
+    }
+    std::swap(previous, current);
+    first = false;
+  }
+  return true;
+}
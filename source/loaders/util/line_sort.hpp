@@ -0,0 +1,38 @@
+#ifndef MONOLITH_LINE_SORT_HPP
+#define MONOLITH_LINE_SORT_HPP
+
+#include <cstddef>
+#include <string>
+
+#include "line_key.hpp"
+#include "sort_options.hpp"
+
+// In-memory and external sort of newline-delimited text. Chunks of the input are packed into one
+// byte arena each, described by an array of LineRefs that is all the sort moves. The runs hold
+// every line behind a uint32_t length, and the output gets the lines back with their newlines. A
+// last line without a newline gets one.
+class LineSorter {
+public:
+  // Sort the whole file in memory, false if it cannot be read or written
+  static bool sortInMemory(
+      const std::string& input_filename,
+      const std::string& output_filename,
+      const SortOptions& options,
+      const std::string& tag
+  );
+
+  // Sort arenas of about `chunk_size_bytes` into runs striped over the spill directories and merge
+  // them in as many passes as the fan-in allows
+  static bool externalSort(
+      const std::string& input_filename,
+      const std::string& output_filename,
+      size_t chunk_size_bytes,
+      const SortOptions& options,
+      const std::string& tag
+  );
+
+  // Check if the lines of the file are in the order of `spec`
+  static bool isFileSorted(const std::string& filename, const LineKeySpec& spec);
+};
+
+#endif  // MONOLITH_LINE_SORT_HPP
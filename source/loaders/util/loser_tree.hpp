@@ -0,0 +1,122 @@
+#ifndef MONOLITH_LOSER_TREE_HPP
+#define MONOLITH_LOSER_TREE_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <utility>
+#include <vector>
+
+// Tournament tree of losers that merges N sorted sources into one sorted stream.
+// Every internal node keeps the loser of the match played there, so advancing the winner
+// costs a single leaf-to-root replay of log2(N) comparisons instead of a heap pop plus push.
+// `Source` must provide `bool next(T& value)` that returns false once it is exhausted.
+template <typename T, typename Source, typename Compare = std::less<T>>
+class LoserTree {
+private:
+  std::vector<Source*> sources_;
+  std::vector<T> current_;
+  std::vector<char> exhausted_;
+  // losers_[0] is the overall winner, losers_[1..N) are the losers of the internal nodes
+  std::vector<size_t> losers_;
+  Compare compare_;
+
+  // Ordering of the leaves: exhausted sources lose against everything, ties go to the lower index
+  bool beats(size_t left, size_t right) const {
+    if (exhausted_[left] != 0) {
+      return false;
+    }
+    if (exhausted_[right] != 0) {
+      return true;
+    }
+    if (compare_(current_[left], current_[right])) {
+      return true;
+    }
+    if (compare_(current_[right], current_[left])) {
+      return false;
+    }
+    return left < right;
+  }
+
+  void replay(size_t leaf) {
+    size_t winner = leaf;
+    for (size_t node = (leaf + sources_.size()) / 2; node > 0; node /= 2) {
+      if (beats(losers_[node], winner)) {
+        std::swap(losers_[node], winner);
+      }
+    }
+    losers_[0] = winner;
+  }
+
+public:
+  explicit LoserTree(std::vector<Source*> sources, Compare compare = Compare())
+      : sources_(std::move(sources))
+      , current_(sources_.size())
+      , exhausted_(sources_.size(), 0)
+      , losers_(std::max<size_t>(sources_.size(), 1), 0)
+      , compare_(std::move(compare)) {
+    const size_t num_sources = sources_.size();
+    for (size_t i = 0; i < num_sources; ++i) {
+      exhausted_[i] = sources_[i]->next(current_[i]) ? 0 : 1;
+    }
+    if (num_sources <= 1) {
+      return;
+    }
+
+    // Play the initial tournament bottom-up, leaf i sits at position N + i
+    std::vector<size_t> winners(2 * num_sources);
+    for (size_t i = 0; i < num_sources; ++i) {
+      winners[num_sources + i] = i;
+    }
+    for (size_t node = num_sources - 1; node > 0; --node) {
+      const size_t left = winners[2 * node];
+      const size_t right = winners[2 * node + 1];
+      const bool left_wins = beats(left, right);
+      winners[node] = left_wins ? left : right;
+      losers_[node] = left_wins ? right : left;
+    }
+    losers_[0] = winners[1];
+  }
+
+  bool empty() const {
+    return sources_.empty() || exhausted_[losers_[0]] != 0;
+  }
+
+  // Smallest value among the heads of all sources, only valid while !empty()
+  const T& top() const {
+    return current_[losers_[0]];
+  }
+
+  // Index of the source holding top()
+  size_t topSource() const {
+    return losers_[0];
+  }
+
+  // Current head of `source`, only valid while it is not exhausted
+  const T& head(size_t source) const {
+    return current_[source];
+  }
+
+  bool exhausted(size_t source) const {
+    return exhausted_[source] != 0;
+  }
+
+  // Advance the source holding top() and replay its path to the root
+  void pop() {
+    const size_t leaf = losers_[0];
+    exhausted_[leaf] = sources_[leaf]->next(current_[leaf]) ? 0 : 1;
+    replay(leaf);
+  }
+
+  // Read the next value of the merged stream, returns false once every source is exhausted
+  bool next(T& value) {
+    if (empty()) {
+      return false;
+    }
+    value = top();
+    pop();
+    return true;
+  }
+};
+
+#endif  // MONOLITH_LOSER_TREE_HPP
@@ -0,0 +1,203 @@
+#include "memory_budget.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "merge_planner.hpp"
+#include "parallel_sort.hpp"
+#include "sorter_utils.hpp"
+
+namespace {
+
+const size_t BytesInKb = 1024;
+const size_t PercentBase = 100;
+
+// Anything this large is the "no limit" value of cgroup v1
+const size_t UnlimitedCgroupBytes = static_cast<size_t>(1) << 62U;
+
+// Run buffers of run formation: the writer of the chunk being saved and the input reader
+const size_t RunFormationBuffers = 2;
+
+// Read the single number of a cgroup control file, 0 if it is missing or says "max"
+size_t ReadLimitFile(const std::filesystem::path& path) {
+  std::ifstream file(path);
+  std::string text;
+  if (!(file >> text) || text == "max") {
+    return 0;
+  }
+  try {
+    return std::stoull(text);
+  } catch (const std::exception&) {
+    return 0;
+  }
+}
+
+size_t ReadMemAvailable() {
+  std::ifstream meminfo("/proc/meminfo");
+  std::string line;
+  while (std::getline(meminfo, line)) {
+    std::istringstream fields(line);
+    std::string name;
+    size_t kilobytes = 0;
+    if (fields >> name >> kilobytes && name == "MemAvailable:") {
+      return kilobytes * BytesInKb;
+    }
+  }
+  return 0;
+}
+
+// Keep the limit with the least headroom, a cgroup is bounded by all of its ancestors
+void TightenCgroupLimit(MemoryLimits& limits, size_t limit, size_t usage) {
+  // cgroup v1 reports "no limit" as LONG_MAX rounded down to a page
+  if (limit == 0 || limit >= UnlimitedCgroupBytes) {
+    return;
+  }
+  size_t const headroom = limit - std::min(limit, usage);
+  size_t const current_headroom =
+      limits.cgroup_limit_bytes - std::min(limits.cgroup_limit_bytes, limits.cgroup_usage_bytes);
+  if (limits.cgroup_limit_bytes == 0 || headroom < current_headroom) {
+    limits.cgroup_limit_bytes = limit;
+    limits.cgroup_usage_bytes = usage;
+  }
+}
+
+void ReadCgroupLimits(MemoryLimits& limits) {
+  std::ifstream cgroups("/proc/self/cgroup");
+  std::string line;
+  while (std::getline(cgroups, line)) {
+    // Lines look like "hierarchy-id:controllers:path"
+    size_t const first_colon = line.find(':');
+    size_t const second_colon = line.find(':', first_colon + 1);
+    if (first_colon == std::string::npos || second_colon == std::string::npos) {
+      continue;
+    }
+    std::string const controllers = line.substr(first_colon + 1, second_colon - first_colon - 1);
+    std::filesystem::path const cgroup_path = line.substr(second_colon + 1);
+
+    if (controllers.empty()) {
+      // cgroup v2: walk up to the root of the unified hierarchy
+      for (std::filesystem::path path = cgroup_path;; path = path.parent_path()) {
+        std::filesystem::path const directory = "/sys/fs/cgroup" / path.relative_path();
+        TightenCgroupLimit(
+            limits,
+            ReadLimitFile(directory / "memory.max"),
+            ReadLimitFile(directory / "memory.current")
+        );
+        if (!path.has_relative_path()) {
+          break;
+        }
+      }
+    } else if (controllers.find("memory") != std::string::npos) {
+      // cgroup v1: the memory controller accounts the hierarchy itself
+      std::filesystem::path directory = "/sys/fs/cgroup/memory" / cgroup_path.relative_path();
+      if (!std::filesystem::exists(directory / "memory.limit_in_bytes")) {
+        directory = "/sys/fs/cgroup/memory";  // Inside a container only the root is mounted
+      }
+      TightenCgroupLimit(
+          limits,
+          ReadLimitFile(directory / "memory.limit_in_bytes"),
+          ReadLimitFile(directory / "memory.usage_in_bytes")
+      );
+    }
+  }
+}
+
+// The radix and SIMD kernels and the parallel sort go through a scratch buffer as large as the
+// data, which the in-memory sort and every chunk of run formation pay for on top of the data.
+// std::sort on one thread works in place, merging natural runs only borrows a temporary buffer
+// while one is available.
+size_t SortCopies(const SortOptions& options) {
+  return SortNeedsScratch(options.threads, options.kernel) ? 2 : 1;
+}
+
+}  // namespace
+
+MemoryLimits ReadMemoryLimits() {
+  MemoryLimits limits;
+  limits.available_bytes = ReadMemAvailable();
+  ReadCgroupLimits(limits);
+  return limits;
+}
+
+size_t DeriveMemoryBudget(const MemoryLimits& limits) {
+  size_t free_bytes = limits.available_bytes;
+  if (limits.cgroup_limit_bytes > 0) {
+    size_t const cgroup_free =
+        limits.cgroup_limit_bytes - std::min(limits.cgroup_limit_bytes, limits.cgroup_usage_bytes);
+    free_bytes = free_bytes == 0 ? cgroup_free : std::min(free_bytes, cgroup_free);
+  }
+  return free_bytes / PercentBase * AutoMemoryBudgetPercent;
+}
+
+size_t MinimumExternalBudget(const SortOptions& options) {
+  return SortCopies(options) * BytesInMb + RunFormationBuffers * MinRunBufferBytes;
+}
+
+BudgetPlan PlanForMemoryBudget(size_t input_bytes, size_t budget_bytes, const SortOptions& options) {
+  BudgetPlan plan{};
+  plan.budget_bytes = budget_bytes;
+  plan.requested_bytes = budget_bytes;
+  plan.run_buffer_bytes = options.run_buffer_bytes;
+
+  size_t const sort_copies = SortCopies(options);
+  if (input_bytes <= plan.budget_bytes / sort_copies) {
+    plan.in_memory = true;
+    plan.chunk_size_mb = (input_bytes + BytesInMb - 1) / BytesInMb;
+    plan.num_runs = 1;
+    return plan;
+  }
+  // Chunks are whole megabytes, a smaller budget cannot hold even one
+  plan.budget_bytes = std::max(plan.budget_bytes, MinimumExternalBudget(options));
+
+  // Size the chunk for a first estimate of the runs, then give every run of a single merge pass an
+  // equal share of the merge memory (the chunk memory), within the buffer bounds
+  size_t const buffers_per_run = MergeRunBuffers(options);
+  auto run_buffer_for = [&](size_t memory_bytes, size_t num_runs) {
+    return std::clamp(
+        memory_bytes / (num_runs + 1) / buffers_per_run, MinRunBufferBytes, DefaultRunBufferBytes
+    );
+  };
+  size_t const estimated_runs = (input_bytes + plan.budget_bytes - 1) / plan.budget_bytes;
+  // The formation buffers leave the chunk at least the 1 MB it is rounded up to otherwise
+  size_t const formation_buffer_bytes = std::min(
+      run_buffer_for(plan.budget_bytes, estimated_runs),
+      std::max(
+          (plan.budget_bytes - sort_copies * BytesInMb) / RunFormationBuffers, MinRunBufferBytes
+      )
+  );
+
+  size_t const chunk_bytes =
+      (plan.budget_bytes -
+       std::min(plan.budget_bytes / 2, RunFormationBuffers * formation_buffer_bytes)) /
+      sort_copies;
+  plan.chunk_size_mb = std::max<size_t>(1, chunk_bytes / BytesInMb);
+  size_t const chunk_elements = plan.chunk_size_mb * BytesInMb / sizeof(uint32_t);
+  size_t const input_elements = input_bytes / sizeof(uint32_t);
+  plan.num_runs = (input_elements + chunk_elements - 1) / chunk_elements;
+  plan.run_buffer_bytes =
+      std::min(formation_buffer_bytes, run_buffer_for(plan.chunk_size_mb * BytesInMb, plan.num_runs));
+
+  plan.fan_in = MaxMergeFanIn(
+      plan.chunk_size_mb * BytesInMb, plan.run_buffer_bytes * buffers_per_run, options.max_fan_in
+  );
+  plan.merge_passes = PlanMergePasses(plan.num_runs, plan.fan_in).passes.size();
+  return plan;
+}
+
+void PrintBudgetPlan(const std::string& tag, const BudgetPlan& plan) {
+  if (plan.budget_bytes > plan.requested_bytes) {
+    std::cout << tag << ": Memory budget " << plan.requested_bytes << " B is below the "
+              << plan.budget_bytes << " B of the smallest external sort, raising it" << '\n';
+  }
+  std::cout << tag << ": Memory budget " << plan.budget_bytes << " B";
+  if (plan.in_memory) {
+    std::cout << " holds the whole input, sorting in memory" << '\n';
+    return;
+  }
+  std::cout << ": chunks of " << plan.chunk_size_mb << " MB, " << plan.num_runs
+            << " runs, run buffers of " << plan.run_buffer_bytes << " B, fan-in " << plan.fan_in
+            << ", " << plan.merge_passes << " merge pass(es)" << '\n';
+}
@@ -0,0 +1,52 @@
+#ifndef MONOLITH_MEMORY_BUDGET_HPP
+#define MONOLITH_MEMORY_BUDGET_HPP
+
+#include <cstddef>
+#include <string>
+
+#include "sort_options.hpp"
+
+// Share of the free memory a sort claims when no budget is given, leaving room for sorts run side
+// by side under the shell
+const size_t AutoMemoryBudgetPercent = 50;
+
+// Where the detected budget came from, 0 for a source that is not present
+struct MemoryLimits {
+  size_t available_bytes = 0;
+  size_t cgroup_limit_bytes = 0;
+  size_t cgroup_usage_bytes = 0;
+};
+
+// Read MemAvailable and the tightest memory limit of the cgroup hierarchy of the process
+MemoryLimits ReadMemoryLimits();
+
+// AutoMemoryBudgetPercent of the memory still free under `limits`
+size_t DeriveMemoryBudget(const MemoryLimits& limits);
+
+// Sizes the sorter derives from one memory budget
+struct BudgetPlan {
+  // Budget the plan fits, raised from `requested_bytes` when that is below the smallest plan
+  size_t budget_bytes;
+  size_t requested_bytes;
+  // The whole input fits the budget and is sorted by RamMemorySorter
+  bool in_memory;
+  size_t chunk_size_mb;
+  size_t run_buffer_bytes;
+  size_t num_runs;
+  size_t fan_in;
+  size_t merge_passes;
+};
+
+// Smallest budget an external sort under `options` fits: a 1 MB chunk with the scratch of its
+// sort and the two run buffers of run formation at MinRunBufferBytes
+size_t MinimumExternalBudget(const SortOptions& options);
+
+// Split `budget_bytes` between the chunk buffer and the run buffers of the merge for an input of
+// `input_bytes`, using `options` for the fan-in cap, the spill format and the scratch buffer of
+// the sort kernel and threads. An input that does not fit a budget below MinimumExternalBudget is
+// planned for the minimum instead.
+BudgetPlan PlanForMemoryBudget(size_t input_bytes, size_t budget_bytes, const SortOptions& options);
+
+void PrintBudgetPlan(const std::string& tag, const BudgetPlan& plan);
+
+#endif  // MONOLITH_MEMORY_BUDGET_HPP
@@ -0,0 +1,108 @@
+#include "merge_partitioner.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <memory>
+
+namespace {
+
+const uint64_t KeyDomainEnd = static_cast<uint64_t>(std::numeric_limits<uint32_t>::max()) + 1;
+
+// Sorted run file searched by random single-value reads
+class RunSearcher {
+private:
+  std::ifstream file_;
+  size_t size_ = 0;
+
+  uint32_t valueAt(size_t index) {
+    uint32_t value = 0;
+    file_.seekg(static_cast<std::streamoff>(index * sizeof(uint32_t)), std::ios::beg);
+    file_.read(reinterpret_cast<char*>(&value), sizeof(uint32_t));
+    return value;
+  }
+
+public:
+  explicit RunSearcher(const std::string& filename)
+      : file_(filename, std::ios::binary | std::ios::ate) {
+    if (file_) {
+      size_ = static_cast<size_t>(file_.tellg()) / sizeof(uint32_t);
+    }
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  // Number of values of the run smaller than `key`
+  size_t lowerBound(uint64_t key) {
+    size_t low = 0;
+    size_t high = size_;
+    while (low < high) {
+      size_t const middle = low + (high - low) / 2;
+      if (valueAt(middle) < key) {
+        low = middle + 1;
+      } else {
+        high = middle;
+      }
+    }
+    return low;
+  }
+};
+
+}  // namespace
+
+std::vector<MergePartition> PartitionRunsByKey(
+    const std::vector<std::string>& run_filenames, size_t partitions
+) {
+  std::vector<std::unique_ptr<RunSearcher>> runs;
+  size_t total_size = 0;
+  for (const std::string& run_filename : run_filenames) {
+    runs.push_back(std::make_unique<RunSearcher>(run_filename));
+    total_size += runs.back()->size();
+  }
+
+  auto count_below = [&runs](uint64_t key) {
+    size_t count = 0;
+    for (auto& run : runs) {
+      count += run->lowerBound(key);
+    }
+    return count;
+  };
+
+  // splitters[j] is the smallest key with at least j * total / partitions values below it
+  partitions = std::max<size_t>(1, partitions);
+  std::vector<uint64_t> splitters = {0};
+  for (size_t j = 1; j < partitions; ++j) {
+    size_t const target_rank = total_size / partitions * j;
+    uint64_t low = splitters.back();
+    uint64_t high = KeyDomainEnd;
+    while (low < high) {
+      uint64_t const middle = low + (high - low) / 2;
+      if (count_below(middle) < target_rank) {
+        low = middle + 1;
+      } else {
+        high = middle;
+      }
+    }
+    splitters.push_back(low);
+  }
+  splitters.push_back(KeyDomainEnd);
+
+  std::vector<MergePartition> result;
+  std::vector<size_t> previous_bounds(runs.size(), 0);
+  size_t output_offset = 0;
+  for (size_t j = 0; j < partitions; ++j) {
+    MergePartition partition{splitters[j], splitters[j + 1], previous_bounds, {}, output_offset, 0};
+    for (size_t i = 0; i < runs.size(); ++i) {
+      size_t const bound =
+          j + 1 == partitions ? runs[i]->size() : runs[i]->lowerBound(splitters[j + 1]);
+      partition.run_end.push_back(bound);
+      partition.size += bound - partition.run_begin[i];
+    }
+    previous_bounds = partition.run_end;
+    output_offset += partition.size;
+    result.push_back(std::move(partition));
+  }
+  return result;
+}
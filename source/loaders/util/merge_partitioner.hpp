@@ -0,0 +1,28 @@
+#ifndef MONOLITH_MERGE_PARTITIONER_HPP
+#define MONOLITH_MERGE_PARTITIONER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Key range [lower_key, upper_key) of the merged output and the slice of every run holding it
+struct MergePartition {
+  uint64_t lower_key;
+  uint64_t upper_key;
+  // Value ranges [run_begin[i], run_end[i]) of run i that fall into the key range
+  std::vector<size_t> run_begin;
+  std::vector<size_t> run_end;
+  // Position of the first value of the partition in the merged output
+  size_t output_offset;
+  size_t size;
+};
+
+// Split sorted runs into `partitions` disjoint key ranges of roughly equal size. The splitters are
+// found by binary search over the key domain, counting the keys below a candidate with a binary
+// search inside every run file, so only O(partitions * runs * log^2) values are read.
+std::vector<MergePartition> PartitionRunsByKey(
+    const std::vector<std::string>& run_filenames, size_t partitions
+);
+
+#endif  // MONOLITH_MERGE_PARTITIONER_HPP
@@ -0,0 +1,56 @@
+#include "merge_planner.hpp"
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <string>
+
+size_t MaxOpenRunFiles() {
+  rlimit file_limit{};
+  if (getrlimit(RLIMIT_NOFILE, &file_limit) != 0 || file_limit.rlim_cur == RLIM_INFINITY) {
+    return std::numeric_limits<size_t>::max();
+  }
+  size_t const open_files = file_limit.rlim_cur;
+  return open_files > ReservedFileDescriptors ? open_files - ReservedFileDescriptors : 0;
+}
+
+size_t MaxMergeFanIn(size_t memory_budget_bytes, size_t run_buffer_bytes, size_t max_fan_in) {
+  size_t fan_in = memory_budget_bytes / std::max<size_t>(1, run_buffer_bytes);
+  fan_in = fan_in > 1 ? fan_in - 1 : 0;  // One buffer belongs to the output
+  fan_in = std::min(fan_in, MaxOpenRunFiles());
+
+  if (max_fan_in > 0) {
+    fan_in = std::min(fan_in, max_fan_in);
+  }
+  return std::max(fan_in, MinMergeFanIn);
+}
+
+MergePlan PlanMergePasses(size_t num_runs, size_t fan_in) {
+  MergePlan plan{std::max(fan_in, MinMergeFanIn), {}};
+
+  size_t runs = num_runs;
+  do {
+    // Spread the runs evenly over the fewest groups the fan-in allows
+    size_t const groups = std::max<size_t>(1, (runs + plan.fan_in - 1) / plan.fan_in);
+    MergePass pass{runs, groups, std::vector<size_t>(groups, runs / groups)};
+    for (size_t i = 0; i < runs % groups; ++i) {
+      ++pass.group_sizes[i];
+    }
+    plan.passes.push_back(std::move(pass));
+    runs = groups;
+  } while (runs > 1);
+
+  return plan;
+}
+
+void PrintMergePlan(const std::string& tag, const MergePlan& plan, size_t total_bytes) {
+  std::cout << tag << ": Merge plan has " << plan.passes.size() << " pass(es) with fan-in "
+            << plan.fan_in << '\n';
+  for (size_t i = 0; i < plan.passes.size(); ++i) {
+    const MergePass& pass = plan.passes[i];
+    std::cout << tag << ": Pass " << i + 1 << " merges " << pass.input_runs << " runs into "
+              << pass.output_runs << ", reading and writing " << total_bytes << " B each" << '\n';
+  }
+}
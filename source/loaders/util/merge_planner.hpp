@@ -0,0 +1,41 @@
+#ifndef MONOLITH_MERGE_PLANNER_HPP
+#define MONOLITH_MERGE_PLANNER_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Descriptors kept free for the input, the output and the standard streams during a merge pass
+const size_t ReservedFileDescriptors = 16;
+
+// Smallest fan-in a merge pass can make progress with
+const size_t MinMergeFanIn = 2;
+
+// One round of the cascade merge: `input_runs` runs are merged in groups into `output_runs`
+struct MergePass {
+  size_t input_runs;
+  size_t output_runs;
+  // Number of runs merged into every output run of this pass
+  std::vector<size_t> group_sizes;
+};
+
+struct MergePlan {
+  size_t fan_in;
+  std::vector<MergePass> passes;
+};
+
+// Run files a merge may hold open at once under the open file limit of the process, what is left
+// after ReservedFileDescriptors
+size_t MaxOpenRunFiles();
+
+// Largest fan-in allowed by the merge memory (one buffer per input run plus one for the output),
+// the open file limit of the process and the optional user cap (0 means no cap)
+size_t MaxMergeFanIn(size_t memory_budget_bytes, size_t run_buffer_bytes, size_t max_fan_in);
+
+// Plan the passes that merge `num_runs` runs into one with at most `fan_in` runs per merge
+MergePlan PlanMergePasses(size_t num_runs, size_t fan_in);
+
+// Print the planned passes and the bytes each of them moves for an input of `total_bytes`
+void PrintMergePlan(const std::string& tag, const MergePlan& plan, size_t total_bytes);
+
+#endif  // MONOLITH_MERGE_PLANNER_HPP
@@ -0,0 +1,124 @@
+#include "natural_runs.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+template <typename FullSort>
+PresortPath SortNaturalRunsWith(uint32_t* data, size_t count, FullSort full_sort) {
+  std::vector<size_t> run_ends;
+  size_t descending_runs = 0;
+  for (size_t start = 0; start < count;) {
+    size_t end = start + 1;
+    if (end < count && data[end] < data[start]) {
+      // Equal values are indistinguishable, so a descending run extends over ties
+      while (end < count && data[end] <= data[end - 1]) {
+        ++end;
+      }
+      std::reverse(data + start, data + end);
+      ++descending_runs;
+    } else {
+      while (end < count && data[end] >= data[end - 1]) {
+        ++end;
+      }
+    }
+    run_ends.push_back(end);
+    start = end;
+
+    if (run_ends.size() >= MinScannedNaturalRuns &&
+        run_ends.size() * MinNaturalRunLength > end) {
+      full_sort(data, count);
+      return PresortPath::FullSort;
+    }
+  }
+
+  if (run_ends.size() <= 1) {
+    return descending_runs == 0 ? PresortPath::Sorted : PresortPath::Reversed;
+  }
+
+  // Merge neighbouring runs pairwise until a single one is left
+  while (run_ends.size() > 1) {
+    std::vector<size_t> merged_ends;
+    size_t begin = 0;
+    for (size_t i = 0; i < run_ends.size(); i += 2) {
+      if (i + 1 < run_ends.size()) {
+        std::inplace_merge(data + begin, data + run_ends[i], data + run_ends[i + 1]);
+      }
+      begin = run_ends[std::min(i + 1, run_ends.size() - 1)];
+      merged_ends.push_back(begin);
+    }
+    run_ends = std::move(merged_ends);
+  }
+  return PresortPath::NaturalRuns;
+}
+
+}  // namespace
+
+PresortPath SortNaturalRuns(uint32_t* data, size_t count, SortKernel kernel) {
+  return SortNaturalRunsWith(data, count, [kernel](uint32_t* values, size_t size) {
+    std::vector<uint32_t> scratch(KernelNeedsScratch(kernel) ? size : 0);
+    SortWithKernel(values, size, kernel, scratch.data());
+  });
+}
+
+PresortPath SortNaturalRuns(uint32_t* data, size_t count, ParallelSorter& sorter) {
+  return SortNaturalRunsWith(data, count, [&sorter](uint32_t* values, size_t size) {
+    sorter.sort(values, size);
+  });
+}
+
+const char* PresortPathName(PresortPath path) {
+  switch (path) {
+    case PresortPath::Sorted:
+      return "already sorted";
+    case PresortPath::Reversed:
+      return "reverse sorted, reversed in place";
+    case PresortPath::NaturalRuns:
+      return "merged natural runs";
+    case PresortPath::FullSort:
+      return "full sort";
+  }
+  return "unknown";
+}
+
+void PresortStats::add(PresortPath path) {
+  switch (path) {
+    case PresortPath::Sorted:
+      ++sorted;
+      break;
+    case PresortPath::Reversed:
+      ++reversed;
+      break;
+    case PresortPath::NaturalRuns:
+      ++natural_runs;
+      break;
+    case PresortPath::FullSort:
+      ++full_sort;
+      break;
+  }
+}
+
+void PrintPresortStats(const std::string& tag, const PresortStats& stats) {
+  std::cout << tag << ": Chunks already sorted " << stats.sorted << ", reversed "
+            << stats.reversed << ", merged from natural runs " << stats.natural_runs
+            << ", fully sorted " << stats.full_sort << '\n';
+}
+
+bool IsRawFileSorted(const std::string& filename, size_t buffer_size_bytes, IoStats& stats) {
+  RunReader reader(filename, sizeof(uint32_t));
+  if (!reader.isOpen()) {
+    return false;
+  }
+  std::vector<uint32_t> block(std::max<size_t>(1, buffer_size_bytes / sizeof(uint32_t)));
+  uint32_t previous = 0;
+  bool sorted = true;
+  for (size_t read = reader.readBlock(block.data(), block.size()); read > 0 && sorted;
+       read = reader.readBlock(block.data(), block.size())) {
+    sorted = block[0] >= previous && std::is_sorted(block.data(), block.data() + read);
+    previous = block[read - 1];
+  }
+  stats += reader.stats();
+  return sorted;
+}
@@ -0,0 +1,56 @@
+#ifndef MONOLITH_NATURAL_RUNS_HPP
+#define MONOLITH_NATURAL_RUNS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "parallel_sort.hpp"
+#include "radix_sort.hpp"
+#include "run_io.hpp"
+
+// Natural runs shorter than this on average are not worth merging, the data is sorted outright
+const size_t MinNaturalRunLength = 16;
+
+// Runs the scan looks at before it may give up on data with short natural runs
+const size_t MinScannedNaturalRuns = 64;
+
+// How SortNaturalRuns put its data in order
+enum class PresortPath {
+  // The data was already sorted and was left alone
+  Sorted,
+  // The data was sorted in reverse and was reversed in place
+  Reversed,
+  // The ascending and descending natural runs of the data were merged
+  NaturalRuns,
+  // Too few values were in order for the natural runs to help, the sort kernel did the work
+  FullSort,
+};
+
+// Sort `count` values in place, scanning for natural ascending and descending runs first. The
+// scan gives up as soon as the runs are too short on average, so random data pays only for a
+// few hundred comparisons before `kernel` sorts it. Merging the runs borrows a temporary buffer
+// when one is available and merges in place without it otherwise.
+PresortPath SortNaturalRuns(uint32_t* data, size_t count, SortKernel kernel = SortKernel::Std);
+
+// Same as above, with the full sort spread over the threads of `sorter`
+PresortPath SortNaturalRuns(uint32_t* data, size_t count, ParallelSorter& sorter);
+
+const char* PresortPathName(PresortPath path);
+
+// Number of chunks sorted along every PresortPath
+struct PresortStats {
+  size_t sorted = 0;
+  size_t reversed = 0;
+  size_t natural_runs = 0;
+  size_t full_sort = 0;
+
+  void add(PresortPath path);
+};
+
+void PrintPresortStats(const std::string& tag, const PresortStats& stats);
+
+// Stream the raw file and stop at the first descent, true if the whole file is in order
+bool IsRawFileSorted(const std::string& filename, size_t buffer_size_bytes, IoStats& stats);
+
+#endif  // MONOLITH_NATURAL_RUNS_HPP
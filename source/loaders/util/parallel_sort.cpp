@@ -0,0 +1,229 @@
+#include "parallel_sort.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <utility>
+
+#include "bucket_distribution.hpp"
+
+size_t ResolveThreadCount(size_t requested) {
+  if (requested != 0) {
+    return requested;
+  }
+  return std::max<size_t>(1, std::thread::hardware_concurrency());
+}
+
+std::vector<size_t> ThreadSweep(size_t max_threads) {
+  std::vector<size_t> sweep;
+  for (size_t threads = 1; threads < max_threads; threads *= 2) {
+    sweep.push_back(threads);
+  }
+  sweep.push_back(std::max<size_t>(1, max_threads));
+  return sweep;
+}
+
+void PrintThreadSpeedup(
+    const std::string& tag,
+    size_t threads,
+    std::chrono::nanoseconds elapsed,
+    std::chrono::nanoseconds baseline
+) {
+  double const speedup = elapsed.count() > 0 ? static_cast<double>(baseline.count()) /
+                                                   static_cast<double>(elapsed.count())
+                                             : 0.0;
+  std::cout << tag << ": " << threads << " thread(s) took " << elapsed.count()
+            << " ns, speedup " << std::fixed << std::setprecision(2) << speedup
+            << "x over 1 thread" << std::defaultfloat << '\n';
+}
+
+bool SortNeedsScratch(size_t threads, SortKernel kernel) {
+  return ResolveThreadCount(threads) > 1 || KernelNeedsScratch(kernel);
+}
+
+TaskPool::TaskPool(size_t threads) {
+  threads = std::max<size_t>(1, threads);
+  for (size_t i = 0; i < threads; ++i) {
+    queues_.push_back(std::make_unique<TaskQueue>());
+  }
+  for (size_t i = 1; i < threads; ++i) {
+    workers_.emplace_back([this, i] { workerLoop(i); });
+  }
+}
+
+TaskPool::~TaskPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  wake_.notify_all();
+  for (auto& worker: workers_) {
+    worker.join();
+  }
+}
+
+bool TaskPool::runOne(size_t self) {
+  std::function<void()> task;
+  for (size_t i = 0; i < queues_.size() && !task; ++i) {
+    TaskQueue& queue = *queues_[(self + i) % queues_.size()];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) {
+      continue;
+    }
+    // The own queue is worked from the back, the others are stolen from at the front
+    if (i == 0) {
+      task = std::move(queue.tasks.back());
+      queue.tasks.pop_back();
+    } else {
+      task = std::move(queue.tasks.front());
+      queue.tasks.pop_front();
+    }
+  }
+  if (!task) {
+    return false;
+  }
+  --queued_;
+  task();
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (--pending_ == 0) {
+    done_.notify_all();
+  }
+  return true;
+}
+
+void TaskPool::workerLoop(size_t self) {
+  while (true) {
+    if (runOne(self)) {
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    wake_.wait(lock, [this] { return stop_ || queued_ > 0; });
+    if (stop_) {
+      return;
+    }
+  }
+}
+
+void TaskPool::run(std::vector<std::function<void()>> tasks) {
+  if (tasks.empty()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_ += tasks.size();
+    queued_ += tasks.size();
+  }
+  for (size_t i = 0; i < tasks.size(); ++i) {
+    TaskQueue& queue = *queues_[i % queues_.size()];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.tasks.push_back(std::move(tasks[i]));
+  }
+  wake_.notify_all();
+
+  while (runOne(0)) {
+  }
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_.wait(lock, [this] { return pending_ == 0; });
+}
+
+ParallelSorter::ParallelSorter(size_t threads, SortKernel kernel): kernel_(kernel) {
+  threads = ResolveThreadCount(threads);
+  if (threads > 1) {
+    pool_ = std::make_unique<TaskPool>(threads);
+  }
+}
+
+void ParallelSorter::sort(uint32_t* data, size_t count) {
+  if (!pool_ || count < ParallelSortMinCount) {
+    if (KernelNeedsScratch(kernel_) && scratch_.size() < count) {
+      scratch_.resize(count);
+    }
+    SortWithKernel(data, count, kernel_, scratch_.data());
+    return;
+  }
+  size_t const threads = pool_->threads();
+
+  // Random positions, so that a pattern repeating through the data cannot bias the splitters
+  size_t const wanted_buckets = threads * ParallelBucketsPerThread;
+  std::vector<uint32_t> sample(wanted_buckets * ParallelSortOversampling);
+  std::mt19937_64 engine(count);
+  for (uint32_t& value: sample) {
+    value = data[engine() % count];
+  }
+  std::sort(sample.begin(), sample.end());
+  std::vector<uint32_t> const splitters = SampleSplitters(sample, wanted_buckets);
+  BucketIndex const index(splitters);
+  size_t const buckets = splitters.size() + 1;
+
+  // Every thread counts the buckets of its stripe of the data
+  std::vector<std::vector<size_t>> stripe_counts(threads, std::vector<size_t>(buckets));
+  auto const stripe_begin = [count, threads](size_t stripe) { return stripe * count / threads; };
+  std::vector<std::function<void()>> tasks;
+  for (size_t stripe = 0; stripe < threads; ++stripe) {
+    tasks.emplace_back([&, stripe] {
+      std::vector<size_t>& counts = stripe_counts[stripe];
+      for (size_t i = stripe_begin(stripe); i < stripe_begin(stripe + 1); ++i) {
+        ++counts[index.bucket(data[i])];
+      }
+    });
+  }
+  pool_->run(std::move(tasks));
+
+  // Buckets follow each other in the scratch, within a bucket the stripes follow each other
+  std::vector<size_t> bucket_begin(buckets + 1);
+  size_t offset = 0;
+  for (size_t bucket = 0; bucket < buckets; ++bucket) {
+    bucket_begin[bucket] = offset;
+    for (std::vector<size_t>& counts: stripe_counts) {
+      offset += std::exchange(counts[bucket], offset);
+    }
+  }
+  bucket_begin[buckets] = count;
+
+  if (scratch_.size() < count) {
+    scratch_.resize(count);
+  }
+  uint32_t* scratch = scratch_.data();
+  tasks.clear();
+  for (size_t stripe = 0; stripe < threads; ++stripe) {
+    tasks.emplace_back([&, stripe, scratch] {
+      std::vector<size_t>& offsets = stripe_counts[stripe];
+      for (size_t i = stripe_begin(stripe); i < stripe_begin(stripe + 1); ++i) {
+        uint32_t const value = data[i];
+        scratch[offsets[index.bucket(value)]++] = value;
+      }
+    });
+  }
+  pool_->run(std::move(tasks));
+
+  // Largest buckets first, so that the small ones fill the gaps at the end
+  std::vector<size_t> order(buckets);
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&bucket_begin](size_t left, size_t right) {
+    return bucket_begin[left + 1] - bucket_begin[left] >
+           bucket_begin[right + 1] - bucket_begin[right];
+  });
+  tasks.clear();
+  for (size_t const bucket: order) {
+    size_t const begin = bucket_begin[bucket];
+    size_t const end = bucket_begin[bucket + 1];
+    if (begin == end) {
+      continue;
+    }
+    bool const single_value = IsSingleValueBucket(splitters, bucket);
+    // Once copied back, the bucket's range of the scratch is the scratch of its sort
+    tasks.emplace_back([this, data, scratch, begin, end, single_value] {
+      std::copy(scratch + begin, scratch + end, data + begin);
+      if (!single_value) {
+        SortWithKernel(data + begin, end - begin, kernel_, scratch + begin);
+      }
+    });
+  }
+  pool_->run(std::move(tasks));
+}
+
+void ParallelSorter::releaseScratch() {
+  std::vector<uint32_t>().swap(scratch_);
+}
@@ -0,0 +1,107 @@
+#ifndef MONOLITH_PARALLEL_SORT_HPP
+#define MONOLITH_PARALLEL_SORT_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "radix_sort.hpp"
+
+// Below this many values a single thread sorts faster than the partitioning pays off
+const size_t ParallelSortMinCount = size_t{1} << 16U;
+
+// Buckets of the parallel sort per thread, the spare ones even out the skew of the sample
+const size_t ParallelBucketsPerThread = 4;
+
+// Sampled values per bucket of the parallel sort
+const size_t ParallelSortOversampling = 64;
+
+// Threads of `requested`, where 0 means every hardware thread
+size_t ResolveThreadCount(size_t requested);
+
+// Thread counts of a speedup sweep: 1, then doubling, and `max_threads` last
+std::vector<size_t> ThreadSweep(size_t max_threads);
+
+// Print the time of a run on `threads` threads and its speedup over `baseline`, the time of the
+// run on one thread
+void PrintThreadSpeedup(
+    const std::string& tag,
+    size_t threads,
+    std::chrono::nanoseconds elapsed,
+    std::chrono::nanoseconds baseline
+);
+
+// Check if a ParallelSorter of `threads` and `kernel` sorts through a scratch buffer as large as
+// the data, which doubles the memory of the buffers it sorts
+bool SortNeedsScratch(size_t threads, SortKernel kernel);
+
+// Fixed set of threads running batches of tasks. Every thread owns a deque of tasks and takes
+// from its back, a thread out of tasks steals from the front of the others. The thread that
+// submits a batch works on it as well until the batch is done.
+class TaskPool {
+private:
+  struct TaskQueue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  // Queue 0 belongs to the submitting thread, queue i to worker i - 1
+  std::vector<std::unique_ptr<TaskQueue>> queues_;
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+  // Tasks waiting in the queues and tasks not finished yet
+  std::atomic<size_t> queued_ = 0;
+  size_t pending_ = 0;
+  bool stop_ = false;
+
+  bool runOne(size_t self);
+  void workerLoop(size_t self);
+
+public:
+  explicit TaskPool(size_t threads);
+  ~TaskPool();
+
+  TaskPool(const TaskPool&) = delete;
+  TaskPool& operator=(const TaskPool&) = delete;
+
+  size_t threads() const { return queues_.size(); }
+
+  // Run every task of `tasks` and return once all of them are done
+  void run(std::vector<std::function<void()>> tasks);
+};
+
+// Sort of u32 buffers on all threads of a pool: a one level samplesort scatters the values into
+// buckets by sampled splitters, then the buckets are sorted with the kernel as tasks of their
+// own. Buckets of a single frequent key need no sort. The scatter goes through a scratch buffer
+// as large as the data, which the bucket sorts reuse and which is kept for the next buffer until
+// releaseScratch().
+class ParallelSorter {
+private:
+  SortKernel kernel_;
+  std::unique_ptr<TaskPool> pool_;
+  std::vector<uint32_t> scratch_;
+
+public:
+  // One thread sorts with `kernel` alone and starts no pool
+  ParallelSorter(size_t threads, SortKernel kernel);
+
+  size_t threads() const { return pool_ ? pool_->threads() : 1; }
+
+  void sort(uint32_t* data, size_t count);
+
+  // Free the scratch buffer, the next sort allocates it again
+  void releaseScratch();
+};
+
+#endif  // MONOLITH_PARALLEL_SORT_HPP
@@ -0,0 +1,75 @@
+#include "radix_sort.hpp"
+
+#include <algorithm>
+#include <array>
+#include <utility>
+
+#include "simd_sort.hpp"
+
+namespace {
+
+const size_t RadixBuckets = size_t{1} << RadixDigitBits;
+const uint32_t RadixDigitMask = RadixBuckets - 1;
+const size_t RadixPasses = (32 + RadixDigitBits - 1) / RadixDigitBits;
+
+}  // namespace
+
+void RadixSort(uint32_t* data, size_t count, uint32_t* scratch) {
+  if (count < RadixSortMinCount) {
+    std::sort(data, data + count);
+    return;
+  }
+
+  std::array<std::array<size_t, RadixBuckets>, RadixPasses> histograms{};
+  for (size_t i = 0; i < count; ++i) {
+    uint32_t const value = data[i];
+    for (size_t pass = 0; pass < RadixPasses; ++pass) {
+      ++histograms[pass][(value >> (pass * RadixDigitBits)) & RadixDigitMask];
+    }
+  }
+
+  uint32_t* from = data;
+  uint32_t* to = scratch;
+  for (size_t pass = 0; pass < RadixPasses; ++pass) {
+    unsigned const shift = pass * RadixDigitBits;
+    std::array<size_t, RadixBuckets>& offsets = histograms[pass];
+    if (offsets[(from[0] >> shift) & RadixDigitMask] == count) {
+      continue;
+    }
+    size_t offset = 0;
+    for (size_t& bucket: offsets) {
+      offset += std::exchange(bucket, offset);
+    }
+    for (size_t i = 0; i < count; ++i) {
+      uint32_t const value = from[i];
+      to[offsets[(value >> shift) & RadixDigitMask]++] = value;
+    }
+    std::swap(from, to);
+  }
+  if (from != data) {
+    std::copy(from, from + count, data);
+  }
+}
+
+void RadixSort(uint32_t* data, size_t count, std::vector<uint32_t>& scratch) {
+  if (count >= RadixSortMinCount && scratch.size() < count) {
+    scratch.resize(count);
+  }
+  RadixSort(data, count, scratch.data());
+}
+
+bool KernelNeedsScratch(SortKernel kernel) {
+  return kernel != SortKernel::Std;
+}
+
+void SortWithKernel(uint32_t* data, size_t count, SortKernel kernel, uint32_t* scratch) {
+  if (kernel == SortKernel::Radix) {
+    RadixSort(data, count, scratch);
+    return;
+  }
+  if (kernel == SortKernel::Simd) {
+    SimdSort(data, count, scratch, DetectSimdIsa());
+    return;
+  }
+  std::sort(data, data + count);
+}
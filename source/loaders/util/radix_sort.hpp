@@ -0,0 +1,39 @@
+#ifndef MONOLITH_RADIX_SORT_HPP
+#define MONOLITH_RADIX_SORT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Below this many values the histograms of the radix sort cost more than std::sort
+const size_t RadixSortMinCount = 1024;
+
+// Bits of the digit sorted by every pass of the radix sort, three passes cover 32 bit keys
+const unsigned RadixDigitBits = 11;
+
+// Sort routine behind the full sorts of chunks and in-memory data
+enum class SortKernel {
+  // Introsort of std::sort
+  Std,
+  // LSD radix sort over 11 bit digits with a scratch buffer as large as the data
+  Radix,
+  // Bitonic networks and vectorized merges of the widest vector unit found at run time
+  Simd,
+};
+
+// Sort `count` values with a least significant digit first radix sort through `scratch`, which
+// holds at least `count` values. The histograms of all passes are counted in one read of the
+// data, and a pass whose digit is the same for every value is skipped.
+void RadixSort(uint32_t* data, size_t count, uint32_t* scratch);
+
+// Same as above, with `scratch` grown to `count` values and kept for the next call
+void RadixSort(uint32_t* data, size_t count, std::vector<uint32_t>& scratch);
+
+// Check if `kernel` sorts through a scratch buffer as large as the data
+bool KernelNeedsScratch(SortKernel kernel);
+
+// Sort `count` values with `kernel`. The radix and SIMD kernels sort through `scratch` of at least
+// `count` values, std::sort does not touch it.
+void SortWithKernel(uint32_t* data, size_t count, SortKernel kernel, uint32_t* scratch);
+
+#endif  // MONOLITH_RADIX_SORT_HPP
@@ -0,0 +1,176 @@
+#ifndef MONOLITH_RECORD_IO_HPP
+#define MONOLITH_RECORD_IO_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "run_io.hpp"
+
+// Records of a buffer of `buffer_size_bytes`, at least one
+template <typename Record>
+size_t RecordsInBuffer(size_t buffer_size_bytes) {
+  return std::max<size_t>(1, buffer_size_bytes / sizeof(Record));
+}
+
+// Sequential reader of a raw file of records that refills its buffer in large blocks, the
+// counterpart of RunReader for every record type
+template <typename Record>
+class RecordReader {
+private:
+  std::ifstream file_;
+  std::vector<Record> buffer_;
+  size_t position_ = 0;
+  size_t size_ = 0;
+  bool eof_ = false;
+  IoStats stats_;
+
+  bool refill() {
+    if (eof_ || !file_.is_open()) {
+      return false;
+    }
+    position_ = 0;
+    size_ = readBlock(buffer_.data(), buffer_.size());
+    return size_ > 0;
+  }
+
+public:
+  RecordReader(const std::string& filename, size_t buffer_size_bytes)
+      : file_(filename, std::ios::binary), buffer_(RecordsInBuffer<Record>(buffer_size_bytes)) {}
+
+  bool isOpen() const {
+    return file_.is_open();
+  }
+
+  // Read the next record, returns false once the file is exhausted
+  bool next(Record& record) {
+    if (position_ == size_ && !refill()) {
+      return false;
+    }
+    record = buffer_[position_++];
+    return true;
+  }
+
+  // Read the next record in place, nullptr once the file is exhausted. The record stays valid
+  // until the next call.
+  const Record* nextInPlace() {
+    if (position_ == size_ && !refill()) {
+      return nullptr;
+    }
+    return &buffer_[position_++];
+  }
+
+  // Read up to `count` records directly into `destination`, returns the number of records read.
+  // A trailing partial record is dropped.
+  size_t readBlock(Record* destination, size_t count) {
+    if (eof_ || !file_.is_open()) {
+      return 0;
+    }
+    auto t_start = std::chrono::steady_clock::now();
+    file_.read(
+        reinterpret_cast<char*>(destination), static_cast<std::streamsize>(count * sizeof(Record))
+    );
+    auto const bytes_read = static_cast<size_t>(file_.gcount());
+    stats_.time += std::chrono::steady_clock::now() - t_start;
+    stats_.bytes += bytes_read;
+    stats_.raw_bytes += bytes_read;
+    if (!file_) {
+      eof_ = true;
+    }
+    return bytes_read / sizeof(Record);
+  }
+
+  // Read every remaining record into `records`, which grows geometrically while the input lasts,
+  // so that inputs of unknown size such as pipes are read as well. Returns the number of records.
+  size_t readAll(std::vector<Record>& records) {
+    size_t count = 0;
+    records.resize(std::max(records.size(), buffer_.size()));
+    while (true) {
+      count += readBlock(records.data() + count, records.size() - count);
+      if (count < records.size()) {
+        break;
+      }
+      records.resize(2 * records.size());
+    }
+    records.resize(count);
+    return count;
+  }
+
+  void close() {
+    file_.close();
+  }
+
+  const IoStats& stats() const {
+    return stats_;
+  }
+};
+
+// Sequential writer of a raw file of records that flushes its buffer in large blocks
+template <typename Record>
+class RecordWriter {
+private:
+  std::ofstream file_;
+  std::vector<Record> buffer_;
+  size_t size_ = 0;
+  IoStats stats_;
+
+public:
+  RecordWriter(const std::string& filename, size_t buffer_size_bytes)
+      : file_(filename, std::ios::binary | std::ios::trunc)
+      , buffer_(RecordsInBuffer<Record>(buffer_size_bytes)) {}
+
+  ~RecordWriter() {
+    close();
+  }
+
+  RecordWriter(const RecordWriter&) = delete;
+  RecordWriter& operator=(const RecordWriter&) = delete;
+
+  bool isOpen() const {
+    return file_.is_open();
+  }
+
+  void put(const Record& record) {
+    buffer_[size_++] = record;
+    if (size_ == buffer_.size()) {
+      flush();
+    }
+  }
+
+  // Write `count` records, bypassing the buffer once it is drained
+  void writeBlock(const Record* source, size_t count) {
+    flush();
+    auto t_start = std::chrono::steady_clock::now();
+    file_.write(
+        reinterpret_cast<const char*>(source), static_cast<std::streamsize>(count * sizeof(Record))
+    );
+    stats_.time += std::chrono::steady_clock::now() - t_start;
+    stats_.bytes += count * sizeof(Record);
+    stats_.raw_bytes += count * sizeof(Record);
+  }
+
+  void flush() {
+    if (size_ == 0) {
+      return;
+    }
+    size_t const count = size_;
+    size_ = 0;
+    writeBlock(buffer_.data(), count);
+  }
+
+  void close() {
+    if (file_.is_open()) {
+      flush();
+      file_.close();
+    }
+  }
+
+  const IoStats& stats() const {
+    return stats_;
+  }
+};
+
+#endif  // MONOLITH_RECORD_IO_HPP
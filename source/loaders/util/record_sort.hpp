@@ -0,0 +1,335 @@
+#ifndef MONOLITH_RECORD_SORT_HPP
+#define MONOLITH_RECORD_SORT_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "loser_tree.hpp"
+#include "merge_planner.hpp"
+#include "record_io.hpp"
+#include "record_types.hpp"
+#include "sort_options.hpp"
+#include "sorter_utils.hpp"
+#include "spill_directories.hpp"
+
+// In-memory and external sort of a file of `Record`s, instantiated for every RecordType. The
+// comparator and key extraction of RecordTraits are resolved at compile time. The uint32_t sorters
+// keep their own tuned engines, this one runs plain chunks and a cascade of stream merges.
+// Records of KeyCacheMinRecordBytes and more are never moved by the sort: chunks are sorted as
+// cache-resident (key, index) arrays and gathered into the run as it is written, and the merge
+// plays its tournament over the cached keys of the heads of the runs.
+template <typename Record>
+class RecordSorter {
+private:
+  static constexpr bool CachesKeys = sizeof(Record) >= KeyCacheMinRecordBytes;
+
+  using SortKey = CachedKey<Record, uint32_t>;
+  using MergeKey = CachedKey<Record, const Record*>;
+
+  // Order of cached keys, a tie of prefix keys is decided by the records themselves
+  struct CachedKeyLess {
+    const Record* records = nullptr;
+
+    const Record& record(const SortKey& key) const {
+      return records[key.position];
+    }
+
+    static const Record& record(const MergeKey& key) {
+      return *key.position;
+    }
+
+    template <typename Key>
+    bool operator()(const Key& left, const Key& right) const {
+      if (left.key != right.key) {
+        return left.key < right.key;
+      }
+      if constexpr (RecordKeyIsPrefix<Record>) {
+        return RecordLess<Record>()(record(left), record(right));
+      }
+      return false;
+    }
+  };
+
+  // Merge source over a run that caches the key of its head record, which stays in the buffer of
+  // the run reader until the merge has written it
+  class CachedKeySource {
+  private:
+    RecordReader<Record>* reader_;
+
+  public:
+    explicit CachedKeySource(RecordReader<Record>* reader): reader_(reader) {}
+
+    bool next(MergeKey& head) {
+      const Record* record = reader_->nextInPlace();
+      if (record == nullptr) {
+        return false;
+      }
+      head = MergeKey{RecordTraits<Record>::key(*record), record};
+      return true;
+    }
+  };
+
+  // Number of records of `filename`, false if it cannot be read or ends in a partial record. A
+  // stream counts as unbounded, it is read until it ends.
+  static bool countRecords(const std::string& filename, size_t& count) {
+    if (IsStreamPath(filename)) {
+      count = std::numeric_limits<size_t>::max();
+      return true;
+    }
+    std::error_code error;
+    size_t const bytes = std::filesystem::file_size(filename, error);
+    if (error) {
+      std::cerr << "Failed to open input file: " << filename << '\n';
+      return false;
+    }
+    if (bytes % sizeof(Record) != 0) {
+      std::cerr << "Input file " << filename << " of " << bytes << " B is not a whole number of "
+                << sizeof(Record) << " B records" << '\n';
+      return false;
+    }
+    count = bytes / sizeof(Record);
+    return true;
+  }
+
+  // Sort the first `count` of `records` and write them to `filename`
+  static bool sortAndWrite(
+      std::vector<Record>& records,
+      size_t count,
+      const std::string& filename,
+      size_t buffer_size_bytes,
+      IoStats& write_stats
+  ) {
+    RecordWriter<Record> output(filename, buffer_size_bytes);
+    if (!output.isOpen()) {
+      std::cerr << "Failed to open output file for writing: " << filename << '\n';
+      return false;
+    }
+    if constexpr (CachesKeys) {
+      std::vector<SortKey> keys(count);
+      for (size_t i = 0; i < count; ++i) {
+        keys[i] = SortKey{RecordTraits<Record>::key(records[i]), static_cast<uint32_t>(i)};
+      }
+      std::sort(keys.begin(), keys.end(), CachedKeyLess{records.data()});
+      for (const SortKey& key: keys) {
+        output.put(records[key.position]);
+      }
+    } else {
+      auto const end = records.begin() + static_cast<std::ptrdiff_t>(count);
+      std::sort(records.begin(), end, RecordLess<Record>());
+      output.writeBlock(records.data(), count);
+    }
+    output.close();
+    write_stats += output.stats();
+    return true;
+  }
+
+  static bool mergeRuns(
+      const std::vector<std::string>& run_filenames,
+      const std::string& output_filename,
+      size_t buffer_size_bytes,
+      IoStats& read_stats,
+      IoStats& write_stats
+  ) {
+    std::vector<std::unique_ptr<RecordReader<Record>>> readers;
+    std::vector<RecordReader<Record>*> sources;
+    for (const std::string& run_filename: run_filenames) {
+      readers.push_back(std::make_unique<RecordReader<Record>>(run_filename, buffer_size_bytes));
+      if (!readers.back()->isOpen()) {
+        std::cerr << "Failed to open temp file: " << run_filename << '\n';
+        return false;
+      }
+      sources.push_back(readers.back().get());
+    }
+    RecordWriter<Record> output(output_filename, buffer_size_bytes);
+    if (!output.isOpen()) {
+      std::cerr << "Failed to open output file for writing: " << output_filename << '\n';
+      return false;
+    }
+
+    if constexpr (CachesKeys) {
+      std::vector<CachedKeySource> cached_sources;
+      cached_sources.reserve(sources.size());
+      std::vector<CachedKeySource*> cached_pointers;
+      for (RecordReader<Record>* source: sources) {
+        cached_sources.emplace_back(source);
+        cached_pointers.push_back(&cached_sources.back());
+      }
+      LoserTree<MergeKey, CachedKeySource, CachedKeyLess> merger(std::move(cached_pointers));
+      while (!merger.empty()) {
+        output.put(*merger.top().position);
+        merger.pop();
+      }
+    } else {
+      LoserTree<Record, RecordReader<Record>, RecordLess<Record>> merger(std::move(sources));
+      while (!merger.empty()) {
+        output.put(merger.top());
+        merger.pop();
+      }
+    }
+    output.close();
+    write_stats += output.stats();
+    for (const auto& reader: readers) {
+      read_stats += reader->stats();
+    }
+    return true;
+  }
+
+public:
+  // Sort the whole file in memory, false if it cannot be read or written
+  static bool sortInMemory(
+      const std::string& input_filename,
+      const std::string& output_filename,
+      const SortOptions& options,
+      const std::string& tag
+  ) {
+    size_t count = 0;
+    if (!countRecords(input_filename, count)) {
+      return false;
+    }
+    auto t_start = std::chrono::steady_clock::now();
+    RecordReader<Record> input(input_filename, options.run_buffer_bytes);
+    std::vector<Record> records;
+    if (count == std::numeric_limits<size_t>::max()) {
+      count = input.readAll(records);
+    } else {
+      records.resize(count);
+      if (input.readBlock(records.data(), count) != count) {
+        std::cerr << "Failed to read input file: " << input_filename << '\n';
+        return false;
+      }
+    }
+    input.close();
+
+    std::cout << "Sorting " << count << " " << RecordTypeName(options.record_type)
+              << " records in memory..." << '\n';
+    IoStats write_stats;
+    if (!sortAndWrite(records, count, output_filename, options.run_buffer_bytes, write_stats)) {
+      return false;
+    }
+    auto t_end = std::chrono::steady_clock::now();
+    PrintPhaseThroughput(tag, "In-memory sort", input.stats(), write_stats, t_end - t_start);
+    return true;
+  }
+
+  // Sort chunks of `chunk_size_bytes` into runs striped over the spill directories and merge them
+  // in as many passes as the fan-in allows
+  static bool externalSort(
+      const std::string& input_filename,
+      const std::string& output_filename,
+      size_t chunk_size_bytes,
+      const SortOptions& options,
+      const std::string& tag
+  ) {
+    size_t count = 0;
+    if (!countRecords(input_filename, count)) {
+      return false;
+    }
+    std::vector<std::string> spill_directories = options.spill_directories;
+    if (spill_directories.empty()) {
+      spill_directories.push_back(std::filesystem::temp_directory_path().string());
+    }
+    for (const std::string& directory: spill_directories) {
+      if (!std::filesystem::is_directory(directory)) {
+        std::cerr << "Spill directory does not exist: " << directory << '\n';
+        return false;
+      }
+    }
+    SpillDirectories spill(spill_directories, options.spill_policy);
+
+    // Step 1: Sort chunks and save them to temporary files
+    auto t_start = std::chrono::steady_clock::now();
+    RecordReader<Record> input(input_filename, options.run_buffer_bytes);
+    std::vector<Record> chunk(std::min(count, RecordsInBuffer<Record>(chunk_size_bytes)));
+    std::vector<std::string> runs;
+    IoStats write_stats;
+    count = 0;
+    for (size_t read = input.readBlock(chunk.data(), chunk.size()); read > 0;
+         read = input.readBlock(chunk.data(), chunk.size())) {
+      runs.push_back(ChunkFilename(spill.directory(runs.size()), input_filename, runs.size()));
+      if (!sortAndWrite(chunk, read, runs.back(), options.run_buffer_bytes, write_stats)) {
+        return false;
+      }
+      count += read;
+    }
+    input.close();
+    chunk = std::vector<Record>();
+    std::cout << tag << ": Sorted " << count << " " << RecordTypeName(options.record_type)
+              << " records into " << runs.size() << " runs" << '\n';
+    PrintPhaseThroughput(
+        tag, "Run formation", input.stats(), write_stats, std::chrono::steady_clock::now() - t_start
+    );
+    if (runs.empty()) {
+      std::cerr << "No chunks were created from input file: " << input_filename << '\n';
+      return false;
+    }
+
+    // Step 2: Merge the sorted chunks into the final output file
+    size_t const fan_in =
+        MaxMergeFanIn(chunk_size_bytes, options.run_buffer_bytes, options.max_fan_in);
+    MergePlan const plan = PlanMergePasses(runs.size(), fan_in);
+    PrintMergePlan(tag, plan, count * sizeof(Record));
+    for (size_t pass_index = 0; pass_index < plan.passes.size(); ++pass_index) {
+      const MergePass& pass = plan.passes[pass_index];
+      bool const last_pass = pass_index + 1 == plan.passes.size();
+      auto t_pass_start = std::chrono::steady_clock::now();
+      IoStats read_stats;
+      IoStats pass_write_stats;
+      std::vector<std::string> next_runs;
+      size_t first_run = 0;
+      for (size_t group = 0; group < pass.output_runs; ++group) {
+        std::vector<std::string> const group_runs(
+            runs.begin() + static_cast<std::ptrdiff_t>(first_run),
+            runs.begin() + static_cast<std::ptrdiff_t>(first_run + pass.group_sizes[group])
+        );
+        std::string const merged_filename =
+            last_pass
+                ? output_filename
+                : MergePassFilename(spill.directory(group), input_filename, pass_index + 1, group);
+        if (!mergeRuns(
+                group_runs, merged_filename, options.run_buffer_bytes, read_stats, pass_write_stats
+            )) {
+          return false;
+        }
+        for (const std::string& run_filename: group_runs) {
+          (void) std::remove(run_filename.c_str());
+        }
+        next_runs.push_back(merged_filename);
+        first_run += pass.group_sizes[group];
+      }
+      runs = std::move(next_runs);
+      PrintPhaseThroughput(
+          tag,
+          "Merge pass " + std::to_string(pass_index + 1),
+          read_stats,
+          pass_write_stats,
+          std::chrono::steady_clock::now() - t_pass_start
+      );
+    }
+    return true;
+  }
+
+  // Check if the records of the file are in key order
+  static bool isFileSorted(const std::string& filename, size_t buffer_size_bytes) {
+    RecordReader<Record> input(filename, buffer_size_bytes);
+    Record previous{};
+    Record current{};
+    bool first = true;
+    while (input.next(current)) {
+      if (!first && RecordLess<Record>()(current, previous)) {
+        return false;
+      }
+      previous = current;
+      first = false;
+    }
+    return true;
+  }
+};
+
+#endif  // MONOLITH_RECORD_SORT_HPP
@@ -0,0 +1,39 @@
+#include "record_types.hpp"
+
+#include <array>
+#include <utility>
+
+namespace {
+
+const std::array<std::pair<const char*, RecordType>, 9> RecordTypeNames{{
+    {"u32", RecordType::U32},
+    {"u64", RecordType::U64},
+    {"i32", RecordType::I32},
+    {"i64", RecordType::I64},
+    {"f32", RecordType::F32},
+    {"f64", RecordType::F64},
+    {"kv64", RecordType::KeyPayload},
+    {"gray100", RecordType::Gray100},
+    {"lines", RecordType::Lines},
+}};
+
+}  // namespace
+
+bool ParseRecordType(const std::string& name, RecordType& type) {
+  for (const auto& [type_name, record_type]: RecordTypeNames) {
+    if (name == type_name) {
+      type = record_type;
+      return true;
+    }
+  }
+  return false;
+}
+
+const char* RecordTypeName(RecordType type) {
+  for (const auto& [type_name, record_type]: RecordTypeNames) {
+    if (record_type == type) {
+      return type_name;
+    }
+  }
+  return "u32";
+}
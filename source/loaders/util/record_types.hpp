@@ -0,0 +1,180 @@
+#ifndef MONOLITH_RECORD_TYPES_HPP
+#define MONOLITH_RECORD_TYPES_HPP
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+// Layout of the records of an input file, chosen with --type
+enum class RecordType {
+  U32,
+  U64,
+  I32,
+  I64,
+  F32,
+  F64,
+  // KeyPayloadRecord: a uint64_t key followed by a uint64_t payload
+  KeyPayload,
+  // GrayRecord: 100 B records of a 10 B key and a 90 B value
+  Gray100,
+  // Newline-delimited text lines of any length, sorted by LineSorter instead of RecordSorter
+  Lines,
+};
+
+// Record sorted by its key, the payload travels along with it
+struct KeyPayloadRecord {
+  uint64_t key;
+  uint64_t payload;
+
+  bool operator==(const KeyPayloadRecord&) const = default;
+};
+
+static_assert(sizeof(KeyPayloadRecord) == 2 * sizeof(uint64_t), "Records must be packed");
+
+const size_t GrayKeyBytes = 10;
+const size_t GrayValueBytes = 90;
+
+// Record of the GraySort benchmark format, ordered by its key bytes compared as unsigned bytes
+struct GrayRecord {
+  uint8_t key[GrayKeyBytes];
+  uint8_t value[GrayValueBytes];
+
+  bool operator==(const GrayRecord&) const = default;
+};
+
+static_assert(sizeof(GrayRecord) == GrayKeyBytes + GrayValueBytes, "Records must be packed");
+
+// Records larger than this are sorted as arrays of (key, index) pairs and only moved once, when
+// they are written in sorted order
+const size_t KeyCacheMinRecordBytes = 32;
+
+// Key extraction of a record type. The key is an unsigned integer whose natural order is the
+// order of the records, so most record types compare with a single unsigned comparison. Where
+// RecordKeyIsPrefix is set, the key orders the records only up to ties.
+template <typename Record>
+struct RecordTraits;
+
+template <typename Record>
+  requires std::is_unsigned_v<Record>
+struct RecordTraits<Record> {
+  using Key = Record;
+
+  static Key key(Record record) {
+    return record;
+  }
+};
+
+// Two's complement integers order as unsigned ones once their sign bit is flipped
+template <typename Record>
+  requires(std::is_integral_v<Record> && std::is_signed_v<Record>)
+struct RecordTraits<Record> {
+  using Key = std::make_unsigned_t<Record>;
+
+  static Key key(Record record) {
+    return static_cast<Key>(record) ^ (Key{1} << (8 * sizeof(Key) - 1));
+  }
+};
+
+// IEEE floats order as unsigned integers once negative values have all their bits flipped and
+// positive values their sign bit. NaNs land beyond the infinities of their sign, -0 right below +0.
+template <typename Record>
+  requires std::is_floating_point_v<Record>
+struct RecordTraits<Record> {
+  using Key = std::conditional_t<sizeof(Record) == sizeof(uint32_t), uint32_t, uint64_t>;
+
+  static Key key(Record record) {
+    Key const bits = std::bit_cast<Key>(record);
+    Key const sign = Key{1} << (8 * sizeof(Key) - 1);
+    return (bits & sign) != 0 ? ~bits : bits | sign;
+  }
+};
+
+template <>
+struct RecordTraits<KeyPayloadRecord> {
+  using Key = uint64_t;
+
+  static Key key(const KeyPayloadRecord& record) {
+    return record.key;
+  }
+};
+
+// The key of a GrayRecord is the big-endian prefix of its first 8 key bytes, equal prefixes are
+// decided by the whole key
+template <>
+struct RecordTraits<GrayRecord> {
+  using Key = uint64_t;
+
+  static Key key(const GrayRecord& record) {
+    Key prefix = 0;
+    for (size_t i = 0; i < sizeof(Key); ++i) {
+      prefix = prefix << 8 | record.key[i];
+    }
+    return prefix;
+  }
+};
+
+// Whether RecordTraits<Record>::key is only a prefix of the sort key
+template <typename Record>
+constexpr bool RecordKeyIsPrefix = false;
+
+template <>
+constexpr bool RecordKeyIsPrefix<GrayRecord> = true;
+
+// Comparator of the sorts and merges of a record type
+template <typename Record>
+struct RecordLess {
+  bool operator()(const Record& left, const Record& right) const {
+    return RecordTraits<Record>::key(left) < RecordTraits<Record>::key(right);
+  }
+};
+
+template <>
+struct RecordLess<GrayRecord> {
+  bool operator()(const GrayRecord& left, const GrayRecord& right) const {
+    return std::memcmp(left.key, right.key, GrayKeyBytes) < 0;
+  }
+};
+
+// Cached key of a record with the record it belongs to, the unit of the key-cached sorts and merges
+// of large records: comparisons look at the cached key and only touch the record on a tie of a
+// prefix key
+template <typename Record, typename Position>
+struct CachedKey {
+  typename RecordTraits<Record>::Key key;
+  Position position;
+};
+
+// Call `function` with a value-initialized record of the type `type` names, which instantiates
+// the function for every fixed-size record type
+template <typename Function>
+decltype(auto) DispatchRecordType(RecordType type, Function&& function) {
+  switch (type) {
+    case RecordType::U64:
+      return function(uint64_t{});
+    case RecordType::I32:
+      return function(int32_t{});
+    case RecordType::I64:
+      return function(int64_t{});
+    case RecordType::F32:
+      return function(float{});
+    case RecordType::F64:
+      return function(double{});
+    case RecordType::KeyPayload:
+      return function(KeyPayloadRecord{});
+    case RecordType::Gray100:
+      return function(GrayRecord{});
+    case RecordType::U32:
+    default:
+      return function(uint32_t{});
+  }
+}
+
+// Parse the name of a --type value, returns false on an unknown name
+bool ParseRecordType(const std::string& name, RecordType& type);
+
+const char* RecordTypeName(RecordType type);
+
+#endif  // MONOLITH_RECORD_TYPES_HPP
@@ -0,0 +1,109 @@
+#include "run_codec.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+namespace {
+
+const size_t ValuesPerLane = RunCodecBlockValues / RunCodecLanes;
+const unsigned BitsInWord = 32;
+
+struct BlockHeader {
+  uint32_t first;
+  uint16_t count;
+  uint8_t bit_width;
+  uint8_t reserved;
+};
+
+static_assert(sizeof(BlockHeader) == RunCodecHeaderBytes);
+
+// A header of a truncated or corrupt run may claim more than a block can hold
+bool IsValidHeader(const BlockHeader& header) {
+  return header.bit_width <= BitsInWord && header.count <= RunCodecBlockValues;
+}
+
+}  // namespace
+
+size_t EncodeRunBlock(const uint32_t* values, size_t count, uint8_t* destination) {
+  count = std::min(count, RunCodecBlockValues);
+  uint32_t deltas[RunCodecBlockValues] = {};
+  uint32_t max_delta = 0;
+  for (size_t i = 1; i < count; ++i) {
+    deltas[i] = values[i] - values[i - 1];
+    max_delta |= deltas[i];
+  }
+
+  BlockHeader const header{
+      count > 0 ? values[0] : 0,
+      static_cast<uint16_t>(count),
+      static_cast<uint8_t>(std::bit_width(max_delta)),
+      0
+  };
+  std::memcpy(destination, &header, sizeof(header));
+
+  // Lane l holds the deltas l, l + 4, l + 8, ... packed back to back into its words, and word w
+  // of every lane is stored at packed[w * RunCodecLanes + l]
+  unsigned const bit_width = header.bit_width;
+  size_t const packed_words = bit_width * RunCodecLanes;
+  uint32_t packed[RunCodecBlockValues] = {};
+  for (size_t k = 0; k < ValuesPerLane; ++k) {
+    size_t const bit = k * bit_width;
+    size_t const word = bit / BitsInWord;
+    unsigned const shift = bit % BitsInWord;
+    for (size_t lane = 0; lane < RunCodecLanes; ++lane) {
+      uint64_t const value = static_cast<uint64_t>(deltas[k * RunCodecLanes + lane]) << shift;
+      packed[word * RunCodecLanes + lane] |= static_cast<uint32_t>(value);
+      if (shift + bit_width > BitsInWord) {
+        packed[(word + 1) * RunCodecLanes + lane] |= static_cast<uint32_t>(value >> BitsInWord);
+      }
+    }
+  }
+  std::memcpy(destination + sizeof(header), packed, packed_words * sizeof(uint32_t));
+  return sizeof(header) + packed_words * sizeof(uint32_t);
+}
+
+size_t EncodedBlockBytes(const uint8_t* source, size_t available) {
+  if (available < sizeof(BlockHeader)) {
+    return 0;
+  }
+  BlockHeader header{};
+  std::memcpy(&header, source, sizeof(header));
+  if (!IsValidHeader(header)) {
+    return 0;
+  }
+  return sizeof(header) + static_cast<size_t>(header.bit_width) * RunCodecLanes * sizeof(uint32_t);
+}
+
+size_t DecodeRunBlock(const uint8_t* source, uint32_t* values) {
+  BlockHeader header{};
+  std::memcpy(&header, source, sizeof(header));
+  if (!IsValidHeader(header)) {
+    return 0;
+  }
+  unsigned const bit_width = header.bit_width;
+  uint32_t packed[RunCodecBlockValues + RunCodecLanes] = {};
+  std::memcpy(packed, source + sizeof(header), bit_width * RunCodecLanes * sizeof(uint32_t));
+
+  uint64_t const mask = (uint64_t{1} << bit_width) - 1;
+  uint32_t deltas[RunCodecBlockValues];
+  for (size_t k = 0; k < ValuesPerLane; ++k) {
+    size_t const bit = k * bit_width;
+    size_t const word = bit / BitsInWord;
+    unsigned const shift = bit % BitsInWord;
+    // Same word and shift in every lane: the lane loop is one vector shift-or-mask
+    for (size_t lane = 0; lane < RunCodecLanes; ++lane) {
+      uint64_t const pair = packed[word * RunCodecLanes + lane] |
+                            static_cast<uint64_t>(packed[(word + 1) * RunCodecLanes + lane]) << BitsInWord;
+      deltas[k * RunCodecLanes + lane] = static_cast<uint32_t>((pair >> shift) & mask);
+    }
+  }
+
+  size_t const count = header.count;
+  uint32_t value = header.first;
+  for (size_t i = 0; i < count; ++i) {
+    value += deltas[i];
+    values[i] = value;
+  }
+  return count;
+}
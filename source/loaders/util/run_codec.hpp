@@ -0,0 +1,37 @@
+#ifndef MONOLITH_RUN_CODEC_HPP
+#define MONOLITH_RUN_CODEC_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+// On-disk layout of a sorted run
+enum class RunFormat {
+  // Plain uint32_t values
+  Raw,
+  // Blocks of delta-encoded, bit-packed values, see EncodeRunBlock
+  Compressed,
+};
+
+// Values per compressed block. The deltas are packed in 4 interleaved lanes of 32 values each, so
+// the unpacking loop works on 4 adjacent words at a time and vectorizes to SSE/NEON.
+const size_t RunCodecBlockValues = 128;
+const size_t RunCodecLanes = 4;
+
+// Block header: first value, number of values, bit width of the deltas
+const size_t RunCodecHeaderBytes = 8;
+
+const size_t MaxEncodedBlockBytes = RunCodecHeaderBytes + RunCodecBlockValues * sizeof(uint32_t);
+
+// Encode up to RunCodecBlockValues sorted values into `destination`, which must hold
+// MaxEncodedBlockBytes, returns the bytes written
+size_t EncodeRunBlock(const uint32_t* values, size_t count, uint8_t* destination);
+
+// Bytes of the block starting at `source`, 0 if fewer than RunCodecHeaderBytes are available or
+// the header is corrupt (a bit width beyond 32 or more than RunCodecBlockValues values)
+size_t EncodedBlockBytes(const uint8_t* source, size_t available);
+
+// Decode one complete block into `values` (room for RunCodecBlockValues), returns its value count
+// or 0 for a corrupt header
+size_t DecodeRunBlock(const uint8_t* source, uint32_t* values);
+
+#endif  // MONOLITH_RUN_CODEC_HPP
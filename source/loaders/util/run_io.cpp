@@ -0,0 +1,298 @@
+#include "run_io.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+size_t ElementsInBuffer(size_t buffer_size_bytes) {
+  return std::max<size_t>(1, buffer_size_bytes / sizeof(uint32_t));
+}
+
+// Compressed runs are encoded and decoded a whole number of blocks at a time
+size_t ElementsInBuffer(size_t buffer_size_bytes, RunFormat format) {
+  size_t const elements = ElementsInBuffer(buffer_size_bytes);
+  if (format == RunFormat::Raw) {
+    return elements;
+  }
+  return (elements + RunCodecBlockValues - 1) / RunCodecBlockValues * RunCodecBlockValues;
+}
+
+double MegabytesPerSecond(size_t bytes, std::chrono::nanoseconds time) {
+  if (time.count() == 0) {
+    return 0.0;
+  }
+  const double seconds = std::chrono::duration<double>(time).count();
+  return static_cast<double>(bytes) / (1024.0 * 1024.0) / seconds;
+}
+
+}  // namespace
+
+void RunChecksum::update(const uint32_t* values, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    sum_ += values[i];
+    weighted_sum_ += sum_;
+  }
+}
+
+uint64_t RunChecksum::value() const {
+  const uint64_t mix = 0x9E3779B97F4A7C15ULL;
+  return weighted_sum_ * mix ^ sum_;
+}
+
+RunReader::RunReader(const std::string& filename, size_t buffer_size_bytes, RunFormat format)
+    : file_(filename, std::ios::binary)
+    , buffer_(ElementsInBuffer(buffer_size_bytes, format))
+    , format_(format) {
+  if (format_ == RunFormat::Compressed) {
+    encoded_.resize(std::max(buffer_size_bytes, MaxEncodedBlockBytes));
+  }
+}
+
+RunReader::RunReader(
+    const std::string& filename,
+    size_t buffer_size_bytes,
+    size_t first_element,
+    size_t element_count
+)
+    : RunReader(filename, buffer_size_bytes) {
+  remaining_ = element_count;
+  // A pipe cannot seek, not even to where it already is
+  if (first_element > 0) {
+    file_.seekg(static_cast<std::streamoff>(first_element * sizeof(uint32_t)), std::ios::beg);
+  }
+}
+
+bool RunReader::refill() {
+  if (format_ == RunFormat::Compressed) {
+    return file_.is_open() && !failed_ && refillCompressed();
+  }
+  if (eof_ || !file_.is_open()) {
+    return false;
+  }
+  const size_t elements_to_read = std::min(buffer_.size(), remaining_);
+  auto t_start = std::chrono::steady_clock::now();
+  file_.read(
+      reinterpret_cast<char*>(buffer_.data()),
+      static_cast<std::streamsize>(elements_to_read * sizeof(uint32_t))
+  );
+  const auto bytes_read = static_cast<size_t>(file_.gcount());
+  stats_.time += std::chrono::steady_clock::now() - t_start;
+  stats_.bytes += bytes_read;
+  stats_.raw_bytes += bytes_read;
+
+  position_ = 0;
+  size_ = bytes_read / sizeof(uint32_t);
+  remaining_ -= size_;
+  if (!file_ || remaining_ == 0) {
+    eof_ = true;
+  }
+  return size_ > 0;
+}
+
+// Decode as many whole blocks as the value buffer holds, topping up the encoded bytes from the file
+bool RunReader::refillCompressed() {
+  position_ = 0;
+  size_ = 0;
+  while (size_ + RunCodecBlockValues <= buffer_.size()) {
+    const size_t available = encoded_size_ - encoded_position_;
+    const size_t block_bytes = EncodedBlockBytes(encoded_.data() + encoded_position_, available);
+    // A whole header that does not parse will not parse with more bytes behind it either
+    if (block_bytes == 0 && available >= RunCodecHeaderBytes) {
+      failed_ = true;
+      break;
+    }
+    if (block_bytes == 0 || block_bytes > available) {
+      if (eof_) {
+        // Bytes left over at the end of the file are the start of a block that was cut off
+        failed_ = available > 0;
+        break;
+      }
+      std::memmove(encoded_.data(), encoded_.data() + encoded_position_, available);
+      encoded_position_ = 0;
+      auto t_start = std::chrono::steady_clock::now();
+      file_.read(
+          reinterpret_cast<char*>(encoded_.data() + available),
+          static_cast<std::streamsize>(encoded_.size() - available)
+      );
+      const auto bytes_read = static_cast<size_t>(file_.gcount());
+      stats_.time += std::chrono::steady_clock::now() - t_start;
+      stats_.bytes += bytes_read;
+      encoded_size_ = available + bytes_read;
+      if (!file_ || bytes_read == 0) {
+        eof_ = true;
+      }
+      continue;
+    }
+    size_ += DecodeRunBlock(encoded_.data() + encoded_position_, buffer_.data() + size_);
+    encoded_position_ += block_bytes;
+  }
+  stats_.raw_bytes += size_ * sizeof(uint32_t);
+  return size_ > 0;
+}
+
+size_t RunReader::readBlock(uint32_t* destination, size_t count) {
+  if (format_ == RunFormat::Compressed) {
+    size_t copied = 0;
+    while (copied < count && (position_ < size_ || refill())) {
+      const size_t chunk = std::min(count - copied, size_ - position_);
+      std::copy_n(
+          buffer_.begin() + static_cast<std::ptrdiff_t>(position_), chunk, destination + copied
+      );
+      position_ += chunk;
+      copied += chunk;
+    }
+    return copied;
+  }
+
+  // Drain whatever is still buffered before going to the file
+  size_t copied = std::min(count, size_ - position_);
+  std::copy_n(buffer_.begin() + static_cast<std::ptrdiff_t>(position_), copied, destination);
+  position_ += copied;
+  if (copied == count || eof_ || !file_.is_open()) {
+    return copied;
+  }
+
+  const size_t elements_to_read = std::min(count - copied, remaining_);
+  auto t_start = std::chrono::steady_clock::now();
+  file_.read(
+      reinterpret_cast<char*>(destination + copied),
+      static_cast<std::streamsize>(elements_to_read * sizeof(uint32_t))
+  );
+  const auto bytes_read = static_cast<size_t>(file_.gcount());
+  stats_.time += std::chrono::steady_clock::now() - t_start;
+  stats_.bytes += bytes_read;
+  stats_.raw_bytes += bytes_read;
+  remaining_ -= bytes_read / sizeof(uint32_t);
+  if (!file_ || remaining_ == 0) {
+    eof_ = true;
+  }
+  return copied + bytes_read / sizeof(uint32_t);
+}
+
+void RunReader::close() {
+  file_.close();
+  buffer_.clear();
+  buffer_.shrink_to_fit();
+  encoded_.clear();
+  encoded_.shrink_to_fit();
+  position_ = 0;
+  size_ = 0;
+}
+
+RunWriter::RunWriter(const std::string& filename, size_t buffer_size_bytes, RunFormat format)
+    : buffer_(ElementsInBuffer(buffer_size_bytes, format))
+    , format_(format) {
+  // The writer buffers the values itself, an unbuffered stream fails on the write that failed
+  file_.rdbuf()->pubsetbuf(nullptr, 0);
+  file_.open(filename, std::ios::binary);
+  if (format_ == RunFormat::Compressed) {
+    encoded_.resize(buffer_.size() / RunCodecBlockValues * MaxEncodedBlockBytes);
+  }
+}
+
+RunWriter::RunWriter(const std::string& filename, size_t buffer_size_bytes, size_t first_element)
+    : buffer_(ElementsInBuffer(buffer_size_bytes)) {
+  file_.rdbuf()->pubsetbuf(nullptr, 0);
+  file_.open(filename, std::ios::binary | std::ios::in | std::ios::out);
+  file_.seekp(static_cast<std::streamoff>(first_element * sizeof(uint32_t)), std::ios::beg);
+}
+
+RunWriter::~RunWriter() {
+  close();
+}
+
+void RunWriter::write(const char* data, size_t bytes, size_t raw_bytes) {
+  auto t_start = std::chrono::steady_clock::now();
+  file_.write(data, static_cast<std::streamsize>(bytes));
+  stats_.time += std::chrono::steady_clock::now() - t_start;
+  // Bytes that did not reach the file do not count, the run is reported by failed()
+  if (file_) {
+    stats_.bytes += bytes;
+    stats_.raw_bytes += raw_bytes;
+  }
+}
+
+void RunWriter::writeBlock(const uint32_t* source, size_t count) {
+  if (size_ + count <= buffer_.size()) {
+    std::copy_n(source, count, buffer_.begin() + static_cast<std::ptrdiff_t>(size_));
+    size_ += count;
+    return;
+  }
+  if (format_ == RunFormat::Compressed) {
+    // Every value has to go through the encoder, fill and flush the buffer
+    while (count > 0) {
+      const size_t chunk = std::min(count, buffer_.size() - size_);
+      std::copy_n(source, chunk, buffer_.begin() + static_cast<std::ptrdiff_t>(size_));
+      size_ += chunk;
+      source += chunk;
+      count -= chunk;
+      if (size_ == buffer_.size()) {
+        flush();
+      }
+    }
+    return;
+  }
+  flush();
+  checksum_.update(source, count);
+  write(reinterpret_cast<const char*>(source), count * sizeof(uint32_t), count * sizeof(uint32_t));
+}
+
+void RunWriter::flush() {
+  if (size_ == 0 || !file_.is_open()) {
+    return;
+  }
+  checksum_.update(buffer_.data(), size_);
+  if (format_ == RunFormat::Compressed) {
+    size_t encoded_bytes = 0;
+    for (size_t first = 0; first < size_; first += RunCodecBlockValues) {
+      encoded_bytes += EncodeRunBlock(
+          buffer_.data() + first,
+          std::min(RunCodecBlockValues, size_ - first),
+          encoded_.data() + encoded_bytes
+      );
+    }
+    write(reinterpret_cast<const char*>(encoded_.data()), encoded_bytes, size_ * sizeof(uint32_t));
+  } else {
+    write(
+        reinterpret_cast<const char*>(buffer_.data()),
+        size_ * sizeof(uint32_t),
+        size_ * sizeof(uint32_t)
+    );
+  }
+  size_ = 0;
+}
+
+void RunWriter::close() {
+  if (!file_.is_open()) {
+    return;
+  }
+  flush();
+  file_.close();
+}
+
+void PrintPhaseThroughput(
+    const std::string& tag,
+    const std::string& phase,
+    const IoStats& read_stats,
+    const IoStats& write_stats,
+    std::chrono::nanoseconds wall_time
+) {
+  std::cout << tag << ": " << phase << " read " << read_stats.bytes << " B in "
+            << read_stats.time.count() << " ns ("
+            << MegabytesPerSecond(read_stats.bytes, read_stats.time) << " MB/s), wrote "
+            << write_stats.bytes << " B in " << write_stats.time.count() << " ns ("
+            << MegabytesPerSecond(write_stats.bytes, write_stats.time) << " MB/s), overall "
+            << MegabytesPerSecond(read_stats.bytes + write_stats.bytes, wall_time) << " MB/s"
+            << '\n';
+}
+
+void PrintCompressionRatio(const std::string& tag, const std::string& phase, const IoStats& stats) {
+  if (stats.bytes == 0) {
+    return;
+  }
+  std::cout << tag << ": " << phase << " compressed " << stats.raw_bytes << " B of runs into "
+            << stats.bytes << " B, ratio "
+            << static_cast<double>(stats.raw_bytes) / static_cast<double>(stats.bytes) << '\n';
+}
@@ -0,0 +1,181 @@
+#ifndef MONOLITH_RUN_IO_HPP
+#define MONOLITH_RUN_IO_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "run_codec.hpp"
+
+// Default per-run buffer used by the external sorter when reading and writing runs
+const size_t DefaultRunBufferBytes = static_cast<size_t>(1024 * 1024);
+
+// Smallest per-run buffer worth splitting the run buffer down to
+const size_t MinRunBufferBytes = static_cast<size_t>(64 * 1024);
+
+// Byte and time counters of a single reader or writer
+struct IoStats {
+  size_t bytes = 0;
+  std::chrono::nanoseconds time{0};
+  // Size of the values behind `bytes` before compression, kept by the run readers and writers
+  size_t raw_bytes = 0;
+
+  IoStats& operator+=(const IoStats& other) {
+    bytes += other.bytes;
+    time += other.time;
+    raw_bytes += other.raw_bytes;
+    return *this;
+  }
+};
+
+// Order-sensitive Fletcher-style checksum of the values of a run, fed block by block
+class RunChecksum {
+private:
+  uint64_t sum_ = 0;
+  uint64_t weighted_sum_ = 0;
+
+public:
+  void update(const uint32_t* values, size_t count);
+
+  uint64_t value() const;
+};
+
+// Sequential reader of a binary uint32_t file that refills its buffer in large blocks
+class RunReader {
+private:
+  std::ifstream file_;
+  std::vector<uint32_t> buffer_;
+  size_t position_ = 0;
+  size_t size_ = 0;
+  bool eof_ = false;
+  // Values of the file range not read into the buffer yet
+  size_t remaining_ = std::numeric_limits<size_t>::max();
+  RunFormat format_ = RunFormat::Raw;
+  // Compressed blocks read from the file and not decoded yet
+  std::vector<uint8_t> encoded_;
+  size_t encoded_position_ = 0;
+  size_t encoded_size_ = 0;
+  bool failed_ = false;
+  IoStats stats_;
+
+  bool refill();
+
+  bool refillCompressed();
+
+public:
+  RunReader(
+      const std::string& filename, size_t buffer_size_bytes, RunFormat format = RunFormat::Raw
+  );
+
+  // Read only the `element_count` values starting at value `first_element` of a raw run
+  RunReader(
+      const std::string& filename,
+      size_t buffer_size_bytes,
+      size_t first_element,
+      size_t element_count
+  );
+
+  bool isOpen() const {
+    return file_.is_open();
+  }
+
+  // Whether the run ended in a corrupt or truncated compressed block instead of a clean end
+  bool failed() const {
+    return failed_;
+  }
+
+  // Read the next value, returns false once the run is exhausted
+  bool next(uint32_t& value) {
+    if (position_ == size_ && !refill()) {
+      return false;
+    }
+    value = buffer_[position_++];
+    return true;
+  }
+
+  // Read up to `count` values directly into `destination`, returns the number of values read
+  size_t readBlock(uint32_t* destination, size_t count);
+
+  void close();
+
+  const IoStats& stats() const {
+    return stats_;
+  }
+};
+
+// Sequential writer of a binary uint32_t file that flushes its buffer in large blocks
+class RunWriter {
+private:
+  std::ofstream file_;
+  std::vector<uint32_t> buffer_;
+  size_t size_ = 0;
+  RunFormat format_ = RunFormat::Raw;
+  std::vector<uint8_t> encoded_;
+  RunChecksum checksum_;
+  IoStats stats_;
+
+  void write(const char* data, size_t bytes, size_t raw_bytes);
+
+public:
+  RunWriter(
+      const std::string& filename, size_t buffer_size_bytes, RunFormat format = RunFormat::Raw
+  );
+
+  // Overwrite an existing raw file starting at value `first_element` instead of truncating it
+  RunWriter(const std::string& filename, size_t buffer_size_bytes, size_t first_element);
+
+  ~RunWriter();
+
+  RunWriter(const RunWriter&) = delete;
+  RunWriter& operator=(const RunWriter&) = delete;
+
+  bool isOpen() const {
+    return file_.is_open();
+  }
+
+  // Whether a write or the close failed, for example on a full disk
+  bool failed() const {
+    return file_.fail();
+  }
+
+  void put(uint32_t value) {
+    buffer_[size_++] = value;
+    if (size_ == buffer_.size()) {
+      flush();
+    }
+  }
+
+  // Write `count` values, bypassing the buffer of a raw run once it is drained
+  void writeBlock(const uint32_t* source, size_t count);
+
+  void flush();
+
+  void close();
+
+  const IoStats& stats() const {
+    return stats_;
+  }
+
+  // Checksum of the values written so far
+  uint64_t checksum() const {
+    return checksum_.value();
+  }
+};
+
+// Print bytes moved and throughput of a sorter phase
+void PrintPhaseThroughput(
+    const std::string& tag,
+    const std::string& phase,
+    const IoStats& read_stats,
+    const IoStats& write_stats,
+    std::chrono::nanoseconds wall_time
+);
+
+// Print how much smaller the compressed runs written in a phase are than their values
+void PrintCompressionRatio(const std::string& tag, const std::string& phase, const IoStats& stats);
+
+#endif  // MONOLITH_RUN_IO_HPP
@@ -0,0 +1,152 @@
+#include "run_manifest.hpp"
+
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+
+#include "run_io.hpp"
+
+namespace {
+
+const char* const ManifestMagic = "ema-sort-int-manifest";
+const int ManifestVersion = 1;
+
+std::string FormatRecord(const RunRecord& record) {
+  return std::to_string(record.first_element) + " " + std::to_string(record.count) + " " +
+         std::to_string(record.checksum);
+}
+
+bool ParseRecord(std::istringstream& fields, RunRecord& record) {
+  record.reused = true;
+  return static_cast<bool>(fields >> record.first_element >> record.count >> record.checksum);
+}
+
+}  // namespace
+
+RunManifest::RunManifest(std::string filename, std::string config)
+    : filename_(std::move(filename))
+    , config_(std::move(config)) {}
+
+void RunManifest::append(const std::string& line) {
+  file_ << line << '\n' << std::flush;
+}
+
+bool RunManifest::load() {
+  std::ifstream file(filename_);
+  std::string line;
+  if (!std::getline(file, line) ||
+      line != std::string(ManifestMagic) + " " + std::to_string(ManifestVersion) ||
+      !std::getline(file, line) || line != "config " + config_) {
+    return false;
+  }
+
+  // A line cut short by a kill fails to parse and ends the manifest
+  while (std::getline(file, line)) {
+    std::istringstream fields(line);
+    std::string kind;
+    fields >> kind;
+    RunRecord record;
+    if (kind == "spill") {
+      spill_weights_.clear();
+      for (uint64_t weight = 0; fields >> weight;) {
+        spill_weights_.push_back(weight);
+      }
+      if (spill_weights_.empty()) {
+        break;
+      }
+    } else if (kind == "run" && ParseRecord(fields, record)) {
+      runs_.push_back(record);
+    } else if (kind == "runs" && fields >> num_runs_) {
+      continue;
+    } else if (kind == "plan" && fields >> fan_in_) {
+      continue;
+    } else if (kind == "merged") {
+      size_t pass = 0;
+      size_t group = 0;
+      if (!(fields >> pass >> group) || !ParseRecord(fields, record)) {
+        break;
+      }
+      merged_runs_[{pass, group}] = record;
+    } else {
+      break;
+    }
+  }
+  file.close();
+
+  file_.open(filename_, std::ios::app);
+  return file_.is_open();
+}
+
+void RunManifest::start() {
+  spill_weights_.clear();
+  runs_.clear();
+  num_runs_ = 0;
+  fan_in_ = 0;
+  merged_runs_.clear();
+  file_.close();
+  file_.open(filename_, std::ios::trunc);
+  if (!file_) {
+    std::cerr << "Failed to open run manifest for writing: " << filename_ << '\n';
+    return;
+  }
+  append(std::string(ManifestMagic) + " " + std::to_string(ManifestVersion));
+  append("config " + config_);
+}
+
+void RunManifest::recordSpillWeights(const std::vector<uint64_t>& weights) {
+  spill_weights_ = weights;
+  std::string line = "spill";
+  for (uint64_t const weight: weights) {
+    line += ' ';
+    line += std::to_string(weight);
+  }
+  append(line);
+}
+
+void RunManifest::recordRun(const RunRecord& record) {
+  runs_.push_back(record);
+  append("run " + FormatRecord(record));
+}
+
+void RunManifest::recordRunsComplete(size_t num_runs) {
+  num_runs_ = num_runs;
+  append("runs " + std::to_string(num_runs));
+}
+
+void RunManifest::recordMergePlan(size_t fan_in) {
+  fan_in_ = fan_in;
+  append("plan " + std::to_string(fan_in));
+}
+
+void RunManifest::recordMergedRun(size_t pass, size_t group, const RunRecord& record) {
+  merged_runs_[{pass, group}] = record;
+  append(
+      "merged " + std::to_string(pass) + " " + std::to_string(group) + " " + FormatRecord(record)
+  );
+}
+
+const RunRecord* RunManifest::mergedRun(size_t pass, size_t group) const {
+  auto found = merged_runs_.find({pass, group});
+  return found == merged_runs_.end() ? nullptr : &found->second;
+}
+
+void RunManifest::remove() {
+  file_.close();
+  (void) std::remove(filename_.c_str());
+}
+
+bool VerifyRunFile(const std::string& filename, RunFormat format, const RunRecord& record) {
+  RunReader reader(filename, DefaultRunBufferBytes, format);
+  if (!reader.isOpen()) {
+    return false;
+  }
+  std::vector<uint32_t> block(DefaultRunBufferBytes / sizeof(uint32_t));
+  RunChecksum checksum;
+  size_t count = 0;
+  for (size_t read = reader.readBlock(block.data(), block.size()); read > 0;
+       read = reader.readBlock(block.data(), block.size())) {
+    checksum.update(block.data(), read);
+    count += read;
+  }
+  return !reader.failed() && count == record.count && checksum.value() == record.checksum;
+}
@@ -0,0 +1,91 @@
+#ifndef MONOLITH_RUN_MANIFEST_HPP
+#define MONOLITH_RUN_MANIFEST_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "run_codec.hpp"
+
+// A completed run: where its values start in the input (run formation only), how many there are
+// and their RunChecksum
+struct RunRecord {
+  size_t first_element = 0;
+  size_t count = 0;
+  uint64_t checksum = 0;
+  // Recorded by an earlier attempt, so the run file has to be verified before it is reused
+  bool reused = false;
+};
+
+// Append-only log of the runs and merge passes an external sort has completed, kept next to the
+// runs so that a killed sort can continue where it stopped. Every line is flushed once written,
+// so a kill leaves a consistent prefix.
+class RunManifest {
+private:
+  std::string filename_;
+  // Input and settings the runs were made with, a resume needs an exact match
+  std::string config_;
+  std::ofstream file_;
+  // Weights the runs were striped over the spill directories with
+  std::vector<uint64_t> spill_weights_;
+  std::vector<RunRecord> runs_;
+  // Number of runs once run formation has completed, 0 before
+  size_t num_runs_ = 0;
+  size_t fan_in_ = 0;
+  // Output runs of the merge passes by (pass, group)
+  std::map<std::pair<size_t, size_t>, RunRecord> merged_runs_;
+
+  void append(const std::string& line);
+
+public:
+  RunManifest(std::string filename, std::string config);
+
+  // Load the manifest of an earlier attempt and continue it, false if there is none for config_
+  bool load();
+
+  // Discard any earlier manifest and start an empty one
+  void start();
+
+  void recordSpillWeights(const std::vector<uint64_t>& weights);
+
+  // Record a run, or below a merged run, once its writer closed it without a failure. A resume
+  // trusts every recorded run up to its VerifyRunFile check.
+  void recordRun(const RunRecord& record);
+
+  void recordRunsComplete(size_t num_runs);
+
+  void recordMergePlan(size_t fan_in);
+
+  void recordMergedRun(size_t pass, size_t group, const RunRecord& record);
+
+  const std::vector<uint64_t>& spillWeights() const {
+    return spill_weights_;
+  }
+
+  const std::vector<RunRecord>& runs() const {
+    return runs_;
+  }
+
+  size_t completedRuns() const {
+    return num_runs_;
+  }
+
+  size_t fanIn() const {
+    return fan_in_;
+  }
+
+  // The recorded output run `group` of merge pass `pass`, nullptr if it is not complete
+  const RunRecord* mergedRun(size_t pass, size_t group) const;
+
+  // Delete the manifest once the sort has completed
+  void remove();
+};
+
+// Check that the run file holds the values recorded in `record`
+bool VerifyRunFile(const std::string& filename, RunFormat format, const RunRecord& record);
+
+#endif  // MONOLITH_RUN_MANIFEST_HPP
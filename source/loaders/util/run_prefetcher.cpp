@@ -0,0 +1,152 @@
+#include "run_prefetcher.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+namespace {
+
+// Sleep of an I/O thread that found every queue full
+const std::chrono::microseconds IdleIoBackoff{20};
+
+}  // namespace
+
+PrefetchedRun::PrefetchedRun(size_t block_elements, size_t blocks_ahead)
+    : blocks_(blocks_ahead + 1)
+    , filled_(blocks_ahead + 1)
+    , free_(blocks_ahead + 1) {
+  for (auto& block : blocks_) {
+    block.data.resize(block_elements);
+    free_.tryPush(&block);
+  }
+}
+
+bool PrefetchedRun::advance(uint32_t& value) {
+  if (finished_) {
+    return false;
+  }
+  if (current_ != nullptr) {
+    free_.tryPush(current_);
+    current_ = nullptr;
+  }
+
+  PrefetchBlock* block = nullptr;
+  if (!filled_.tryPop(block)) {
+    auto t_stall = std::chrono::steady_clock::now();
+    while (!filled_.tryPop(block)) {
+      std::this_thread::yield();
+    }
+    stall_time_ += std::chrono::steady_clock::now() - t_stall;
+    ++stalls_;
+  }
+
+  if (block->size == 0) {
+    finished_ = true;
+    return false;
+  }
+  current_ = block;
+  value = current_->data[0];
+  position_ = 1;
+  return true;
+}
+
+RunPrefetcher::RunPrefetcher(
+    size_t num_runs,
+    size_t block_size_bytes,
+    size_t blocks_ahead,
+    size_t num_io_threads,
+    BlockReadFunction read_block,
+    const std::vector<size_t>& run_devices
+)
+    : read_block_(std::move(read_block)) {
+  size_t const block_elements = std::max<size_t>(1, block_size_bytes / sizeof(uint32_t));
+  for (size_t i = 0; i < num_runs; ++i) {
+    runs_.push_back(std::make_unique<PrefetchedRun>(block_elements, std::max<size_t>(1, blocks_ahead)));
+  }
+
+  // Every run is owned by exactly one I/O thread, which keeps its queues single-producer
+  if (run_devices.empty()) {
+    num_io_threads = std::clamp<size_t>(num_io_threads, 1, std::max<size_t>(1, num_runs));
+    thread_runs_.resize(num_io_threads);
+    for (size_t i = 0; i < num_runs; ++i) {
+      thread_runs_[i % num_io_threads].push_back(i);
+    }
+  } else {
+    size_t const num_devices = *std::max_element(run_devices.begin(), run_devices.end()) + 1;
+    size_t const threads_per_device = std::max<size_t>(1, num_io_threads / num_devices);
+    std::vector<size_t> device_runs(num_devices, 0);
+    thread_runs_.resize(num_devices * threads_per_device);
+    for (size_t i = 0; i < num_runs; ++i) {
+      size_t const device = run_devices[i];
+      thread_runs_[device + num_devices * (device_runs[device]++ % threads_per_device)].push_back(i);
+    }
+  }
+  io_stats_.resize(thread_runs_.size());
+  for (size_t t = 0; t < thread_runs_.size(); ++t) {
+    io_threads_.emplace_back(&RunPrefetcher::ioLoop, this, t);
+  }
+}
+
+RunPrefetcher::~RunPrefetcher() {
+  stop();
+}
+
+void RunPrefetcher::ioLoop(size_t thread_index) {
+  IoStats& stats = io_stats_[thread_index];
+  while (!stop_) {
+    bool active = false;
+    bool worked = false;
+    for (size_t const i : thread_runs_[thread_index]) {
+      PrefetchedRun& run = *runs_[i];
+      if (run.end_queued_) {
+        continue;
+      }
+      active = true;
+
+      PrefetchBlock* block = nullptr;
+      if (!run.free_.tryPop(block)) {
+        continue;
+      }
+      auto t_read = std::chrono::steady_clock::now();
+      block->size = read_block_(i, block->data.data(), block->data.size());
+      stats.time += std::chrono::steady_clock::now() - t_read;
+      stats.bytes += block->size * sizeof(uint32_t);
+
+      run.filled_.tryPush(block);
+      run.end_queued_ = block->size == 0;
+      worked = true;
+    }
+    if (!active) {
+      return;
+    }
+    if (!worked) {
+      std::this_thread::sleep_for(IdleIoBackoff);
+    }
+  }
+}
+
+void RunPrefetcher::stop() {
+  stop_ = true;
+  for (auto& io_thread : io_threads_) {
+    if (io_thread.joinable()) {
+      io_thread.join();
+    }
+  }
+}
+
+PrefetchStats RunPrefetcher::stats() const {
+  PrefetchStats stats;
+  for (const auto& run : runs_) {
+    stats.stalls += run->stalls_;
+    stats.stall_time += run->stall_time_;
+  }
+  for (const IoStats& io_stats : io_stats_) {
+    stats.io += io_stats;
+  }
+  return stats;
+}
+
+void PrintPrefetchStats(const std::string& tag, const PrefetchStats& stats) {
+  std::cout << tag << ": Prefetch read " << stats.io.bytes << " B in " << stats.io.time.count()
+            << " ns, merger stalled " << stats.stalls << " times for "
+            << stats.stall_time.count() << " ns waiting on I/O" << '\n';
+}
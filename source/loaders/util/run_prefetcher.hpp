@@ -0,0 +1,112 @@
+#ifndef MONOLITH_RUN_PREFETCHER_HPP
+#define MONOLITH_RUN_PREFETCHER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "run_io.hpp"
+#include "spsc_queue.hpp"
+
+// Block of values read ahead for one run, an empty block marks the end of the run
+struct PrefetchBlock {
+  std::vector<uint32_t> data;
+  size_t size = 0;
+};
+
+// Merge source whose blocks are read ahead by a background I/O thread. Filled blocks travel to
+// the merger and drained blocks travel back through a pair of lock-free SPSC queues.
+class PrefetchedRun {
+private:
+  friend class RunPrefetcher;
+
+  std::vector<PrefetchBlock> blocks_;
+  SpscQueue<PrefetchBlock*> filled_;
+  SpscQueue<PrefetchBlock*> free_;
+
+  // Merger side
+  PrefetchBlock* current_ = nullptr;
+  size_t position_ = 0;
+  bool finished_ = false;
+  size_t stalls_ = 0;
+  std::chrono::nanoseconds stall_time_{0};
+
+  // I/O thread side
+  bool end_queued_ = false;
+
+  bool advance(uint32_t& value);
+
+public:
+  PrefetchedRun(size_t block_elements, size_t blocks_ahead);
+
+  bool next(uint32_t& value) {
+    if (current_ != nullptr && position_ < current_->size) {
+      value = current_->data[position_++];
+      return true;
+    }
+    return advance(value);
+  }
+};
+
+// Counters of the merger waiting on the I/O threads
+struct PrefetchStats {
+  size_t stalls = 0;
+  std::chrono::nanoseconds stall_time{0};
+  IoStats io;
+};
+
+// Background I/O threads that keep `blocks_ahead` blocks read ahead for every run of a merge
+class RunPrefetcher {
+public:
+  // Reads up to `count` values of run `run_index`, only ever called from the owning I/O thread
+  using BlockReadFunction =
+      std::function<size_t(size_t run_index, uint32_t* destination, size_t count)>;
+
+private:
+  std::vector<std::unique_ptr<PrefetchedRun>> runs_;
+  BlockReadFunction read_block_;
+  // Runs served by every I/O thread
+  std::vector<std::vector<size_t>> thread_runs_;
+  std::vector<std::thread> io_threads_;
+  std::vector<IoStats> io_stats_;
+  std::atomic<bool> stop_ = false;
+
+  void ioLoop(size_t thread_index);
+
+public:
+  // With `run_devices`, the device every run is stored on, each I/O thread only serves the runs of
+  // one device and every device gets num_io_threads / devices of them, at least one
+  RunPrefetcher(
+      size_t num_runs,
+      size_t block_size_bytes,
+      size_t blocks_ahead,
+      size_t num_io_threads,
+      BlockReadFunction read_block,
+      const std::vector<size_t>& run_devices = {}
+  );
+
+  ~RunPrefetcher();
+
+  RunPrefetcher(const RunPrefetcher&) = delete;
+  RunPrefetcher& operator=(const RunPrefetcher&) = delete;
+
+  PrefetchedRun* run(size_t run_index) {
+    return runs_[run_index].get();
+  }
+
+  // Join the I/O threads, stats() is complete afterwards
+  void stop();
+
+  PrefetchStats stats() const;
+};
+
+// Print how often and how long the merger waited for prefetched blocks
+void PrintPrefetchStats(const std::string& tag, const PrefetchStats& stats);
+
+#endif  // MONOLITH_RUN_PREFETCHER_HPP
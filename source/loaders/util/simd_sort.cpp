@@ -0,0 +1,332 @@
+#include "simd_sort.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <utility>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define MONOLITH_SIMD_SORT_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// Comparator stages of the bitonic sort of one vector of `Width` lanes. A stage compares every
+// lane with lane `partner` and keeps the larger value on the lanes of `take_max`. The last
+// log2(Width) stages alone sort a bitonic vector.
+template <size_t Width>
+struct BitonicStages {
+  static constexpr size_t LogWidth = std::countr_zero(Width);
+  static constexpr size_t SortStages = LogWidth * (LogWidth + 1) / 2;
+  static constexpr size_t FirstMergeStage = SortStages - LogWidth;
+
+  std::array<std::array<uint32_t, Width>, SortStages> partner{};
+  // All ones on the lanes keeping the maximum, and the same lanes as a bit mask
+  std::array<std::array<uint32_t, Width>, SortStages> take_max{};
+  std::array<uint32_t, SortStages> max_mask{};
+  std::array<uint32_t, Width> reverse{};
+};
+
+template <size_t Width>
+constexpr BitonicStages<Width> MakeBitonicStages() {
+  BitonicStages<Width> stages;
+  size_t stage = 0;
+  for (size_t k = 2; k <= Width; k *= 2) {
+    for (size_t j = k / 2; j > 0; j /= 2) {
+      for (size_t lane = 0; lane < Width; ++lane) {
+        // Blocks of k lanes alternate between ascending and descending, the last one ascends
+        bool const upper = (lane & j) != 0;
+        bool const descending = (lane & k) != 0;
+        stages.partner[stage][lane] = static_cast<uint32_t>(lane ^ j);
+        if (upper != descending) {
+          stages.take_max[stage][lane] = 0xFFFFFFFFU;
+          stages.max_mask[stage] |= 1U << lane;
+        }
+      }
+      ++stage;
+    }
+  }
+  for (size_t lane = 0; lane < Width; ++lane) {
+    stages.reverse[lane] = static_cast<uint32_t>(Width - 1 - lane);
+  }
+  return stages;
+}
+
+// Vector sort and vectorized 2-way merge of one instruction set
+struct SimdKernels {
+  size_t width;
+  void (*sort_vectors)(uint32_t* data, size_t count);
+  // Both ranges hold at least one vector
+  void (*merge)(
+      const uint32_t* a, size_t a_count, const uint32_t* b, size_t b_count, uint32_t* out
+  );
+};
+
+// Merge the sorted runs of `run` values of `from` pairwise until one is left, returns the buffer
+// of `from` and `to` that holds the sorted values
+uint32_t* MergePasses(
+    const SimdKernels& kernels, uint32_t* from, uint32_t* to, size_t count, size_t run
+) {
+  for (; run < count; run *= 2) {
+    for (size_t begin = 0; begin < count; begin += 2 * run) {
+      size_t const middle = std::min(begin + run, count);
+      size_t const end = std::min(begin + 2 * run, count);
+      if (end - middle < kernels.width) {
+        // Only the last run may be shorter than a vector
+        std::merge(from + begin, from + middle, from + middle, from + end, to + begin);
+      } else {
+        kernels.merge(from + begin, middle - begin, from + middle, end - middle, to + begin);
+      }
+    }
+    std::swap(from, to);
+  }
+  return from;
+}
+
+void SortWithKernels(
+    const SimdKernels& kernels, uint32_t* data, size_t count, uint32_t* scratch
+) {
+  if (count < 2 * kernels.width) {
+    std::sort(data, data + count);
+    return;
+  }
+  size_t const vectors_end = count / kernels.width * kernels.width;
+  kernels.sort_vectors(data, vectors_end);
+  std::sort(data + vectors_end, data + count);
+
+  // Blocks within the cache first, then the passes over the whole data
+  for (size_t begin = 0; begin < count; begin += SimdSortBlockElements) {
+    size_t const size = std::min(SimdSortBlockElements, count - begin);
+    uint32_t* sorted = MergePasses(kernels, data + begin, scratch + begin, size, kernels.width);
+    if (sorted != data + begin) {
+      std::copy(sorted, sorted + size, data + begin);
+    }
+  }
+  uint32_t* sorted = MergePasses(kernels, data, scratch, count, SimdSortBlockElements);
+  if (sorted != data) {
+    std::copy(sorted, sorted + count, data);
+  }
+}
+
+// Finish a vectorized merge: `tail` holds the larger half of the last merged vectors, and at
+// least one of the rests of `a` and `b` is shorter than a vector
+void MergeTail(
+    const uint32_t* tail,
+    size_t width,
+    const uint32_t* a,
+    size_t a_count,
+    const uint32_t* b,
+    size_t b_count,
+    uint32_t* out
+) {
+  if (a_count > b_count) {
+    std::swap(a, b);
+    std::swap(a_count, b_count);
+  }
+  std::array<uint32_t, 64> merged{};
+  uint32_t* merged_end = std::merge(tail, tail + width, a, a + a_count, merged.data());
+  std::merge(merged.data(), merged_end, b, b + b_count, out);
+}
+
+#ifdef MONOLITH_SIMD_SORT_X86
+
+constexpr BitonicStages<8> Avx2Stages = MakeBitonicStages<8>();
+constexpr BitonicStages<16> Avx512Stages = MakeBitonicStages<16>();
+
+// The zero-masked forms over all lanes stand in for the plain ones, whose undefined pass-through
+// operand trips -Wuninitialized inside the headers of GCC 12
+const __mmask16 Avx512AllLanes = 0xFFFF;
+
+__attribute__((target("avx2"))) inline __m256i Avx2Lanes(const std::array<uint32_t, 8>& lanes) {
+  return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lanes.data()));
+}
+
+__attribute__((target("avx2"))) inline __m256i Avx2Stage(__m256i values, size_t stage) {
+  __m256i const partner =
+      _mm256_permutevar8x32_epi32(values, Avx2Lanes(Avx2Stages.partner[stage]));
+  return _mm256_blendv_epi8(
+      _mm256_min_epu32(values, partner),
+      _mm256_max_epu32(values, partner),
+      Avx2Lanes(Avx2Stages.take_max[stage])
+  );
+}
+
+// Merge the sorted vectors `low` and `high` into the lower and the upper half of their values
+__attribute__((target("avx2"))) inline void Avx2MergeVectors(__m256i& low, __m256i& high) {
+  __m256i const reversed = _mm256_permutevar8x32_epi32(high, Avx2Lanes(Avx2Stages.reverse));
+  high = _mm256_max_epu32(low, reversed);
+  low = _mm256_min_epu32(low, reversed);
+  for (size_t stage = Avx2Stages.FirstMergeStage; stage < Avx2Stages.SortStages; ++stage) {
+    low = Avx2Stage(low, stage);
+    high = Avx2Stage(high, stage);
+  }
+}
+
+__attribute__((target("avx2"))) void Avx2SortVectors(uint32_t* data, size_t count) {
+  for (size_t i = 0; i < count; i += 8) {
+    __m256i values = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+    for (size_t stage = 0; stage < Avx2Stages.SortStages; ++stage) {
+      values = Avx2Stage(values, stage);
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(data + i), values);
+  }
+}
+
+__attribute__((target("avx2"))) void Avx2Merge(
+    const uint32_t* a, size_t a_count, const uint32_t* b, size_t b_count, uint32_t* out
+) {
+  size_t const width = 8;
+  __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a));
+  __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b));
+  size_t a_next = width;
+  size_t b_next = width;
+  while (true) {
+    Avx2MergeVectors(low, high);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), low);
+    out += width;
+    // The next vector comes from the side with the smaller next value, whole vectors only
+    if (b_next == b_count || (a_next < a_count && a[a_next] <= b[b_next])) {
+      if (a_count - a_next < width) {
+        break;
+      }
+      low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + a_next));
+      a_next += width;
+    } else {
+      if (b_count - b_next < width) {
+        break;
+      }
+      low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + b_next));
+      b_next += width;
+    }
+  }
+  std::array<uint32_t, width> tail{};
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(tail.data()), high);
+  MergeTail(tail.data(), width, a + a_next, a_count - a_next, b + b_next, b_count - b_next, out);
+}
+
+__attribute__((target("avx512f"))) inline __m512i Avx512Lanes(
+    const std::array<uint32_t, 16>& lanes
+) {
+  return _mm512_loadu_si512(lanes.data());
+}
+
+__attribute__((target("avx512f"))) inline __m512i Avx512Stage(__m512i values, size_t stage) {
+  __m512i const partner = _mm512_maskz_permutexvar_epi32(
+      Avx512AllLanes, Avx512Lanes(Avx512Stages.partner[stage]), values
+  );
+  return _mm512_mask_blend_epi32(
+      static_cast<__mmask16>(Avx512Stages.max_mask[stage]),
+      _mm512_maskz_min_epu32(Avx512AllLanes, values, partner),
+      _mm512_maskz_max_epu32(Avx512AllLanes, values, partner)
+  );
+}
+
+__attribute__((target("avx512f"))) inline void Avx512MergeVectors(__m512i& low, __m512i& high) {
+  __m512i const reversed =
+      _mm512_maskz_permutexvar_epi32(Avx512AllLanes, Avx512Lanes(Avx512Stages.reverse), high);
+  high = _mm512_maskz_max_epu32(Avx512AllLanes, low, reversed);
+  low = _mm512_maskz_min_epu32(Avx512AllLanes, low, reversed);
+  for (size_t stage = Avx512Stages.FirstMergeStage; stage < Avx512Stages.SortStages; ++stage) {
+    low = Avx512Stage(low, stage);
+    high = Avx512Stage(high, stage);
+  }
+}
+
+__attribute__((target("avx512f"))) void Avx512SortVectors(uint32_t* data, size_t count) {
+  for (size_t i = 0; i < count; i += 16) {
+    __m512i values = _mm512_loadu_si512(data + i);
+    for (size_t stage = 0; stage < Avx512Stages.SortStages; ++stage) {
+      values = Avx512Stage(values, stage);
+    }
+    _mm512_storeu_si512(data + i, values);
+  }
+}
+
+__attribute__((target("avx512f"))) void Avx512Merge(
+    const uint32_t* a, size_t a_count, const uint32_t* b, size_t b_count, uint32_t* out
+) {
+  size_t const width = 16;
+  __m512i low = _mm512_loadu_si512(a);
+  __m512i high = _mm512_loadu_si512(b);
+  size_t a_next = width;
+  size_t b_next = width;
+  while (true) {
+    Avx512MergeVectors(low, high);
+    _mm512_storeu_si512(out, low);
+    out += width;
+    if (b_next == b_count || (a_next < a_count && a[a_next] <= b[b_next])) {
+      if (a_count - a_next < width) {
+        break;
+      }
+      low = _mm512_loadu_si512(a + a_next);
+      a_next += width;
+    } else {
+      if (b_count - b_next < width) {
+        break;
+      }
+      low = _mm512_loadu_si512(b + b_next);
+      b_next += width;
+    }
+  }
+  std::array<uint32_t, width> tail{};
+  _mm512_storeu_si512(tail.data(), high);
+  MergeTail(tail.data(), width, a + a_next, a_count - a_next, b + b_next, b_count - b_next, out);
+}
+
+#endif  // MONOLITH_SIMD_SORT_X86
+
+}  // namespace
+
+SimdIsa DetectSimdIsa() {
+#ifdef MONOLITH_SIMD_SORT_X86
+  static SimdIsa const isa = [] {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+      return SimdIsa::Avx512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+      return SimdIsa::Avx2;
+    }
+    return SimdIsa::Scalar;
+  }();
+  return isa;
+#else
+  return SimdIsa::Scalar;
+#endif
+}
+
+const char* SimdIsaName(SimdIsa isa) {
+  switch (isa) {
+    case SimdIsa::Scalar:
+      return "scalar";
+    case SimdIsa::Avx2:
+      return "avx2";
+    case SimdIsa::Avx512:
+      return "avx512";
+  }
+  return "unknown";
+}
+
+void SimdSort(uint32_t* data, size_t count, uint32_t* scratch, SimdIsa isa) {
+#ifdef MONOLITH_SIMD_SORT_X86
+  if (isa == SimdIsa::Avx512) {
+    SortWithKernels(SimdKernels{16, Avx512SortVectors, Avx512Merge}, data, count, scratch);
+    return;
+  }
+  if (isa == SimdIsa::Avx2) {
+    SortWithKernels(SimdKernels{8, Avx2SortVectors, Avx2Merge}, data, count, scratch);
+    return;
+  }
+#endif
+  (void) scratch;
+  (void) isa;
+  std::sort(data, data + count);
+}
+
+void SimdSort(uint32_t* data, size_t count, std::vector<uint32_t>& scratch, SimdIsa isa) {
+  if (scratch.size() < count) {
+    scratch.resize(count);
+  }
+  SimdSort(data, count, scratch.data(), isa);
+}
@@ -0,0 +1,35 @@
+#ifndef MONOLITH_SIMD_SORT_HPP
+#define MONOLITH_SIMD_SORT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Values sorted and merged within one cache-sized block before the merge passes over the data
+const size_t SimdSortBlockElements = size_t{1} << 14U;
+
+// Vector instruction sets of the SIMD sort kernel
+enum class SimdIsa {
+  // No usable vector unit, std::sort does the work
+  Scalar,
+  // 8 lanes of u32
+  Avx2,
+  // 16 lanes of u32
+  Avx512,
+};
+
+// Widest instruction set the CPU supports, asked from CPUID once
+SimdIsa DetectSimdIsa();
+
+const char* SimdIsaName(SimdIsa isa);
+
+// Sort `count` values with vector registers of `isa`, which the CPU must support: a bitonic
+// network sorts every vector, and vectorized 2-way merges join the sorted vectors, first within
+// cache-sized blocks and then over the whole data. The merges go through `scratch`, which holds
+// at least `count` values.
+void SimdSort(uint32_t* data, size_t count, uint32_t* scratch, SimdIsa isa);
+
+// Same as above, with `scratch` grown to `count` values and kept for the next call
+void SimdSort(uint32_t* data, size_t count, std::vector<uint32_t>& scratch, SimdIsa isa);
+
+#endif  // MONOLITH_SIMD_SORT_HPP
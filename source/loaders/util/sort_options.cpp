@@ -0,0 +1,320 @@
+#include "sort_options.hpp"
+
+#include <iostream>
+#include <string>
+#include <utility>
+
+#include "sorter_utils.hpp"
+
+namespace {
+
+const size_t BytesInKb = 1024;
+
+bool ParseSize(const std::string& text, size_t& value) {
+  try {
+    size_t parsed_length = 0;
+    value = std::stoull(text, &parsed_length);
+    return parsed_length == text.size();
+  } catch (const std::exception&) {
+    return false;
+  }
+}
+
+}  // namespace
+
+bool ParseSortOptions(int argc, char* argv[], int first, SortOptions& options) {
+  bool line_key_given = false;
+  for (int i = first; i < argc; ++i) {
+    const std::string argument = argv[i];
+    const size_t equals = argument.find('=');
+    const std::string name = argument.substr(0, equals);
+    const std::string value = equals == std::string::npos ? "" : argument.substr(equals + 1);
+
+    if (name == "--run-buffer-kb") {
+      size_t run_buffer_kb = 0;
+      if (!ParseSize(value, run_buffer_kb) || run_buffer_kb == 0) {
+        std::cerr << "Invalid value of " << name << ": " << value << '\n';
+        return false;
+      }
+      options.run_buffer_bytes = run_buffer_kb * BytesInKb;
+    } else if (argument == "--pipelined") {
+      options.pipelined = true;
+    } else if (name == "--run-generation") {
+      if (value == "chunks") {
+        options.run_generation = RunGeneration::Chunks;
+      } else if (value == "replacement") {
+        options.run_generation = RunGeneration::ReplacementSelection;
+      } else {
+        std::cerr << "Invalid value of " << name << ": " << value << '\n';
+        return false;
+      }
+    } else if (name == "--strategy") {
+      if (value == "merge") {
+        options.strategy = SortStrategy::Merge;
+      } else if (value == "distribution") {
+        options.strategy = SortStrategy::Distribution;
+      } else if (value == "auto") {
+        options.strategy = SortStrategy::Auto;
+      } else {
+        std::cerr << "Invalid value of " << name << ": " << value << '\n';
+        return false;
+      }
+    } else if (name == "--kernel") {
+      if (value == "std") {
+        options.kernel = SortKernel::Std;
+      } else if (value == "radix") {
+        options.kernel = SortKernel::Radix;
+      } else if (value == "simd") {
+        options.kernel = SortKernel::Simd;
+      } else {
+        std::cerr << "Invalid value of " << name << ": " << value << '\n';
+        return false;
+      }
+    } else if (name == "--threads") {
+      if (!ParseSize(value, options.threads)) {
+        std::cerr << "Invalid value of " << name << ": " << value << '\n';
+        return false;
+      }
+    } else if (name == "--max-fan-in") {
+      if (!ParseSize(value, options.max_fan_in) || options.max_fan_in == 1) {
+        std::cerr << "Invalid value of " << name << ": " << value << '\n';
+        return false;
+      }
+    } else if (name == "--merge-threads") {
+      if (!ParseSize(value, options.merge_threads) || options.merge_threads == 0) {
+        std::cerr << "Invalid value of " << name << ": " << value << '\n';
+        return false;
+      }
+    } else if (name == "--prefetch-blocks") {
+      if (!ParseSize(value, options.prefetch_blocks)) {
+        std::cerr << "Invalid value of " << name << ": " << value << '\n';
+        return false;
+      }
+    } else if (name == "--prefetch-threads") {
+      if (!ParseSize(value, options.prefetch_threads) || options.prefetch_threads == 0) {
+        std::cerr << "Invalid value of " << name << ": " << value << '\n';
+        return false;
+      }
+    } else if (name == "--io-engine") {
+      if (value == "stream") {
+        options.io_engine = IoEngineKind::Stream;
+      } else if (value == "sync") {
+        options.io_engine = IoEngineKind::Sync;
+      } else if (value == "uring") {
+        options.io_engine = IoEngineKind::IoUring;
+      } else {
+        std::cerr << "Invalid value of " << name << ": " << value << '\n';
+        return false;
+      }
+    } else if (name == "--queue-depth") {
+      if (!ParseSize(value, options.queue_depth) || options.queue_depth == 0) {
+        std::cerr << "Invalid value of " << name << ": " << value << '\n';
+        return false;
+      }
+    } else if (argument == "--register-buffers") {
+      options.register_buffers = true;
+    } else if (argument == "--mmap") {
+      options.mmap_io = true;
+    } else if (argument == "--in-place") {
+      options.mmap_io = true;
+      options.in_place = true;
+    } else if (argument == "--compress-runs") {
+      options.spill_format = RunFormat::Compressed;
+    } else if (argument == "--unique" || argument == "--count") {
+      OutputMode const mode = argument == "--unique" ? OutputMode::Unique : OutputMode::Count;
+      if (options.output_mode != OutputMode::All && options.output_mode != mode) {
+        std::cerr << "--unique and --count cannot be combined" << '\n';
+        return false;
+      }
+      options.output_mode = mode;
+    } else if (name == "--type") {
+      if (!ParseRecordType(value, options.record_type)) {
+        std::cerr << "Invalid value of " << name << ": " << value << '\n';
+        return false;
+      }
+    } else if (name == "--key-field") {
+      if (!ParseSize(value, options.line_key.field) || options.line_key.field == 0) {
+        std::cerr << "Invalid value of " << name << ": " << value << '\n';
+        return false;
+      }
+      line_key_given = true;
+    } else if (name == "--field-separator") {
+      if (value.size() != 1 || value[0] == '\n') {
+        std::cerr << "Invalid value of " << name << ": " << value << '\n';
+        return false;
+      }
+      options.line_key.separator = value[0];
+      line_key_given = true;
+    } else if (argument == "--numeric") {
+      options.line_key.numeric = true;
+      line_key_given = true;
+    } else if (argument == "--resume") {
+      options.resume = true;
+    } else if (name == "--spill-dirs") {
+      options.spill_directories = SplitSpillDirectories(value);
+      if (options.spill_directories.empty()) {
+        std::cerr << "Invalid value of " << name << ": " << value << '\n';
+        return false;
+      }
+    } else if (name == "--spill-policy") {
+      if (value == "round-robin") {
+        options.spill_policy = SpillPolicy::RoundRobin;
+      } else if (value == "free-space") {
+        options.spill_policy = SpillPolicy::FreeSpace;
+      } else {
+        std::cerr << "Invalid value of " << name << ": " << value << '\n';
+        return false;
+      }
+    } else if (name == "--memory-budget") {
+      size_t memory_budget_mb = 0;
+      if (!value.empty() && value != "auto" &&
+          (!ParseSize(value, memory_budget_mb) || memory_budget_mb == 0)) {
+        std::cerr << "Invalid value of " << name << ": " << value << '\n';
+        return false;
+      }
+      options.memory_budget_mode = true;
+      options.memory_budget_bytes = memory_budget_mb * BytesInMb;
+    } else {
+      std::cerr << "Unknown option: " << argument << '\n';
+      return false;
+    }
+  }
+  if (options.output_mode != OutputMode::All && options.record_type != RecordType::U32) {
+    std::cerr << "--unique and --count need --type=u32" << '\n';
+    return false;
+  }
+  if (line_key_given && options.record_type != RecordType::Lines) {
+    std::cerr << "--key-field, --field-separator and --numeric need --type=lines" << '\n';
+    return false;
+  }
+  return true;
+}
+
+bool RequirePlainU32Options(const SortOptions& options, const std::string& tool) {
+  if (options.record_type != RecordType::U32) {
+    std::cerr << tool << " sorts --type=u32 only, not --type=" << RecordTypeName(options.record_type)
+              << '\n';
+    return false;
+  }
+  if (options.output_mode != OutputMode::All) {
+    std::cerr << tool << " keeps every value, --unique and --count are not supported" << '\n';
+    return false;
+  }
+  return true;
+}
+
+bool RequireDirectIoOptions(const SortOptions& options) {
+  const std::string tool = "ema-sort-int-directio";
+  if (!RequirePlainU32Options(options, tool)) {
+    return false;
+  }
+  SortOptions const defaults;
+  const std::pair<bool, const char*> unsupported[] = {
+      {options.pipelined, "--pipelined"},
+      {options.run_generation != defaults.run_generation, "--run-generation"},
+      {options.strategy != defaults.strategy, "--strategy"},
+      {options.max_fan_in != defaults.max_fan_in, "--max-fan-in"},
+      {options.merge_threads != defaults.merge_threads, "--merge-threads"},
+      {options.io_engine != defaults.io_engine, "--io-engine"},
+      {options.queue_depth != defaults.queue_depth, "--queue-depth"},
+      {options.register_buffers, "--register-buffers"},
+      {options.mmap_io, "--mmap and --in-place"},
+      {options.spill_format != defaults.spill_format, "--compress-runs"},
+      {options.memory_budget_mode, "--memory-budget"},
+      {options.resume, "--resume"},
+  };
+  for (const auto& [given, flag]: unsupported) {
+    if (given) {
+      std::cerr << tool << " does not support " << flag << '\n';
+      return false;
+    }
+  }
+  return true;
+}
+
+size_t MergeRunBuffers(const SortOptions& options) {
+  size_t prefetch_blocks = options.prefetch_blocks;
+  if (prefetch_blocks == 0 && options.spill_directories.size() > 1) {
+    prefetch_blocks = StripedPrefetchBlocks;
+  }
+  size_t const reader_buffers = options.spill_format == RunFormat::Compressed ? 2 : 1;
+  if (prefetch_blocks == 0) {
+    return reader_buffers;
+  }
+  // A prefetched raw run is read straight into its blocks, one of which is being merged
+  return reader_buffers - (options.spill_format == RunFormat::Raw ? 1 : 0) + prefetch_blocks + 1;
+}
+
+void PrintSortOptionsHelp() {
+  std::cout << "Options:\n"
+            << "\t--run-buffer-kb=<kb>\n\t\tSize of the block buffer of every run reader/writer "
+               "(default "
+            << DefaultRunBufferBytes / BytesInKb << ")\n"
+            << "\t--pipelined\n\t\tRead the next chunk and write the previous one while the "
+               "current one is sorted,\n\t\tsplitting the chunk memory into "
+            << PipelineBufferCount << " rotating buffers\n"
+            << "\t--run-generation=<chunks|replacement>\n\t\tCut the input into chunk-sized "
+               "runs (default) or into runs of about\n\t\ttwice the chunk size by replacement "
+               "selection, a single run if the input is sorted\n"
+            << "\t--strategy=<merge|distribution|auto>\n\t\tSort u32 files by merging sorted "
+               "runs (default), by partitioning the\n\t\tinput into value ranges chosen from a "
+               "sample and sorting every range\n\t\tin memory, or by whichever the sample "
+               "favours\n"
+            << "\t--kernel=<std|radix|simd>\n\t\tSort u32 chunks and in-memory data with "
+               "std::sort (default), with an\n\t\tLSD radix sort over 11 bit digits or with "
+               "bitonic networks and merges\n\t\ton AVX2/AVX-512 chosen at run time. Radix "
+               "and simd take a scratch\n\t\tbuffer as large as the chunk\n"
+            << "\t--threads=<threads>\n\t\tSort every chunk and the in-memory data on this "
+               "many threads, 0 takes\n\t\tevery hardware thread (default 1). More than one "
+               "thread scatters the data\n\t\tthrough a scratch buffer as large as the chunk\n"
+            << "\t--max-fan-in=<runs>\n\t\tMerge at most this many runs at once, adding merge "
+               "passes as needed\n\t\t(default: limited by chunk memory and open files)\n"
+            << "\t--merge-threads=<threads>\n\t\tSplit the final merge pass into this many "
+               "disjoint key ranges merged in parallel (default 1)\n"
+            << "\t--prefetch-blocks=<blocks>\n\t\tKeep this many run buffers read ahead for "
+               "every run during the merge (default 0, off)\n"
+            << "\t--prefetch-threads=<threads>\n\t\tBackground I/O threads serving the "
+               "prefetch (default 1)\n"
+            << "\t--io-engine=<stream|sync|uring>\n\t\tI/O backend: buffered streams (default), "
+               "pread/pwrite, or batched io_uring\n\t\tsubmissions (falls back to pread/pwrite "
+               "without io_uring support)\n"
+            << "\t--queue-depth=<requests>\n\t\tRequests submitted to the io_uring at once "
+               "(default "
+            << DefaultQueueDepth << ")\n"
+            << "\t--register-buffers\n\t\tRegister the I/O buffers with the io_uring\n"
+            << "\t--mmap\n\t\tSort u32 files in memory within a shared mapping of the "
+               "output file,\n\t\twhich the input is read into directly\n"
+            << "\t--in-place\n\t\tSort the mapped input file itself, the output must name "
+               "the same file\n"
+            << "\t--compress-runs\n\t\tStore the temporary runs as delta-encoded, bit-packed "
+               "blocks; the runs are then\n\t\tread and written through buffered streams and "
+               "the final merge pass is sequential\n"
+            << "\t--memory-budget[=<mb|auto>]\n\t\tDerive the chunk size, run buffers and merge "
+               "fan-in from one memory budget,\n\t\tsorting in memory when the input fits "
+               "(auto: half of the memory free under\n\t\tMemAvailable and the cgroup limit)\n"
+            << "\t--resume\n\t\tContinue an interrupted sort of the same input with the same "
+               "options from the\n\t\truns and merge passes recorded in its run manifest\n"
+            << "\t--spill-dirs=<dir>[,<dir>...]\n\t\tStripe the temporary runs over these "
+               "directories, ideally one per device;\n\t\tthe merge then reads every device on "
+               "its own I/O thread\n"
+            << "\t--spill-policy=<round-robin|free-space>\n\t\tGive every spill directory the "
+               "same share of the runs (default) or a share\n\t\tproportional to its free "
+               "space\n"
+            << "\t--unique\n\t\tWrite every distinct value once, duplicates are dropped from "
+               "every chunk\n\t\tbefore it is spilled and again in every merge\n"
+            << "\t--count\n\t\tWrite a (value, count) pair of uint32_t for every distinct "
+               "value, collapsing\n\t\tduplicates in the runs and the merges like --unique\n"
+            << "\t--type=<u32|u64|i32|i64|f32|f64|kv64|gray100|lines>\n\t\tRecord type of the "
+               "files (default u32): unsigned or signed integers,\n\t\tIEEE floats, 16 B records "
+               "of a uint64_t key and a uint64_t payload,\n\t\t100 B records of a 10 B key "
+               "and a 90 B value sorted through cached key\n\t\tprefixes, or newline-delimited "
+               "text lines. Types other than u32 are sorted\n\t\tin plain chunks and stream "
+               "merges, the I/O engine, compression,\n\t\tpipelining and resume options apply "
+               "to u32 only\n"
+            << "\t--key-field=<field>\n\t\tSort lines by this 1-based field instead of the "
+               "whole line, ties are\n\t\tdecided by the whole lines\n"
+            << "\t--field-separator=<char>\n\t\tSeparator of the fields of --key-field "
+               "(default ',')\n"
+            << "\t--numeric\n\t\tSort lines by the number their key starts with instead of "
+               "by its bytes\n";
+}
@@ -0,0 +1,99 @@
+#ifndef MONOLITH_SORT_OPTIONS_HPP
+#define MONOLITH_SORT_OPTIONS_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "bucket_distribution.hpp"
+#include "collapsing_output.hpp"
+#include "io_engine.hpp"
+#include "line_key.hpp"
+#include "radix_sort.hpp"
+#include "record_types.hpp"
+#include "run_io.hpp"
+#include "spill_directories.hpp"
+
+// Number of rotating chunk buffers of the pipelined run formation: one read, one sorted, one written
+const size_t PipelineBufferCount = 3;
+
+// How the external sorter cuts the input into sorted runs
+enum class RunGeneration {
+  // Every run is one memory-sized chunk sorted in place
+  Chunks,
+  // Runs are streamed out of a min-heap over the memory budget, about twice as long as a chunk
+  ReplacementSelection,
+};
+
+// Requests kept in flight by the io_uring engine unless --queue-depth is given
+const size_t DefaultQueueDepth = 32;
+
+// Tuning knobs of the sorters, filled from the optional `--name=value` command line flags
+struct SortOptions {
+  // Buffer size of every run reader/writer, the merge holds one per run plus one for output
+  size_t run_buffer_bytes = DefaultRunBufferBytes;
+  // Overlap reading, sorting and writing of chunks during run formation
+  bool pipelined = false;
+  RunGeneration run_generation = RunGeneration::Chunks;
+  SortStrategy strategy = SortStrategy::Merge;
+  // Sort routine of the chunks and of the in-memory sort
+  SortKernel kernel = SortKernel::Std;
+  // Threads of the chunk and in-memory sorts, 0 takes every hardware thread
+  size_t threads = 1;
+  // Upper bound of the runs merged at once, 0 derives it from the memory and open file limits
+  size_t max_fan_in = 0;
+  // Threads of the final merge pass, each merging its own key range into its slice of the output
+  size_t merge_threads = 1;
+  // Blocks read ahead for every run by background I/O threads during the merge, 0 reads on demand
+  size_t prefetch_blocks = 0;
+  size_t prefetch_threads = 1;
+  // Backend of the run formation and merge I/O
+  IoEngineKind io_engine = IoEngineKind::Stream;
+  size_t queue_depth = DefaultQueueDepth;
+  // Register the chunk and run buffers with the io_uring to skip the per-request page pinning
+  bool register_buffers = false;
+  // Sort in memory within a shared mapping of the output file, or of the input file itself
+  bool mmap_io = false;
+  bool in_place = false;
+  // Layout of the temporary runs, the sorted output is always raw
+  RunFormat spill_format = RunFormat::Raw;
+  // Derive the chunk size, run buffers and fan-in from one memory budget instead of the chunk size
+  bool memory_budget_mode = false;
+  // Budget of the budget mode, 0 derives it from the available memory and the cgroup limit
+  size_t memory_budget_bytes = 0;
+  // Continue from the run manifest left by an interrupted sort of the same input
+  bool resume = false;
+  // Directories the temporary runs are striped over, empty keeps them in the system temp directory
+  std::vector<std::string> spill_directories;
+  SpillPolicy spill_policy = SpillPolicy::RoundRobin;
+  // Collapse duplicates into distinct values or (value, count) pairs, in the runs and the output
+  OutputMode output_mode = OutputMode::All;
+  // Layout of the records of the input and output files
+  RecordType record_type = RecordType::U32;
+  // Key of the lines of --type=lines
+  LineKeySpec line_key;
+};
+
+// Blocks read ahead for every striped run of a merge when --prefetch-blocks does not ask for more
+const size_t StripedPrefetchBlocks = 2;
+
+// Parse the flags in argv[first..argc), returns false and prints the culprit on a bad flag
+bool ParseSortOptions(int argc, char* argv[], int first, SortOptions& options);
+
+// For the sorters of plain u32 values that keep every value, returns false and prints the culprit
+// when `options` asks for another record type or for --unique/--count
+bool RequirePlainU32Options(const SortOptions& options, const std::string& tool);
+
+// For the direct I/O sorter, which honours only the threads, kernel, spill and prefetch options on
+// top of the plain u32 ones, returns false and prints the culprit for any other option
+bool RequireDirectIoOptions(const SortOptions& options);
+
+// Run buffers one input run of a merge under `options` takes: the reader's buffer, which compressed
+// runs need besides an encoded one, and the prefetched blocks, which are turned on by
+// --prefetch-blocks or by runs striped over several spill directories
+size_t MergeRunBuffers(const SortOptions& options);
+
+// Print the description of the supported flags
+void PrintSortOptionsHelp();
+
+#endif  // MONOLITH_SORT_OPTIONS_HPP
@@ -1,5 +1,6 @@
 #include "sorter_utils.hpp"
 
+#include <filesystem>
 #include <random>
 #include <algorithm>
 
@@ -14,4 +15,47 @@ std::string SanitizeInputFilename(const std::string& input_filename) {
   std::string sanitized = input_filename;
   std::replace(sanitized.begin(), sanitized.end(), '/', '_'); // Replace '/' with '_'
   return sanitized;
-}
\ No newline at end of file
+}
+
+std::string ChunkFilename(
+    const std::string& temp_directory, const std::string& input_filename, size_t chunk_index
+) {
+  return temp_directory + "/" + SanitizeInputFilename(input_filename) + "_chunk_" +
+         std::to_string(chunk_index) + ".dat";
+}
+
+std::string MergePassFilename(
+    const std::string& temp_directory,
+    const std::string& input_filename,
+    size_t pass,
+    size_t run_index
+) {
+  return temp_directory + "/" + SanitizeInputFilename(input_filename) + "_pass_" +
+         std::to_string(pass) + "_run_" + std::to_string(run_index) + ".dat";
+}
+
+std::string BucketFilename(
+    const std::string& temp_directory, const std::string& input_filename, size_t bucket_index
+) {
+  return temp_directory + "/" + SanitizeInputFilename(input_filename) + "_bucket_" +
+         std::to_string(bucket_index) + ".dat";
+}
+
+std::string ManifestFilename(const std::string& temp_directory, const std::string& input_filename) {
+  return temp_directory + "/" + SanitizeInputFilename(input_filename) + "_manifest.txt";
+}
+
+std::string InputPath(const std::string& path) {
+  return path == StandardStreamName ? "/dev/stdin" : path;
+}
+
+std::string OutputPath(const std::string& path) {
+  return path == StandardStreamName ? "/dev/stdout" : path;
+}
+
+bool IsStreamPath(const std::string& path) {
+  std::error_code error;
+  std::filesystem::file_status const status = std::filesystem::status(path, error);
+  return !error && (status.type() == std::filesystem::file_type::fifo ||
+                    status.type() == std::filesystem::file_type::character);
+}
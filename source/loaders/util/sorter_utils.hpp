@@ -12,6 +12,41 @@ static const size_t BytesInMb = static_cast<size_t>(1024 * 1024);
 
 std::string SanitizeInputFilename(const std::string& input_filename);
 
+// Name of the temporary file holding the sorted chunk `chunk_index` of `input_filename`
+std::string ChunkFilename(
+    const std::string& temp_directory, const std::string& input_filename, size_t chunk_index
+);
+
+// Name of the temporary file holding run `run_index` produced by merge pass `pass`
+std::string MergePassFilename(
+    const std::string& temp_directory,
+    const std::string& input_filename,
+    size_t pass,
+    size_t run_index
+);
+
+// Name of the temporary file holding bucket `bucket_index` of a distribution sort of
+// `input_filename`
+std::string BucketFilename(
+    const std::string& temp_directory, const std::string& input_filename, size_t bucket_index
+);
+
+// Name of the run manifest of an external sort of `input_filename`
+std::string ManifestFilename(const std::string& temp_directory, const std::string& input_filename);
+
 uint32_t RandomUint32();
 
+// Command line name of the standard input or output
+static const char* const StandardStreamName = "-";
+
+// Path of the standard input for "-", `path` otherwise
+std::string InputPath(const std::string& path);
+
+// Path of the standard output for "-", `path` otherwise
+std::string OutputPath(const std::string& path);
+
+// Whether `path` is a pipe, FIFO or terminal, which is read or written once from start to end and
+// has no size to learn up front
+bool IsStreamPath(const std::string& path);
+
 #endif  // MONOLITH_SORTER_UTILS_HPP
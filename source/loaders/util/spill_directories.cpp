@@ -0,0 +1,62 @@
+#include "spill_directories.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <sstream>
+
+#include "sorter_utils.hpp"
+
+SpillDirectories::SpillDirectories(std::vector<std::string> directories, SpillPolicy policy)
+    : directories_(std::move(directories)) {
+  weights_.assign(directories_.size(), 1);
+  if (policy == SpillPolicy::FreeSpace) {
+    for (size_t i = 0; i < directories_.size(); ++i) {
+      std::error_code error;
+      std::filesystem::space_info const space = std::filesystem::space(directories_[i], error);
+      // A directory without free space still takes the occasional run instead of failing the sort
+      weights_[i] = error ? 1 : std::max<uint64_t>(1, space.available / BytesInMb);
+    }
+  }
+  credits_.assign(directories_.size(), 0);
+}
+
+void SpillDirectories::setWeights(const std::vector<uint64_t>& weights) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  weights_ = weights;
+  credits_.assign(directories_.size(), 0);
+  placement_.clear();
+}
+
+size_t SpillDirectories::device(size_t index) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  int64_t total_weight = 0;
+  for (uint64_t const weight: weights_) {
+    total_weight += static_cast<int64_t>(weight);
+  }
+  // Every step credits each directory with its weight and places the run on the directory with
+  // the most credit, which interleaves the directories as evenly as their weights allow
+  while (placement_.size() <= index) {
+    size_t best = 0;
+    for (size_t i = 0; i < credits_.size(); ++i) {
+      credits_[i] += static_cast<int64_t>(weights_[i]);
+      if (credits_[i] > credits_[best]) {
+        best = i;
+      }
+    }
+    credits_[best] -= total_weight;
+    placement_.push_back(best);
+  }
+  return placement_[index];
+}
+
+std::vector<std::string> SplitSpillDirectories(const std::string& list) {
+  std::vector<std::string> directories;
+  std::istringstream stream(list);
+  std::string directory;
+  while (std::getline(stream, directory, ',')) {
+    if (!directory.empty()) {
+      directories.push_back(directory);
+    }
+  }
+  return directories;
+}
@@ -0,0 +1,64 @@
+#ifndef MONOLITH_SPILL_DIRECTORIES_HPP
+#define MONOLITH_SPILL_DIRECTORIES_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// How the temporary runs are spread over the spill directories
+enum class SpillPolicy {
+  // Every directory takes the same share of the runs
+  RoundRobin,
+  // Directories take shares of the runs proportional to their free space when the sort starts
+  FreeSpace,
+};
+
+// Directories the temporary runs are striped over, each one ideally on its own device. The runs of
+// every kind (chunks, outputs of a merge pass) are numbered from 0 and run `index` always lives
+// on device(index), so consecutive runs, which are merged together, sit on different devices.
+class SpillDirectories {
+private:
+  std::vector<std::string> directories_;
+  std::vector<uint64_t> weights_;
+  // Smooth weighted round-robin state, extended on demand by device()
+  std::vector<int64_t> credits_;
+  std::vector<size_t> placement_;
+  std::mutex mutex_;
+
+public:
+  // Weights of the FreeSpace policy are the free megabytes of every directory
+  SpillDirectories(std::vector<std::string> directories, SpillPolicy policy);
+
+  SpillDirectories(const SpillDirectories&) = delete;
+  SpillDirectories& operator=(const SpillDirectories&) = delete;
+
+  size_t size() const {
+    return directories_.size();
+  }
+
+  // Directory of the files that are not striped, like the run manifest
+  const std::string& primary() const {
+    return directories_.front();
+  }
+
+  const std::vector<uint64_t>& weights() const {
+    return weights_;
+  }
+
+  // Replace the weights by those an earlier attempt placed its runs with
+  void setWeights(const std::vector<uint64_t>& weights);
+
+  // Index of the directory holding run `index`, safe to call from several threads
+  size_t device(size_t index);
+
+  const std::string& directory(size_t index) {
+    return directories_[device(index)];
+  }
+};
+
+// Split a comma separated list of directories
+std::vector<std::string> SplitSpillDirectories(const std::string& list);
+
+#endif  // MONOLITH_SPILL_DIRECTORIES_HPP
@@ -0,0 +1,46 @@
+#ifndef MONOLITH_SPSC_QUEUE_HPP
+#define MONOLITH_SPSC_QUEUE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Bounded lock-free ring buffer for exactly one producer thread and one consumer thread
+template <typename T>
+class SpscQueue {
+private:
+  std::vector<T> slots_;
+  // Written by the consumer only
+  alignas(64) std::atomic<size_t> head_{0};
+  // Written by the producer only
+  alignas(64) std::atomic<size_t> tail_{0};
+
+public:
+  // One slot always stays empty to tell a full ring from an empty one
+  explicit SpscQueue(size_t capacity): slots_(capacity + 1) {}
+
+  // Producer side, returns false if the queue is full
+  bool tryPush(const T& item) {
+    size_t const tail = tail_.load(std::memory_order_relaxed);
+    size_t const next_tail = tail + 1 == slots_.size() ? 0 : tail + 1;
+    if (next_tail == head_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    slots_[tail] = item;
+    tail_.store(next_tail, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side, returns false if the queue is empty
+  bool tryPop(T& item) {
+    size_t const head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    item = slots_[head];
+    head_.store(head + 1 == slots_.size() ? 0 : head + 1, std::memory_order_release);
+    return true;
+  }
+};
+
+#endif  // MONOLITH_SPSC_QUEUE_HPP
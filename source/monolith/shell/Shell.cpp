@@ -67,7 +67,6 @@ void Shell::StartProcessMonitor() {
           std::this_thread::sleep_for(std::chrono::milliseconds(10));
       }
   });
-  monitor_thread_.detach();
 }
 
 void Shell::Run() {
@@ -104,8 +103,9 @@ std::string Shell::ReadNextCommandString() {
 }
 
 void Shell::Stop() {
-  StopProcessMonitor();
+  // The monitor reads running_ and active_processes_, so it must finish before the shell goes away
   running_ = false;
+  StopProcessMonitor();
 }
 
 void Shell::StopProcessMonitor() {
@@ -4,6 +4,7 @@
 
 #ifndef SHELL_HPP
 #define SHELL_HPP
+#include <atomic>
 #include <functional>
 #include <map>
 #include <mutex>
@@ -17,7 +18,7 @@ class Shell {
 private:
   std::istream& input_;
   std::ostream& output_;
-  bool running_;
+  std::atomic<bool> running_;
   std::map<pid_t, ProcessInfo> active_processes_;
   std::thread monitor_thread_;
   inline static const std::string PromptString = "> ";
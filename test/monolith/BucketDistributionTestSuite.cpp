@@ -0,0 +1,110 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "loaders/util/bucket_distribution.hpp"
+#include "loaders/util/run_io.hpp"
+
+namespace {
+
+std::vector<uint32_t> UniformSample(size_t count, uint32_t seed) {
+  std::mt19937 engine(seed);
+  std::vector<uint32_t> sample(count);
+  for (uint32_t& value: sample) {
+    value = static_cast<uint32_t>(engine());
+  }
+  return sample;
+}
+
+}  // namespace
+
+TEST(BucketDistributionTest, BucketIndexMatchesBinarySearch) {
+  // Splitters crowded into one top-bits range as well as spread over the whole key space
+  std::vector<uint32_t> splitters = {5, 70000, 70001, 70002, 0x12345678, 0x80000000, 0xFFFFFFFF};
+  BucketIndex const index(splitters);
+  std::vector<uint32_t> values = UniformSample(100000, 1);
+  for (uint32_t const splitter: splitters) {
+    values.push_back(splitter);
+    values.push_back(splitter - 1);
+  }
+  values.push_back(0);
+  for (uint32_t const value: values) {
+    auto const expected = static_cast<size_t>(
+        std::upper_bound(splitters.begin(), splitters.end(), value) - splitters.begin()
+    );
+    ASSERT_EQ(index.bucket(value), expected) << value;
+  }
+}
+
+TEST(BucketDistributionTest, AutoDistributesUniformKeys) {
+  // 64 Mi values in chunks of 4 Mi need 22 buckets filled to three quarters
+  size_t const chunk_elements = size_t{4} << 20U;
+  DistributionPlan const plan = PlanDistribution(
+      UniformSample(DistributionSampleSize, 2), size_t{64} << 20U, chunk_elements, 1 << 20, 1000,
+      SortStrategy::Auto
+  );
+  ASSERT_EQ(plan.bucket_count, 22);
+  ASSERT_EQ(plan.splitters.size(), 21);
+  ASSERT_TRUE(std::is_sorted(plan.splitters.begin(), plan.splitters.end()));
+  ASSERT_LE(plan.largest_bucket_elements, chunk_elements);
+  ASSERT_GE(plan.bucket_buffer_bytes, MinRunBufferBytes);
+}
+
+TEST(BucketDistributionTest, AutoFallsBackToMerge) {
+  size_t const input_elements = size_t{64} << 20U;
+  size_t const chunk_elements = size_t{4} << 20U;
+
+  std::vector<uint32_t> sorted = UniformSample(DistributionSampleSize, 3);
+  std::sort(sorted.begin(), sorted.end());
+  ASSERT_EQ(
+      PlanDistribution(sorted, input_elements, chunk_elements, 1 << 20, 1000, SortStrategy::Auto)
+          .bucket_count,
+      0
+  );
+
+  // Too few open files for the buckets
+  ASSERT_EQ(
+      PlanDistribution(
+          UniformSample(DistributionSampleSize, 4), input_elements, chunk_elements, 1 << 20, 8,
+          SortStrategy::Auto
+      )
+          .bucket_count,
+      0
+  );
+
+  ASSERT_TRUE(IsSingleValueBucket({7, 8, 20}, 1));
+  ASSERT_FALSE(IsSingleValueBucket({7, 8, 20}, 0));
+  ASSERT_FALSE(IsSingleValueBucket({7, 8, 20}, 2));
+  ASSERT_TRUE(IsSingleValueBucket({7, 0xFFFFFFFF}, 2));
+}
+
+TEST(BucketDistributionTest, FrequentKeysGetBucketsOfTheirOwn) {
+  size_t const input_elements = size_t{64} << 20U;
+  size_t const chunk_elements = size_t{4} << 20U;
+  uint32_t const hot = 0x80000000;
+
+  // Half of the values are one key, which would take half of the buckets
+  std::vector<uint32_t> skewed = UniformSample(DistributionSampleSize, 5);
+  for (size_t i = 0; i < skewed.size(); i += 2) {
+    skewed[i] = hot;
+  }
+  for (SortStrategy const strategy: {SortStrategy::Auto, SortStrategy::Distribution}) {
+    DistributionPlan const plan =
+        PlanDistribution(skewed, input_elements, chunk_elements, 1 << 20, 1000, strategy);
+    ASSERT_GT(plan.bucket_count, 1);
+    ASSERT_LT(plan.bucket_count, 22);
+    ASSERT_TRUE(
+        std::adjacent_find(plan.splitters.begin(), plan.splitters.end()) == plan.splitters.end()
+    );
+    // The rest shares the other buckets, which fit the chunk
+    ASSERT_LE(plan.largest_bucket_elements, chunk_elements);
+    BucketIndex const index(plan.splitters);
+    size_t const bucket = index.bucket(hot);
+    ASSERT_TRUE(IsSingleValueBucket(plan.splitters, bucket));
+    ASSERT_NE(index.bucket(hot - 1), bucket);
+    ASSERT_NE(index.bucket(hot + 1), bucket);
+  }
+}
@@ -0,0 +1,117 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "loaders/util/collapsing_output.hpp"
+
+namespace {
+
+struct VectorOutput {
+  std::vector<uint32_t> values;
+
+  void put(uint32_t value) {
+    values.push_back(value);
+  }
+
+  void writeBlock(const uint32_t* block, size_t count) {
+    values.insert(values.end(), block, block + count);
+  }
+};
+
+// Merge source over a vector
+struct VectorSource {
+  std::vector<uint32_t> values;
+  size_t position = 0;
+
+  bool next(uint32_t& value) {
+    if (position == values.size()) {
+      return false;
+    }
+    value = values[position++];
+    return true;
+  }
+};
+
+}  // namespace
+
+TEST(CollapsingOutputTest, AllKeepsDuplicates) {
+  VectorOutput output;
+  CollapsingOutput<VectorOutput> collapsed(output, OutputMode::All);
+  for (uint32_t const value: {1, 1, 2, 3, 3, 3}) {
+    collapsed.put(value);
+  }
+  collapsed.finish();
+  ASSERT_EQ(output.values, (std::vector<uint32_t>{1, 1, 2, 3, 3, 3}));
+}
+
+TEST(CollapsingOutputTest, UniqueAndCountCollapseNeighbours) {
+  std::vector<uint32_t> const sorted{0, 0, 5, 7, 7, 7, 9};
+
+  VectorOutput unique;
+  CollapsingOutput<VectorOutput> collapsed_unique(unique, OutputMode::Unique);
+  VectorOutput counted;
+  CollapsingOutput<VectorOutput> collapsed_count(counted, OutputMode::Count);
+  for (uint32_t const value: sorted) {
+    collapsed_unique.put(value);
+    collapsed_count.put(value);
+  }
+  collapsed_unique.finish();
+  collapsed_count.finish();
+  ASSERT_EQ(unique.values, (std::vector<uint32_t>{0, 5, 7, 9}));
+  ASSERT_EQ(counted.values, (std::vector<uint32_t>{0, 2, 5, 1, 7, 3, 9, 1}));
+
+  // An empty stream writes nothing
+  VectorOutput empty;
+  CollapsingOutput<VectorOutput>(empty, OutputMode::Count).finish();
+  ASSERT_TRUE(empty.values.empty());
+}
+
+TEST(CollapsingOutputTest, CountsBeyondUint32AreSplit) {
+  uint32_t const max_count = std::numeric_limits<uint32_t>::max();
+  VectorOutput output;
+  CollapsingOutput<VectorOutput> collapsed(output, OutputMode::Count);
+  collapsed.put(4, max_count);
+  collapsed.put(4, 10);
+  collapsed.put(6);
+  collapsed.finish();
+  ASSERT_EQ(output.values, (std::vector<uint32_t>{4, max_count, 4, 10, 6, 1}));
+}
+
+TEST(CollapsingOutputTest, CountedSourcesAddUpInTheOutput) {
+  // Two count runs merged by value, the counts of equal values are added up
+  VectorSource first{{1, 2, 3, 4}};
+  VectorSource second{{1, 5, 3, 1}};
+  CountedSource<VectorSource> counted_first(&first);
+  CountedSource<VectorSource> counted_second(&second);
+
+  VectorOutput output;
+  CollapsingOutput<VectorOutput> collapsed(output, OutputMode::Count);
+  uint32_t a = 0;
+  uint32_t b = 0;
+  bool has_a = counted_first.next(a);
+  bool has_b = counted_second.next(b);
+  while (has_a || has_b) {
+    if (has_a && (!has_b || a <= b)) {
+      collapsed.put(a, counted_first.count());
+      has_a = counted_first.next(a);
+    } else {
+      collapsed.put(b, counted_second.count());
+      has_b = counted_second.next(b);
+    }
+  }
+  collapsed.finish();
+  ASSERT_EQ(output.values, (std::vector<uint32_t>{1, 7, 3, 5}));
+}
+
+TEST(CollapsingOutputTest, WriteSortedBlock) {
+  std::vector<uint32_t> values{2, 2, 2, 8, 9, 9};
+  VectorOutput counted;
+  WriteSortedBlock(counted, values.data(), values.size(), OutputMode::Count);
+  ASSERT_EQ(counted.values, (std::vector<uint32_t>{2, 3, 8, 1, 9, 2}));
+
+  VectorOutput unique;
+  WriteSortedBlock(unique, values.data(), values.size(), OutputMode::Unique);
+  ASSERT_EQ(unique.values, (std::vector<uint32_t>{2, 8, 9}));
+}
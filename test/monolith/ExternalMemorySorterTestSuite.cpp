@@ -1,10 +1,19 @@
 #include <gtest/gtest.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
 
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
+#include <limits>
+#include <random>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "loaders/ema-sort-int/ExternalMemorySorter.hpp"
+#include "loaders/util/merge_planner.hpp"
 
 // Test fixture class
 class ExternalMemorySorterTest : public ::testing::Test {
@@ -71,6 +80,986 @@ TEST_F(ExternalMemorySorterTest, ExternalMemorySort) {
   deleteFile(output_filename);
 }
 
+// Test case: Pipelined run formation produces the same sorted output
+TEST_F(ExternalMemorySorterTest, ExternalMemorySortPipelined) {
+  std::string input_filename = temp_dir + "test_input_pipelined.dat";
+  std::string output_filename = temp_dir + "test_output_pipelined.dat";
+  size_t file_size_mb = 8;
+  size_t chunk_size_mb = 3;
+
+  SortOptions options;
+  options.pipelined = true;
+
+  ASSERT_NO_THROW(ExternalMemorySorter::generateRandomFile(input_filename, file_size_mb));
+  ASSERT_NO_THROW(ExternalMemorySorter::externalMemorySort(
+      input_filename, output_filename, chunk_size_mb, options
+  ));
+
+  std::vector<uint32_t> input_data = readBinaryFile(input_filename);
+  std::vector<uint32_t> sorted_data = readBinaryFile(output_filename);
+  std::sort(input_data.begin(), input_data.end());
+  ASSERT_EQ(sorted_data, input_data) << "Output is not the sorted input.";
+
+  deleteFile(input_filename);
+  deleteFile(output_filename);
+}
+
+// Test case: Replacement selection sorts random input and keeps sorted input in one run
+TEST_F(ExternalMemorySorterTest, ExternalMemorySortReplacementSelection) {
+  std::string input_filename = temp_dir + "test_input_replacement.dat";
+  std::string output_filename = temp_dir + "test_output_replacement.dat";
+  size_t chunk_size_mb = 1;
+
+  SortOptions options;
+  options.run_generation = RunGeneration::ReplacementSelection;
+
+  ASSERT_NO_THROW(ExternalMemorySorter::generateRandomFile(input_filename, 4));
+  ASSERT_NO_THROW(ExternalMemorySorter::externalMemorySort(
+      input_filename, output_filename, chunk_size_mb, options
+  ));
+
+  std::vector<uint32_t> input_data = readBinaryFile(input_filename);
+  std::vector<uint32_t> sorted_data = readBinaryFile(output_filename);
+  std::sort(input_data.begin(), input_data.end());
+  ASSERT_EQ(sorted_data, input_data) << "Output is not the sorted input.";
+
+  // The sorted output with its first two values swapped, which the presortedness scan does not
+  // take for sorted, must come out as a single run
+  std::vector<uint32_t> nearly_sorted = sorted_data;
+  std::swap(nearly_sorted[0], nearly_sorted[1]);
+  {
+    std::ofstream file(output_filename, std::ios::binary | std::ios::trunc);
+    file.write(
+        reinterpret_cast<const char*>(nearly_sorted.data()),
+        static_cast<std::streamsize>(nearly_sorted.size() * sizeof(uint32_t))
+    );
+  }
+  testing::internal::CaptureStdout();
+  ExternalMemorySorter::externalMemorySort(output_filename, input_filename, chunk_size_mb, options);
+  std::string output = testing::internal::GetCapturedStdout();
+  ASSERT_NE(output.find("formed 1 runs"), std::string::npos) << output;
+  ASSERT_EQ(readBinaryFile(input_filename), sorted_data);
+
+  deleteFile(input_filename);
+  deleteFile(output_filename);
+}
+
+// Test case: A fan-in of two forces a cascade of merge passes
+TEST_F(ExternalMemorySorterTest, ExternalMemorySortMultiPassMerge) {
+  std::string input_filename = temp_dir + "test_input_multipass.dat";
+  std::string output_filename = temp_dir + "test_output_multipass.dat";
+
+  SortOptions options;
+  options.max_fan_in = 2;
+
+  ASSERT_NO_THROW(ExternalMemorySorter::generateRandomFile(input_filename, 5));
+  testing::internal::CaptureStdout();
+  ExternalMemorySorter::externalMemorySort(input_filename, output_filename, 1, options);
+  std::string output = testing::internal::GetCapturedStdout();
+  ASSERT_NE(output.find("Merge plan has 3 pass(es)"), std::string::npos) << output;
+
+  std::vector<uint32_t> input_data = readBinaryFile(input_filename);
+  std::vector<uint32_t> sorted_data = readBinaryFile(output_filename);
+  std::sort(input_data.begin(), input_data.end());
+  ASSERT_EQ(sorted_data, input_data) << "Output is not the sorted input.";
+
+  deleteFile(input_filename);
+  deleteFile(output_filename);
+}
+
+// Test case: The final merge split over several threads writes every key range in place
+TEST_F(ExternalMemorySorterTest, ExternalMemorySortParallelMerge) {
+  std::string input_filename = temp_dir + "test_input_parallel.dat";
+  std::string output_filename = temp_dir + "test_output_parallel.dat";
+
+  SortOptions options;
+  options.merge_threads = 4;
+
+  ASSERT_NO_THROW(ExternalMemorySorter::generateRandomFile(input_filename, 6));
+  ASSERT_NO_THROW(ExternalMemorySorter::externalMemorySort(input_filename, output_filename, 2, options));
+
+  std::vector<uint32_t> input_data = readBinaryFile(input_filename);
+  std::vector<uint32_t> sorted_data = readBinaryFile(output_filename);
+  std::sort(input_data.begin(), input_data.end());
+  ASSERT_EQ(sorted_data, input_data) << "Output is not the sorted input.";
+
+  deleteFile(input_filename);
+  deleteFile(output_filename);
+}
+
+// Test case: A parallel merge whose threads would hold more run files open than the limit allows
+// merges on one thread
+TEST_F(ExternalMemorySorterTest, ExternalMemorySortParallelMergeWithinFileLimit) {
+  std::string input_filename = temp_dir + "test_input_parallel_limit.dat";
+  std::string output_filename = temp_dir + "test_output_parallel_limit.dat";
+
+  // 8 runs merged in one pass fit one thread, but not 4 threads opening every run
+  rlimit saved{};
+  ASSERT_EQ(getrlimit(RLIMIT_NOFILE, &saved), 0);
+  rlimit lowered = saved;
+  lowered.rlim_cur = ReservedFileDescriptors + 20;
+  ASSERT_EQ(setrlimit(RLIMIT_NOFILE, &lowered), 0);
+
+  SortOptions options;
+  options.merge_threads = 4;
+  options.run_buffer_bytes = 64 * 1024;
+  ASSERT_NO_THROW(ExternalMemorySorter::generateRandomFile(input_filename, 8));
+  testing::internal::CaptureStdout();
+  ExternalMemorySorter::externalMemorySort(input_filename, output_filename, 1, options);
+  std::string const output = testing::internal::GetCapturedStdout();
+  ASSERT_EQ(setrlimit(RLIMIT_NOFILE, &saved), 0);
+  ASSERT_NE(output.find("merging on one thread"), std::string::npos) << output;
+
+  std::vector<uint32_t> input_data = readBinaryFile(input_filename);
+  std::sort(input_data.begin(), input_data.end());
+  ASSERT_EQ(readBinaryFile(output_filename), input_data);
+
+  deleteFile(input_filename);
+  deleteFile(output_filename);
+}
+
+// Test case: Runs read ahead by background I/O threads merge into the same output
+TEST_F(ExternalMemorySorterTest, ExternalMemorySortPrefetchedMerge) {
+  std::string input_filename = temp_dir + "test_input_prefetch.dat";
+  std::string output_filename = temp_dir + "test_output_prefetch.dat";
+
+  SortOptions options;
+  options.run_buffer_bytes = 64 * 1024;
+  options.prefetch_blocks = 2;
+  options.prefetch_threads = 2;
+
+  ASSERT_NO_THROW(ExternalMemorySorter::generateRandomFile(input_filename, 6));
+  ASSERT_NO_THROW(ExternalMemorySorter::externalMemorySort(input_filename, output_filename, 1, options));
+
+  std::vector<uint32_t> input_data = readBinaryFile(input_filename);
+  std::vector<uint32_t> sorted_data = readBinaryFile(output_filename);
+  std::sort(input_data.begin(), input_data.end());
+  ASSERT_EQ(sorted_data, input_data) << "Output is not the sorted input.";
+
+  deleteFile(input_filename);
+  deleteFile(output_filename);
+}
+
+TEST_F(ExternalMemorySorterTest, ExternalMemorySortIoUringEngine) {
+  std::string input_filename = temp_dir + "test_input_uring.dat";
+  std::string output_filename = temp_dir + "test_output_uring.dat";
+
+  SortOptions options;
+  options.run_buffer_bytes = 64 * 1024;
+  options.io_engine = IoEngineKind::IoUring;
+  options.queue_depth = 4;
+  options.register_buffers = true;
+
+  ASSERT_NO_THROW(ExternalMemorySorter::generateRandomFile(input_filename, 6));
+  ASSERT_NO_THROW(ExternalMemorySorter::externalMemorySort(input_filename, output_filename, 1, options));
+
+  std::vector<uint32_t> input_data = readBinaryFile(input_filename);
+  std::vector<uint32_t> sorted_data = readBinaryFile(output_filename);
+  std::sort(input_data.begin(), input_data.end());
+  ASSERT_EQ(sorted_data, input_data) << "Output is not the sorted input.";
+
+  deleteFile(input_filename);
+  deleteFile(output_filename);
+}
+
+TEST_F(ExternalMemorySorterTest, ExternalMemorySortSyncEngineMultiPass) {
+  std::string input_filename = temp_dir + "test_input_sync.dat";
+  std::string output_filename = temp_dir + "test_output_sync.dat";
+
+  SortOptions options;
+  options.run_buffer_bytes = 64 * 1024;
+  options.io_engine = IoEngineKind::Sync;
+  options.max_fan_in = 3;
+
+  ASSERT_NO_THROW(ExternalMemorySorter::generateRandomFile(input_filename, 6));
+  ASSERT_NO_THROW(ExternalMemorySorter::externalMemorySort(input_filename, output_filename, 1, options));
+
+  std::vector<uint32_t> input_data = readBinaryFile(input_filename);
+  std::vector<uint32_t> sorted_data = readBinaryFile(output_filename);
+  std::sort(input_data.begin(), input_data.end());
+  ASSERT_EQ(sorted_data, input_data) << "Output is not the sorted input.";
+
+  deleteFile(input_filename);
+  deleteFile(output_filename);
+}
+
+TEST_F(ExternalMemorySorterTest, ExternalMemorySortCompressedRuns) {
+  std::string input_filename = temp_dir + "test_input_compressed.dat";
+  std::string output_filename = temp_dir + "test_output_compressed.dat";
+
+  SortOptions options;
+  options.run_buffer_bytes = 64 * 1024;
+  options.spill_format = RunFormat::Compressed;
+  options.max_fan_in = 3;
+  options.prefetch_blocks = 2;
+
+  ASSERT_NO_THROW(ExternalMemorySorter::generateRandomFile(input_filename, 6));
+  ASSERT_NO_THROW(ExternalMemorySorter::externalMemorySort(input_filename, output_filename, 1, options));
+
+  std::vector<uint32_t> input_data = readBinaryFile(input_filename);
+  std::vector<uint32_t> sorted_data = readBinaryFile(output_filename);
+  std::sort(input_data.begin(), input_data.end());
+  ASSERT_EQ(sorted_data, input_data) << "Output is not the sorted input.";
+
+  deleteFile(input_filename);
+  deleteFile(output_filename);
+}
+
+TEST_F(ExternalMemorySorterTest, MemoryBudgetSort) {
+  std::string input_filename = temp_dir + "test_input_budget.dat";
+  std::string output_filename = temp_dir + "test_output_budget.dat";
+
+  // 2 MB cannot hold the 6 MB input, so it is sorted externally in chunks sized from the budget
+  SortOptions options;
+  options.memory_budget_mode = true;
+  options.memory_budget_bytes = 2 * 1024 * 1024;
+
+  ASSERT_NO_THROW(ExternalMemorySorter::generateRandomFile(input_filename, 6));
+  testing::internal::CaptureStdout();
+  ASSERT_NO_THROW(ExternalMemorySorter::memoryBudgetSort(input_filename, output_filename, options));
+  std::string output = testing::internal::GetCapturedStdout();
+  ASSERT_NE(output.find("External memory sort completed."), std::string::npos);
+
+  std::vector<uint32_t> input_data = readBinaryFile(input_filename);
+  std::vector<uint32_t> sorted_data = readBinaryFile(output_filename);
+  std::sort(input_data.begin(), input_data.end());
+  ASSERT_EQ(sorted_data, input_data) << "Output is not the sorted input.";
+
+  // The detected budget holds a 6 MB input easily
+  options.memory_budget_bytes = 0;
+  deleteFile(output_filename);
+  testing::internal::CaptureStdout();
+  ASSERT_NO_THROW(ExternalMemorySorter::memoryBudgetSort(input_filename, output_filename, options));
+  output = testing::internal::GetCapturedStdout();
+  ASSERT_NE(output.find("In-memory sort completed."), std::string::npos);
+  ASSERT_EQ(readBinaryFile(output_filename), input_data);
+
+  deleteFile(input_filename);
+  deleteFile(output_filename);
+}
+
+// Test case: A sort whose final merge fails continues from the run manifest
+TEST_F(ExternalMemorySorterTest, ExternalMemorySortResume) {
+  std::string input_filename = temp_dir + "test_input_resume.dat";
+  std::string output_filename = temp_dir + "test_output_resume.dat";
+
+  SortOptions options;
+  options.max_fan_in = 3;
+
+  ASSERT_NO_THROW(ExternalMemorySorter::generateRandomFile(input_filename, 5));
+  // The output directory does not exist, so the sort stops after the intermediate merge pass
+  testing::internal::CaptureStdout();
+  testing::internal::CaptureStderr();
+  ExternalMemorySorter::externalMemorySort(
+      input_filename, temp_dir + "missing_directory/out.dat", 1, options
+  );
+  testing::internal::GetCapturedStdout();
+  testing::internal::GetCapturedStderr();
+
+  options.resume = true;
+  testing::internal::CaptureStdout();
+  ExternalMemorySorter::externalMemorySort(input_filename, output_filename, 1, options);
+  std::string output = testing::internal::GetCapturedStdout();
+  ASSERT_NE(output.find("Resuming from the run manifest"), std::string::npos) << output;
+  ASSERT_NE(output.find("reused 2 of 2 runs"), std::string::npos) << output;
+
+  std::vector<uint32_t> input_data = readBinaryFile(input_filename);
+  std::vector<uint32_t> sorted_data = readBinaryFile(output_filename);
+  std::sort(input_data.begin(), input_data.end());
+  ASSERT_EQ(sorted_data, input_data) << "Output is not the sorted input.";
+
+  // The completed sort removed its manifest, so there is nothing left to resume
+  testing::internal::CaptureStdout();
+  ExternalMemorySorter::externalMemorySort(input_filename, output_filename, 1, options);
+  output = testing::internal::GetCapturedStdout();
+  ASSERT_NE(output.find("No run manifest matches"), std::string::npos) << output;
+
+  deleteFile(input_filename);
+  deleteFile(output_filename);
+}
+
+// Test case: Runs striped over two spill directories are merged from both
+TEST_F(ExternalMemorySorterTest, ExternalMemorySortStripedSpill) {
+  std::string input_filename = temp_dir + "test_input_striped.dat";
+  std::string output_filename = temp_dir + "test_output_striped.dat";
+  std::vector<std::string> const spill_directories = {
+      temp_dir + "test_spill_0", temp_dir + "test_spill_1"
+  };
+  for (const std::string& directory: spill_directories) {
+    std::filesystem::create_directory(directory);
+  }
+
+  SortOptions options;
+  options.spill_directories = spill_directories;
+  options.max_fan_in = 3;
+
+  ASSERT_NO_THROW(ExternalMemorySorter::generateRandomFile(input_filename, 5));
+  testing::internal::CaptureStdout();
+  ExternalMemorySorter::externalMemorySort(input_filename, output_filename, 1, options);
+  std::string output = testing::internal::GetCapturedStdout();
+  ASSERT_NE(output.find("Striping runs over 2 spill directories"), std::string::npos) << output;
+  ASSERT_NE(output.find("Prefetch read"), std::string::npos) << output;
+
+  std::vector<uint32_t> input_data = readBinaryFile(input_filename);
+  std::vector<uint32_t> sorted_data = readBinaryFile(output_filename);
+  std::sort(input_data.begin(), input_data.end());
+  ASSERT_EQ(sorted_data, input_data) << "Output is not the sorted input.";
+
+  // Every temporary run was removed from both directories
+  for (const std::string& directory: spill_directories) {
+    ASSERT_TRUE(std::filesystem::is_empty(directory)) << directory;
+    std::filesystem::remove(directory);
+  }
+  deleteFile(input_filename);
+  deleteFile(output_filename);
+}
+
+// Test case: A sorted input is copied, and presorted chunks skip the full sort
+TEST_F(ExternalMemorySorterTest, ExternalMemorySortPresortedInput) {
+  std::string input_filename = temp_dir + "test_input_presorted.dat";
+  std::string output_filename = temp_dir + "test_output_presorted.dat";
+
+  ASSERT_NO_THROW(ExternalMemorySorter::generateRandomFile(input_filename, 3));
+  std::vector<uint32_t> values = readBinaryFile(input_filename);
+  std::sort(values.begin(), values.end());
+  auto write_input = [&](const std::vector<uint32_t>& data) {
+    std::ofstream file(input_filename, std::ios::binary | std::ios::trunc);
+    file.write(
+        reinterpret_cast<const char*>(data.data()),
+        static_cast<std::streamsize>(data.size() * sizeof(uint32_t))
+    );
+  };
+  write_input(values);
+
+  testing::internal::CaptureStdout();
+  ExternalMemorySorter::externalMemorySort(input_filename, output_filename, 1);
+  std::string output = testing::internal::GetCapturedStdout();
+  ASSERT_NE(output.find("Input is already sorted, copied it"), std::string::npos) << output;
+  ASSERT_EQ(output.find("Sorting"), std::string::npos) << output;
+  ASSERT_EQ(readBinaryFile(output_filename), values);
+
+  // Sorting the sorted file onto itself leaves it alone
+  testing::internal::CaptureStdout();
+  ExternalMemorySorter::externalMemorySort(input_filename, input_filename, 1);
+  output = testing::internal::GetCapturedStdout();
+  ASSERT_NE(output.find("Input is already sorted, nothing to do"), std::string::npos) << output;
+  ASSERT_EQ(readBinaryFile(input_filename), values);
+
+  // Reversed input: every 1 MB chunk is a descending run
+  std::vector<uint32_t> reversed(values.rbegin(), values.rend());
+  write_input(reversed);
+  testing::internal::CaptureStdout();
+  ExternalMemorySorter::externalMemorySort(input_filename, output_filename, 1);
+  output = testing::internal::GetCapturedStdout();
+  ASSERT_NE(output.find("Chunks already sorted 0, reversed 3,"), std::string::npos) << output;
+  ASSERT_EQ(readBinaryFile(output_filename), values);
+
+  deleteFile(input_filename);
+  deleteFile(output_filename);
+}
+
+// Test case: The k smallest values come out sorted, also when 2k values exceed the budget
+TEST_F(ExternalMemorySorterTest, TopK) {
+  std::string input_filename = temp_dir + "test_input_topk.dat";
+  std::string output_filename = temp_dir + "test_output_topk.dat";
+
+  ASSERT_NO_THROW(ExternalMemorySorter::generateRandomFile(input_filename, 4));
+  std::vector<uint32_t> sorted_input = readBinaryFile(input_filename);
+  std::sort(sorted_input.begin(), sorted_input.end());
+
+  SortOptions options;
+  options.memory_budget_bytes = 1024 * 1024;
+  for (size_t const k: {size_t{0}, size_t{1}, size_t{1000}, size_t{200000}}) {
+    testing::internal::CaptureStdout();
+    ExternalMemorySorter::topK(input_filename, output_filename, k, options);
+    std::string output = testing::internal::GetCapturedStdout();
+    std::vector<uint32_t> const expected(
+        sorted_input.begin(), sorted_input.begin() + static_cast<std::ptrdiff_t>(k)
+    );
+    ASSERT_EQ(readBinaryFile(output_filename), expected) << "k = " << k;
+    ASSERT_EQ(output.find("exceed the memory budget") != std::string::npos, k == 200000) << output;
+  }
+
+  // More values asked for than the input holds
+  testing::internal::CaptureStdout();
+  ExternalMemorySorter::topK(input_filename, output_filename, sorted_input.size() * 2);
+  testing::internal::GetCapturedStdout();
+  ASSERT_EQ(readBinaryFile(output_filename), sorted_input);
+
+  deleteFile(input_filename);
+  deleteFile(output_filename);
+}
+
+// Test case: The values of a key range come out sorted, also when they are spilled
+TEST_F(ExternalMemorySorterTest, ExtractRange) {
+  std::string input_filename = temp_dir + "test_input_range.dat";
+  std::string output_filename = temp_dir + "test_output_range.dat";
+
+  ASSERT_NO_THROW(ExternalMemorySorter::generateRandomFile(input_filename, 4));
+  std::vector<uint32_t> sorted_input = readBinaryFile(input_filename);
+  std::sort(sorted_input.begin(), sorted_input.end());
+  auto expected_range = [&](uint32_t low, uint32_t high) {
+    return std::vector<uint32_t>(
+        std::lower_bound(sorted_input.begin(), sorted_input.end(), low),
+        std::upper_bound(sorted_input.begin(), sorted_input.end(), high)
+    );
+  };
+
+  SortOptions options;
+  options.memory_budget_bytes = 1024 * 1024;
+  testing::internal::CaptureStdout();
+  ExternalMemorySorter::extractRange(input_filename, output_filename, 1000000, 50000000, options);
+  std::string output = testing::internal::GetCapturedStdout();
+  ASSERT_EQ(output.find("spilling"), std::string::npos) << output;
+  ASSERT_EQ(readBinaryFile(output_filename), expected_range(1000000, 50000000));
+
+  // The whole 4 MB input is in range, more than the 1 MB budget holds
+  testing::internal::CaptureStdout();
+  ExternalMemorySorter::extractRange(
+      input_filename, output_filename, 0, std::numeric_limits<uint32_t>::max(), options
+  );
+  output = testing::internal::GetCapturedStdout();
+  ASSERT_NE(output.find("spilling"), std::string::npos) << output;
+  ASSERT_EQ(readBinaryFile(output_filename), sorted_input);
+
+  deleteFile(input_filename);
+  deleteFile(output_filename);
+}
+
+// Test case: Unique and count outputs collapse duplicates in the runs and across merge passes
+TEST_F(ExternalMemorySorterTest, ExternalMemorySortUniqueAndCount) {
+  std::string input_filename = temp_dir + "test_input_collapse.dat";
+  std::string output_filename = temp_dir + "test_output_collapse.dat";
+
+  // 5 MB over a thousand distinct values
+  ASSERT_NO_THROW(ExternalMemorySorter::generateRandomFile(input_filename, 5));
+  std::vector<uint32_t> input_data = readBinaryFile(input_filename);
+  for (uint32_t& value: input_data) {
+    value %= 1000;
+  }
+  {
+    std::ofstream file(input_filename, std::ios::binary | std::ios::trunc);
+    file.write(
+        reinterpret_cast<const char*>(input_data.data()),
+        static_cast<std::streamsize>(input_data.size() * sizeof(uint32_t))
+    );
+  }
+  std::sort(input_data.begin(), input_data.end());
+  std::vector<uint32_t> expected_unique;
+  std::vector<uint32_t> expected_count;
+  for (size_t i = 0; i < input_data.size();) {
+    size_t j = i;
+    while (j < input_data.size() && input_data[j] == input_data[i]) {
+      ++j;
+    }
+    expected_unique.push_back(input_data[i]);
+    expected_count.push_back(input_data[i]);
+    expected_count.push_back(static_cast<uint32_t>(j - i));
+    i = j;
+  }
+
+  std::vector<SortOptions> configurations(5);
+  configurations[1].max_fan_in = 2;
+  configurations[2].run_generation = RunGeneration::ReplacementSelection;
+  configurations[2].spill_format = RunFormat::Compressed;
+  configurations[3].merge_threads = 4;
+  configurations[4].pipelined = true;
+  configurations[4].io_engine = IoEngineKind::Sync;
+  for (size_t c = 0; c < configurations.size(); ++c) {
+    for (OutputMode const mode: {OutputMode::Unique, OutputMode::Count}) {
+      SortOptions options = configurations[c];
+      options.output_mode = mode;
+      testing::internal::CaptureStdout();
+      ExternalMemorySorter::externalMemorySort(input_filename, output_filename, 1, options);
+      testing::internal::GetCapturedStdout();
+      ASSERT_EQ(
+          readBinaryFile(output_filename),
+          mode == OutputMode::Unique ? expected_unique : expected_count
+      ) << "configuration " << c;
+    }
+  }
+
+  // The input fits the budget and is sorted in memory
+  SortOptions options;
+  options.memory_budget_bytes = 64 * 1024 * 1024;
+  options.output_mode = OutputMode::Count;
+  testing::internal::CaptureStdout();
+  ExternalMemorySorter::memoryBudgetSort(input_filename, output_filename, options);
+  testing::internal::GetCapturedStdout();
+  ASSERT_EQ(readBinaryFile(output_filename), expected_count);
+
+  deleteFile(input_filename);
+  deleteFile(output_filename);
+}
+
+// Write `records` as a raw file
+template <typename Record>
+void WriteRecordFile(const std::string& filename, const std::vector<Record>& records) {
+  std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+  file.write(
+      reinterpret_cast<const char*>(records.data()),
+      static_cast<std::streamsize>(records.size() * sizeof(Record))
+  );
+}
+
+template <typename Record>
+std::vector<Record> ReadRecordFile(const std::string& filename) {
+  std::ifstream file(filename, std::ios::binary | std::ios::ate);
+  std::vector<Record> records(static_cast<size_t>(file.tellg()) / sizeof(Record));
+  file.seekg(0);
+  file.read(
+      reinterpret_cast<char*>(records.data()),
+      static_cast<std::streamsize>(records.size() * sizeof(Record))
+  );
+  return records;
+}
+
+// Test case: Records of every type are sorted by their key through a cascade of merge passes
+TEST_F(ExternalMemorySorterTest, ExternalMemorySortRecordTypes) {
+  std::string input_filename = temp_dir + "test_input_records.dat";
+  std::string output_filename = temp_dir + "test_output_records.dat";
+
+  // 4 MB of random bits reinterpreted as every record type, the floats include NaNs
+  ASSERT_NO_THROW(ExternalMemorySorter::generateRandomFile(input_filename, 4));
+  SortOptions options;
+  options.max_fan_in = 2;
+  for (RecordType const type:
+       {RecordType::U64, RecordType::I32, RecordType::I64, RecordType::F32, RecordType::F64,
+        RecordType::KeyPayload}) {
+    options.record_type = type;
+    DispatchRecordType(type, [&](auto record) {
+      using Record = decltype(record);
+      std::vector<Record> expected = ReadRecordFile<Record>(input_filename);
+      testing::internal::CaptureStdout();
+      ExternalMemorySorter::externalMemorySort(input_filename, output_filename, 1, options);
+      std::string output = testing::internal::GetCapturedStdout();
+      ASSERT_NE(output.find("Merge plan has 2 pass(es)"), std::string::npos) << output;
+
+      std::vector<Record> sorted = ReadRecordFile<Record>(output_filename);
+      ASSERT_EQ(sorted.size(), expected.size());
+      ASSERT_TRUE(std::is_sorted(sorted.begin(), sorted.end(), RecordLess<Record>()))
+          << RecordTypeName(type);
+      // Compare as keys, a NaN never equals itself
+      auto by_key = [](const Record& left, const Record& right) {
+        return RecordTraits<Record>::key(left) < RecordTraits<Record>::key(right);
+      };
+      std::stable_sort(expected.begin(), expected.end(), by_key);
+      std::vector<typename RecordTraits<Record>::Key> expected_keys;
+      std::vector<typename RecordTraits<Record>::Key> sorted_keys;
+      for (size_t i = 0; i < sorted.size(); ++i) {
+        expected_keys.push_back(RecordTraits<Record>::key(expected[i]));
+        sorted_keys.push_back(RecordTraits<Record>::key(sorted[i]));
+      }
+      ASSERT_EQ(sorted_keys, expected_keys) << RecordTypeName(type);
+
+      testing::internal::CaptureStdout();
+      ExternalMemorySorter::checkFileSorted(output_filename, options);
+      output = testing::internal::GetCapturedStdout();
+      ASSERT_NE(output.find("File is sorted."), std::string::npos) << output;
+    });
+  }
+
+  // Payloads travel with their keys
+  std::vector<KeyPayloadRecord> records;
+  for (uint64_t i = 0; i < 100000; ++i) {
+    records.push_back(KeyPayloadRecord{(i * 7919) % 100000, ((i * 7919) % 100000) ^ 0xABCDEF});
+  }
+  WriteRecordFile(input_filename, records);
+  options.record_type = RecordType::KeyPayload;
+  testing::internal::CaptureStdout();
+  ExternalMemorySorter::memoryBudgetSort(input_filename, output_filename, options);
+  testing::internal::GetCapturedStdout();
+  std::vector<KeyPayloadRecord> const sorted = ReadRecordFile<KeyPayloadRecord>(output_filename);
+  ASSERT_EQ(sorted.size(), records.size());
+  for (uint64_t i = 0; i < sorted.size(); ++i) {
+    ASSERT_EQ(sorted[i], (KeyPayloadRecord{i, i ^ 0xABCDEF}));
+  }
+
+  deleteFile(input_filename);
+  deleteFile(output_filename);
+}
+
+// Test case: 100 byte records are sorted by their whole 10 byte key and keep their values
+TEST_F(ExternalMemorySorterTest, ExternalMemorySortGrayRecords) {
+  std::string input_filename = temp_dir + "test_input_gray.dat";
+  std::string output_filename = temp_dir + "test_output_gray.dat";
+
+  // Few distinct 8 byte prefixes, so that the last two key bytes decide most comparisons
+  std::mt19937 engine(17);
+  std::vector<GrayRecord> records(60000);
+  for (size_t i = 0; i < records.size(); ++i) {
+    GrayRecord& record = records[i];
+    record.key[0] = static_cast<uint8_t>(engine() % 3);
+    for (size_t k = 8; k < GrayKeyBytes; ++k) {
+      record.key[k] = static_cast<uint8_t>(engine());
+    }
+    std::memcpy(record.value, &i, sizeof(i));
+    std::memset(
+        record.value + sizeof(i), static_cast<int>(record.key[9]), GrayValueBytes - sizeof(i)
+    );
+  }
+  WriteRecordFile(input_filename, records);
+  std::vector<GrayRecord> expected = records;
+  std::stable_sort(expected.begin(), expected.end(), RecordLess<GrayRecord>());
+
+  SortOptions options;
+  options.record_type = RecordType::Gray100;
+  options.max_fan_in = 2;
+  testing::internal::CaptureStdout();
+  ExternalMemorySorter::externalMemorySort(input_filename, output_filename, 1, options);
+  std::string output = testing::internal::GetCapturedStdout();
+  ASSERT_NE(output.find("into 6 runs"), std::string::npos) << output;
+  std::vector<GrayRecord> sorted = ReadRecordFile<GrayRecord>(output_filename);
+  ASSERT_EQ(sorted.size(), expected.size());
+  ASSERT_TRUE(std::is_sorted(sorted.begin(), sorted.end(), RecordLess<GrayRecord>()));
+  // Every record is intact and present once
+  std::vector<bool> seen(records.size(), false);
+  for (const GrayRecord& record: sorted) {
+    size_t index = 0;
+    std::memcpy(&index, record.value, sizeof(index));
+    ASSERT_LT(index, records.size());
+    ASSERT_FALSE(seen[index]);
+    seen[index] = true;
+    ASSERT_EQ(record, records[index]);
+  }
+
+  // The same through the in-memory sort
+  options.memory_budget_bytes = 64 * 1024 * 1024;
+  testing::internal::CaptureStdout();
+  ExternalMemorySorter::memoryBudgetSort(input_filename, output_filename, options);
+  testing::internal::GetCapturedStdout();
+  sorted = ReadRecordFile<GrayRecord>(output_filename);
+  ASSERT_TRUE(std::is_sorted(sorted.begin(), sorted.end(), RecordLess<GrayRecord>()));
+  ASSERT_EQ(sorted.size(), records.size());
+
+  deleteFile(input_filename);
+  deleteFile(output_filename);
+}
+
+// Test case: Text lines are sorted through arenas, length-prefixed runs and merge passes
+TEST_F(ExternalMemorySorterTest, ExternalMemorySortLines) {
+  std::string input_filename = temp_dir + "test_input_lines.txt";
+  std::string output_filename = temp_dir + "test_output_lines.txt";
+
+  // CSV rows with a numeric second field, one row longer than a whole chunk, no final newline
+  std::mt19937 engine(5);
+  std::vector<std::string> lines;
+  for (size_t i = 0; i < 40000; ++i) {
+    int const value = static_cast<int>(engine() % 2001) - 1000;
+    lines.push_back(
+        "key" + std::to_string(engine() % 5000) + "," + std::to_string(value) + ",payload" +
+        std::string(engine() % 40, 'x')
+    );
+  }
+  lines[1234] = "key-long," + std::string(1536 * 1024, 'y');
+  {
+    std::ofstream file(input_filename, std::ios::binary | std::ios::trunc);
+    for (size_t i = 0; i < lines.size(); ++i) {
+      file << lines[i] << (i + 1 < lines.size() ? "\n" : "");
+    }
+  }
+  auto read_lines = [](const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary);
+    std::vector<std::string> result;
+    for (std::string line; std::getline(file, line);) {
+      result.push_back(line);
+    }
+    return result;
+  };
+
+  SortOptions options;
+  options.record_type = RecordType::Lines;
+  options.max_fan_in = 2;
+  testing::internal::CaptureStdout();
+  ExternalMemorySorter::externalMemorySort(input_filename, output_filename, 1, options);
+  std::string output = testing::internal::GetCapturedStdout();
+  ASSERT_NE(output.find("Merge plan has 2 pass(es)"), std::string::npos) << output;
+  std::vector<std::string> expected = lines;
+  std::sort(expected.begin(), expected.end());
+  ASSERT_EQ(read_lines(output_filename), expected);
+
+  // Numeric order of the second field, in memory and external
+  options.line_key.field = 2;
+  options.line_key.numeric = true;
+  std::vector<std::string> numeric = lines;
+  auto number = [](const std::string& line) {
+    size_t const comma = line.find(',');
+    return line[comma + 1] == 'y' ? 0 : std::stoi(line.substr(comma + 1));
+  };
+  std::sort(numeric.begin(), numeric.end(), [&](const std::string& left, const std::string& right) {
+    return number(left) != number(right) ? number(left) < number(right) : left < right;
+  });
+  testing::internal::CaptureStdout();
+  ExternalMemorySorter::externalMemorySort(input_filename, output_filename, 1, options);
+  ExternalMemorySorter::checkFileSorted(output_filename, options);
+  output = testing::internal::GetCapturedStdout();
+  ASSERT_NE(output.find("File is sorted."), std::string::npos) << output;
+  ASSERT_EQ(read_lines(output_filename), numeric);
+
+  options.memory_budget_bytes = 64 * 1024 * 1024;
+  testing::internal::CaptureStdout();
+  ExternalMemorySorter::memoryBudgetSort(input_filename, output_filename, options);
+  testing::internal::GetCapturedStdout();
+  ASSERT_EQ(read_lines(output_filename), numeric);
+
+  deleteFile(input_filename);
+  deleteFile(output_filename);
+}
+
+// Test case: A pipe is sorted until it ends without knowing its size, and the output can be a pipe
+TEST_F(ExternalMemorySorterTest, ExternalMemorySortPipes) {
+  std::string input_filename = temp_dir + "test_input_pipe.dat";
+  std::string output_filename = temp_dir + "test_output_pipe.dat";
+  std::string input_fifo = temp_dir + "test_input_pipe.fifo";
+  std::string output_fifo = temp_dir + "test_output_pipe.fifo";
+  deleteFile(input_fifo);
+  deleteFile(output_fifo);
+  ASSERT_EQ(mkfifo(input_fifo.c_str(), 0600), 0);
+  ASSERT_EQ(mkfifo(output_fifo.c_str(), 0600), 0);
+
+  ASSERT_NO_THROW(ExternalMemorySorter::generateRandomFile(input_filename, 5));
+  std::vector<uint32_t> expected = readBinaryFile(input_filename);
+  std::sort(expected.begin(), expected.end());
+  auto feed_input = [&] {
+    return std::thread([&] {
+      std::ifstream input(input_filename, std::ios::binary);
+      std::ofstream pipe(input_fifo, std::ios::binary);
+      pipe << input.rdbuf();
+    });
+  };
+
+  // 5 MB in chunks of 2 MB, the last one cut short by the end of the stream
+  std::thread writer = feed_input();
+  testing::internal::CaptureStdout();
+  ExternalMemorySorter::externalMemorySort(input_fifo, output_filename, 2);
+  std::string output = testing::internal::GetCapturedStdout();
+  writer.join();
+  ASSERT_NE(output.find("Sorting chunks until the end of the stream"), std::string::npos) << output;
+  ASSERT_NE(output.find("Chunk 3 sorted"), std::string::npos) << output;
+  ASSERT_EQ(output.find("Chunk 4 sorted"), std::string::npos) << output;
+  ASSERT_EQ(readBinaryFile(output_filename), expected);
+
+  // Pipe to pipe, with the options that need a file falling back to plain streams
+  SortOptions options;
+  options.pipelined = true;
+  options.merge_threads = 4;
+  options.resume = true;
+  std::vector<uint32_t> drained;
+  writer = feed_input();
+  std::thread reader([&] { drained = readBinaryFile(output_fifo); });
+  testing::internal::CaptureStdout();
+  ExternalMemorySorter::externalMemorySort(input_fifo, output_fifo, 2, options);
+  output = testing::internal::GetCapturedStdout();
+  writer.join();
+  reader.join();
+  ASSERT_NE(output.find("--resume is ignored"), std::string::npos) << output;
+  ASSERT_EQ(drained, expected);
+
+  // A stream of unknown size never fits the budget up front
+  options = SortOptions();
+  options.memory_budget_bytes = 2 * 1024 * 1024;
+  writer = feed_input();
+  testing::internal::CaptureStdout();
+  ExternalMemorySorter::memoryBudgetSort(input_fifo, output_filename, options);
+  output = testing::internal::GetCapturedStdout();
+  writer.join();
+  ASSERT_NE(output.find("External memory sort completed."), std::string::npos) << output;
+  ASSERT_EQ(readBinaryFile(output_filename), expected);
+
+  // Top-K counts the values of a pipe as it reads them
+  writer = feed_input();
+  testing::internal::CaptureStdout();
+  ExternalMemorySorter::topK(input_fifo, output_filename, 1000, options);
+  output = testing::internal::GetCapturedStdout();
+  writer.join();
+  ASSERT_NE(output.find("smallest of " + std::to_string(expected.size())), std::string::npos)
+      << output;
+  ASSERT_EQ(
+      readBinaryFile(output_filename),
+      std::vector<uint32_t>(expected.begin(), expected.begin() + 1000)
+  );
+
+  // Past the budget the sorted values cannot be truncated in an output pipe, only k are copied
+  size_t const k = 400000;
+  writer = feed_input();
+  reader = std::thread([&] { drained = readBinaryFile(output_fifo); });
+  testing::internal::CaptureStdout();
+  ExternalMemorySorter::topK(input_fifo, output_fifo, k, options);
+  output = testing::internal::GetCapturedStdout();
+  writer.join();
+  reader.join();
+  ASSERT_NE(output.find("exceed the memory budget"), std::string::npos) << output;
+  ASSERT_EQ(drained, std::vector<uint32_t>(expected.begin(), expected.begin() + k));
+
+  writer = feed_input();
+  testing::internal::CaptureStdout();
+  ExternalMemorySorter::extractRange(input_fifo, output_filename, 0, 100000000, options);
+  output = testing::internal::GetCapturedStdout();
+  writer.join();
+  ASSERT_EQ(
+      readBinaryFile(output_filename),
+      std::vector<uint32_t>(
+          expected.begin(), std::upper_bound(expected.begin(), expected.end(), 100000000)
+      )
+  );
+
+  deleteFile(input_fifo);
+  deleteFile(output_fifo);
+  deleteFile(input_filename);
+  deleteFile(output_filename);
+}
+
+// Test case: Distribution sort partitions the input into buckets by sampled splitters
+TEST_F(ExternalMemorySorterTest, ExternalMemorySortDistribution) {
+  std::string input_filename = temp_dir + "test_input_distribution.dat";
+  std::string output_filename = temp_dir + "test_output_distribution.dat";
+  auto write_values = [&](const std::vector<uint32_t>& values) {
+    std::ofstream file(input_filename, std::ios::binary | std::ios::trunc);
+    file.write(
+        reinterpret_cast<const char*>(values.data()),
+        static_cast<std::streamsize>(values.size() * sizeof(uint32_t))
+    );
+  };
+
+  // Uniform keys, forced and chosen by the sample
+  ASSERT_NO_THROW(ExternalMemorySorter::generateRandomFile(input_filename, 8));
+  std::vector<uint32_t> expected = readBinaryFile(input_filename);
+  std::sort(expected.begin(), expected.end());
+  SortOptions options;
+  for (SortStrategy const strategy: {SortStrategy::Distribution, SortStrategy::Auto}) {
+    options.strategy = strategy;
+    testing::internal::CaptureStdout();
+    ExternalMemorySorter::externalMemorySort(input_filename, output_filename, 2, options);
+    std::string output = testing::internal::GetCapturedStdout();
+    ASSERT_NE(output.find("Distributing into 6 buckets"), std::string::npos) << output;
+    ASSERT_EQ(output.find("Merge plan"), std::string::npos) << output;
+    ASSERT_EQ(readBinaryFile(output_filename), expected);
+  }
+
+  // Two thirds of the values are one key, which goes to a bucket of its own and is never sorted
+  std::mt19937 engine(11);
+  std::vector<uint32_t> values(2 * 1024 * 1024);
+  for (size_t i = 0; i < values.size(); ++i) {
+    values[i] = i % 3 != 0 ? 0x80000000 : static_cast<uint32_t>(engine());
+  }
+  write_values(values);
+  std::sort(values.begin(), values.end());
+  options.strategy = SortStrategy::Auto;
+  options.output_mode = OutputMode::Unique;
+  testing::internal::CaptureStdout();
+  ExternalMemorySorter::externalMemorySort(input_filename, output_filename, 2, options);
+  std::string output = testing::internal::GetCapturedStdout();
+  ASSERT_NE(output.find("Distributing into"), std::string::npos) << output;
+  std::vector<uint32_t> unique = values;
+  unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+  ASSERT_EQ(readBinaryFile(output_filename), unique);
+
+  // Values between the sampled positions crowd into one bucket the sample cannot see, which is
+  // sorted by merging
+  for (size_t i = 0; i < values.size(); ++i) {
+    values[i] = i % 128 == 0 ? static_cast<uint32_t>(engine()) : 5000 + engine() % (1U << 20U);
+  }
+  write_values(values);
+  std::sort(values.begin(), values.end());
+  options.strategy = SortStrategy::Distribution;
+  options.output_mode = OutputMode::All;
+  testing::internal::CaptureStdout();
+  ExternalMemorySorter::externalMemorySort(input_filename, output_filename, 2, options);
+  output = testing::internal::GetCapturedStdout();
+  ASSERT_NE(output.find("exceeds the chunk, sorting it by merging"), std::string::npos) << output;
+  ASSERT_EQ(readBinaryFile(output_filename), values);
+
+  // An oversized bucket spilled compressed is decoded before it is sorted by merging
+  values.resize(4 * 1024 * 1024);
+  for (size_t i = 0; i < values.size(); ++i) {
+    values[i] = i % 256 == 0 ? static_cast<uint32_t>(engine()) : 1000 + engine() % 199000;
+  }
+  write_values(values);
+  std::sort(values.begin(), values.end());
+  options.spill_format = RunFormat::Compressed;
+  testing::internal::CaptureStdout();
+  ExternalMemorySorter::externalMemorySort(input_filename, output_filename, 1, options);
+  output = testing::internal::GetCapturedStdout();
+  ASSERT_NE(output.find("exceeds the chunk, sorting it by merging"), std::string::npos) << output;
+  ASSERT_EQ(readBinaryFile(output_filename), values);
+
+  deleteFile(input_filename);
+  deleteFile(output_filename);
+}
+
+// Test case: Already sorted files are merged without sorting them again, the inputs stay
+TEST_F(ExternalMemorySorterTest, MergeSortedFiles) {
+  std::string output_filename = temp_dir + "test_output_merged.dat";
+  std::mt19937 engine(21);
+  std::vector<std::string> inputs;
+  std::vector<uint32_t> expected;
+  for (size_t i = 0; i < 7; ++i) {
+    // Narrow keys for plenty of duplicates within and across the files, one file is empty
+    std::vector<uint32_t> values(i == 3 ? 0 : 1000 + engine() % 200000);
+    for (uint32_t& value: values) {
+      value = engine() % 50000;
+    }
+    std::sort(values.begin(), values.end());
+    inputs.push_back(temp_dir + "test_input_merge_" + std::to_string(i) + ".dat");
+    std::ofstream file(inputs.back(), std::ios::binary | std::ios::trunc);
+    file.write(
+        reinterpret_cast<const char*>(values.data()),
+        static_cast<std::streamsize>(values.size() * sizeof(uint32_t))
+    );
+    expected.insert(expected.end(), values.begin(), values.end());
+  }
+  std::sort(expected.begin(), expected.end());
+
+  // 7 files at a fan-in of 3 take two passes
+  SortOptions options;
+  options.max_fan_in = 3;
+  options.memory_budget_bytes = 64 * 1024 * 1024;
+  testing::internal::CaptureStdout();
+  ASSERT_TRUE(ExternalMemorySorter::mergeSortedFiles(inputs, output_filename, options));
+  std::string output = testing::internal::GetCapturedStdout();
+  ASSERT_NE(output.find("Merge plan has 2 pass(es)"), std::string::npos) << output;
+  ASSERT_EQ(readBinaryFile(output_filename), expected);
+  for (const std::string& input: inputs) {
+    ASSERT_TRUE(std::filesystem::exists(input)) << input;
+  }
+
+  // Counted across passes from inputs of plain values
+  options.output_mode = OutputMode::Count;
+  testing::internal::CaptureStdout();
+  ASSERT_TRUE(ExternalMemorySorter::mergeSortedFiles(inputs, output_filename, options));
+  testing::internal::GetCapturedStdout();
+  std::vector<uint32_t> counted;
+  for (size_t i = 0; i < expected.size();) {
+    size_t j = i;
+    while (j < expected.size() && expected[j] == expected[i]) {
+      ++j;
+    }
+    counted.push_back(expected[i]);
+    counted.push_back(static_cast<uint32_t>(j - i));
+    i = j;
+  }
+  ASSERT_EQ(readBinaryFile(output_filename), counted);
+
+  // A single pass with a parallel final merge
+  options = SortOptions();
+  options.memory_budget_bytes = 64 * 1024 * 1024;
+  options.merge_threads = 3;
+  testing::internal::CaptureStdout();
+  ASSERT_TRUE(ExternalMemorySorter::mergeSortedFiles(inputs, output_filename, options));
+  testing::internal::GetCapturedStdout();
+  ASSERT_EQ(readBinaryFile(output_filename), expected);
+
+  // The output must not overwrite an input
+  testing::internal::CaptureStderr();
+  ASSERT_FALSE(ExternalMemorySorter::mergeSortedFiles(inputs, inputs[0], options));
+  testing::internal::GetCapturedStderr();
+
+  for (const std::string& input: inputs) {
+    deleteFile(input);
+  }
+  deleteFile(output_filename);
+}
+
 // Test case: Check if file is sorted
 TEST_F(ExternalMemorySorterTest, CheckFileSorted) {
   std::string filename = temp_dir + "test_sorted.dat";
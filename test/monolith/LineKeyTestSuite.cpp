@@ -0,0 +1,95 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "loaders/util/line_key.hpp"
+
+namespace {
+
+// Lines of random length over a small alphabet with long shared prefixes, some holding zero bytes
+std::vector<std::string> RandomLines(size_t count, uint32_t seed) {
+  std::mt19937 engine(seed);
+  std::vector<std::string> lines;
+  for (size_t i = 0; i < count; ++i) {
+    std::string line = engine() % 2 == 0 ? "common/prefix/of/many/keys/" : "";
+    size_t const length = engine() % 24;
+    for (size_t k = 0; k < length; ++k) {
+      line.push_back("ab\0z,"[engine() % 5]);
+    }
+    lines.push_back(line);
+  }
+  return lines;
+}
+
+// Sort `lines` through SortLines over one arena
+std::vector<std::string> SortThroughArena(
+    const std::vector<std::string>& lines, const LineKeySpec& spec
+) {
+  std::string arena;
+  std::vector<LineRef> refs;
+  for (const std::string& line: lines) {
+    refs.push_back(MakeLineRef(
+        line.data(), static_cast<uint32_t>(arena.size()), static_cast<uint32_t>(line.size()), spec
+    ));
+    arena += line;
+  }
+  SortLines(arena.data(), refs, spec);
+  std::vector<std::string> sorted;
+  for (const LineRef& ref: refs) {
+    sorted.push_back(arena.substr(ref.offset, ref.length));
+  }
+  return sorted;
+}
+
+std::string Field(const std::string& line, size_t field, char separator) {
+  size_t begin = 0;
+  for (size_t i = 1; i < field; ++i) {
+    begin = line.find(separator, begin);
+    if (begin == std::string::npos) {
+      return "";
+    }
+    ++begin;
+  }
+  return line.substr(begin, line.find(separator, begin) - begin);
+}
+
+}  // namespace
+
+TEST(LineKeyTest, MultikeyQuicksortMatchesByteOrder) {
+  std::vector<std::string> lines = RandomLines(20000, 3);
+  LineKeySpec const spec;
+  std::vector<std::string> const sorted = SortThroughArena(lines, spec);
+  std::sort(lines.begin(), lines.end());
+  ASSERT_EQ(sorted, lines);
+}
+
+TEST(LineKeyTest, FieldKeysOrderByTheFieldThenTheLine) {
+  std::vector<std::string> lines = RandomLines(20000, 4);
+  LineKeySpec spec;
+  spec.field = 2;
+  std::vector<std::string> const sorted = SortThroughArena(lines, spec);
+  std::sort(lines.begin(), lines.end(), [](const std::string& left, const std::string& right) {
+    std::string const left_key = Field(left, 2, ',');
+    std::string const right_key = Field(right, 2, ',');
+    return left_key != right_key ? left_key < right_key : left < right;
+  });
+  ASSERT_EQ(sorted, lines);
+}
+
+TEST(LineKeyTest, NumericKeys) {
+  LineKeySpec spec;
+  spec.numeric = true;
+  spec.field = 2;
+  spec.separator = ';';
+  std::vector<std::string> const lines{
+      "a;10", "b;-2.5", "c;+3", "d;x", "e; 7e2", "f;-1e9", "g", "h;3", "i;0.001"
+  };
+  std::vector<std::string> const expected{
+      "f;-1e9", "b;-2.5", "d;x", "g", "i;0.001", "c;+3", "h;3", "a;10", "e; 7e2"
+  };
+  ASSERT_EQ(SortThroughArena(lines, spec), expected);
+}
@@ -0,0 +1,76 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "loaders/util/loser_tree.hpp"
+
+// Sorted in-memory source for the loser tree
+struct VectorSource {
+  std::vector<uint32_t> values;
+  size_t position = 0;
+
+  bool next(uint32_t& value) {
+    if (position == values.size()) {
+      return false;
+    }
+    value = values[position++];
+    return true;
+  }
+};
+
+std::vector<uint32_t> MergeAll(std::vector<VectorSource>& sources) {
+  std::vector<VectorSource*> pointers;
+  for (auto& source : sources) {
+    pointers.push_back(&source);
+  }
+  LoserTree<uint32_t, VectorSource> merger(pointers);
+  std::vector<uint32_t> merged;
+  uint32_t value = 0;
+  while (merger.next(value)) {
+    merged.push_back(value);
+  }
+  return merged;
+}
+
+TEST(LoserTreeTest, MergesUnevenSourcesIncludingEmptyOnes) {
+  std::vector<VectorSource> sources = {
+      {{1, 4, 9, 9, 12}},
+      {{}},
+      {{0, 2, 3}},
+      {{5}},
+      {{2, 6, 7, 8, 10, 11, 30}},
+  };
+  std::vector<uint32_t> expected;
+  for (const auto& source : sources) {
+    expected.insert(expected.end(), source.values.begin(), source.values.end());
+  }
+  std::sort(expected.begin(), expected.end());
+
+  ASSERT_EQ(MergeAll(sources), expected);
+}
+
+TEST(LoserTreeTest, HandlesSingleAndNoSources) {
+  std::vector<VectorSource> single = {{{3, 5, 8}}};
+  ASSERT_EQ(MergeAll(single), std::vector<uint32_t>({3, 5, 8}));
+
+  std::vector<VectorSource> none;
+  ASSERT_TRUE(MergeAll(none).empty());
+}
+
+TEST(LoserTreeTest, MergesHundredsOfSources) {
+  std::vector<VectorSource> sources(300);
+  std::vector<uint32_t> expected;
+  for (uint32_t i = 0; i < sources.size(); ++i) {
+    for (uint32_t j = 0; j < i % 7; ++j) {
+      uint32_t value = (i * 2654435761U + j * 40503U) % 1000;
+      sources[i].values.push_back(value);
+      expected.push_back(value);
+    }
+    std::sort(sources[i].values.begin(), sources[i].values.end());
+  }
+  std::sort(expected.begin(), expected.end());
+
+  ASSERT_EQ(MergeAll(sources), expected);
+}
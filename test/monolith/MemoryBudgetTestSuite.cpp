@@ -0,0 +1,101 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+
+#include "loaders/util/memory_budget.hpp"
+#include "loaders/util/sorter_utils.hpp"
+
+TEST(MemoryBudgetTest, InputThatFitsIsSortedInMemory) {
+  BudgetPlan plan = PlanForMemoryBudget(100 * BytesInMb, 128 * BytesInMb, SortOptions());
+  ASSERT_TRUE(plan.in_memory);
+  ASSERT_EQ(plan.chunk_size_mb, 100);
+}
+
+TEST(MemoryBudgetTest, ChunksAndRunBuffersStayWithinTheBudget) {
+  SortOptions options;
+  BudgetPlan plan = PlanForMemoryBudget(1024 * BytesInMb, 64 * BytesInMb, options);
+  ASSERT_FALSE(plan.in_memory);
+  ASSERT_GE(plan.run_buffer_bytes, MinRunBufferBytes);
+  ASSERT_LE(plan.run_buffer_bytes, DefaultRunBufferBytes);
+  ASSERT_LE(plan.chunk_size_mb * BytesInMb + 2 * plan.run_buffer_bytes, plan.budget_bytes);
+  ASSERT_GE(plan.num_runs, 17);
+  // 64 MB holds a buffer for every run of a single pass
+  ASSERT_GE(plan.fan_in, plan.num_runs);
+  ASSERT_EQ(plan.merge_passes, 1);
+}
+
+TEST(MemoryBudgetTest, TightBudgetAddsMergePasses) {
+  SortOptions options;
+  options.max_fan_in = 4;
+  BudgetPlan plan = PlanForMemoryBudget(64 * BytesInMb, 2 * BytesInMb, options);
+  ASSERT_FALSE(plan.in_memory);
+  ASSERT_EQ(plan.fan_in, 4);
+  ASSERT_GT(plan.merge_passes, 1);
+}
+
+TEST(MemoryBudgetTest, SmallBudgetsAreRaisedToTheSmallestPlan) {
+  for (SortKernel const kernel: {SortKernel::Std, SortKernel::Radix}) {
+    SortOptions options;
+    options.kernel = kernel;
+    size_t const sort_copies = kernel == SortKernel::Std ? 1 : 2;
+    ASSERT_EQ(
+        MinimumExternalBudget(options), sort_copies * BytesInMb + 2 * MinRunBufferBytes
+    );
+    for (size_t budget = 256 * 1024; budget <= 8 * BytesInMb; budget += 96 * 1024) {
+      for (size_t const input: {budget + 1, 2 * budget, 64 * BytesInMb}) {
+        BudgetPlan const plan = PlanForMemoryBudget(input, budget, options);
+        ASSERT_FALSE(plan.in_memory);
+        ASSERT_EQ(plan.requested_bytes, budget);
+        ASSERT_EQ(plan.budget_bytes, std::max(budget, MinimumExternalBudget(options)));
+        // The chunk, its scratch and both run formation buffers fit what the plan claims
+        ASSERT_LE(
+            sort_copies * plan.chunk_size_mb * BytesInMb + 2 * plan.run_buffer_bytes,
+            plan.budget_bytes
+        ) << "budget " << budget << ", input " << input;
+      }
+    }
+  }
+}
+
+TEST(MemoryBudgetTest, SortScratchIsCharged) {
+  SortOptions options;
+  BudgetPlan const in_place = PlanForMemoryBudget(1024 * BytesInMb, 64 * BytesInMb, options);
+  for (size_t const threads: {1, 4}) {
+    options.threads = threads;
+    options.kernel = threads == 1 ? SortKernel::Radix : SortKernel::Std;
+    ASSERT_FALSE(PlanForMemoryBudget(100 * BytesInMb, 128 * BytesInMb, options).in_memory);
+    ASSERT_TRUE(PlanForMemoryBudget(60 * BytesInMb, 128 * BytesInMb, options).in_memory);
+    BudgetPlan const plan = PlanForMemoryBudget(1024 * BytesInMb, 64 * BytesInMb, options);
+    ASSERT_LE(2 * plan.chunk_size_mb * BytesInMb + 2 * plan.run_buffer_bytes, plan.budget_bytes);
+    ASSERT_LE(plan.chunk_size_mb, in_place.chunk_size_mb / 2);
+  }
+}
+
+TEST(MemoryBudgetTest, PrefetchBlocksNarrowTheFanIn) {
+  SortOptions options;
+  ASSERT_EQ(MergeRunBuffers(options), 1);
+  BudgetPlan const on_demand = PlanForMemoryBudget(1024 * BytesInMb, 16 * BytesInMb, options);
+  options.prefetch_blocks = 4;
+  ASSERT_EQ(MergeRunBuffers(options), 5);
+  BudgetPlan const prefetched = PlanForMemoryBudget(1024 * BytesInMb, 16 * BytesInMb, options);
+  ASSERT_LE(
+      5 * prefetched.run_buffer_bytes * (prefetched.fan_in + 1), prefetched.chunk_size_mb * BytesInMb
+  );
+  ASSERT_LT(prefetched.fan_in, on_demand.fan_in);
+
+  // Runs striped over several directories are prefetched without --prefetch-blocks
+  options.prefetch_blocks = 0;
+  options.spill_directories = {"/tmp", "/var/tmp"};
+  options.spill_format = RunFormat::Compressed;
+  ASSERT_EQ(MergeRunBuffers(options), 2 + StripedPrefetchBlocks + 1);
+}
+
+TEST(MemoryBudgetTest, BudgetIsHalfOfTheTighterLimit) {
+  MemoryLimits limits;
+  limits.available_bytes = 1000 * BytesInMb;
+  ASSERT_EQ(DeriveMemoryBudget(limits), 500 * BytesInMb);
+
+  limits.cgroup_limit_bytes = 600 * BytesInMb;
+  limits.cgroup_usage_bytes = 400 * BytesInMb;
+  ASSERT_EQ(DeriveMemoryBudget(limits), 100 * BytesInMb);
+}
@@ -0,0 +1,38 @@
+#include <gtest/gtest.h>
+
+#include <numeric>
+#include <vector>
+
+#include "loaders/util/merge_planner.hpp"
+
+TEST(MergePlannerTest, SinglePassWhenRunsFitTheFanIn) {
+  MergePlan plan = PlanMergePasses(16, 16);
+  ASSERT_EQ(plan.passes.size(), 1);
+  ASSERT_EQ(plan.passes[0].output_runs, 1);
+  ASSERT_EQ(plan.passes[0].group_sizes, std::vector<size_t>({16}));
+}
+
+TEST(MergePlannerTest, CascadesAndBalancesGroups) {
+  MergePlan plan = PlanMergePasses(100, 8);
+  // 100 -> 13 -> 2 -> 1
+  ASSERT_EQ(plan.passes.size(), 3);
+  for (const MergePass& pass : plan.passes) {
+    ASSERT_EQ(pass.group_sizes.size(), pass.output_runs);
+    ASSERT_EQ(
+        std::accumulate(pass.group_sizes.begin(), pass.group_sizes.end(), size_t{0}),
+        pass.input_runs
+    );
+    for (size_t group_size : pass.group_sizes) {
+      ASSERT_LE(group_size, plan.fan_in);
+      ASSERT_GE(group_size, pass.input_runs / pass.output_runs);
+    }
+  }
+  ASSERT_EQ(plan.passes.back().output_runs, 1);
+}
+
+TEST(MergePlannerTest, FanInIsBoundedByMemoryAndOption) {
+  // 8 buffers of 1 MB: 7 inputs and the output
+  ASSERT_EQ(MaxMergeFanIn(8 * 1024 * 1024, 1024 * 1024, 0), 7);
+  ASSERT_EQ(MaxMergeFanIn(8 * 1024 * 1024, 1024 * 1024, 3), 3);
+  ASSERT_EQ(MaxMergeFanIn(1024, 1024 * 1024, 0), MinMergeFanIn);
+}
@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "loaders/util/natural_runs.hpp"
+
+namespace {
+
+std::vector<uint32_t> RandomValues(size_t count, uint32_t seed) {
+  std::mt19937 engine(seed);
+  std::vector<uint32_t> values(count);
+  for (uint32_t& value: values) {
+    value = engine();
+  }
+  return values;
+}
+
+}  // namespace
+
+TEST(NaturalRunsTest, SortedInputIsLeftAlone) {
+  std::vector<uint32_t> values = RandomValues(10000, 1);
+  std::sort(values.begin(), values.end());
+  std::vector<uint32_t> const expected = values;
+  ASSERT_EQ(SortNaturalRuns(values.data(), values.size()), PresortPath::Sorted);
+  ASSERT_EQ(values, expected);
+}
+
+TEST(NaturalRunsTest, ReverseSortedInputIsReversed) {
+  std::vector<uint32_t> values = RandomValues(10000, 2);
+  std::sort(values.begin(), values.end(), std::greater<>());
+  ASSERT_EQ(SortNaturalRuns(values.data(), values.size()), PresortPath::Reversed);
+  ASSERT_TRUE(std::is_sorted(values.begin(), values.end()));
+}
+
+TEST(NaturalRunsTest, SortedSegmentsAreMerged) {
+  // Ascending and descending segments of different lengths, with duplicates across segments
+  std::vector<uint32_t> values;
+  for (size_t segment = 0; segment < 7; ++segment) {
+    std::vector<uint32_t> part = RandomValues(1000 + 300 * segment, segment % 3);
+    if (segment % 2 == 0) {
+      std::sort(part.begin(), part.end());
+    } else {
+      std::sort(part.begin(), part.end(), std::greater<>());
+    }
+    values.insert(values.end(), part.begin(), part.end());
+  }
+  std::vector<uint32_t> expected = values;
+  std::sort(expected.begin(), expected.end());
+
+  ASSERT_EQ(SortNaturalRuns(values.data(), values.size()), PresortPath::NaturalRuns);
+  ASSERT_EQ(values, expected);
+}
+
+TEST(NaturalRunsTest, RandomInputFallsBackToFullSort) {
+  std::vector<uint32_t> values = RandomValues(100000, 3);
+  std::vector<uint32_t> expected = values;
+  std::sort(expected.begin(), expected.end());
+  ASSERT_EQ(SortNaturalRuns(values.data(), values.size()), PresortPath::FullSort);
+  ASSERT_EQ(values, expected);
+}
+
+TEST(NaturalRunsTest, ShortInputs) {
+  std::vector<uint32_t> values;
+  ASSERT_EQ(SortNaturalRuns(values.data(), 0), PresortPath::Sorted);
+  values = {7, 7, 7};
+  ASSERT_EQ(SortNaturalRuns(values.data(), values.size()), PresortPath::Sorted);
+  values = {3, 1};
+  ASSERT_EQ(SortNaturalRuns(values.data(), values.size()), PresortPath::Reversed);
+  ASSERT_EQ(values, (std::vector<uint32_t>{1, 3}));
+}
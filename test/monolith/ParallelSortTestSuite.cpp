@@ -0,0 +1,98 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <random>
+#include <vector>
+
+#include "loaders/util/natural_runs.hpp"
+#include "loaders/util/parallel_sort.hpp"
+
+namespace {
+
+std::vector<uint32_t> RandomValues(size_t count, uint32_t seed) {
+  std::mt19937 engine(seed);
+  std::vector<uint32_t> values(count);
+  for (uint32_t& value: values) {
+    value = static_cast<uint32_t>(engine());
+  }
+  return values;
+}
+
+void ExpectParallelSorted(ParallelSorter& sorter, std::vector<uint32_t> values) {
+  std::vector<uint32_t> expected = values;
+  std::sort(expected.begin(), expected.end());
+  sorter.sort(values.data(), values.size());
+  ASSERT_EQ(values, expected);
+}
+
+}  // namespace
+
+TEST(ParallelSortTest, TaskPoolRunsEveryTask) {
+  for (size_t const threads: {1, 2, 5}) {
+    TaskPool pool(threads);
+    ASSERT_EQ(pool.threads(), threads);
+    // The pool is reused across batches, with more tasks than threads
+    for (size_t batch = 0; batch < 10; ++batch) {
+      std::atomic<size_t> sum = 0;
+      std::vector<std::function<void()>> tasks;
+      for (size_t i = 1; i <= 100; ++i) {
+        tasks.emplace_back([&sum, i] { sum += i; });
+      }
+      pool.run(std::move(tasks));
+      ASSERT_EQ(sum, 5050);
+    }
+    pool.run({});
+  }
+}
+
+TEST(ParallelSortTest, MatchesStdSort) {
+  for (SortKernel const kernel: {SortKernel::Std, SortKernel::Radix}) {
+    for (size_t const threads: {1, 2, 3, 8}) {
+      ParallelSorter sorter(threads, kernel);
+      ASSERT_EQ(sorter.threads(), threads);
+      ExpectParallelSorted(sorter, RandomValues(300000, 1));
+      // Below the parallel cutoff and just above it
+      ExpectParallelSorted(sorter, RandomValues(1000, 2));
+      ExpectParallelSorted(sorter, RandomValues(ParallelSortMinCount + 1, 3));
+    }
+  }
+}
+
+TEST(ParallelSortTest, SkewedKeys) {
+  ParallelSorter sorter(4, SortKernel::Std);
+  // Half of the values are one key, which gets a bucket of its own
+  std::vector<uint32_t> skewed = RandomValues(200000, 4);
+  for (size_t i = 0; i < skewed.size(); i += 2) {
+    skewed[i] = 0x80000000;
+  }
+  ExpectParallelSorted(sorter, skewed);
+  // A few distinct keys, including both ends of the key space
+  std::vector<uint32_t> few = RandomValues(200000, 5);
+  for (uint32_t& value: few) {
+    value = value % 3 == 0 ? 0 : value % 3 == 1 ? 0xFFFFFFFF : 7;
+  }
+  ExpectParallelSorted(sorter, few);
+  ExpectParallelSorted(sorter, std::vector<uint32_t>(200000, 42));
+}
+
+TEST(ParallelSortTest, NaturalRunsFallBackToTheSorter) {
+  ParallelSorter sorter(3, SortKernel::Radix);
+  std::vector<uint32_t> values = RandomValues(200000, 6);
+  std::vector<uint32_t> expected = values;
+  std::sort(expected.begin(), expected.end());
+  ASSERT_EQ(SortNaturalRuns(values.data(), values.size(), sorter), PresortPath::FullSort);
+  ASSERT_EQ(values, expected);
+  ASSERT_EQ(SortNaturalRuns(values.data(), values.size(), sorter), PresortPath::Sorted);
+  ASSERT_GE(ResolveThreadCount(0), 1);
+  ASSERT_EQ(ResolveThreadCount(6), 6);
+}
+
+TEST(ParallelSortTest, ThreadSweepDoublesUpToTheMaximum) {
+  ASSERT_EQ(ThreadSweep(1), std::vector<size_t>({1}));
+  ASSERT_EQ(ThreadSweep(4), std::vector<size_t>({1, 2, 4}));
+  ASSERT_EQ(ThreadSweep(6), std::vector<size_t>({1, 2, 4, 6}));
+  ASSERT_EQ(ThreadSweep(0), std::vector<size_t>({1}));
+}
@@ -0,0 +1,81 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "loaders/util/natural_runs.hpp"
+#include "loaders/util/radix_sort.hpp"
+
+namespace {
+
+std::vector<uint32_t> RandomValues(size_t count, uint32_t seed, uint32_t mask) {
+  std::mt19937 engine(seed);
+  std::vector<uint32_t> values(count);
+  for (uint32_t& value: values) {
+    value = static_cast<uint32_t>(engine()) & mask;
+  }
+  return values;
+}
+
+void ExpectRadixSorted(std::vector<uint32_t> values) {
+  std::vector<uint32_t> expected = values;
+  std::sort(expected.begin(), expected.end());
+  std::vector<uint32_t> scratch;
+  RadixSort(values.data(), values.size(), scratch);
+  ASSERT_EQ(values, expected);
+}
+
+}  // namespace
+
+TEST(RadixSortTest, MatchesStdSort) {
+  ExpectRadixSorted(RandomValues(100000, 1, 0xFFFFFFFF));
+  // Counts around the cutoff to std::sort
+  std::vector<size_t> const counts = {0, 1, 2, RadixSortMinCount - 1, RadixSortMinCount, 5000};
+  for (size_t const count: counts) {
+    ExpectRadixSorted(RandomValues(count, 2, 0xFFFFFFFF));
+  }
+}
+
+TEST(RadixSortTest, ConstantDigitsAreSkipped) {
+  // Only the lowest digit varies, then only the highest, then only the middle one
+  ExpectRadixSorted(RandomValues(50000, 3, 0x000007FF));
+  ExpectRadixSorted(RandomValues(50000, 4, 0xFFC00000));
+  ExpectRadixSorted(RandomValues(50000, 5, 0x003FF800));
+  // Two digits vary, so the sorted values end up in the scratch buffer and are copied back
+  ExpectRadixSorted(RandomValues(50000, 6, 0x003FFFFF));
+  // Every digit is constant
+  ExpectRadixSorted(std::vector<uint32_t>(50000, 0x12345678));
+}
+
+TEST(RadixSortTest, DuplicatesAndExtremes) {
+  std::vector<uint32_t> values = RandomValues(50000, 7, 0xF000000F);
+  for (size_t i = 0; i < values.size(); i += 3) {
+    values[i] = i % 2 == 0 ? 0 : std::numeric_limits<uint32_t>::max();
+  }
+  ExpectRadixSorted(values);
+}
+
+TEST(RadixSortTest, ScratchIsReused) {
+  std::vector<uint32_t> scratch;
+  std::vector<uint32_t> large = RandomValues(20000, 8, 0xFFFFFFFF);
+  RadixSort(large.data(), large.size(), scratch);
+  ASSERT_TRUE(std::is_sorted(large.begin(), large.end()));
+  size_t const capacity = scratch.capacity();
+  std::vector<uint32_t> small = RandomValues(10000, 9, 0xFFFFFFFF);
+  RadixSort(small.data(), small.size(), scratch);
+  ASSERT_TRUE(std::is_sorted(small.begin(), small.end()));
+  ASSERT_EQ(scratch.capacity(), capacity);
+}
+
+TEST(RadixSortTest, NaturalRunsFallBackToTheKernel) {
+  std::vector<uint32_t> values = RandomValues(100000, 10, 0xFFFFFFFF);
+  std::vector<uint32_t> expected = values;
+  std::sort(expected.begin(), expected.end());
+  ASSERT_EQ(
+      SortNaturalRuns(values.data(), values.size(), SortKernel::Radix), PresortPath::FullSort
+  );
+  ASSERT_EQ(values, expected);
+}
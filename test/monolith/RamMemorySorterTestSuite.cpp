@@ -1,5 +1,6 @@
 #include <gtest/gtest.h>
 
+#include <algorithm>
 #include <cstdint>
 #include <fstream>
 #include <vector>
@@ -53,6 +54,42 @@ TEST_F(RamMemorySorterTest, SortInMemory) {
       << "File is not sorted correctly.";
 }
 
+TEST_F(RamMemorySorterTest, SortInMemoryIoUringEngine) {
+  size_t sizeMb = 1;
+  RamMemorySorter::generateRandomFile(testInputFile, sizeMb);
+
+  SortOptions options;
+  options.run_buffer_bytes = 64 * 1024;
+  options.io_engine = IoEngineKind::IoUring;
+  options.register_buffers = true;
+  RamMemorySorter::sortInMemory(testInputFile, testOutputFile, options);
+
+  auto inputData = readBinaryFile(testInputFile);
+  auto sortedData = readBinaryFile(testOutputFile);
+  std::sort(inputData.begin(), inputData.end());
+  ASSERT_EQ(sortedData, inputData) << "Output is not the sorted input.";
+}
+
+TEST_F(RamMemorySorterTest, SortInMemoryReverseSortedInput) {
+  RamMemorySorter::generateRandomFile(testInputFile, 1);
+  auto data = readBinaryFile(testInputFile);
+  std::sort(data.begin(), data.end(), std::greater<>());
+  {
+    std::ofstream file(testInputFile, std::ios::binary | std::ios::trunc);
+    file.write(
+        reinterpret_cast<const char*>(data.data()),
+        static_cast<std::streamsize>(data.size() * sizeof(uint32_t))
+    );
+  }
+
+  testing::internal::CaptureStdout();
+  RamMemorySorter::sortInMemory(testInputFile, testOutputFile);
+  std::string output = testing::internal::GetCapturedStdout();
+  ASSERT_NE(output.find("Sort path: reverse sorted"), std::string::npos) << output;
+  std::reverse(data.begin(), data.end());
+  ASSERT_EQ(readBinaryFile(testOutputFile), data);
+}
+
 TEST_F(RamMemorySorterTest, CheckFileSorted) {
   size_t sizeMb = 1;
   RamMemorySorter::generateRandomFile(testInputFile, sizeMb);
@@ -84,4 +121,57 @@ TEST_F(RamMemorySorterTest, CheckFileNotSorted) {
   std::string output = testing::internal::GetCapturedStdout();
   ASSERT_NE(output.find("File is not sorted."), std::string::npos)
       << "Expected 'File is not sorted.' message not found.";
-}
\ No newline at end of file
+}
+TEST_F(RamMemorySorterTest, SortInMappedOutputFile) {
+  RamMemorySorter::generateRandomFile(testInputFile, 1);
+  // A partial value trailing the input is not part of the output
+  {
+    std::ofstream file(testInputFile, std::ios::binary | std::ios::app);
+    file.write("xy", 2);
+  }
+  auto expected = readBinaryFile(testInputFile);
+  std::sort(expected.begin(), expected.end());
+
+  SortOptions options;
+  options.mmap_io = true;
+  options.threads = 2;
+  RamMemorySorter::sortInMemory(testInputFile, testOutputFile, options);
+  ASSERT_EQ(readBinaryFile(testOutputFile), expected);
+
+  // Duplicates are dropped within the mapping and the file is cut to the distinct values
+  std::vector<uint32_t> duplicates = {5, 1, 5, 3, 1, 5, 9};
+  {
+    std::ofstream file(testInputFile, std::ios::binary | std::ios::trunc);
+    file.write(
+        reinterpret_cast<const char*>(duplicates.data()),
+        static_cast<std::streamsize>(duplicates.size() * sizeof(uint32_t))
+    );
+  }
+  options.output_mode = OutputMode::Unique;
+  RamMemorySorter::sortInMemory(testInputFile, testOutputFile, options);
+  ASSERT_EQ(readBinaryFile(testOutputFile), (std::vector<uint32_t>{1, 3, 5, 9}));
+
+  // An empty input maps nothing and leaves an empty output
+  { std::ofstream file(testInputFile, std::ios::binary | std::ios::trunc); }
+  RamMemorySorter::sortInMemory(testInputFile, testOutputFile, options);
+  std::ifstream output(testOutputFile, std::ios::binary | std::ios::ate);
+  ASSERT_TRUE(output.is_open());
+  ASSERT_EQ(output.tellg(), 0);
+}
+
+TEST_F(RamMemorySorterTest, SortInPlace) {
+  RamMemorySorter::generateRandomFile(testInputFile, 1);
+  auto expected = readBinaryFile(testInputFile);
+  std::sort(expected.begin(), expected.end());
+
+  SortOptions options;
+  options.mmap_io = true;
+  options.in_place = true;
+  // The output has to name the input file
+  RamMemorySorter::sortInMemory(testInputFile, testOutputFile, options);
+  ASSERT_FALSE(std::ifstream(testOutputFile).is_open());
+  ASSERT_NE(readBinaryFile(testInputFile), expected);
+
+  RamMemorySorter::sortInMemory(testInputFile, testInputFile, options);
+  ASSERT_EQ(readBinaryFile(testInputFile), expected);
+}
@@ -0,0 +1,86 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "loaders/util/record_types.hpp"
+
+namespace {
+
+// Keys of `records`, which are in ascending order, must ascend as well
+template <typename Record>
+void ExpectKeysAscend(const std::vector<Record>& records) {
+  for (size_t i = 1; i < records.size(); ++i) {
+    EXPECT_LT(RecordTraits<Record>::key(records[i - 1]), RecordTraits<Record>::key(records[i]))
+        << "at " << i;
+  }
+}
+
+}  // namespace
+
+TEST(RecordTypesTest, SignedKeysOrderAsUnsigned) {
+  ExpectKeysAscend<int32_t>(
+      {std::numeric_limits<int32_t>::min(), -70000, -1, 0, 1, 70000,
+       std::numeric_limits<int32_t>::max()}
+  );
+  ExpectKeysAscend<int64_t>(
+      {std::numeric_limits<int64_t>::min(), -(int64_t{1} << 40), -1, 0, 1, int64_t{1} << 40,
+       std::numeric_limits<int64_t>::max()}
+  );
+}
+
+TEST(RecordTypesTest, FloatKeysOrderAsUnsigned) {
+  ExpectKeysAscend<float>(
+      {-std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::max(), -1.5F,
+       -std::numeric_limits<float>::denorm_min(), -0.0F, 0.0F,
+       std::numeric_limits<float>::denorm_min(), 1.5F, std::numeric_limits<float>::max(),
+       std::numeric_limits<float>::infinity(), std::numeric_limits<float>::quiet_NaN()}
+  );
+  ExpectKeysAscend<double>(
+      {-std::numeric_limits<double>::infinity(), -1e300, -1.0, -1e-300, -0.0, 0.0, 1e-300, 1.0,
+       1e300, std::numeric_limits<double>::infinity()}
+  );
+}
+
+TEST(RecordTypesTest, KeyPayloadRecordsOrderByKeyOnly) {
+  RecordLess<KeyPayloadRecord> const less;
+  ASSERT_TRUE(less(KeyPayloadRecord{1, 9}, KeyPayloadRecord{2, 0}));
+  ASSERT_FALSE(less(KeyPayloadRecord{2, 0}, KeyPayloadRecord{2, 9}));
+  ASSERT_FALSE(less(KeyPayloadRecord{2, 9}, KeyPayloadRecord{2, 0}));
+}
+
+TEST(RecordTypesTest, GrayRecordsOrderByKeyBytes) {
+  GrayRecord low{};
+  GrayRecord high{};
+  // Equal 8 byte prefixes, the last key bytes decide
+  low.key[9] = 1;
+  high.key[8] = 1;
+  low.value[0] = 0xFF;
+  ASSERT_EQ(RecordTraits<GrayRecord>::key(low), RecordTraits<GrayRecord>::key(high));
+  ASSERT_TRUE(RecordLess<GrayRecord>()(low, high));
+  ASSERT_FALSE(RecordLess<GrayRecord>()(high, low));
+
+  // The prefix reads the key big-endian, as the bytes compare
+  high.key[0] = 0x80;
+  low.key[7] = 0xFF;
+  ASSERT_LT(RecordTraits<GrayRecord>::key(low), RecordTraits<GrayRecord>::key(high));
+}
+
+TEST(RecordTypesTest, ParseAndDispatch) {
+  for (std::string const name: {"u32", "u64", "i32", "i64", "f32", "f64", "kv64", "gray100"}) {
+    RecordType type = RecordType::U32;
+    ASSERT_TRUE(ParseRecordType(name, type)) << name;
+    ASSERT_EQ(RecordTypeName(type), name);
+  }
+  RecordType type = RecordType::U32;
+  ASSERT_FALSE(ParseRecordType("u16", type));
+
+  auto record_size = [](auto record) { return sizeof(record); };
+  ASSERT_EQ(DispatchRecordType(RecordType::U32, record_size), 4U);
+  ASSERT_EQ(DispatchRecordType(RecordType::F64, record_size), 8U);
+  ASSERT_EQ(DispatchRecordType(RecordType::KeyPayload, record_size), 16U);
+  ASSERT_EQ(DispatchRecordType(RecordType::Gray100, record_size), 100U);
+}
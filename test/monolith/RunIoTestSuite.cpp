@@ -0,0 +1,134 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "loaders/util/run_io.hpp"
+
+class RunIoTest : public ::testing::Test {
+protected:
+  std::string testRunFile = "test_run.bin";
+
+  void TearDown() override {
+    std::remove(testRunFile.c_str());
+  }
+};
+
+TEST_F(RunIoTest, WriterAndReaderRoundTripAcrossBufferBoundaries) {
+  // A 16-byte buffer forces a refill every 4 values
+  const size_t bufferSizeBytes = 4 * sizeof(uint32_t);
+  std::vector<uint32_t> values(37);
+  for (uint32_t i = 0; i < values.size(); ++i) {
+    values[i] = i * 3;
+  }
+
+  RunWriter writer(testRunFile, bufferSizeBytes);
+  ASSERT_TRUE(writer.isOpen());
+  writer.writeBlock(values.data(), 10);
+  for (size_t i = 10; i < values.size(); ++i) {
+    writer.put(values[i]);
+  }
+  writer.close();
+  ASSERT_EQ(writer.stats().bytes, values.size() * sizeof(uint32_t));
+
+  RunReader reader(testRunFile, bufferSizeBytes);
+  ASSERT_TRUE(reader.isOpen());
+  std::vector<uint32_t> readBack(5);
+  ASSERT_EQ(reader.readBlock(readBack.data(), readBack.size()), readBack.size());
+  uint32_t value = 0;
+  while (reader.next(value)) {
+    readBack.push_back(value);
+  }
+  ASSERT_EQ(readBack, values);
+  ASSERT_EQ(reader.stats().bytes, values.size() * sizeof(uint32_t));
+}
+
+TEST_F(RunIoTest, CompressedRunRoundTripsAndShrinks) {
+  // Small gaps, a run of duplicates and a jump that needs all 32 bits of the delta
+  std::vector<uint32_t> values;
+  for (uint32_t i = 0; i < 1000; ++i) {
+    values.push_back(i * 7);
+  }
+  values.insert(values.end(), 300, values.back());
+  values.push_back(0xFFFFFFFFU);
+  for (uint32_t i = 0; i < 77; ++i) {
+    values.push_back(0xFFFFFFFFU);
+  }
+
+  RunWriter writer(testRunFile, 512 * sizeof(uint32_t), RunFormat::Compressed);
+  ASSERT_TRUE(writer.isOpen());
+  writer.writeBlock(values.data(), 700);
+  for (size_t i = 700; i < values.size(); ++i) {
+    writer.put(values[i]);
+  }
+  writer.close();
+  ASSERT_EQ(writer.stats().raw_bytes, values.size() * sizeof(uint32_t));
+  ASSERT_LT(writer.stats().bytes * 2, writer.stats().raw_bytes);
+
+  // A reader buffer smaller than a block still decodes whole blocks
+  RunReader reader(testRunFile, 16, RunFormat::Compressed);
+  ASSERT_TRUE(reader.isOpen());
+  std::vector<uint32_t> readBack(300);
+  ASSERT_EQ(reader.readBlock(readBack.data(), readBack.size()), readBack.size());
+  uint32_t value = 0;
+  while (reader.next(value)) {
+    readBack.push_back(value);
+  }
+  ASSERT_EQ(readBack, values);
+  ASSERT_EQ(reader.stats().bytes, writer.stats().bytes);
+  ASSERT_FALSE(reader.failed());
+}
+
+TEST_F(RunIoTest, CompressedReaderFailsOnCorruptOrTruncatedBlock) {
+  std::vector<uint32_t> values(3 * RunCodecBlockValues);
+  for (uint32_t i = 0; i < values.size(); ++i) {
+    values[i] = i * 5;
+  }
+  RunWriter writer(testRunFile, DefaultRunBufferBytes, RunFormat::Compressed);
+  ASSERT_TRUE(writer.isOpen());
+  writer.writeBlock(values.data(), values.size());
+  writer.close();
+  const auto fileSize = std::filesystem::file_size(testRunFile);
+
+  // A block cut short at the end of the file decodes the whole blocks before it and then fails
+  std::filesystem::resize_file(testRunFile, fileSize - 3);
+  RunReader truncated(testRunFile, DefaultRunBufferBytes, RunFormat::Compressed);
+  std::vector<uint32_t> readBack(values.size());
+  ASSERT_EQ(truncated.readBlock(readBack.data(), readBack.size()), 2 * RunCodecBlockValues);
+  ASSERT_TRUE(truncated.failed());
+  truncated.close();
+
+  // Byte 6 of the first header is its bit width, 0xFF is beyond the 32 bits a delta can need
+  {
+    std::fstream file(testRunFile, std::ios::binary | std::ios::in | std::ios::out);
+    file.seekp(6);
+    file.put(static_cast<char>(0xFF));
+  }
+  RunReader corrupt(testRunFile, DefaultRunBufferBytes, RunFormat::Compressed);
+  uint32_t value = 0;
+  ASSERT_FALSE(corrupt.next(value));
+  ASSERT_TRUE(corrupt.failed());
+}
+
+TEST_F(RunIoTest, ReaderOfMissingFileIsNotOpen) {
+  RunReader reader("no_such_run.bin", DefaultRunBufferBytes);
+  ASSERT_FALSE(reader.isOpen());
+  uint32_t value = 0;
+  ASSERT_FALSE(reader.next(value));
+}
+
+TEST_F(RunIoTest, WriterOnFullDiskFailsAndCountsNothing) {
+  // Every write to /dev/full fails with ENOSPC
+  RunWriter writer("/dev/full", 16);
+  ASSERT_TRUE(writer.isOpen());
+  std::vector<uint32_t> const values(100, 7);
+  writer.writeBlock(values.data(), values.size());
+  writer.close();
+  ASSERT_TRUE(writer.failed());
+  ASSERT_EQ(writer.stats().bytes, 0);
+  ASSERT_EQ(writer.stats().raw_bytes, 0);
+}
@@ -0,0 +1,147 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "loaders/util/run_codec.hpp"
+#include "loaders/util/run_io.hpp"
+#include "loaders/util/run_manifest.hpp"
+
+TEST(RunManifestTest, RecordsAreLoadedByTheNextAttempt) {
+  std::string const filename = "./test_manifest_round_trip.txt";
+  {
+    RunManifest manifest(filename, "input_bytes=64");
+    manifest.start();
+    manifest.recordRun({0, 8, 11});
+    manifest.recordRun({8, 8, 12});
+    manifest.recordRunsComplete(2);
+    manifest.recordMergePlan(4);
+    manifest.recordMergedRun(1, 0, {0, 16, 13});
+  }
+
+  RunManifest manifest(filename, "input_bytes=64");
+  ASSERT_TRUE(manifest.load());
+  ASSERT_EQ(manifest.runs().size(), 2);
+  ASSERT_EQ(manifest.runs()[1].first_element, 8);
+  ASSERT_EQ(manifest.runs()[1].checksum, 12);
+  ASSERT_TRUE(manifest.runs()[1].reused);
+  ASSERT_EQ(manifest.completedRuns(), 2);
+  ASSERT_EQ(manifest.fanIn(), 4);
+  ASSERT_NE(manifest.mergedRun(1, 0), nullptr);
+  ASSERT_EQ(manifest.mergedRun(1, 0)->count, 16);
+  ASSERT_EQ(manifest.mergedRun(1, 1), nullptr);
+
+  manifest.remove();
+  ASSERT_FALSE(std::ifstream(filename).good());
+}
+
+TEST(RunManifestTest, OtherConfigIsNotResumed) {
+  std::string const filename = "./test_manifest_config.txt";
+  {
+    RunManifest manifest(filename, "input_bytes=64");
+    manifest.start();
+    manifest.recordRun({0, 8, 11});
+  }
+
+  RunManifest manifest(filename, "input_bytes=128");
+  ASSERT_FALSE(manifest.load());
+  std::remove(filename.c_str());
+}
+
+TEST(RunManifestTest, TruncatedLineEndsTheManifest) {
+  std::string const filename = "./test_manifest_truncated.txt";
+  {
+    RunManifest manifest(filename, "input_bytes=64");
+    manifest.start();
+    manifest.recordRun({0, 8, 11});
+  }
+  {
+    // A kill in the middle of a line leaves only part of it
+    std::ofstream file(filename, std::ios::app);
+    file << "run 8 8";
+  }
+
+  RunManifest manifest(filename, "input_bytes=64");
+  ASSERT_TRUE(manifest.load());
+  ASSERT_EQ(manifest.runs().size(), 1);
+  ASSERT_EQ(manifest.completedRuns(), 0);
+  manifest.remove();
+}
+
+TEST(RunManifestTest, VerifyRunFileDetectsChangedRuns) {
+  std::string const filename = "./test_manifest_run.dat";
+  std::vector<uint32_t> const values = {1, 2, 3, 5, 8, 13, 21, 34};
+  RunRecord record;
+  {
+    RunWriter writer(filename, 16);
+    ASSERT_TRUE(writer.isOpen());
+    for (uint32_t value: values) {
+      writer.put(value);
+    }
+    writer.close();
+    record.count = values.size();
+    record.checksum = writer.checksum();
+  }
+  ASSERT_TRUE(VerifyRunFile(filename, RunFormat::Raw, record));
+
+  {
+    std::fstream file(filename, std::ios::in | std::ios::out | std::ios::binary);
+    uint32_t const changed = 4;
+    file.seekp(3 * sizeof(uint32_t));
+    file.write(reinterpret_cast<const char*>(&changed), sizeof(changed));
+  }
+  ASSERT_FALSE(VerifyRunFile(filename, RunFormat::Raw, record));
+
+  record.count = values.size() + 1;
+  ASSERT_FALSE(VerifyRunFile(filename, RunFormat::Raw, record));
+  std::remove(filename.c_str());
+}
+
+TEST(RunManifestTest, VerifyRunFileRejectsCorruptBlockHeaders) {
+  std::string const filename = "./test_manifest_corrupt_run.dat";
+  RunRecord record;
+  {
+    RunWriter writer(filename, 4096, RunFormat::Compressed);
+    ASSERT_TRUE(writer.isOpen());
+    for (uint32_t value = 0; value < 1000; ++value) {
+      writer.put(value * 3);
+    }
+    writer.close();
+    record.count = 1000;
+    record.checksum = writer.checksum();
+  }
+  ASSERT_TRUE(VerifyRunFile(filename, RunFormat::Compressed, record));
+
+  // Bytes 4-5 of the block header hold the value count and byte 6 the bit width
+  for (auto const& [offset, corrupt]: std::vector<std::pair<long, std::vector<uint8_t>>>{
+           {6, {200}}, {4, {0xFF, 0x7F}}
+       }) {
+    std::vector<uint8_t> original(corrupt.size());
+    {
+      std::fstream file(filename, std::ios::in | std::ios::out | std::ios::binary);
+      file.seekg(offset);
+      file.read(reinterpret_cast<char*>(original.data()), static_cast<long>(original.size()));
+      file.seekp(offset);
+      file.write(reinterpret_cast<const char*>(corrupt.data()), static_cast<long>(corrupt.size()));
+    }
+    ASSERT_FALSE(VerifyRunFile(filename, RunFormat::Compressed, record));
+    {
+      std::fstream file(filename, std::ios::in | std::ios::out | std::ios::binary);
+      file.seekp(offset);
+      file.write(
+          reinterpret_cast<const char*>(original.data()), static_cast<long>(original.size())
+      );
+    }
+  }
+  ASSERT_TRUE(VerifyRunFile(filename, RunFormat::Compressed, record));
+
+  std::vector<uint8_t> header(MaxEncodedBlockBytes);
+  header[6] = 33;
+  ASSERT_EQ(EncodedBlockBytes(header.data(), header.size()), 0);
+  std::vector<uint32_t> values(RunCodecBlockValues);
+  ASSERT_EQ(DecodeRunBlock(header.data(), values.data()), 0);
+  std::remove(filename.c_str());
+}
@@ -0,0 +1,86 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <random>
+#include <vector>
+
+#include "loaders/util/radix_sort.hpp"
+#include "loaders/util/simd_sort.hpp"
+
+namespace {
+
+std::vector<uint32_t> RandomValues(size_t count, uint32_t seed, uint32_t modulo = 0) {
+  std::mt19937 engine(seed);
+  std::vector<uint32_t> values(count);
+  for (uint32_t& value: values) {
+    value = static_cast<uint32_t>(engine());
+    if (modulo != 0) {
+      value %= modulo;
+    }
+  }
+  return values;
+}
+
+// Instruction sets of the kernel this CPU can run
+std::vector<SimdIsa> SupportedIsas() {
+  std::vector<SimdIsa> isas = {SimdIsa::Scalar};
+  if (DetectSimdIsa() == SimdIsa::Avx2 || DetectSimdIsa() == SimdIsa::Avx512) {
+    isas.push_back(SimdIsa::Avx2);
+  }
+  if (DetectSimdIsa() == SimdIsa::Avx512) {
+    isas.push_back(SimdIsa::Avx512);
+  }
+  return isas;
+}
+
+void ExpectSimdSorted(SimdIsa isa, std::vector<uint32_t> values) {
+  std::vector<uint32_t> expected = values;
+  std::sort(expected.begin(), expected.end());
+  std::vector<uint32_t> scratch;
+  SimdSort(values.data(), values.size(), scratch, isa);
+  ASSERT_EQ(values, expected) << SimdIsaName(isa) << ", " << values.size() << " values";
+}
+
+}  // namespace
+
+TEST(SimdSortTest, MatchesStdSortForEveryCount) {
+  // Every count below a few vectors, around the cache block and an odd large count
+  for (SimdIsa const isa: SupportedIsas()) {
+    for (size_t count = 0; count <= 100; ++count) {
+      ExpectSimdSorted(isa, RandomValues(count, count));
+    }
+    std::vector<size_t> const counts = {
+        SimdSortBlockElements - 1, SimdSortBlockElements, SimdSortBlockElements + 5, 200003
+    };
+    for (size_t const count: counts) {
+      ExpectSimdSorted(isa, RandomValues(count, 1));
+    }
+  }
+}
+
+TEST(SimdSortTest, DuplicatesAndPatterns) {
+  for (SimdIsa const isa: SupportedIsas()) {
+    ExpectSimdSorted(isa, RandomValues(50000, 2, 5));
+    ExpectSimdSorted(isa, std::vector<uint32_t>(50000, 0xFFFFFFFF));
+    std::vector<uint32_t> extremes = RandomValues(50000, 3, 2);
+    for (uint32_t& value: extremes) {
+      value = value == 0 ? 0 : 0xFFFFFFFF;
+    }
+    ExpectSimdSorted(isa, extremes);
+    std::vector<uint32_t> descending = RandomValues(50000, 4);
+    std::sort(descending.begin(), descending.end(), std::greater<>());
+    ExpectSimdSorted(isa, descending);
+  }
+}
+
+TEST(SimdSortTest, KernelUsesTheDetectedIsa) {
+  std::vector<uint32_t> values = RandomValues(100000, 5);
+  std::vector<uint32_t> expected = values;
+  std::sort(expected.begin(), expected.end());
+  std::vector<uint32_t> scratch(values.size());
+  SortWithKernel(values.data(), values.size(), SortKernel::Simd, scratch.data());
+  ASSERT_EQ(values, expected);
+  ASSERT_STRNE(SimdIsaName(DetectSimdIsa()), "unknown");
+}
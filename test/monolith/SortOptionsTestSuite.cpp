@@ -0,0 +1,54 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "loaders/util/sort_options.hpp"
+
+namespace {
+
+bool Parse(std::vector<std::string> arguments, SortOptions& options) {
+  std::vector<char*> argv;
+  for (std::string& argument: arguments) {
+    argv.push_back(argument.data());
+  }
+  return ParseSortOptions(static_cast<int>(argv.size()), argv.data(), 0, options);
+}
+
+}  // namespace
+
+TEST(SortOptionsTest, PlainU32SortersRejectRecordTypesAndCollapsing) {
+  SortOptions options;
+  ASSERT_TRUE(Parse({"--kernel=radix", "--threads=2"}, options));
+  ASSERT_TRUE(RequirePlainU32Options(options, "ema-sort-int-directio"));
+
+  SortOptions u64;
+  ASSERT_TRUE(Parse({"--type=u64"}, u64));
+  ASSERT_FALSE(RequirePlainU32Options(u64, "ema-sort-int-directio"));
+
+  for (std::string const flag: {"--unique", "--count"}) {
+    SortOptions collapsing;
+    ASSERT_TRUE(Parse({flag}, collapsing));
+    ASSERT_FALSE(RequirePlainU32Options(collapsing, "ema-sort-int-directio"));
+  }
+}
+
+TEST(SortOptionsTest, DirectIoSorterRejectsOptionsItIgnores) {
+  SortOptions options;
+  ASSERT_TRUE(Parse(
+      {"--kernel=simd", "--threads=2", "--spill-dirs=/tmp", "--prefetch-blocks=2",
+       "--run-buffer-kb=64"},
+      options
+  ));
+  ASSERT_TRUE(RequireDirectIoOptions(options));
+
+  for (std::string const flag:
+       {"--pipelined", "--run-generation=replacement", "--strategy=distribution",
+        "--max-fan-in=4", "--merge-threads=2", "--io-engine=uring", "--queue-depth=8",
+        "--register-buffers", "--mmap", "--in-place", "--compress-runs", "--memory-budget=64",
+        "--resume", "--unique", "--type=u64"}) {
+    SortOptions ignored;
+    ASSERT_TRUE(Parse({flag}, ignored));
+    ASSERT_FALSE(RequireDirectIoOptions(ignored)) << flag;
+  }
+}
@@ -0,0 +1,40 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "loaders/util/spill_directories.hpp"
+
+TEST(SpillDirectoriesTest, RoundRobinCyclesThroughTheDirectories) {
+  SpillDirectories spill({"a", "b", "c"}, SpillPolicy::RoundRobin);
+  ASSERT_EQ(spill.primary(), "a");
+  for (size_t i = 0; i < 9; ++i) {
+    ASSERT_EQ(spill.device(i), i % 3);
+  }
+  ASSERT_EQ(spill.directory(4), "b");
+}
+
+TEST(SpillDirectoriesTest, WeightsSetTheShareOfEveryDirectory) {
+  SpillDirectories spill({"a", "b"}, SpillPolicy::RoundRobin);
+  spill.setWeights({3, 1});
+  std::vector<size_t> runs(2, 0);
+  for (size_t i = 0; i < 40; ++i) {
+    ++runs[spill.device(i)];
+  }
+  ASSERT_EQ(runs[0], 30);
+  ASSERT_EQ(runs[1], 10);
+  // The lighter directory is interleaved, not left for the end
+  ASSERT_EQ(spill.device(2), 1);
+}
+
+TEST(SpillDirectoriesTest, FreeSpaceWeightsAreNeverZero) {
+  SpillDirectories spill({".", "./missing_spill_directory"}, SpillPolicy::FreeSpace);
+  ASSERT_GE(spill.weights()[0], 1);
+  ASSERT_EQ(spill.weights()[1], 1);
+}
+
+TEST(SpillDirectoriesTest, SplitSkipsEmptyEntries) {
+  std::vector<std::string> const expected = {"/mnt/a", "/mnt/b"};
+  ASSERT_EQ(SplitSpillDirectories("/mnt/a,,/mnt/b,"), expected);
+  ASSERT_TRUE(SplitSpillDirectories(",").empty());
+}